@@ -0,0 +1,30 @@
+function write_fit_data(file_name, exp_data, columns, days_run)
+%Writes time-course data for the C++ calibration (gnr_fit), one line per point:
+%   <column>:fold <day> <value>
+%exp_data{metric} holds [day, value] rows, as excel_data in run_fit_data.m or
+%the experimental data .mat files; columns{metric} is the GnR_out column the
+%metric is compared with (e.g. 'h', 'P'), or '' to leave the metric out.
+%Values are fold changes over the first time point, as in exp_results.m.
+
+    fid = fopen(file_name, 'w');
+    fprintf(fid, '#column day value\n');
+
+    for metric = 1:numel(exp_data)
+        if metric > numel(columns) || isempty(columns{metric}) || isempty(exp_data{metric})
+            continue
+        end
+
+        days = exp_data{metric}(:,1);
+        data = exp_data{metric}(:,2);
+
+        for unit = 1:numel(days)
+            if days(unit) > days_run
+                continue
+            end
+            fprintf(fid, '%s:fold %g %.10g\n', columns{metric}, days(unit), data(unit) / data(1));
+        end
+    end
+
+    fclose(fid);
+
+end
@@ -0,0 +1,160 @@
+// adj.h
+#ifndef ADJ
+#define ADJ
+
+#include <cmath>
+#include <type_traits>
+#include <vector>
+
+using std::vector;
+
+//Record of the operations on reverse mode numbers (adj): each node is a result with the
+//partial derivatives on its (up to two) arguments, in order of evaluation.
+struct adj_tape {
+    vector<int> arg_0, arg_1;
+    vector<double> partial_0, partial_1;
+
+    int variable() { return node(-1, 0.0, -1, 0.0); }
+    int node(int i_0, double d_0, int i_1, double d_1) {
+        arg_0.push_back(i_0);
+        partial_0.push_back(d_0);
+        arg_1.push_back(i_1);
+        partial_1.push_back(d_1);
+        return int(arg_0.size()) - 1;
+    }
+    int size() const { return int(arg_0.size()); }
+    void clear() { truncate(0); }
+    void truncate(int n) { arg_0.resize(n); arg_1.resize(n); partial_0.resize(n); partial_1.resize(n); }
+
+    //Adjoints bar[i * width + w] of every node from seeds on the results, for width
+    //independent seeds at once
+    void reverse(vector<double>& bar, int width) const {
+        for (int i = size() - 1; i >= 0; i--) {
+            for (int w = 0; w < width; w++) {
+                double b = bar[i * width + w];
+                if (b == 0.0) continue;
+                if (arg_0[i] >= 0) bar[arg_0[i] * width + w] += partial_0[i] * b;
+                if (arg_1[i] >= 0) bar[arg_1[i] * width + w] += partial_1[i] * b;
+            }
+        }
+    }
+
+    //As reverse for the nodes from first on only, with bar[(i - first) * width + w]. The
+    //nodes before first must be variables; what reaches them is passed to leaf(i, w, b)
+    template <typename L>
+    void reverse_from(int first, vector<double>& bar, int width, L leaf) const {
+        for (int i = size() - 1; i >= first; i--) {
+            for (int w = 0; w < width; w++) {
+                double b = bar[(i - first) * width + w];
+                if (b == 0.0) continue;
+                const int args[2] = { arg_0[i], arg_1[i] };
+                const double partials[2] = { partial_0[i], partial_1[i] };
+                for (int k = 0; k < 2; k++) {
+                    if (args[k] >= first) bar[(args[k] - first) * width + w] += partials[k] * b;
+                    else if (args[k] >= 0) leaf(args[k], w, partials[k] * b);
+                }
+            }
+        }
+    }
+};
+
+//Tape of the calling thread; operations are recorded only while one is set
+inline adj_tape*& adj_current_tape() {
+    static thread_local adj_tape* tape = NULL;
+    return tape;
+}
+
+//Reverse mode number: a value and its node on the tape (-1 for constants and values
+//computed while not recording). Comparisons use the value, as for dual.
+struct adj {
+    double v;
+    int i;
+
+    adj(double v_inp = 0.0) : v(v_inp), i(-1) {}
+
+    //A new independent variable on the current tape
+    static adj variable(double v_inp) {
+        adj r(v_inp);
+        if (adj_current_tape() != NULL) r.i = adj_current_tape()->variable();
+        return r;
+    }
+
+    adj& operator+=(const adj& b);
+    adj& operator-=(const adj& b);
+    adj& operator*=(const adj& b);
+    adj& operator/=(const adj& b);
+};
+
+//Result f of a with df/da, and of a and b with df/da and df/db
+inline adj adj_unary(const adj& a, double f, double df) {
+    adj r(f);
+    adj_tape* tape = adj_current_tape();
+    if (tape != NULL && a.i >= 0) r.i = tape->node(a.i, df, -1, 0.0);
+    return r;
+}
+inline adj adj_binary(const adj& a, const adj& b, double f, double df_a, double df_b) {
+    adj r(f);
+    adj_tape* tape = adj_current_tape();
+    if (tape != NULL && (a.i >= 0 || b.i >= 0)) {
+        if (a.i < 0) r.i = tape->node(b.i, df_b, -1, 0.0);
+        else if (b.i < 0) r.i = tape->node(a.i, df_a, -1, 0.0);
+        else r.i = tape->node(a.i, df_a, b.i, df_b);
+    }
+    return r;
+}
+
+inline adj operator+(const adj& a, const adj& b) { return adj_binary(a, b, a.v + b.v, 1.0, 1.0); }
+inline adj operator-(const adj& a, const adj& b) { return adj_binary(a, b, a.v - b.v, 1.0, -1.0); }
+inline adj operator*(const adj& a, const adj& b) { return adj_binary(a, b, a.v * b.v, b.v, a.v); }
+inline adj operator/(const adj& a, const adj& b) {
+    double r = a.v / b.v;
+    return adj_binary(a, b, r, 1.0 / b.v, -r / b.v);
+}
+inline adj operator+(const adj& a, double b) { return adj_unary(a, a.v + b, 1.0); }
+inline adj operator+(double a, const adj& b) { return adj_unary(b, a + b.v, 1.0); }
+inline adj operator-(const adj& a, double b) { return adj_unary(a, a.v - b, 1.0); }
+inline adj operator-(double a, const adj& b) { return adj_unary(b, a - b.v, -1.0); }
+inline adj operator*(const adj& a, double b) { return adj_unary(a, a.v * b, b); }
+inline adj operator*(double a, const adj& b) { return adj_unary(b, a * b.v, a); }
+inline adj operator/(const adj& a, double b) { return adj_unary(a, a.v / b, 1.0 / b); }
+inline adj operator/(double a, const adj& b) { return adj_unary(b, a / b.v, -a / (b.v * b.v)); }
+inline adj operator-(const adj& a) { return adj_unary(a, -a.v, -1.0); }
+
+inline adj& adj::operator+=(const adj& b) { return *this = *this + b; }
+inline adj& adj::operator-=(const adj& b) { return *this = *this - b; }
+inline adj& adj::operator*=(const adj& b) { return *this = *this * b; }
+inline adj& adj::operator/=(const adj& b) { return *this = *this / b; }
+
+inline bool operator<(const adj& a, const adj& b) { return a.v < b.v; }
+inline bool operator>(const adj& a, const adj& b) { return a.v > b.v; }
+inline bool operator<=(const adj& a, const adj& b) { return a.v <= b.v; }
+inline bool operator>=(const adj& a, const adj& b) { return a.v >= b.v; }
+inline bool operator<(const adj& a, double b) { return a.v < b; }
+inline bool operator>(const adj& a, double b) { return a.v > b; }
+inline bool operator<(double a, const adj& b) { return a < b.v; }
+inline bool operator>(double a, const adj& b) { return a > b.v; }
+
+inline adj exp(const adj& a) { double e = std::exp(a.v); return adj_unary(a, e, e); }
+inline adj log(const adj& a) { return adj_unary(a, std::log(a.v), 1.0 / a.v); }
+inline adj sqrt(const adj& a) { double r = std::sqrt(a.v); return adj_unary(a, r, 0.5 / r); }
+inline adj sin(const adj& a) { return adj_unary(a, std::sin(a.v), std::cos(a.v)); }
+inline adj cos(const adj& a) { return adj_unary(a, std::cos(a.v), -std::sin(a.v)); }
+
+//pow of adj only, as for dual
+template <typename A>
+using adj_only = typename std::enable_if<std::is_same<A, adj>::value, adj>::type;
+
+template <typename A>
+inline adj_only<A> pow(const A& a, double b) {
+    if (b == 2.0) return a * a;
+    return adj_unary(a, std::pow(a.v, b), b == 0.0 ? 0.0 : b * std::pow(a.v, b - 1));
+}
+template <typename A>
+inline adj_only<A> pow(double a, const A& b) { double p = std::pow(a, b.v); return adj_unary(b, p, p * std::log(a)); }
+template <typename A>
+inline adj_only<A> pow(const A& a, const A& b) {
+    double p = std::pow(a.v, b.v);
+    return adj_binary(a, b, p, b.v * std::pow(a.v, b.v - 1), a.v > 0 ? p * std::log(a.v) : 0.0);
+}
+
+#endif /* ADJ */
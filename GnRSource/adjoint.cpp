@@ -0,0 +1,316 @@
+// adjoint.cpp
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <gsl/gsl_errno.h>
+#include <gsl/gsl_vector.h>
+#include <gsl/gsl_roots.h>
+#include <gsl/gsl_multiroots.h>
+
+#include "vessel.h"
+#include "functions.h"
+#include "dual_vessel.h"
+#include "adjoint.h"
+#include "step_transaction.h"
+
+using std::string;
+using std::vector;
+
+void inflammation_adjoint::forward(vessel& curr_vessel, int n_steps_inp) {
+    if (curr_vessel.mech_exp_flag == 1) {
+        throw std::runtime_error("No adjoint of mechanical experiments");
+    }
+    const int n_out = vessel::n_native_outputs;
+    int nts = curr_vessel.nts;
+    n_steps = std::min(n_steps_inp, nts - 1);
+    vector<vector<double>*> arrays = step_history_arrays(curr_vessel);
+    vector<double*> carried = step_carried_state(curr_vessel);
+
+    journal_width = int(carried.size()) + 3;
+    for (int j = 0; j < arrays.size(); j++) {
+        journal_width += int(arrays[j]->size()) / nts;
+    }
+    journal.assign((n_steps + 1) * journal_width, 0.0);
+    rows.assign((n_steps + 1) * n_out, 0.0);
+    curr_vessel.nativeOutputRow(&rows[0]);
+
+    for (int sn = 1; sn <= n_steps; sn++) {
+        double* entry = &journal[sn * journal_width];
+        for (int j = 0; j < arrays.size(); j++) {
+            for (int b = 0; b < int(arrays[j]->size()) / nts; b++) {
+                *entry++ = (*arrays[j])[b * nts + sn];
+            }
+        }
+        for (int j = 0; j < carried.size(); j++) {
+            *entry++ = *carried[j];
+        }
+
+        step_vessel(curr_vessel, sn);
+        curr_vessel.nativeOutputRow(&rows[sn * n_out]);
+
+        //Loads of the step, after any load schedule
+        *entry++ = curr_vessel.P;
+        *entry++ = curr_vessel.Q;
+        *entry++ = curr_vessel.T_act;
+    }
+}
+
+void inflammation_adjoint::restore(adjoint_vessel& tangent, int sn, bool record) {
+    //State before step sn: the history up to sn - 1 is that of the final vessel, which the
+    //tangent vessel keeps throughout; the entries at sn and the carried state are from the
+    //journal. The entries keep their variables on the tape, the carried state is new ones
+    //if recording
+    int nts = tangent.nts;
+    vector<vector<adj>*> arrays = step_history_arrays(tangent);
+    vector<adj*> carried = step_carried_state(tangent);
+
+    const double* entry = &journal[sn * journal_width];
+    for (int j = 0; j < arrays.size(); j++) {
+        for (int b = 0; b < int(arrays[j]->size()) / nts; b++) {
+            adj& x = (*arrays[j])[b * nts + sn];
+            x = adj(*entry++);
+            x.i = hist_base[j] + b * nts + sn;
+        }
+    }
+    for (int j = 0; j < carried.size(); j++) {
+        *carried[j] = record ? adj::variable(*entry++) : adj(*entry++);
+    }
+    tangent.P = *entry++;
+    tangent.Q = *entry++;
+    tangent.T_act = *entry++;
+    tangent.s = tangent.dt * sn;
+    tangent.sn = sn;
+}
+
+static void adj_iv_residuals(adjoint_vessel& tangent, double a_mid, double a_act, double* R) {
+    //Residuals of the equilibrium and of the active radius lagged in update_sigma
+    tangent.a_act[tangent.sn] = a_act;
+    R[0] = iv_residual(adj(a_mid), &tangent).v;
+    R[1] = tangent.a_act[tangent.sn].v - a_act;
+}
+
+static void find_adj_iv_geom(adjoint_vessel& tangent, double& a_mid, double& a_act) {
+    //Equilibrium radius and active radius of the step, not recorded, by chord steps with
+    //a difference Jacobian at a_mid and a_act
+    double tol = 1E-12; //Relative convergence tolerance
+    double rel_step = 1E-7;
+    int iter = 0;
+
+    double R[2], R_a[2], R_c[2];
+    adj_iv_residuals(tangent, a_mid * (1 + rel_step), a_act, R_a);
+    adj_iv_residuals(tangent, a_mid, a_act * (1 + rel_step), R_c);
+    adj_iv_residuals(tangent, a_mid, a_act, R);
+    double J_00 = (R_a[0] - R[0]) / (a_mid * rel_step), J_01 = (R_c[0] - R[0]) / (a_act * rel_step);
+    double J_10 = (R_a[1] - R[1]) / (a_mid * rel_step), J_11 = (R_c[1] - R[1]) / (a_act * rel_step);
+    double det = J_00 * J_11 - J_01 * J_10;
+
+    double change = 0.0;
+    do {
+        iter++;
+        double delta_a = -(J_11 * R[0] - J_01 * R[1]) / det;
+        double delta_c = -(-J_10 * R[0] + J_00 * R[1]) / det;
+        a_mid += delta_a;
+        a_act += delta_c;
+        adj_iv_residuals(tangent, a_mid, a_act, R);
+        change = std::max(fabs(delta_a) / a_mid, fabs(delta_c) / a_act);
+    } while (change > tol && iter < 100);
+
+    if (iter == 100){
+        printf("%s %f %s\n", "Time step :", tangent.s, "Adjoint radius exceeded max iterations");
+    }
+}
+
+void inflammation_adjoint::reverse(const vessel& curr_vessel, const vector<double>& row_bar, vector<double>& ups_bar) {
+    const int n_out = vessel::n_native_outputs;
+    int nts = curr_vessel.nts;
+    double tol = 1E-14; //Convergence tolerance of update_time_step
+
+    adjoint_vessel tangent(curr_vessel);
+    vector<vector<adj>*> arrays = step_history_arrays(tangent);
+    vector<adj*> carried = step_carried_state(tangent);
+    vector<vector<double>*> primal_arrays = step_history_arrays(const_cast<vessel&>(curr_vessel));
+
+    //The history of the final vessel as variables at the start of the tape, once; entry
+    //b * nts + k of array j is node hist_base[j] + b * nts + k. Every step is recorded
+    //after them and truncated off again
+    tape.clear();
+    adj_current_tape() = &tape;
+    hist_base.assign(arrays.size() + 1, 0);
+    for (int j = 0; j < arrays.size(); j++) {
+        hist_base[j] = tape.size();
+        for (int e = 0; e < arrays[j]->size(); e++) {
+            (*arrays[j])[e] = adj::variable((*arrays[j])[e].v);
+        }
+    }
+    const int n_hist = tape.size();
+    hist_base[arrays.size()] = n_hist;
+    adj_current_tape() = NULL;
+
+    //Adjoints of the history and of the carried state
+    vector<vector<double>> hist_bar(arrays.size());
+    for (int j = 0; j < arrays.size(); j++) {
+        hist_bar[j].assign(arrays[j]->size(), 0.0);
+    }
+    vector<double> carried_bar(carried.size(), 0.0);
+
+    //Adjoints of the history variables of a step, and which of them it reached
+    vector<double> bar, hist_node_bar;
+    vector<int> touched;
+    vector<char> is_touched(n_hist, 0);
+
+    for (int sn = n_steps; sn >= 1; sn--) {
+        //Radii of the passes of update_time_step, without recording
+        adj_current_tape() = NULL;
+        restore(tangent, sn, false);
+        vector<double> root_a, root_act;
+        double a_mid = curr_vessel.a_mid[sn], a_act = curr_vessel.a_act[sn];
+        double rhoR_s0 = 0, rhoR_s1 = 0, mass_check = 0;
+        int iter = 0;
+        update_kinetics(tangent);
+        find_adj_iv_geom(tangent, a_mid, a_act);
+        root_a.push_back(a_mid);
+        root_act.push_back(a_act);
+        do {
+            iter++;
+            rhoR_s0 = tangent.rhoR[sn].v;
+            update_kinetics(tangent);
+            find_adj_iv_geom(tangent, a_mid, a_act);
+            root_a.push_back(a_mid);
+            root_act.push_back(a_act);
+            rhoR_s1 = tangent.rhoR[sn].v;
+            mass_check = abs((rhoR_s1 - rhoR_s0) / rhoR_s0);
+        } while (mass_check > tol && iter < 100);
+
+        //The step recorded once at the radii, which are independent variables with the
+        //residuals R = (F, a_act_out - a_act_in) of the passes
+        int n_pass = int(root_a.size());
+        tape.truncate(n_hist);
+        adj_current_tape() = &tape;
+        restore(tangent, sn, true);
+        vector<adj> input_carried;
+        for (int j = 0; j < carried.size(); j++) {
+            input_carried.push_back(*carried[j]);
+        }
+        vector<adj> u_a(n_pass), u_act(n_pass), F(n_pass), A(n_pass);
+        for (int p = 0; p < n_pass; p++) {
+            update_kinetics(tangent);
+            u_a[p] = adj::variable(root_a[p]);
+            u_act[p] = adj::variable(root_act[p]);
+            tangent.a_act[sn] = u_act[p];
+            F[p] = iv_residual(u_a[p], &tangent);
+            A[p] = tangent.a_act[sn];
+        }
+        tangent.sigma_prev = tangent.sigma;
+        tangent.bar_tauw_prev = tangent.bar_tauw;
+        tangent.lambda_z_tau[sn] = tangent.lambda_z_curr;
+        adj row[vessel::n_native_outputs];
+        tangent.nativeOutputRow(row);
+        adj_current_tape() = NULL;
+
+        //Seeds: the adjoints of the outputs in slot 0, and each residual in its own slot.
+        //The nodes of the step are in bar, the history variables in hist_node_bar
+        int width = 1 + 2 * n_pass;
+        bar.assign((tape.size() - n_hist) * width, 0.0);
+        if (hist_node_bar.size() < n_hist * width) {
+            hist_node_bar.assign(n_hist * width, 0.0);
+        }
+        auto leaf = [&](int i, int w, double b) {
+            if (!is_touched[i]) {
+                is_touched[i] = 1;
+                touched.push_back(i);
+            }
+            hist_node_bar[i * width + w] += b;
+        };
+        auto seed = [&](const adj& x, int w, double b) {
+            if (x.i >= n_hist) bar[(x.i - n_hist) * width + w] += b;
+            else if (x.i >= 0 && b != 0.0) leaf(x.i, w, b);
+        };
+        for (int j = 0; j < arrays.size(); j++) {
+            for (int b = 0; b < int(arrays[j]->size()) / nts; b++) {
+                seed((*arrays[j])[b * nts + sn], 0, hist_bar[j][b * nts + sn]);
+            }
+        }
+        for (int j = 0; j < carried.size(); j++) {
+            seed(*carried[j], 0, carried_bar[j]);
+        }
+        for (int k = 0; k < n_out; k++) {
+            seed(row[k], 0, row_bar[sn * n_out + k]);
+        }
+        for (int p = 0; p < n_pass; p++) {
+            seed(F[p], 1 + 2 * p, 1.0);
+            seed(A[p], 2 + 2 * p, 1.0);
+        }
+        tape.reverse_from(n_hist, bar, width, leaf);
+
+        //Multipliers of the residuals, last pass first: J_p^T lambda_p = -dL/du_p
+        auto G_node = [&](int w, int i) {
+            return i >= n_hist ? bar[(i - n_hist) * width + w] : i >= 0 ? hist_node_bar[i * width + w] : 0.0;
+        };
+        auto G = [&](int w, const adj& x) { return G_node(w, x.i); };
+        vector<double> lambda(2 * n_pass, 0.0);
+        for (int p = n_pass - 1; p >= 0; p--) {
+            double g_a = G(0, u_a[p]), g_act = G(0, u_act[p]);
+            for (int q = p + 1; q < n_pass; q++) {
+                g_a += lambda[2 * q] * G(1 + 2 * q, u_a[p]) + lambda[2 * q + 1] * G(2 + 2 * q, u_a[p]);
+                g_act += lambda[2 * q] * G(1 + 2 * q, u_act[p]) + lambda[2 * q + 1] * G(2 + 2 * q, u_act[p]);
+            }
+            double J_00 = G(1 + 2 * p, u_a[p]), J_01 = G(1 + 2 * p, u_act[p]);
+            double J_10 = G(2 + 2 * p, u_a[p]), J_11 = G(2 + 2 * p, u_act[p]) - 1.0;
+            double det = J_00 * J_11 - J_01 * J_10;
+            lambda[2 * p] = -(J_11 * g_a - J_10 * g_act) / det;
+            lambda[2 * p + 1] = -(-J_01 * g_a + J_00 * g_act) / det;
+        }
+        auto total = [&](int i) {
+            double t = G_node(0, i);
+            for (int p = 0; p < n_pass; p++) {
+                t += lambda[2 * p] * G_node(1 + 2 * p, i) + lambda[2 * p + 1] * G_node(2 + 2 * p, i);
+            }
+            return t;
+        };
+
+        //Adjoints of the inputs: the history read, added to those of its later uses, and
+        //the entries at sn and the state before the step, which have no earlier uses. Only
+        //the history variables the step reached have any; the entries of ups_infl_p at sn
+        //are then the gradient
+        for (int j = 0; j < arrays.size(); j++) {
+            for (int b = 0; b < int(arrays[j]->size()) / nts; b++) {
+                hist_bar[j][b * nts + sn] = 0.0;
+            }
+        }
+        for (int t = 0; t < touched.size(); t++) {
+            int i = touched[t];
+            int j = int(std::upper_bound(hist_base.begin(), hist_base.end(), i) - hist_base.begin()) - 1;
+            int e = i - hist_base[j];
+            if (e % nts <= sn) {
+                hist_bar[j][e] += total(i);
+            }
+            for (int w = 0; w < width; w++) {
+                hist_node_bar[i * width + w] = 0.0;
+            }
+            is_touched[i] = 0;
+        }
+        touched.clear();
+        for (int j = 0; j < carried.size(); j++) {
+            carried_bar[j] = total(input_carried[j].i);
+        }
+
+        //Back to the history of the final vessel at sn, for the earlier steps
+        for (int j = 0; j < arrays.size(); j++) {
+            for (int b = 0; b < int(arrays[j]->size()) / nts; b++) {
+                adj& x = (*arrays[j])[b * nts + sn];
+                x = adj((*primal_arrays[j])[b * nts + sn]);
+                x.i = hist_base[j] + b * nts + sn;
+            }
+        }
+    }
+    tape.clear();
+
+    int j_ups = int(std::find(arrays.begin(), arrays.end(), &tangent.ups_infl_p) - arrays.begin());
+    ups_bar = hist_bar[j_ups];
+}
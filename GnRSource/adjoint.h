@@ -0,0 +1,53 @@
+// adjoint.h
+#ifndef ADJOINT
+#define ADJOINT
+
+#include <vector>
+
+#include "adj.h"
+
+using std::vector;
+
+class vessel;
+template <typename T> class ad_vessel;
+typedef ad_vessel<adj> adjoint_vessel;
+
+//Discrete adjoint of a vessel's G&R with respect to the inflammation stimulus history
+//ups_infl_p [nts * alpha + sn], one control per step and constituent, for fitting the
+//history to data where forward sensitivities would need a run per step.
+//
+//The forward run steps the vessel and keeps a journal of what each step overwrites: the
+//entries of the history arrays at that step, before it, and the state carried to the
+//next step, O(n_alpha) per step. With the history arrays of the final vessel this
+//recreates the input of any step. The reverse sweep then goes back one step at a time:
+//the step is solved again for its radii without recording, replayed once on a tape
+//(adj.h) at the solved radii, and the adjoints of its outputs are carried back to the
+//history it read. The history is put on the tape once, ahead of the steps, and each
+//step is truncated off after its sweep, so a step costs what it reads and not the
+//length of the history. The equilibrium solves are differentiated implicitly, so a step is
+//recorded once rather than through its iterations, and the sweep costs about two
+//forward runs. The derivatives are those of each step's equilibrium solved exactly from
+//the history of the forward run, as for the forward sensitivities (sensitivity.h).
+class inflammation_adjoint {
+public:
+    //Steps the vessel, with its loads set, to n_steps; rows[sn * n_native_outputs + k] are
+    //the GnR_out rows, row 0 the state before the first step
+    void forward(vessel& curr_vessel, int n_steps);
+    //Gradient ups_bar [nts * alpha + sn] of an objective of the rows of the forward run,
+    //from its derivatives row_bar[sn * n_native_outputs + k]. curr_vessel is the vessel of
+    //the forward run
+    void reverse(const vessel& curr_vessel, const vector<double>& row_bar, vector<double>& ups_bar);
+
+    int n_steps;
+    vector<double> rows;
+    vector<double> journal; //per step: history entries, carried state, then loads
+    int journal_width;
+
+private:
+    void restore(adjoint_vessel& tangent, int sn, bool record);
+
+    adj_tape tape;
+    vector<int> hist_base; //node of the first history entry of each array, then the end
+};
+
+#endif /* ADJOINT */
@@ -0,0 +1,583 @@
+// calibration.cpp
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <gsl/gsl_errno.h>
+#include <gsl/gsl_vector.h>
+#include <gsl/gsl_matrix.h>
+#include <gsl/gsl_blas.h>
+#include <gsl/gsl_roots.h>
+#include <gsl/gsl_multiroots.h>
+#include <gsl/gsl_multifit_nlinear.h>
+
+#include "vessel.h"
+#include "functions.h"
+#include "ensemble.h"
+#include "adjoint.h"
+#include "calibration.h"
+
+using std::string;
+using std::vector;
+using std::cout;
+
+//Residual of every data point of a failed run, large enough for the trust region to
+//reject the step
+static const double failed_residual = 1e6;
+
+calibration::calibration(int n_threads) : pool(n_threads) {
+    n_data = 0;
+    n_relative = 0;
+    n_fit = 0;
+    fd_step = 1e-4;
+    steady_tol = 0.0;
+    steady_steps = 10;
+    chisq = 0.0;
+    n_iter = 0;
+    n_evals = 0;
+    n_failed = 0;
+    n_steady = 0;
+    n_days = 0.0;
+    dt = 1.0;
+}
+
+//Fields of a line of a data or parameter file, without the comment after '#'
+static vector<string> split_fields(string line) {
+    size_t hash = line.find('#');
+    if (hash != string::npos) {
+        line = line.substr(0, hash);
+    }
+    std::stringstream ss(line);
+    vector<string> fields;
+    string field;
+    while (ss >> field) {
+        fields.push_back(field);
+    }
+    return fields;
+}
+
+static double to_number(const string& field, const string& line) {
+    char* end = NULL;
+    double number = strtod(field.c_str(), &end);
+    if (*end != '\0') {
+        throw std::runtime_error("Not a number: " + field + " in " + line);
+    }
+    return number;
+}
+
+void calibration::readData(string data_file) {
+    std::ifstream data_in(data_file);
+    if (!data_in) {
+        throw std::runtime_error("Could not open data file " + data_file);
+    }
+
+    vector<string> native_names = vessel::nativeOutputNames();
+    string line;
+    while (std::getline(data_in, line)) {
+        vector<string> fields = split_fields(line);
+        if (fields.empty()) {
+            continue;
+        }
+        if (fields.size() < 3 || fields.size() > 4) {
+            throw std::runtime_error("Data line needs <column>[:fold] <day> <value> [sd]: " + line);
+        }
+
+        string column = fields[0];
+        int fold = 0;
+        size_t colon = column.find(':');
+        if (colon != string::npos) {
+            if (column.substr(colon + 1) != "fold") {
+                throw std::runtime_error("Unknown data modifier in " + column);
+            }
+            column = column.substr(0, colon);
+            fold = 1;
+        }
+        int idx = int(std::find(native_names.begin(), native_names.end(), column) - native_names.begin());
+        if (idx == native_names.size()) {
+            throw std::runtime_error("Unknown GnR_out column " + column);
+        }
+
+        double day = to_number(fields[1], line);
+        double data = to_number(fields[2], line);
+        double sd = fields.size() > 3 ? to_number(fields[3], line) : fabs(data);
+        if (!(sd > 0)) {
+            throw std::runtime_error("Data point needs a positive sd (or a nonzero value): " + line);
+        }
+        data_column.push_back(fields[0]);
+        data_index.push_back(idx);
+        data_fold.push_back(fold);
+        data_day.push_back(day);
+        data_value.push_back(data);
+        data_sd.push_back(sd);
+        n_relative += fields.size() < 4;
+    }
+    n_data = int(data_value.size());
+    if (n_data == 0) {
+        throw std::runtime_error("No data points in " + data_file);
+    }
+}
+
+void calibration::readParameters(string param_file) {
+    std::ifstream params_in(param_file);
+    if (!params_in) {
+        throw std::runtime_error("Could not open parameter file " + param_file);
+    }
+
+    vector<string> fixed_params;
+    vector<double> fixed_values;
+    string line;
+    while (std::getline(params_in, line)) {
+        vector<string> fields = split_fields(line);
+        if (fields.empty()) {
+            continue;
+        }
+        if (fields.size() < 2) {
+            throw std::runtime_error("Parameter line needs <parameter> <initial> [log|fixed] [<low> <high>]: " + line);
+        }
+        string mode = "";
+        int n_mode = 0;
+        if (fields.size() > 2 && (fields[2] == "log" || fields[2] == "fixed")) {
+            mode = fields[2];
+            n_mode = 1;
+        }
+        int n_bounds = int(fields.size()) - 2 - n_mode;
+        if (n_bounds != 0 && n_bounds != 2) {
+            throw std::runtime_error("Parameter line needs <parameter> <initial> [log|fixed] [<low> <high>]: " + line);
+        }
+        double initial = to_number(fields[1], line);
+        if (mode == "fixed") {
+            fixed_params.push_back(fields[0]);
+            fixed_values.push_back(initial);
+            continue;
+        }
+        if (mode == "log" && !(initial > 0)) {
+            throw std::runtime_error("Log parameter needs a positive initial value: " + line);
+        }
+        double low_i = mode == "log" ? 0.0 : -HUGE_VAL, high_i = HUGE_VAL;
+        if (n_bounds == 2) {
+            low_i = to_number(fields[2 + n_mode], line);
+            high_i = to_number(fields[3 + n_mode], line);
+            if (!(low_i <= initial && initial <= high_i) || (mode == "log" && !(low_i > 0))) {
+                throw std::runtime_error("Parameter needs low <= initial <= high, and low > 0 for log: " + line);
+            }
+        }
+        params.push_back(fields[0]);
+        value.push_back(initial);
+        log_flag.push_back(mode == "log");
+        low.push_back(low_i);
+        high.push_back(high_i);
+    }
+    n_fit = int(params.size());
+    params.insert(params.end(), fixed_params.begin(), fixed_params.end());
+    value.insert(value.end(), fixed_values.begin(), fixed_values.end());
+    log_flag.resize(params.size(), 0);
+}
+
+void calibration::initialize(string native_file, double n_days_inp, double dt_inp, string cache_dir) {
+    std::ifstream native_in(native_file);
+    if (!native_in) {
+        throw std::runtime_error("Could not open " + native_file);
+    }
+    std::stringstream contents;
+    contents << native_in.rdbuf();
+    native_text = contents.str();
+    n_days = n_days_inp;
+    dt = dt_inp;
+
+    //Steps of the data points, within the simulated days
+    int nts = int(n_days / dt);
+    data_step.resize(n_data);
+    for (int k = 0; k < n_data; k++) {
+        data_step[k] = int(floor(data_day[k] / dt + 0.5));
+        if (data_step[k] < 0 || data_step[k] >= nts) {
+            throw std::runtime_error("Data day " + std::to_string((long long) data_day[k]) +
+                                     " is outside the simulated days (see max_days)");
+        }
+    }
+
+    vessel base_vessel;
+    if (cache_dir.empty()) {
+        base_vessel.initializeNative(native_file, n_days, dt);
+    }
+    else {
+        base_vessel.initializeNativeCached(native_file, cache_dir, n_days, dt);
+    }
+    std::ostringstream state_out(std::ios::binary);
+    base_vessel.writeState(state_out);
+    base_state = state_out.str();
+
+    //Native_in entries, and checks of the other parameters
+    int n_params = int(params.size());
+    native_line.assign(n_params, 0);
+    native_col.assign(n_params, 0);
+    for (int i = 0; i < n_params; i++) {
+        if (params[i].compare(0, 10, "Native_in:") == 0) {
+            if (sscanf(params[i].c_str() + 10, "%d:%d", &native_line[i], &native_col[i]) != 2) {
+                throw std::runtime_error("Native_in parameter needs <line>:<column>: " + params[i]);
+            }
+            ensemble::editNative(native_text, native_line[i], native_col[i], 0.0);
+        }
+        else {
+            ensemble::setParameter(base_vessel, params[i], value[i]);
+        }
+    }
+}
+
+void calibration::loadVessel(vessel& curr_vessel, const vector<double>& values, double* initial) {
+    //Edited Native_in, or the shared base vessel
+    int n_params = int(params.size());
+    string text = native_text;
+    bool native_flag = false;
+    for (int i = 0; i < n_params; i++) {
+        if (native_line[i] > 0) {
+            text = ensemble::editNative(text, native_line[i], native_col[i], values[i]);
+            native_flag = true;
+        }
+    }
+    if (native_flag) {
+        std::istringstream native_in(text);
+        curr_vessel.initializeNative(native_in, n_days, dt);
+    }
+    else {
+        std::istringstream state_in(base_state, std::ios::binary);
+        curr_vessel.readState(state_in);
+    }
+
+    //Initial state, before the loads, as written by gnr
+    curr_vessel.nativeOutputRow(initial);
+    curr_vessel.P = curr_vessel.P_h;
+    curr_vessel.Q = curr_vessel.Q_h;
+    curr_vessel.T_act = curr_vessel.T_act_h;
+    curr_vessel.wss_calc_flag = 1;
+    bool infl_flag = false;
+    for (int i = 0; i < n_params; i++) {
+        if (native_line[i] == 0) {
+            ensemble::setParameter(curr_vessel, params[i], values[i]);
+            infl_flag = infl_flag || !ensemble::isLoadParameter(params[i]);
+        }
+    }
+    if (infl_flag) {
+        curr_vessel.updateInflammation();
+    }
+}
+
+double calibration::steadyChange(const vessel& curr_vessel, const double* prev, const double* row) const {
+    //Largest relative change of the data columns over the last step, and absolute change
+    //of the inflammatory stimulus, which is prescribed in time
+    double change = 0.0;
+    for (int k = 0; k < n_data; k++) {
+        int i = data_index[k];
+        change = std::max(change, fabs(row[i] - prev[i]) / std::max(fabs(row[i]), 1E-300));
+    }
+    int nts = curr_vessel.nts, sn = curr_vessel.sn;
+    if (sn + 1 < nts) {
+        for (int b = 0; b < int(curr_vessel.ups_infl_p.size()) / nts; b++) {
+            change = std::max(change, fabs(curr_vessel.ups_infl_p[nts * b + sn + 1] - curr_vessel.ups_infl_p[nts * b + sn]));
+            change = std::max(change, fabs(curr_vessel.ups_infl_d[nts * b + sn + 1] - curr_vessel.ups_infl_d[nts * b + sn]));
+        }
+    }
+    return change;
+}
+
+bool calibration::residuals(const double* x, double* r) {
+    vector<double> values(value);
+    for (int i = 0; i < n_fit; i++) {
+        values[i] = log_flag[i] ? exp(x[i]) : x[i];
+    }
+    int last_step = *std::max_element(data_step.begin(), data_step.end());
+    n_evals++;
+
+    try {
+        vessel curr_vessel;
+        double initial[vessel::n_native_outputs], row[vessel::n_native_outputs];
+        auto compare = [&](int sn, const double* sim_row) {
+            for (int k = 0; k < n_data; k++) {
+                if (data_step[k] == sn) {
+                    double sim = sim_row[data_index[k]];
+                    if (data_fold[k]) {
+                        sim /= initial[data_index[k]];
+                    }
+                    r[k] = (sim - data_value[k]) / data_sd[k];
+                }
+            }
+        };
+
+        loadVessel(curr_vessel, values, initial);
+        compare(0, initial);
+
+        //With a steady state, the rest of the run repeats the last row
+        double prev[vessel::n_native_outputs];
+        int n_quiet = 0;
+        std::copy(initial, initial + vessel::n_native_outputs, prev);
+        for (int sn = 1; sn <= last_step; sn++) {
+            step_vessel(curr_vessel, sn);
+            curr_vessel.nativeOutputRow(row);
+            compare(sn, row);
+
+            if (steady_tol > 0 && sn < last_step) {
+                n_quiet = steadyChange(curr_vessel, prev, row) < steady_tol ? n_quiet + 1 : 0;
+                std::copy(row, row + vessel::n_native_outputs, prev);
+                if (n_quiet >= steady_steps) {
+                    for (int sn_rest = sn + 1; sn_rest <= last_step; sn_rest++) {
+                        compare(sn_rest, row);
+                    }
+                    n_steady++;
+                    break;
+                }
+            }
+        }
+        for (int k = 0; k < n_data; k++) {
+            if (!std::isfinite(r[k])) {
+                throw std::runtime_error("Residual is not finite");
+            }
+        }
+    }
+    catch (std::exception& e) {
+        n_failed++;
+        for (int k = 0; k < n_data; k++) {
+            r[k] = failed_residual;
+        }
+        return false;
+    }
+    return true;
+}
+
+static int fit_f(const gsl_vector* x, void* params, gsl_vector* f) {
+    calibration* cal = (calibration*) params;
+    vector<double> x_fit(cal->n_fit), r(cal->n_data);
+    for (int i = 0; i < cal->n_fit; i++) {
+        x_fit[i] = gsl_vector_get(x, i);
+    }
+    cal->residuals(&x_fit[0], &r[0]);
+    for (int k = 0; k < cal->n_data; k++) {
+        gsl_vector_set(f, k, r[k]);
+    }
+    return GSL_SUCCESS;
+}
+
+//Forward difference Jacobian, one G&R run per column (and one at x) in parallel
+static int fit_df(const gsl_vector* x, void* params, gsl_matrix* J) {
+    calibration* cal = (calibration*) params;
+    int p = cal->n_fit, n = cal->n_data;
+    vector<double> x_fit(p), h(p), r((p + 1) * n);
+    vector<int> ok(p + 1);
+    for (int i = 0; i < p; i++) {
+        x_fit[i] = gsl_vector_get(x, i);
+        h[i] = cal->fd_step * fabs(x_fit[i]);
+        if (h[i] == 0.0) {
+            h[i] = cal->fd_step;
+        }
+    }
+
+    cal->pool.run(p + 1, [&](int j) {
+        vector<double> x_j(x_fit);
+        if (j < p) {
+            x_j[j] += h[j];
+            h[j] = x_j[j] - x_fit[j];
+        }
+        ok[j] = cal->residuals(&x_j[0], &r[j * n]);
+        //A backward difference if the forward step failed
+        if (!ok[j] && j < p) {
+            x_j[j] = x_fit[j] - h[j];
+            h[j] = x_j[j] - x_fit[j];
+            ok[j] = cal->residuals(&x_j[0], &r[j * n]);
+        }
+    });
+    //No exceptions through GSL; an error status ends the fit
+    for (int j = 0; j <= p; j++) {
+        if (!ok[j]) {
+            printf("%s %s\n", "G&R run failed in the Jacobian column of", j < p ? cal->params[j].c_str() : "the residuals");
+            return GSL_EBADFUNC;
+        }
+    }
+
+    for (int j = 0; j < p; j++) {
+        for (int k = 0; k < n; k++) {
+            gsl_matrix_set(J, k, j, (r[j * n + k] - r[p * n + k]) / h[j]);
+        }
+    }
+    return GSL_SUCCESS;
+}
+
+//Progress of every iteration
+static void fit_callback(const size_t iter, void* params, const gsl_multifit_nlinear_workspace* w) {
+    calibration* cal = (calibration*) params;
+    gsl_vector* x = gsl_multifit_nlinear_position(w);
+    gsl_vector* f = gsl_multifit_nlinear_residual(w);
+    double f_norm = gsl_blas_dnrm2(f);
+    printf("%s %d %s %e %s %ld", "Iteration:", int(iter), "chisq:", f_norm * f_norm, "runs:", long(cal->n_evals));
+    for (int i = 0; i < cal->n_fit; i++) {
+        double x_i = gsl_vector_get(x, i);
+        printf(" %s %e", cal->params[i].c_str(), cal->log_flag[i] ? exp(x_i) : x_i);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+int calibration::fit(int max_iter, double xtol, double gtol, double ftol, string out_prefix) {
+    int p = n_fit, n = n_data;
+    if (p == 0) {
+        throw std::runtime_error("No parameters to fit");
+    }
+    if (n < p) {
+        throw std::runtime_error("Fewer data points than fitted parameters");
+    }
+    n_evals = 0;
+    n_failed = 0;
+
+    gsl_vector* x = gsl_vector_alloc(p);
+    for (int i = 0; i < p; i++) {
+        gsl_vector_set(x, i, log_flag[i] ? log(value[i]) : value[i]);
+    }
+
+    gsl_multifit_nlinear_fdf fdf;
+    fdf.f = fit_f;
+    fdf.df = fit_df;
+    fdf.fvv = NULL;
+    fdf.n = n;
+    fdf.p = p;
+    fdf.params = this;
+
+    gsl_multifit_nlinear_parameters fdf_params = gsl_multifit_nlinear_default_parameters();
+    gsl_multifit_nlinear_workspace* w = gsl_multifit_nlinear_alloc(gsl_multifit_nlinear_trust, &fdf_params, n, p);
+    gsl_multifit_nlinear_init(x, &fdf, w);
+    if (n_failed > 0) {
+        gsl_multifit_nlinear_free(w);
+        gsl_vector_free(x);
+        throw std::runtime_error("G&R run failed at the initial parameters");
+    }
+
+    int info = 0;
+    int status = gsl_multifit_nlinear_driver(max_iter, xtol, gtol, ftol, fit_callback, this, &info, w);
+    n_iter = int(gsl_multifit_nlinear_niter(w));
+
+    //Fitted values and covariance, scaled by the reduced chi-square: as the error variance
+    //with relative errors, or when the fit is worse than the given sd
+    gsl_vector* x_fit = gsl_multifit_nlinear_position(w);
+    gsl_vector* f = gsl_multifit_nlinear_residual(w);
+    gsl_matrix* J = gsl_multifit_nlinear_jac(w);
+    gsl_matrix* covar_fit = gsl_matrix_alloc(p, p);
+    gsl_multifit_nlinear_covar(J, 0.0, covar_fit);
+    double f_norm = gsl_blas_dnrm2(f);
+    chisq = f_norm * f_norm;
+    int dof = n - p;
+    double c2 = 1.0;
+    if (dof > 0) {
+        c2 = n_relative > 0 ? chisq / dof : std::max(1.0, chisq / dof);
+    }
+    covar.resize(p * p);
+    for (int i = 0; i < p; i++) {
+        double x_i = gsl_vector_get(x_fit, i);
+        value[i] = log_flag[i] ? exp(x_i) : x_i;
+        for (int j = 0; j < p; j++) {
+            covar[i * p + j] = c2 * gsl_matrix_get(covar_fit, i, j);
+        }
+    }
+    vector<double> r(n);
+    for (int k = 0; k < n; k++) {
+        r[k] = gsl_vector_get(f, k);
+    }
+    gsl_matrix_free(covar_fit);
+    gsl_multifit_nlinear_free(w);
+    gsl_vector_free(x);
+
+    printf("%s %s %s %d %s %s\n", "Fit status:", gsl_strerror(status), "iterations:", n_iter, "stop:",
+           info == 1 ? "small step" : info == 2 ? "small gradient" : "none");
+    printf("%s %e %s %d %s %ld %s %ld\n", "chisq:", chisq, "dof:", dof, "runs:", long(n_evals), "failed runs:", long(n_failed));
+
+    //Parameters with standard deviations (of the value, to first order for log
+    //parameters), then the covariance of the fitted values
+    std::ofstream fit_out(out_prefix + "_fit");
+    fit_out << "#parameter\tvalue\tsd\tfit\n";
+    for (int i = 0; i < int(params.size()); i++) {
+        if (i < p) {
+            double sd = sqrt(covar[i * p + i]);
+            if (log_flag[i]) {
+                sd *= value[i];
+            }
+            fit_out << params[i] << "\t" << value[i] << "\t" << sd << "\t" << (log_flag[i] ? "log" : "linear") << "\n";
+            printf("%s %s %e %s %e\n", "Parameter:", params[i].c_str(), value[i], "sd:", sd);
+        }
+        else {
+            fit_out << params[i] << "\t" << value[i] << "\t0\tfixed\n";
+        }
+    }
+    fit_out << "#covariance\n";
+    for (int i = 0; i < p; i++) {
+        for (int j = 0; j < p; j++) {
+            fit_out << covar[i * p + j] << (j < p - 1 ? "\t" : "\n");
+        }
+    }
+    fit_out.close();
+
+    std::ofstream residuals_out(out_prefix + "_residuals");
+    residuals_out << "#column\tday\tvalue\tsimulated\tresidual\n";
+    for (int k = 0; k < n; k++) {
+        residuals_out << data_column[k] << "\t" << data_day[k] << "\t" << data_value[k] << "\t"
+                      << data_value[k] + r[k] * data_sd[k] << "\t" << r[k] << "\n";
+    }
+    residuals_out.close();
+
+    return status;
+}
+
+double calibration::inflammationGradient(string out_prefix) {
+    //One forward run to the last data day with its journal, then the adjoint sweep
+    //seeded with the derivatives of 1/2 sum r^2 on the rows of the data
+    const int n_out = vessel::n_native_outputs;
+    int last_step = *std::max_element(data_step.begin(), data_step.end());
+
+    vessel curr_vessel;
+    double initial[vessel::n_native_outputs];
+    loadVessel(curr_vessel, value, initial);
+
+    inflammation_adjoint adjoint;
+    adjoint.forward(curr_vessel, last_step);
+    n_evals++;
+
+    vector<double> row_bar(adjoint.rows.size(), 0.0);
+    chisq = 0.0;
+    for (int k = 0; k < n_data; k++) {
+        if (data_step[k] > adjoint.n_steps) {
+            throw std::runtime_error("Data beyond the last time step");
+        }
+        double sim = data_step[k] == 0 ? initial[data_index[k]] : adjoint.rows[data_step[k] * n_out + data_index[k]];
+        double scale = data_fold[k] ? 1.0 / initial[data_index[k]] : 1.0;
+        double r = (sim * scale - data_value[k]) / data_sd[k];
+        chisq += r * r;
+        if (data_step[k] > 0) {
+            row_bar[data_step[k] * n_out + data_index[k]] += r * scale / data_sd[k];
+        }
+    }
+    if (!std::isfinite(chisq)) {
+        throw std::runtime_error("Residual is not finite");
+    }
+
+    vector<double> ups_bar;
+    adjoint.reverse(curr_vessel, row_bar, ups_bar);
+
+    //Gradient for the constituents with an inflammatory stimulus
+    int nts = curr_vessel.nts;
+    std::ofstream gradient_out(out_prefix + "_ups_gradient");
+    gradient_out << "#s\talpha\tups_infl_p\tdJ/dups_infl_p\n";
+    for (int alpha = 0; alpha < curr_vessel.n_alpha; alpha++) {
+        if (curr_vessel.alpha_infl[alpha] == 0 && curr_vessel.alpha_mechinfl[alpha] == 0) {
+            continue;
+        }
+        for (int sn = 0; sn <= adjoint.n_steps; sn++) {
+            gradient_out << curr_vessel.dt * sn << "\t" << alpha << "\t" << curr_vessel.ups_infl_p[nts * alpha + sn]
+                         << "\t" << ups_bar[nts * alpha + sn] << "\n";
+        }
+    }
+    gradient_out.close();
+
+    printf("%s %e\n", "Objective:", chisq / 2);
+    return chisq / 2;
+}
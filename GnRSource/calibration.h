@@ -0,0 +1,92 @@
+// calibration.h
+#ifndef CALIBRATION
+#define CALIBRATION
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "thread_pool.h"
+
+using std::string;
+using std::vector;
+
+class vessel;
+
+//Nonlinear least-squares fit of vessel parameters to time-course data, in place of
+//lsqnonlin calling gnr from MATLAB. A data file has one measurement per line:
+//
+//  <column>[:fold] <day> <value> [sd]
+//
+//with a GnR_out column, as a fold change over its value at day 0 with ":fold", as in
+//the experimental data. The residual is (simulated - value) / sd, sd defaulting to
+//|value| (relative error). A parameter file has one parameter per line:
+//
+//  <parameter> <initial> [log|fixed] [<low> <high>]
+//
+//with the ensemble parameters (ensemble.h) or Native_in:<line>:<column>; "log" fits the
+//logarithm of a positive parameter and "fixed" only sets it, e.g. a load gamma_p. The
+//bounds are the support of the uniform (log-uniform for log) prior of the posterior
+//sampler (mcmc.h). Text after '#' is ignored in both.
+//
+//Every residual evaluation is one G&R run to the last data day from the shared
+//initialized base vessel (re-initialized from the edited file with Native_in
+//parameters). The forward difference Jacobian runs its columns in parallel. With
+//steady_tol set, a run stops once the data columns have changed by less than steady_tol
+//(relative) for steady_steps steps and the inflammatory stimulus no longer changes, and
+//the later data are compared with the last row.
+//
+//For inferring the inflammation stimulus history rather than parameters, the gradient
+//of the objective 1/2 sum r^2 with respect to every entry of ups_infl_p comes from one
+//adjoint sweep (adjoint.h) at the initial values.
+class calibration {
+public:
+    calibration(int n_threads = 0);
+
+    void readData(string data_file);
+    void readParameters(string param_file);
+    void initialize(string native_file, double n_days, double dt, string cache_dir = "");
+    //Residuals at fitted values x (log for log parameters); false if the run failed
+    bool residuals(const double* x, double* r);
+    //Trust region (Levenberg-Marquardt) fit from the initial values; returns the GSL status
+    int fit(int max_iter, double xtol, double gtol, double ftol, string out_prefix);
+    //Objective at the initial values, writing its gradient with respect to ups_infl_p of
+    //the inflamed constituents to <out_prefix>_ups_gradient
+    double inflammationGradient(string out_prefix);
+    //Vessel at parameter values, with its initial GnR_out row before the loads are set
+    void loadVessel(vessel& curr_vessel, const vector<double>& values, double* initial);
+    //Change of a run over its last step, from the GnR_out row before it, for steady_tol
+    double steadyChange(const vessel& curr_vessel, const double* prev, const double* row) const;
+
+    //Data
+    int n_data;
+    int n_relative; //data points without an sd
+    vector<string> data_column;
+    vector<int> data_index, data_fold, data_step;
+    vector<double> data_day, data_value, data_sd;
+
+    //Parameters, fitted ones first
+    int n_fit;
+    vector<string> params;
+    vector<double> value; //initial, then fitted
+    vector<int> log_flag;
+    vector<double> low, high; //bounds of the fitted parameters
+    vector<int> native_line, native_col; //0 if not a Native_in entry
+    double fd_step; //relative step of the forward differences
+    double steady_tol; //0 to run every step
+    int steady_steps;
+
+    //Fit results
+    vector<double> covar; //[i * n_fit + j] of the fitted values (log for log parameters)
+    double chisq;
+    int n_iter;
+    std::atomic<long> n_evals, n_failed; //G&R runs, and those that failed
+    std::atomic<long> n_steady; //runs stopped at a steady state
+
+    string native_text; //contents of the Native_in file
+    string base_state; //writeState of the initialized base vessel
+    double n_days, dt;
+    thread_pool pool;
+};
+
+#endif /* CALIBRATION */
@@ -0,0 +1,95 @@
+// dual.h
+#ifndef DUAL
+#define DUAL
+
+#include <cmath>
+#include <type_traits>
+
+//Forward mode dual number: a value and its derivatives along n_dirs directions, e.g.
+//with respect to a batch of parameters. Comparisons use the value, so branches of the
+//model follow the primal solution.
+struct dual {
+    static const int n_dirs = 8;
+    double v;
+    double d[n_dirs];
+
+    dual(double v_inp = 0.0) : v(v_inp) {
+        for (int i = 0; i < n_dirs; i++) d[i] = 0.0;
+    }
+
+    dual& operator+=(const dual& b) { v += b.v; for (int i = 0; i < n_dirs; i++) d[i] += b.d[i]; return *this; }
+    dual& operator-=(const dual& b) { v -= b.v; for (int i = 0; i < n_dirs; i++) d[i] -= b.d[i]; return *this; }
+    dual& operator*=(const dual& b) {
+        for (int i = 0; i < n_dirs; i++) d[i] = d[i] * b.v + v * b.d[i];
+        v *= b.v;
+        return *this;
+    }
+    dual& operator/=(const dual& b) {
+        double inv = 1.0 / b.v;
+        v *= inv;
+        for (int i = 0; i < n_dirs; i++) d[i] = (d[i] - v * b.d[i]) * inv;
+        return *this;
+    }
+};
+
+//Derivative of f at b.v along every direction of b
+inline dual chain(const dual& b, double f, double df) {
+    dual r(f);
+    for (int i = 0; i < dual::n_dirs; i++) r.d[i] = df * b.d[i];
+    return r;
+}
+
+inline dual operator+(dual a, const dual& b) { return a += b; }
+inline dual operator-(dual a, const dual& b) { return a -= b; }
+inline dual operator*(dual a, const dual& b) { return a *= b; }
+inline dual operator/(dual a, const dual& b) { return a /= b; }
+inline dual operator+(dual a, double b) { a.v += b; return a; }
+inline dual operator+(double a, dual b) { b.v += a; return b; }
+inline dual operator-(dual a, double b) { a.v -= b; return a; }
+inline dual operator-(double a, const dual& b) { return chain(b, a - b.v, -1.0); }
+inline dual operator*(const dual& a, double b) { return chain(a, a.v * b, b); }
+inline dual operator*(double a, const dual& b) { return chain(b, a * b.v, a); }
+inline dual operator/(const dual& a, double b) { return chain(a, a.v / b, 1.0 / b); }
+inline dual operator/(double a, const dual& b) { return chain(b, a / b.v, -a / (b.v * b.v)); }
+inline dual operator-(const dual& a) { return chain(a, -a.v, -1.0); }
+
+inline bool operator<(const dual& a, const dual& b) { return a.v < b.v; }
+inline bool operator>(const dual& a, const dual& b) { return a.v > b.v; }
+inline bool operator<=(const dual& a, const dual& b) { return a.v <= b.v; }
+inline bool operator>=(const dual& a, const dual& b) { return a.v >= b.v; }
+inline bool operator<(const dual& a, double b) { return a.v < b; }
+inline bool operator>(const dual& a, double b) { return a.v > b; }
+inline bool operator<(double a, const dual& b) { return a < b.v; }
+inline bool operator>(double a, const dual& b) { return a > b.v; }
+
+inline dual exp(const dual& a) { double e = std::exp(a.v); return chain(a, e, e); }
+inline dual log(const dual& a) { return chain(a, std::log(a.v), 1.0 / a.v); }
+inline dual sqrt(const dual& a) { double r = std::sqrt(a.v); return chain(a, r, 0.5 / r); }
+inline dual sin(const dual& a) { return chain(a, std::sin(a.v), std::cos(a.v)); }
+inline dual cos(const dual& a) { return chain(a, std::cos(a.v), -std::sin(a.v)); }
+
+//pow of duals only: with the implicit conversion from double, plain overloads would
+//compete with pow(double, double) for integer exponents
+template <typename D>
+using dual_only = typename std::enable_if<std::is_same<D, dual>::value, dual>::type;
+
+template <typename D>
+inline dual_only<D> pow(const D& a, double b) {
+    if (b == 2.0) return a * a;
+    double p = std::pow(a.v, b);
+    return chain(a, p, b == 0.0 ? 0.0 : b * std::pow(a.v, b - 1));
+}
+template <typename D>
+inline dual_only<D> pow(double a, const D& b) { double p = std::pow(a, b.v); return chain(b, p, p * std::log(a)); }
+template <typename D>
+inline dual_only<D> pow(const D& a, const D& b) {
+    //d(a^b) = b a^(b-1) da + a^b log(a) db
+    double p = std::pow(a.v, b.v);
+    dual r = chain(a, p, b.v * std::pow(a.v, b.v - 1));
+    if (a.v > 0) {
+        for (int i = 0; i < dual::n_dirs; i++) r.d[i] += p * std::log(a.v) * b.d[i];
+    }
+    return r;
+}
+
+#endif /* DUAL */
@@ -0,0 +1,173 @@
+// dual_vessel.cpp
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "vessel.h"
+#include "dual_vessel.h"
+
+using std::string;
+using std::vector;
+
+template <typename T>
+static vector<T> to_scalar(const vector<double>& x) {
+    return vector<T>(x.begin(), x.end());
+}
+
+template <typename T>
+ad_vessel<T>::ad_vessel(const vessel& primal) {
+    nts = primal.nts;
+    sn = primal.sn;
+    dt = primal.dt;
+    s = primal.s;
+    n_alpha = primal.n_alpha;
+    n_pol_alpha = primal.n_pol_alpha;
+    num_exp_flag = primal.num_exp_flag;
+    pol_only_flag = primal.pol_only_flag;
+    wss_calc_flag = primal.wss_calc_flag;
+    mech_infl_flag = primal.mech_infl_flag;
+    alpha_infl = primal.alpha_infl;
+    alpha_mechinfl = primal.alpha_mechinfl;
+    alpha_active = primal.alpha_active;
+
+    a_mid_h = primal.a_mid_h;
+    h_h = primal.h_h;
+    rhoR_h = primal.rhoR_h;
+    mu = primal.mu;
+    gamma_inf = primal.gamma_inf;
+    k_act = primal.k_act;
+    P_h = primal.P_h;
+    Q_h = primal.Q_h;
+    f_h = primal.f_h;
+    T_act_h = primal.T_act_h;
+    bar_tauw_h = primal.bar_tauw_h;
+    CB = primal.CB;
+    CS = primal.CS;
+    lambda_m = primal.lambda_m;
+    lambda_0 = primal.lambda_0;
+    K_i_Tact = primal.K_i_Tact;
+    phi_Tact0_min = primal.phi_Tact0_min;
+    k_alpha_h = primal.k_alpha_h;
+    sigma_h = primal.sigma_h;
+    rhoR_alpha_h = primal.rhoR_alpha_h;
+    mR_alpha_h = primal.mR_alpha_h;
+    rho_hat_alpha_h = primal.rho_hat_alpha_h;
+    c_alpha_h = primal.c_alpha_h;
+    eta_alpha_h = primal.eta_alpha_h;
+    g_alpha_h = primal.g_alpha_h;
+    G_alpha_h = primal.G_alpha_h;
+
+    K_sigma_p_alpha_h = to_scalar<T>(primal.K_sigma_p_alpha_h);
+    K_sigma_d_alpha_h = to_scalar<T>(primal.K_sigma_d_alpha_h);
+    K_tauw_p_alpha_h = to_scalar<T>(primal.K_tauw_p_alpha_h);
+    K_tauw_d_alpha_h = to_scalar<T>(primal.K_tauw_d_alpha_h);
+    delta_i = primal.delta_i;
+    K_infl_eff = primal.K_infl_eff;
+    s_int_infl = primal.s_int_infl;
+    Ki_trans = primal.Ki_trans;
+    Ki_steady = primal.Ki_steady;
+    Ki_deg = primal.Ki_deg;
+    beta_i = primal.beta_i;
+    delta_m = primal.delta_m;
+    K_mech_eff = primal.K_mech_eff;
+    s_int_mech = primal.s_int_mech;
+
+    P = primal.P;
+    Q = primal.Q;
+    T_act = primal.T_act;
+
+    a = to_scalar<T>(primal.a);
+    a_mid = to_scalar<T>(primal.a_mid);
+    h = to_scalar<T>(primal.h);
+    a_act = to_scalar<T>(primal.a_act);
+    rhoR = to_scalar<T>(primal.rhoR);
+    rho = to_scalar<T>(primal.rho);
+    rhoR_alpha = to_scalar<T>(primal.rhoR_alpha);
+    mR_alpha = to_scalar<T>(primal.mR_alpha);
+    k_alpha = to_scalar<T>(primal.k_alpha);
+    epsilonR_alpha = to_scalar<T>(primal.epsilonR_alpha);
+    epsilon_alpha = to_scalar<T>(primal.epsilon_alpha);
+    epsilon_pol_min = to_scalar<T>(primal.epsilon_pol_min);
+    ups_infl_p = to_scalar<T>(primal.ups_infl_p);
+    ups_infl_d = to_scalar<T>(primal.ups_infl_d);
+    K_sigma_p_alpha = to_scalar<T>(primal.K_sigma_p_alpha);
+    K_sigma_d_alpha = to_scalar<T>(primal.K_sigma_d_alpha);
+    K_tauw_p_alpha = to_scalar<T>(primal.K_tauw_p_alpha);
+    K_tauw_d_alpha = to_scalar<T>(primal.K_tauw_d_alpha);
+    lambda_th_curr = primal.lambda_th_curr;
+    lambda_z_curr = primal.lambda_z_curr;
+    f = primal.f;
+    bar_tauw = primal.bar_tauw;
+    bar_tauw_prev = primal.bar_tauw_prev;
+    sigma = to_scalar<T>(primal.sigma);
+    sigma_prev = to_scalar<T>(primal.sigma_prev);
+    Cbar = to_scalar<T>(primal.Cbar);
+    lambda_alpha_tau = to_scalar<T>(primal.lambda_alpha_tau);
+    lambda_z_tau = to_scalar<T>(primal.lambda_z_tau);
+}
+
+template <>
+bool ad_vessel<dual>::seed(const string& name, int dir) {
+    if (dir < 0 || dir >= dual::n_dirs) {
+        throw std::runtime_error("Sensitivity direction out of range");
+    }
+    //Loads relative to the homeostatic state, as ensemble::setParameter
+    if (name == "gamma_p") { P.d[dir] = P_h; return false; }
+    if (name == "gamma_q") { Q.d[dir] = Q_h; return false; }
+    if (name == "gamma_act") { T_act.d[dir] = T_act_h; return false; }
+
+    //Inflammation
+    dual* param = NULL;
+    if (name == "Ki_trans") param = &Ki_trans;
+    else if (name == "Ki_steady") param = &Ki_steady;
+    else if (name == "Ki_deg") param = &Ki_deg;
+    else if (name == "delta_i") param = &delta_i;
+    else if (name == "beta_i") param = &beta_i;
+    else if (name == "K_infl_eff") param = &K_infl_eff;
+    else if (name == "s_int_infl") param = &s_int_infl;
+    else if (name == "delta_m") param = &delta_m;
+    else if (name == "K_mech_eff") param = &K_mech_eff;
+    else if (name == "s_int_mech") param = &s_int_mech;
+    else {
+        //Homeostatic gains of one constituent
+        size_t colon = name.find(':');
+        string gain = name.substr(0, colon);
+        vector<dual>* gains = NULL;
+        if (gain == "K_sigma_p") gains = &K_sigma_p_alpha_h;
+        else if (gain == "K_sigma_d") gains = &K_sigma_d_alpha_h;
+        else if (gain == "K_tauw_p") gains = &K_tauw_p_alpha_h;
+        else if (gain == "K_tauw_d") gains = &K_tauw_d_alpha_h;
+        if (gains == NULL || colon == string::npos) {
+            throw std::runtime_error("No sensitivity with respect to " + name +
+                                     " (loads, inflammation parameters and gains only)");
+        }
+        int alpha = atoi(name.substr(colon + 1).c_str());
+        if (alpha < 0 || alpha >= int(gains->size())) {
+            throw std::runtime_error("Constituent index out of range in " + name);
+        }
+        param = &(*gains)[alpha];
+    }
+    param->d[dir] = 1.0;
+    return true;
+}
+
+template <typename T>
+void ad_vessel<T>::nativeOutputRow(T* out) const {
+    const T row[] = { a[sn], h[sn], rhoR[sn], rhoR_alpha[0 * nts + sn],
+        rhoR_alpha[1 * nts + sn], rhoR_alpha[2 * nts + sn],
+        bar_tauw, bar_tauw_h, P, P_h, f, f_h,
+        Q, Q_h, Cbar[1], k_alpha[0 * nts + sn], k_alpha[1 * nts + sn],
+        k_alpha[2 * nts + sn], mR_alpha[0 * nts + sn], mR_alpha[1 * nts + sn],
+        mR_alpha[2 * nts + sn], mR_alpha[3 * nts + sn], mR_alpha[4 * nts + sn], mR_alpha[5 * nts + sn] };
+    for (int k = 0; k < vessel::n_native_outputs; k++) {
+        out[k] = row[k];
+    }
+}
+
+template class ad_vessel<dual>;
+template ad_vessel<adj>::ad_vessel(const vessel&);
+template void ad_vessel<adj>::nativeOutputRow(adj*) const;
@@ -0,0 +1,70 @@
+// dual_vessel.h
+#ifndef DUAL_VESSEL
+#define DUAL_VESSEL
+
+#include <string>
+#include <vector>
+
+#include "dual.h"
+#include "adj.h"
+
+using std::string;
+using std::vector;
+
+class vessel;
+
+//The members of a vessel read and written by the step kernels (functions.h), with the
+//evolving state, the loads and the G&R parameters as differentiable numbers T. With dual
+//numbers, stepped alongside a vessel's solution, it carries the derivatives of the G&R
+//with respect to up to dual::n_dirs parameters (dual_vessel); with adj numbers it
+//records steps for the adjoint (adjoint.h). The homeostatic state (material parameters,
+//reference geometry and stresses) is fixed, so parameters that set it are not
+//differentiated.
+template <typename T>
+class ad_vessel {
+public:
+    typedef T scalar;
+
+    ad_vessel(const vessel& primal); //Values of the vessel, all derivatives zero
+    //Seeds direction dir with a parameter (ensemble::setParameter names); returns true if
+    //the inflammation schedules depend on it (update_inflammation). Dual numbers only
+    bool seed(const string& name, int dir);
+    void nativeOutputRow(T* out) const; //GnR_out row, as vessel::nativeOutputRow
+
+    //Time and flags
+    int nts, sn;
+    double dt, s;
+    int n_alpha, n_pol_alpha;
+    int num_exp_flag, pol_only_flag, wss_calc_flag, mech_infl_flag;
+    vector<int> alpha_infl, alpha_mechinfl, alpha_active;
+
+    //Homeostatic state and material parameters
+    double a_mid_h, h_h, rhoR_h, mu, gamma_inf, k_act;
+    double P_h, Q_h, f_h, T_act_h, bar_tauw_h;
+    double CB, CS, lambda_m, lambda_0, K_i_Tact, phi_Tact0_min;
+    vector<double> k_alpha_h, sigma_h, rhoR_alpha_h, mR_alpha_h, rho_hat_alpha_h;
+    vector<double> c_alpha_h, eta_alpha_h, g_alpha_h, G_alpha_h;
+
+    //G&R parameters
+    vector<T> K_sigma_p_alpha_h, K_sigma_d_alpha_h, K_tauw_p_alpha_h, K_tauw_d_alpha_h;
+    T delta_i, K_infl_eff, s_int_infl;
+    T Ki_trans, Ki_steady, Ki_deg, beta_i;
+    T delta_m, K_mech_eff, s_int_mech;
+
+    //Loads
+    T P, Q, T_act;
+
+    //Evolving state
+    vector<T> a, a_mid, h, a_act;
+    vector<T> rhoR, rho, rhoR_alpha, mR_alpha, k_alpha;
+    vector<T> epsilonR_alpha, epsilon_alpha, epsilon_pol_min;
+    vector<T> ups_infl_p, ups_infl_d;
+    vector<T> K_sigma_p_alpha, K_sigma_d_alpha, K_tauw_p_alpha, K_tauw_d_alpha;
+    T lambda_th_curr, lambda_z_curr, f, bar_tauw, bar_tauw_prev;
+    vector<T> sigma, sigma_prev, Cbar, lambda_alpha_tau, lambda_z_tau;
+};
+
+typedef ad_vessel<dual> dual_vessel;
+typedef ad_vessel<adj> adjoint_vessel;
+
+#endif /* DUAL_VESSEL */
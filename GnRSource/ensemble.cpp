@@ -0,0 +1,353 @@
+// ensemble.cpp
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <gsl/gsl_errno.h>
+#include <gsl/gsl_vector.h>
+#include <gsl/gsl_roots.h>
+#include <gsl/gsl_multiroots.h>
+
+#include "vessel.h"
+#include "functions.h"
+#include "gnr_binary.h"
+#include "ensemble.h"
+
+using std::string;
+using std::vector;
+using std::cout;
+
+ensemble::ensemble(int n_threads) : pool(n_threads) {
+    n_jobs = 0;
+    branch_step = 0;
+    prefix_seconds = 0.0;
+}
+
+vector<string> ensemble::parameterNames() {
+    return { "gamma_p", "gamma_q", "gamma_act", "mech_infl_flag", "mech_exp_flag",
+        "Ki_trans", "Ki_steady", "Ki_deg", "delta_i", "beta_i", "K_infl_eff", "s_int_infl",
+        "delta_m", "K_mech_eff", "s_int_mech",
+        "K_sigma_p:<alpha>", "K_sigma_d:<alpha>", "K_tauw_p:<alpha>", "K_tauw_d:<alpha>" };
+}
+
+bool ensemble::isLoadParameter(const string& name) {
+    return name == "gamma_p" || name == "gamma_q" || name == "gamma_act" ||
+           name == "mech_infl_flag" || name == "mech_exp_flag";
+}
+
+void ensemble::setParameter(vessel& curr_vessel, const string& name, double value) {
+    //Loads relative to the homeostatic state, as --gamma_p/--gamma_q/--gamma_act
+    if (name == "gamma_p") curr_vessel.P = (1 + value) * curr_vessel.P_h;
+    else if (name == "gamma_q") curr_vessel.Q = (1 + value) * curr_vessel.Q_h;
+    else if (name == "gamma_act") curr_vessel.T_act = (1 + value) * curr_vessel.T_act_h;
+    else if (name == "mech_infl_flag") curr_vessel.mech_infl_flag = int(value);
+    else if (name == "mech_exp_flag") curr_vessel.mech_exp_flag = int(value);
+    //Inflammation
+    else if (name == "Ki_trans") curr_vessel.Ki_trans = value;
+    else if (name == "Ki_steady") curr_vessel.Ki_steady = value;
+    else if (name == "Ki_deg") curr_vessel.Ki_deg = value;
+    else if (name == "delta_i") curr_vessel.delta_i = value;
+    else if (name == "beta_i") curr_vessel.beta_i = value;
+    else if (name == "K_infl_eff") curr_vessel.K_infl_eff = value;
+    else if (name == "s_int_infl") curr_vessel.s_int_infl = value;
+    else if (name == "delta_m") curr_vessel.delta_m = value;
+    else if (name == "K_mech_eff") curr_vessel.K_mech_eff = value;
+    else if (name == "s_int_mech") curr_vessel.s_int_mech = value;
+    else {
+        //Homeostatic gains of one constituent
+        size_t colon = name.find(':');
+        string gain = name.substr(0, colon);
+        vector<double>* gains = NULL;
+        if (gain == "K_sigma_p") gains = &curr_vessel.K_sigma_p_alpha_h;
+        else if (gain == "K_sigma_d") gains = &curr_vessel.K_sigma_d_alpha_h;
+        else if (gain == "K_tauw_p") gains = &curr_vessel.K_tauw_p_alpha_h;
+        else if (gain == "K_tauw_d") gains = &curr_vessel.K_tauw_d_alpha_h;
+        if (gains == NULL || colon == string::npos) {
+            throw std::runtime_error("Unknown ensemble parameter " + name);
+        }
+        int alpha = atoi(name.substr(colon + 1).c_str());
+        if (alpha < 0 || alpha >= int(gains->size())) {
+            throw std::runtime_error("Constituent index out of range in " + name);
+        }
+        (*gains)[alpha] = value;
+    }
+}
+
+string ensemble::editNative(const string& text, int line_no, int col_no, double value) {
+    std::istringstream text_in(text);
+    std::ostringstream text_out;
+    string line;
+    int l = 0;
+    bool found = false;
+    while (std::getline(text_in, line)) {
+        l++;
+        if (l == line_no) {
+            std::istringstream ss(line);
+            string field;
+            int c = 0;
+            line.clear();
+            while (ss >> field) {
+                c++;
+                if (c == col_no) {
+                    char buf[32];
+                    snprintf(buf, sizeof(buf), "%.17g", value);
+                    field = buf;
+                    found = true;
+                }
+                line += (c > 1 ? " " : "") + field;
+            }
+        }
+        text_out << line << "\n";
+    }
+    if (!found) {
+        throw std::runtime_error("Native_in has no entry at line " + std::to_string((long long) line_no) +
+                                 " column " + std::to_string((long long) col_no));
+    }
+    return text_out.str();
+}
+
+void ensemble::readJobs(string job_file) {
+    std::ifstream jobs_in(job_file);
+    if (!jobs_in) {
+        throw std::runtime_error("Could not open job table " + job_file);
+    }
+
+    string line;
+    int name_col = -1;
+    vector<string> header;
+    while (std::getline(jobs_in, line)) {
+        size_t hash = line.find('#');
+        if (hash != string::npos) {
+            line = line.substr(0, hash);
+        }
+        std::stringstream ss(line);
+        vector<string> fields;
+        string field;
+        while (ss >> field) {
+            fields.push_back(field);
+        }
+        if (fields.empty()) {
+            continue;
+        }
+
+        //Header of column names, checked against a scratch vessel
+        if (header.empty()) {
+            header = fields;
+            vessel check;
+            check.K_sigma_p_alpha_h.assign(16, 0.0);
+            check.K_sigma_d_alpha_h.assign(16, 0.0);
+            check.K_tauw_p_alpha_h.assign(16, 0.0);
+            check.K_tauw_d_alpha_h.assign(16, 0.0);
+            for (int k = 0; k < header.size(); k++) {
+                if (header[k] == "name") {
+                    name_col = k;
+                    continue;
+                }
+                setParameter(check, header[k], 0.0);
+                columns.push_back(header[k]);
+            }
+            continue;
+        }
+
+        if (fields.size() != header.size()) {
+            throw std::runtime_error("Job table line does not match the header: " + line);
+        }
+        names.push_back(name_col >= 0 ? fields[name_col] : std::to_string((long long) names.size()));
+        for (int k = 0; k < fields.size(); k++) {
+            if (k == name_col) {
+                continue;
+            }
+            char* end = NULL;
+            double value = strtod(fields[k].c_str(), &end);
+            if (*end != '\0') {
+                throw std::runtime_error("Job table value is not a number: " + fields[k]);
+            }
+            values.push_back(value);
+        }
+    }
+    n_jobs = int(names.size());
+    if (n_jobs == 0) {
+        throw std::runtime_error("Job table has no jobs: " + job_file);
+    }
+}
+
+void ensemble::initialize(string native_file, double n_days, double dt, string cache_dir) {
+    vessel base_vessel;
+    if (cache_dir.empty()) {
+        base_vessel.initializeNative(native_file, n_days, dt);
+    }
+    else {
+        base_vessel.initializeNativeCached(native_file, cache_dir, n_days, dt);
+    }
+    std::ostringstream state_out(std::ios::binary);
+    base_vessel.writeState(state_out);
+    base_state = state_out.str();
+}
+
+void ensemble::run(int n_steps, int equil_flag, string out_prefix) {
+    int n_cols = int(columns.size());
+    job_seconds.assign(n_jobs, 0.0);
+    job_status.assign(n_jobs, "");
+
+    //Costliest first: a pressure or active stress jump of more than 5% is ramped over
+    //a hundred or more solves in the first step
+    vector<double> jump(n_jobs, 0.0);
+    for (int j = 0; j < n_jobs; j++) {
+        for (int k = 0; k < n_cols; k++) {
+            if (columns[k] == "gamma_p" || columns[k] == "gamma_act") {
+                jump[j] = std::max(jump[j], fabs(values[j * n_cols + k]));
+            }
+        }
+    }
+    vector<int> order(n_jobs);
+    for (int j = 0; j < n_jobs; j++) {
+        order[j] = j;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](int i, int j) {
+        return jump[i] > jump[j];
+    });
+
+    vector<string> out_cols = { "job", "s" };
+    vector<string> equil_cols = { "job" };
+    vector<string> native_names = vessel::nativeOutputNames();
+    vector<string> equil_names = vessel::nativeEquilibratedOutputNames();
+    out_cols.insert(out_cols.end(), native_names.begin(), native_names.end());
+    equil_cols.insert(equil_cols.end(), equil_names.begin(), equil_names.end());
+
+    binary_table_writer out_table, equil_table;
+    out_table.open(out_prefix + "_out.bin", out_cols, false);
+    if (equil_flag) {
+        equil_table.open(out_prefix + "_equil.bin", equil_cols, false);
+    }
+    std::ofstream jobs_out(out_prefix + "_jobs");
+    std::mutex out_mutex;
+    const int n_out = 2 + vessel::n_native_outputs;
+
+    //Shared history of the branches, run once and written as job -1
+    string start_state = base_state;
+    int first_step = 1;
+    if (branch_step > 0) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        vessel trunk;
+        std::istringstream state_in(base_state, std::ios::binary);
+        trunk.readState(state_in);
+        vector<double> row(n_out);
+        auto record = [&]() {
+            row[0] = -1;
+            row[1] = trunk.dt * trunk.sn;
+            trunk.nativeOutputRow(&row[2]);
+            out_table.write_row(&row[0]);
+        };
+        record();
+        trunk.P = trunk.P_h;
+        trunk.Q = trunk.Q_h;
+        trunk.T_act = trunk.T_act_h;
+        trunk.wss_calc_flag = 1;
+        for (int sn = 1; sn <= branch_step && sn < std::min(n_steps, trunk.nts); sn++) {
+            step_vessel(trunk, sn);
+            record();
+        }
+        first_step = trunk.sn + 1;
+        std::ostringstream state_out(std::ios::binary);
+        trunk.writeState(state_out);
+        start_state = state_out.str();
+        prefix_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("%s %d %s %f\n", "Shared history steps:", trunk.sn, "seconds:", prefix_seconds);
+        fflush(stdout);
+    }
+
+    pool.run_stealing(order, [&](int j) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        vector<double> rows, equil_row;
+        try {
+            vessel curr_vessel;
+            std::istringstream state_in(start_state, std::ios::binary);
+            curr_vessel.readState(state_in);
+
+            auto record = [&]() {
+                rows.resize(rows.size() + n_out);
+                double* row = &rows[rows.size() - n_out];
+                row[0] = j;
+                row[1] = curr_vessel.dt * curr_vessel.sn;
+                curr_vessel.nativeOutputRow(row + 2);
+            };
+
+            //Initial state as written by gnr, before the job's loads, unless shared
+            if (branch_step == 0) {
+                record();
+            }
+            curr_vessel.P = curr_vessel.P_h;
+            curr_vessel.Q = curr_vessel.Q_h;
+            curr_vessel.T_act = curr_vessel.T_act_h;
+            curr_vessel.wss_calc_flag = 1;
+            bool infl_flag = false;
+            for (int k = 0; k < n_cols; k++) {
+                setParameter(curr_vessel, columns[k], values[j * n_cols + k]);
+                infl_flag = infl_flag || !isLoadParameter(columns[k]);
+            }
+            if (infl_flag) {
+                curr_vessel.updateInflammation();
+            }
+            double P_load = curr_vessel.P, Q_load = curr_vessel.Q;
+
+            //Run the G&R time stepping
+            for (int sn = first_step; sn < std::min(n_steps, curr_vessel.nts); sn++) {
+                step_vessel(curr_vessel, sn);
+                record();
+            }
+
+            //Long-term equilibrated solution
+            if (equil_flag) {
+                curr_vessel.sn = curr_vessel.nts - 1;
+                curr_vessel.s = curr_vessel.dt * curr_vessel.sn;
+                curr_vessel.P = P_load;
+                curr_vessel.Q = Q_load;
+                int solve_status = find_equil_geom(&curr_vessel);
+                equil_row.resize(1 + vessel::n_native_equil_outputs);
+                equil_row[0] = j;
+                curr_vessel.nativeEquilibratedOutputRow(&equil_row[1]);
+                //An equilibrium that did not converge is a failed job, as in equil_map::build
+                bool ok = solve_status == GSL_SUCCESS;
+                for (int k = 1; k < equil_row.size(); k++) {
+                    ok = ok && std::isfinite(equil_row[k]);
+                }
+                if (!ok) {
+                    equil_row.clear();
+                    throw std::runtime_error(string("equilibrated solution ") +
+                                             (solve_status != GSL_SUCCESS ? gsl_strerror(solve_status) : "not finite"));
+                }
+            }
+            job_status[j] = "ok";
+        }
+        catch (std::exception& e) {
+            job_status[j] = string("failed: ") + e.what();
+        }
+        job_seconds[j] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::lock_guard<std::mutex> lock(out_mutex);
+        for (size_t r = 0; r < rows.size(); r += n_out) {
+            out_table.write_row(&rows[r]);
+        }
+        if (!equil_row.empty()) {
+            equil_table.write_row(&equil_row[0]);
+        }
+        jobs_out << j << "\t" << names[j] << "\t" << job_seconds[j] << "\t" << job_status[j] << "\n";
+        printf("%s %d %s %s %s %f %s\n", "Job:", j, "name:", names[j].c_str(), "seconds:", job_seconds[j], job_status[j].c_str());
+        fflush(stdout);
+    });
+
+    out_table.close();
+    if (equil_flag) {
+        equil_table.close();
+    }
+    jobs_out.close();
+}
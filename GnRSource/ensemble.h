@@ -0,0 +1,65 @@
+// ensemble.h
+#ifndef ENSEMBLE
+#define ENSEMBLE
+
+#include <string>
+#include <vector>
+
+#include "thread_pool.h"
+
+using std::string;
+using std::vector;
+
+class vessel;
+
+//Parameter sweep over one Native_in file. The base vessel is read and initialized once
+//and every job starts from its state snapshot with its own parameters. A job table has
+//a header line of column names and one job per line:
+//
+//  name  gamma_p  gamma_q  K_infl_eff  K_sigma_p:1
+//  base  0        0        1           0.5
+//  high  0.5      0        0.8         0.5
+//
+//The name column is optional. Other columns are parameters (parameterNames), the gains
+//taking the constituent index after ':'. Text after '#' is ignored.
+//
+//Jobs run by work stealing, those with large load jumps (and so pressure or active
+//stress ramping) first. Outputs of all jobs go to binary tables (gnr_binary.h):
+//  <prefix>_out.bin    job, s and the GnR_out columns, every step of every job
+//  <prefix>_equil.bin  job and the Equil_GnR_out columns, with equilibrated solutions
+//  <prefix>_jobs       job, name, run time (s) and status, as text
+//with the rows of each job contiguous, the jobs in order of completion.
+//
+//With branch_step set, the jobs branch from a shared history: the base vessel is run
+//once at its homeostatic loads to branch_step, its rows written as job -1, and every
+//job starts from that state with its own parameters, writing only the steps after it.
+class ensemble {
+public:
+    ensemble(int n_threads = 0);
+
+    void readJobs(string job_file);
+    void initialize(string native_file, double n_days, double dt, string cache_dir = "");
+    void run(int n_steps, int equil_flag, string out_prefix);
+
+    //Sets a named parameter of a vessel; inflammation parameters and gains need
+    //updateInflammation afterwards
+    static void setParameter(vessel& curr_vessel, const string& name, double value);
+    static bool isLoadParameter(const string& name); //gamma_p, gamma_q, gamma_act and the flags
+    static vector<string> parameterNames();
+    //Native_in text with the entry at (line, column), both 1-based, replaced by value
+    static string editNative(const string& text, int line_no, int col_no, double value);
+
+    int n_jobs;
+    vector<string> names;
+    vector<string> columns; //parameter columns
+    vector<double> values; //[job * columns.size() + k]
+    vector<double> job_seconds;
+    vector<string> job_status;
+
+    string base_state; //writeState of the initialized base vessel
+    int branch_step; //0 to run every job from the start
+    double prefix_seconds; //run time of the shared history
+    thread_pool pool;
+};
+
+#endif /* ENSEMBLE */
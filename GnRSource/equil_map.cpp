@@ -0,0 +1,278 @@
+// equil_map.cpp
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <gsl/gsl_errno.h>
+#include <gsl/gsl_vector.h>
+#include <gsl/gsl_roots.h>
+#include <gsl/gsl_multiroots.h>
+
+#include "vessel.h"
+#include "functions.h"
+#include "equil_map.h"
+
+using std::string;
+using std::vector;
+
+static const char equil_map_magic[8] = { 'G', 'N', 'R', 'E', 'Q', 'M', '1', '\0' };
+
+equil_map::equil_map() {
+    n_warm = 0;
+    n_cold = 0;
+    n_failed = 0;
+}
+
+int equil_map::point(int ip, int iq, int ia) const {
+    return (ip * int(gamma_q.size()) + iq) * int(gamma_act.size()) + ia;
+}
+
+vector<double> equil_map::parseAxis(const string& spec) {
+    std::stringstream ss(spec);
+    double low = 0, high = 0;
+    int n = 1;
+    char sep_1 = ':', sep_2 = ':';
+    if (!(ss >> low)) {
+        throw std::runtime_error("Bad grid axis: " + spec);
+    }
+    if (ss >> sep_1) {
+        if (sep_1 != ':' || !(ss >> high >> sep_2 >> n) || sep_2 != ':' || n < 1 || (n > 1 && !(high > low))) {
+            throw std::runtime_error("Grid axis needs <value> or <low>:<high>:<points>: " + spec);
+        }
+    }
+    vector<double> axis(n);
+    for (int k = 0; k < n; k++) {
+        axis[k] = n > 1 ? low + (high - low) * k / (n - 1) : low;
+    }
+    return axis;
+}
+
+void equil_map::unknowns(const vessel& curr_vessel, const double* row, double* x) {
+    //Row a_e, h_e, rho_m_e, rho_c_e, f_z_e, mb_equil_e; equil_obj_f takes rho_c_e per J_e
+    double J_e = row[1] / curr_vessel.h_h * (row[0] + row[1] / 2) /
+                 (curr_vessel.a_h + curr_vessel.h_h / 2) * curr_vessel.lambda_z_curr;
+    x[0] = row[0];
+    x[1] = row[1];
+    x[2] = row[3] / J_e;
+    x[3] = row[4];
+}
+
+void equil_map::build(const string& base_state, string key_inp, thread_pool& pool) {
+    const vector<double>* axes[3] = { &gamma_p, &gamma_q, &gamma_act };
+    for (int d = 0; d < 3; d++) {
+        if (axes[d]->empty()) {
+            throw std::runtime_error("Equilibrated map needs at least one point on every axis");
+        }
+        for (size_t k = 1; k < axes[d]->size(); k++) {
+            if (!((*axes[d])[k] > (*axes[d])[k - 1])) {
+                throw std::runtime_error("Equilibrated map axes must be ascending");
+            }
+        }
+    }
+    key = key_inp;
+    const int n_p = int(gamma_p.size()), n_q = int(gamma_q.size()), n_act = int(gamma_act.size());
+    const int n_out = vessel::n_native_equil_outputs;
+    status.assign(n_p * n_q * n_act, GSL_FAILURE);
+    values.assign(n_p * n_q * n_act * n_out, 0.0);
+
+    //Lines start nearest the homeostatic pressure, where the load-based guess is best
+    int ip_0 = 0;
+    for (int ip = 1; ip < n_p; ip++) {
+        if (fabs(gamma_p[ip]) < fabs(gamma_p[ip_0])) {
+            ip_0 = ip;
+        }
+    }
+
+    std::atomic<int> warm(0), cold(0), failed(0);
+    pool.run(n_q * n_act, [&](int line) {
+        int iq = line / n_act, ia = line % n_act;
+        vessel curr_vessel;
+        std::istringstream state_in(base_state, std::ios::binary);
+        curr_vessel.readState(state_in);
+        curr_vessel.sn = curr_vessel.nts - 1;
+        curr_vessel.s = curr_vessel.dt * curr_vessel.sn;
+        curr_vessel.Q = (1.0 + gamma_q[iq]) * curr_vessel.Q_h;
+        curr_vessel.T_act = (1.0 + gamma_act[ia]) * curr_vessel.T_act_h;
+
+        auto solve = [&](int ip, const double* x_guess) {
+            int j = point(ip, iq, ia);
+            curr_vessel.P = (1.0 + gamma_p[ip]) * curr_vessel.P_h;
+            int solve_status = find_equil_geom(&curr_vessel, x_guess);
+            double* row = &values[j * n_out];
+            curr_vessel.nativeEquilibratedOutputRow(row);
+            bool ok = solve_status == GSL_SUCCESS;
+            for (int k = 0; k < n_out; k++) {
+                ok = ok && std::isfinite(row[k]);
+            }
+            status[j] = ok ? GSL_SUCCESS : (solve_status != GSL_SUCCESS ? solve_status : GSL_FAILURE);
+            return ok;
+        };
+
+        double x_0[4];
+        bool ok_0 = solve(ip_0, NULL);
+        (ok_0 ? cold : failed)++;
+        if (ok_0) {
+            unknowns(curr_vessel, &values[point(ip_0, iq, ia) * n_out], x_0);
+        }
+
+        //Continuation outward, each point from its solved neighbour
+        for (int dir = 1; dir >= -1; dir -= 2) {
+            double x[4];
+            bool have_x = ok_0;
+            std::copy(x_0, x_0 + 4, x);
+            for (int ip = ip_0 + dir; ip >= 0 && ip < n_p; ip += dir) {
+                bool ok = have_x && solve(ip, x);
+                if (ok) {
+                    warm++;
+                }
+                else {
+                    ok = solve(ip, NULL);
+                    (ok ? cold : failed)++;
+                }
+                if (ok) {
+                    unknowns(curr_vessel, &values[point(ip, iq, ia) * n_out], x);
+                    have_x = true;
+                }
+            }
+        }
+    });
+    n_warm = warm;
+    n_cold = cold;
+    n_failed = failed;
+}
+
+void equil_map::write(string file_name) const {
+    //Written to a temporary file and renamed, as the init cache
+    string tmp_name = file_name + ".tmp" + std::to_string((long long) std::chrono::steady_clock::now().time_since_epoch().count());
+    std::ofstream map_out(tmp_name, std::ios::binary);
+    uint64_t key_size = key.size();
+    uint32_t n[3] = { uint32_t(gamma_p.size()), uint32_t(gamma_q.size()), uint32_t(gamma_act.size()) };
+    map_out.write(equil_map_magic, 8);
+    map_out.write(reinterpret_cast<const char*>(&key_size), sizeof(key_size));
+    map_out.write(key.data(), key_size);
+    map_out.write(reinterpret_cast<const char*>(n), sizeof(n));
+    map_out.write(reinterpret_cast<const char*>(&gamma_p[0]), n[0] * sizeof(double));
+    map_out.write(reinterpret_cast<const char*>(&gamma_q[0]), n[1] * sizeof(double));
+    map_out.write(reinterpret_cast<const char*>(&gamma_act[0]), n[2] * sizeof(double));
+    const int n_out = vessel::n_native_equil_outputs;
+    for (size_t j = 0; j < status.size(); j++) {
+        int32_t status_j = status[j];
+        map_out.write(reinterpret_cast<const char*>(&status_j), sizeof(status_j));
+        map_out.write(reinterpret_cast<const char*>(&values[j * n_out]), n_out * sizeof(double));
+    }
+    map_out.close();
+    if (!map_out || std::rename(tmp_name.c_str(), file_name.c_str()) != 0) {
+        std::remove(tmp_name.c_str());
+        throw std::runtime_error("Could not write equilibrated map " + file_name);
+    }
+}
+
+bool equil_map::read(string file_name, const string& key_expected) {
+    std::ifstream map_in(file_name, std::ios::binary);
+    if (!map_in) {
+        return false;
+    }
+    char magic[8];
+    uint64_t key_size = 0;
+    map_in.read(magic, 8);
+    map_in.read(reinterpret_cast<char*>(&key_size), sizeof(key_size));
+    if (!map_in || memcmp(magic, equil_map_magic, 8) != 0) {
+        throw std::runtime_error("Not an equilibrated map: " + file_name);
+    }
+    if (key_size != key_expected.size()) {
+        return false;
+    }
+    string map_key(key_size, '\0');
+    map_in.read(&map_key[0], key_size);
+    if (!map_in || map_key != key_expected) {
+        return false;
+    }
+
+    uint32_t n[3] = { 0, 0, 0 };
+    map_in.read(reinterpret_cast<char*>(n), sizeof(n));
+    gamma_p.resize(n[0]);
+    gamma_q.resize(n[1]);
+    gamma_act.resize(n[2]);
+    map_in.read(reinterpret_cast<char*>(&gamma_p[0]), n[0] * sizeof(double));
+    map_in.read(reinterpret_cast<char*>(&gamma_q[0]), n[1] * sizeof(double));
+    map_in.read(reinterpret_cast<char*>(&gamma_act[0]), n[2] * sizeof(double));
+    const int n_out = vessel::n_native_equil_outputs;
+    size_t n_points = size_t(n[0]) * n[1] * n[2];
+    status.resize(n_points);
+    values.resize(n_points * n_out);
+    n_failed = 0;
+    for (size_t j = 0; j < n_points; j++) {
+        int32_t status_j = 0;
+        map_in.read(reinterpret_cast<char*>(&status_j), sizeof(status_j));
+        map_in.read(reinterpret_cast<char*>(&values[j * n_out]), n_out * sizeof(double));
+        status[j] = status_j;
+        n_failed += status_j != GSL_SUCCESS;
+    }
+    if (!map_in || n_points == 0) {
+        throw std::runtime_error("Truncated equilibrated map " + file_name);
+    }
+    key = map_key;
+    return true;
+}
+
+bool equil_map::lookup(double g_p, double g_q, double g_act, double* row) const {
+    const vector<double>* axes[3] = { &gamma_p, &gamma_q, &gamma_act };
+    const double g[3] = { g_p, g_q, g_act };
+    int lo[3];
+    double w[3];
+    for (int d = 0; d < 3; d++) {
+        const vector<double>& axis = *axes[d];
+        int n = int(axis.size());
+        if (n == 0) {
+            return false;
+        }
+        if (n == 1) {
+            if (fabs(g[d] - axis[0]) > 1e-12 * std::max(1.0, fabs(axis[0]))) {
+                return false;
+            }
+            lo[d] = 0;
+            w[d] = 0.0;
+            continue;
+        }
+        if (!(g[d] >= axis[0] && g[d] <= axis[n - 1])) {
+            return false;
+        }
+        lo[d] = std::min(int(std::upper_bound(axis.begin(), axis.end(), g[d]) - axis.begin()) - 1, n - 2);
+        w[d] = (g[d] - axis[lo[d]]) / (axis[lo[d] + 1] - axis[lo[d]]);
+    }
+
+    const int n_out = vessel::n_native_equil_outputs;
+    std::fill(row, row + n_out, 0.0);
+    for (int corner = 0; corner < 8; corner++) {
+        int b[3] = { corner & 1, (corner >> 1) & 1, (corner >> 2) & 1 };
+        double weight = 1.0;
+        for (int d = 0; d < 3; d++) {
+            weight *= b[d] ? w[d] : 1.0 - w[d];
+        }
+        if (weight == 0.0) {
+            continue;
+        }
+        int j = point(lo[0] + b[0], lo[1] + b[1], lo[2] + b[2]);
+        if (status[j] != GSL_SUCCESS) {
+            return false;
+        }
+        for (int k = 0; k < n_out; k++) {
+            row[k] += weight * values[j * n_out + k];
+        }
+    }
+    return true;
+}
+
+bool equil_map::lookup(const vessel& curr_vessel, double* row) const {
+    double g_act = curr_vessel.T_act_h != 0 ? curr_vessel.T_act / curr_vessel.T_act_h - 1.0 : 0.0;
+    return lookup(curr_vessel.P / curr_vessel.P_h - 1.0, curr_vessel.Q / curr_vessel.Q_h - 1.0, g_act, row);
+}
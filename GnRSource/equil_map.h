@@ -0,0 +1,55 @@
+// equil_map.h
+#ifndef EQUIL_MAP
+#define EQUIL_MAP
+
+#include <string>
+#include <vector>
+
+#include "thread_pool.h"
+
+using std::string;
+using std::vector;
+
+class vessel;
+
+//Mechanobiologically equilibrated states (find_equil_geom) of one vessel over a grid of
+//loads gamma_p x gamma_q x gamma_act, interpolated trilinearly. The equilibrium depends
+//only on the Native_in file, n_days and dt (through the prescribed elastin at the last
+//step) and the loads, so a map is keyed as the init cache and found by the tree
+//solvers as <map_dir>/equil_<hash>.bin.
+//
+//The grid is solved in lines along gamma_p, in parallel. Each line starts at its point
+//nearest gamma_p = 0 from the load-based guess of find_equil_geom and continues outward,
+//each point from the solution of its neighbour, again from the load-based guess if that
+//fails. Points that fail both are marked and never interpolated.
+//
+//File layout (native byte order): "GNREQM1" + '\0', uint64 key size, the key, uint32
+//n_p, n_q, n_act, the axes as doubles, then per point int32 status and the
+//Equil_GnR_out columns, gamma_act fastest.
+class equil_map {
+public:
+    equil_map();
+
+    void build(const string& base_state, string key_inp, thread_pool& pool); //base_state from writeState
+    void write(string file_name) const;
+    bool read(string file_name, const string& key_expected); //false if missing or for other inputs
+
+    //Equil_GnR_out row at the loads; false outside the grid or next to a failed point
+    bool lookup(double g_p, double g_q, double g_act, double* row) const;
+    bool lookup(const vessel& curr_vessel, double* row) const; //at the vessel's P, Q, T_act
+    //Unknowns of equil_obj_f from an Equil_GnR_out row, e.g. to start find_equil_geom
+    static void unknowns(const vessel& curr_vessel, const double* row, double* x);
+    //Grid axis from "<value>" or "<low>:<high>:<points>"
+    static vector<double> parseAxis(const string& spec);
+
+    string key;
+    vector<double> gamma_p, gamma_q, gamma_act; //ascending
+    vector<int> status; //GSL status of each point, 0 if solved
+    vector<double> values; //[point * n_native_equil_outputs + k]
+    int n_warm, n_cold, n_failed; //points solved from a neighbour, from the guess, not at all
+
+private:
+    int point(int ip, int iq, int ia) const;
+};
+
+#endif /* EQUIL_MAP */
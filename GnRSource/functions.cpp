@@ -2,6 +2,8 @@
 #include <fstream>
 #include <cstring>
 #include <cmath>
+#include <algorithm>
+#include <stdexcept>
 #include <string>
 #include <vector>
 #include <gsl/gsl_errno.h>
@@ -11,11 +13,126 @@
 
 #include "vessel.h"
 #include "functions.h"
+#include "load_schedule.h"
+#include "viscosity_kernel.h"
+#include "dual_vessel.h"
 
 using std::string;
 using std::vector;
 using std::cout;
 
+void step_vessel(vessel& curr_vessel, int sn) {
+    //Advances the G&R solution to step sn, applying the load schedule if one is set,
+    //and stores the loading state for the next step
+    curr_vessel.s = curr_vessel.dt * sn;
+    curr_vessel.sn = sn;
+    if (curr_vessel.schedule != NULL) {
+        curr_vessel.schedule->apply(curr_vessel);
+    }
+
+    update_time_step(curr_vessel);
+    printf("%s \n", "---------------------------");
+    if (curr_vessel.writer == NULL) fflush(stdout);
+
+    //Store axial stretch history
+    curr_vessel.lambda_z_tau[sn] = curr_vessel.lambda_z_curr;
+
+    //Update previous loading state
+    curr_vessel.P_prev = curr_vessel.P;
+    curr_vessel.T_act_prev = curr_vessel.T_act;
+}
+
+//Largest change of a dual number relative to its value and derivatives
+static double dual_change(const dual& x_new, const dual& x_old) {
+    double change = fabs(x_new.v - x_old.v) / fabs(x_new.v);
+    double scale = 0.0;
+    for (int i = 0; i < dual::n_dirs; i++) {
+        scale = std::max(scale, fabs(x_new.d[i]));
+    }
+    for (int i = 0; i < dual::n_dirs; i++) {
+        change = std::max(change, fabs(x_new.d[i] - x_old.d[i]) / (fabs(x_new.d[i]) + 1E-8 * scale + 1E-300));
+    }
+    return change;
+}
+
+static void find_dual_iv_geom(dual_vessel& tangent, double a_mid_primal) {
+    //Equilibrium radius of the dual vessel for its current mass, as find_iv_geom, by
+    //chord Newton steps from the primal radius. The active radius is iterated with it
+    int sn = tangent.sn;
+    double tol = 1E-11; //Convergence tolerance of values and derivatives, above round off
+    int iter = 0;
+
+    dual a_mid = tangent.a_mid[sn];
+    a_mid.v = a_mid_primal;
+
+    //Slope of the residual in the radius along a unit derivative of the radius
+    dual a_mid_probe = a_mid;
+    a_mid_probe.d[0] += 1.0;
+    double F_a = iv_residual(a_mid_probe, &tangent).d[0];
+    dual F = iv_residual(a_mid, &tangent);
+    F_a -= F.d[0];
+
+    double change = 0.0;
+    dual a_act_prev;
+    do {
+        iter++;
+        a_act_prev = tangent.a_act[sn];
+        dual a_mid_new = a_mid - F / F_a;
+        F = iv_residual(a_mid_new, &tangent);
+        change = std::max(dual_change(a_mid_new, a_mid), dual_change(tangent.a_act[sn], a_act_prev));
+        a_mid = a_mid_new;
+    } while (change > tol && iter < 100);
+
+    if (iter == 100){
+        printf("%s %f %s\n", "Time step :", tangent.s, "Derivatives exceeded max iterations");
+    }
+}
+
+void step_dual_vessel(dual_vessel& tangent, const vessel& primal, int sn) {
+    //Advances the derivatives to step sn of the primal solution, which must have been
+    //stepped to sn. The mass production and the equilibrium radius are updated in the
+    //passes of update_time_step, so that the derivatives are those of the solution as
+    //computed
+    tangent.s = tangent.dt * sn;
+    tangent.sn = sn;
+    double tol = 1E-11; //Convergence tolerance of values and derivatives, as find_dual_iv_geom
+    double tol_primal = 1E-14; //Convergence tolerance of update_time_step
+    int iter = 0;
+    dual rhoR_prev;
+
+    //Initial guess from the last derivatives
+    tangent.a_mid[sn] = tangent.a_mid[sn - 1];
+    tangent.a_act[sn] = tangent.a_act[sn - 1];
+    tangent.a_act[sn].v = primal.a_act[sn];
+
+    update_kinetics(tangent);
+    find_dual_iv_geom(tangent, primal.a_mid[sn]);
+
+    //The mass is converged in its derivatives as well as its value, which can settle
+    //before them, but over no more passes than update_time_step took: its test is
+    //replayed on the values exactly as it evaluates it, so the derivatives stay those
+    //of the solution as computed
+    double mass_check = 0.0, primal_check = 0.0;
+    do {
+        iter++;
+        rhoR_prev = tangent.rhoR[sn];
+
+        update_kinetics(tangent);
+        find_dual_iv_geom(tangent, primal.a_mid[sn]);
+
+        mass_check = dual_change(tangent.rhoR[sn], rhoR_prev);
+        primal_check = abs((tangent.rhoR[sn].v - rhoR_prev.v) / rhoR_prev.v);
+    } while (mass_check > tol && primal_check > tol_primal && iter < 100);
+
+    if (iter == 100){
+        printf("%s %f %s\n", "Time step :", tangent.s, "Mass derivatives exceeded max iterations");
+    }
+
+    tangent.sigma_prev = tangent.sigma;
+    tangent.bar_tauw_prev = tangent.bar_tauw;
+    tangent.lambda_z_tau[sn] = tangent.lambda_z_curr;
+}
+
 void update_time_step(vessel& curr_vessel) {
     //Solves equilibrium equations at the current time point and updates kinetic variables
     //Find current time step
@@ -130,7 +247,8 @@ void update_time_step(vessel& curr_vessel) {
     //Print current state
     printf("%s %f %s %f %s %f %s %f %s %f\n", "Time:", s, "a: ", curr_vessel.a[sn], "a_act: ", curr_vessel.a_act[sn], 
            "h:", curr_vessel.h[sn], "mb_equil:", mb_equil);
-    fflush(stdout);
+    //With asynchronous output stdout is flushed by the writer's flush policy
+    if (curr_vessel.writer == NULL) fflush(stdout);
 
 }
 
@@ -202,7 +320,60 @@ int run_pd_test(vessel& curr_vessel, double P_low, double P_high, double lambda_
     return 0;
 }
 
-int find_equil_geom(void* curr_vessel) {
+int find_pd_response(vessel& curr_vessel, const vector<double>& P_test, vector<double>& a_test) {
+    //Loaded inner radius at each test pressure (ascending) for the current mass and axial
+    //stretch, as a numerical experiment that leaves the vessel state unchanged.
+    //Returns the number of pressures that did not converge
+
+    int sn = curr_vessel.sn;
+
+    //State changed by find_iv_geom
+    double a_mid_store = curr_vessel.a_mid[sn], a_store = curr_vessel.a[sn];
+    double h_store = curr_vessel.h[sn], a_act_store = curr_vessel.a_act[sn];
+    double lambda_th_store = curr_vessel.lambda_th_curr, lambda_z_store = curr_vessel.lambda_z_curr;
+    double P_store = curr_vessel.P, f_store = curr_vessel.f, bar_tauw_store = curr_vessel.bar_tauw;
+    vector<double> sigma_store = curr_vessel.sigma, Cbar_store = curr_vessel.Cbar;
+    int num_exp_store = curr_vessel.num_exp_flag;
+
+    int equil_check = 0;
+    int n_P = P_test.size();
+    a_test.assign(n_P, 0.0);
+    curr_vessel.num_exp_flag = 1;
+
+    //Continue outwards from the current pressure so each search starts close to its root
+    int i_split = 0;
+    while (i_split < n_P && P_test[i_split] < P_store) {
+        i_split++;
+    }
+    for (int i = i_split; i < n_P; i++) {
+        curr_vessel.P = P_test[i];
+        equil_check += find_iv_geom(&curr_vessel) != GSL_SUCCESS;
+        a_test[i] = curr_vessel.a[sn];
+    }
+    curr_vessel.a_mid[sn] = a_mid_store;
+    for (int i = i_split - 1; i >= 0; i--) {
+        curr_vessel.P = P_test[i];
+        equil_check += find_iv_geom(&curr_vessel) != GSL_SUCCESS;
+        a_test[i] = curr_vessel.a[sn];
+    }
+
+    curr_vessel.a_mid[sn] = a_mid_store;
+    curr_vessel.a[sn] = a_store;
+    curr_vessel.h[sn] = h_store;
+    curr_vessel.a_act[sn] = a_act_store;
+    curr_vessel.lambda_th_curr = lambda_th_store;
+    curr_vessel.lambda_z_curr = lambda_z_store;
+    curr_vessel.P = P_store;
+    curr_vessel.f = f_store;
+    curr_vessel.bar_tauw = bar_tauw_store;
+    curr_vessel.sigma = sigma_store;
+    curr_vessel.Cbar = Cbar_store;
+    curr_vessel.num_exp_flag = num_exp_store;
+
+    return equil_check;
+}
+
+int find_equil_geom(void* curr_vessel, const double* x_guess) {
     //Finds the mechanobiologically equilibrated geometry for a given set of loads inclduing
     //pressure, flow, and axial stretch with a set of G&R parameter values from the original
     //homeostatic state
@@ -250,7 +421,7 @@ int find_equil_geom(void* curr_vessel) {
     gsl_vector* x = gsl_vector_alloc(n);
 
     for (int i = 0; i < n; i++) {
-        gsl_vector_set(x, i, x_init[i]);
+        gsl_vector_set(x, i, x_guess ? x_guess[i] : x_init[i]);
     }
 
     T = gsl_multiroot_fsolver_hybrids;
@@ -286,7 +457,7 @@ int find_equil_geom(void* curr_vessel) {
     gsl_multiroot_fsolver_free(s);
     gsl_vector_free(x);
 
-    return 0;
+    return status;
 
 }
 
@@ -580,7 +751,7 @@ int tf_obj_f(const gsl_vector* x, void* curr_vessel, gsl_vector* f) {
     ((struct vessel*) curr_vessel)->lambda_th_curr = lambda_th_ul_guess * lambda_th_ref;
     ((struct vessel*) curr_vessel)->lambda_z_curr = lambda_z_ul_guess * lambda_z_ref;
 
-    update_sigma(curr_vessel);
+    update_sigma((struct vessel*) curr_vessel);
 
     //Should be 0 for the traction-free configuration
     double J1 = ((struct vessel*) curr_vessel)->sigma[1];
@@ -646,67 +817,75 @@ int find_iv_geom(void* curr_vessel) {
 }
 
 double iv_obj_f(double a_mid_guess, void* curr_vessel) {
+    return iv_residual(a_mid_guess, (struct vessel*) curr_vessel);
+}
+
+template <typename V>
+typename V::scalar iv_residual(typename V::scalar a_mid_guess, V* curr_vessel) {
     //Finds the difference in the theoretical stress from Laplace for deformed mixture
     //from the stress calculated from the mixture equations
 
-    int sn = ((struct vessel*) curr_vessel)->sn;
-    double a = 0.0, h = 0.0, lambda_t = 0.0, lambda_z = 0.0, J_s = 0.0;
-    double mu = 0.0;
+    typedef typename V::scalar T;
+    int sn = ((V*) curr_vessel)->sn;
+    T a = 0.0, h = 0.0, lambda_t = 0.0, lambda_z = 0.0, J_s = 0.0;
+    T mu = 0.0;
 
-    if (sn > 0 || ((struct vessel*) curr_vessel)->num_exp_flag == 1) {
-        lambda_t = a_mid_guess / ((struct vessel*) curr_vessel)->a_mid_h;
-        lambda_z = ((struct vessel*) curr_vessel)->lambda_z_curr;
-        J_s = ((struct vessel*) curr_vessel)->rhoR[sn] / ((struct vessel*) curr_vessel)->rho[sn];
+    if (sn > 0 || ((V*) curr_vessel)->num_exp_flag == 1) {
+        lambda_t = a_mid_guess / ((V*) curr_vessel)->a_mid_h;
+        lambda_z = ((V*) curr_vessel)->lambda_z_curr;
+        J_s = ((V*) curr_vessel)->rhoR[sn] / ((V*) curr_vessel)->rho[sn];
 
         //Update vessel geometry for calculation of next time step
-        h = J_s / (lambda_t * lambda_z) * ((struct vessel*) curr_vessel)->h_h;
+        h = J_s / (lambda_t * lambda_z) * ((V*) curr_vessel)->h_h;
         a = a_mid_guess - h / 2;
-        ((struct vessel*) curr_vessel)->a_mid[sn] = a_mid_guess;
-        ((struct vessel*) curr_vessel)->a[sn] = a;
-        ((struct vessel*) curr_vessel)->h[sn] = h;
-        ((struct vessel*) curr_vessel)->lambda_th_curr = lambda_t;
-        ((struct vessel*) curr_vessel)->lambda_z_curr = lambda_z;
+        ((V*) curr_vessel)->a_mid[sn] = a_mid_guess;
+        ((V*) curr_vessel)->a[sn] = a;
+        ((V*) curr_vessel)->h[sn] = h;
+        ((V*) curr_vessel)->lambda_th_curr = lambda_t;
+        ((V*) curr_vessel)->lambda_z_curr = lambda_z;
         //Update WSS from Q Flow
-        if (((struct vessel*) curr_vessel)->wss_calc_flag > 0) {
-            mu = ((struct vessel*) curr_vessel)-> mu;
-            ((struct vessel*) curr_vessel)->bar_tauw = 4 * mu * ((struct vessel*)curr_vessel)->Q / (3.14159265 * pow(a * 100, 3));
+        if (((V*) curr_vessel)->wss_calc_flag > 0) {
+            mu = ((V*) curr_vessel)-> mu;
+            ((V*) curr_vessel)->bar_tauw = 4 * mu * ((V*)curr_vessel)->Q / (3.14159265 * pow(a * 100, 3));
         }
 
     }
     else {
         //This only checks that the current state is the initial equilibrium state
-        lambda_t = a_mid_guess / ((struct vessel*) curr_vessel)->a_mid_h;
-        lambda_z = ((struct vessel*) curr_vessel)->lambda_z_curr;
+        lambda_t = a_mid_guess / ((V*) curr_vessel)->a_mid_h;
+        lambda_z = ((V*) curr_vessel)->lambda_z_curr;
         J_s = 1.0;
 
         //Update vessel geometry for calculation of next time step
-        h = J_s / (lambda_t * lambda_z) * ((struct vessel*) curr_vessel)->h_h;
+        h = J_s / (lambda_t * lambda_z) * ((V*) curr_vessel)->h_h;
         a = a_mid_guess - h / 2;
-        ((struct vessel*) curr_vessel)->a_mid[sn] = a_mid_guess;
-        ((struct vessel*) curr_vessel)->a_act[sn] = a;
-        ((struct vessel*) curr_vessel)->a[sn] = a;
-        ((struct vessel*) curr_vessel)->h[sn] = h;
-        ((struct vessel*) curr_vessel)->lambda_th_curr = 1.0;
-        ((struct vessel*) curr_vessel)->lambda_z_curr = lambda_z;
+        ((V*) curr_vessel)->a_mid[sn] = a_mid_guess;
+        ((V*) curr_vessel)->a_act[sn] = a;
+        ((V*) curr_vessel)->a[sn] = a;
+        ((V*) curr_vessel)->h[sn] = h;
+        ((V*) curr_vessel)->lambda_th_curr = 1.0;
+        ((V*) curr_vessel)->lambda_z_curr = lambda_z;
         //Update WSS from Q Flow (ELS)
-        //((struct vessel*)curr_vessel)->bar_tauw = 4 * 0.04 * ((struct vessel*)curr_vessel)->Q / (3.14159265 * pow(a * 100, 3));
+        //((V*)curr_vessel)->bar_tauw = 4 * 0.04 * ((V*)curr_vessel)->Q / (3.14159265 * pow(a * 100, 3));
     }
 
     //Calculating sigma_t_th from pressure P
-    double sigma_t_th = ((struct vessel*) curr_vessel)->P * a / h;
+    T sigma_t_th = ((V*) curr_vessel)->P * a / h;
 
     update_sigma(curr_vessel);
-    double sigma_t_calc = ((struct vessel*) curr_vessel)->sigma[1];
+    T sigma_t_calc = ((V*) curr_vessel)->sigma[1];
 
-    ((struct vessel*) curr_vessel)->f = M_PI * h * (2 * a + h) *
-        ((struct vessel*) curr_vessel)->sigma[2];
+    ((V*) curr_vessel)->f = M_PI * h * (2 * a + h) *
+        ((V*) curr_vessel)->sigma[2];
 
-    double J = sigma_t_calc - sigma_t_th;
+    T J = sigma_t_calc - sigma_t_th;
 
     return J;
 }
 
-void update_kinetics(vessel& curr_vessel) {
+template <typename V>
+void update_kinetics(V& curr_vessel) {
+    typedef typename V::scalar T;
 
     //This function updates the kinetics for G&R.
     int n_alpha = curr_vessel.n_alpha;
@@ -720,13 +899,13 @@ void update_kinetics(vessel& curr_vessel) {
 
     //Differences in current mechanical state from the reference state
     //Circumfrential stress
-    double delta_sigma = ( (curr_vessel.sigma[1] + curr_vessel.sigma_prev[1]) / 2 +
+    T delta_sigma = ( (curr_vessel.sigma[1] + curr_vessel.sigma_prev[1]) / 2 +
                            (curr_vessel.sigma[2] + curr_vessel.sigma_prev[2]) / 2 ) /
                          ((curr_vessel.sigma_h[1] + curr_vessel.sigma_h[2])) - 1;
     //std::cout << "d_sigma: " << delta_sigma << std::endl;
     
     //Wall shear stress
-    double delta_tauw = ( (curr_vessel.bar_tauw + curr_vessel.bar_tauw_prev) / 2
+    T delta_tauw = ( (curr_vessel.bar_tauw + curr_vessel.bar_tauw_prev) / 2
                         / (curr_vessel.bar_tauw_h)) - 1;
 
     //Mechano-inflammation
@@ -734,7 +913,7 @@ void update_kinetics(vessel& curr_vessel) {
     double delta_tauw_trans = 1.5;
     double accel_sig = 6;
     double Kmech_scale = 1;
-    double ups_tauw_p = 0, ups_tauw_d = 0;
+    T ups_tauw_p = 0, ups_tauw_d = 0;
 
     if (curr_vessel.mech_infl_flag > 0){
         //Calculate immunological stimulus
@@ -774,18 +953,18 @@ void update_kinetics(vessel& curr_vessel) {
     //std::cout << "d_tauw: " << delta_tauw << std::endl;
 
     //Initialize pars for looping later
-    double K_sigma_p = 0, K_tauw_p = 0, K_sigma_d = 0, K_tauw_d = 0;
-    double upsilon_p = 0, upsilon_d = 0;
+    T K_sigma_p = 0, K_tauw_p = 0, K_sigma_d = 0, K_tauw_d = 0;
+    T upsilon_p = 0, upsilon_d = 0;
 
-    double k_alpha_s = 0;
-    double mR_alpha_s = 0;
-    double rhoR_alpha_calc = 0;
+    T k_alpha_s = 0;
+    T mR_alpha_s = 0;
+    T rhoR_alpha_calc = 0;
 
-    double mq_0 = 0, mq_1 = 0, mq_2;
-    double q_0 = 0, q_1 = 0, q_2;
-    double k_0 = 0, k_1 = 0, k_2;
-    double rhoR_s = 0, rhoR_alpha_s = 0;
-    double J_s = 0;
+    T mq_0 = 0, mq_1 = 0, mq_2;
+    T q_0 = 0, q_1 = 0, q_2;
+    T k_0 = 0, k_1 = 0, k_2;
+    T rhoR_s = 0, rhoR_alpha_s = 0;
+    T J_s = 0;
 
     int n = 0; //number of points in integration interval
 
@@ -936,33 +1115,35 @@ void update_kinetics(vessel& curr_vessel) {
     // //
 }
 
-void update_sigma(void* curr_vessel) {
+template <typename V>
+void update_sigma(V* curr_vessel) {
+    typedef typename V::scalar T;
 
     //Get current time index
-    double s = ((struct vessel*)curr_vessel)->s;
-    int sn = ((struct vessel*)curr_vessel)->sn;
-    int nts = ((struct vessel*)curr_vessel)->nts;
-    double dt = ((struct vessel*)curr_vessel)->dt;
+    double s = ((V*)curr_vessel)->s;
+    int sn = ((V*)curr_vessel)->sn;
+    int nts = ((V*)curr_vessel)->nts;
+    double dt = ((V*)curr_vessel)->dt;
     int taun_min = 0;
 
-    double tau_max = 10000 * (1 / ((struct vessel*)curr_vessel)->k_alpha_h[3]); //max time of 10 half-lives
+    double tau_max = 10000 * (1 / ((V*)curr_vessel)->k_alpha_h[3]); //max time of 10 half-lives
 
     //Specify vessel geometry
-    double a0 = ((struct vessel*)curr_vessel)->a[0];
-    double h0 = ((struct vessel*)curr_vessel)->h[0];
+    T a0 = ((V*)curr_vessel)->a[0];
+    T h0 = ((V*)curr_vessel)->h[0];
 
     //Calculate vessel stretches
-    double lambda_th_s = ((struct vessel*)curr_vessel)->lambda_th_curr;
-    double lambda_z_s = ((struct vessel*)curr_vessel)->lambda_z_curr;
+    T lambda_th_s = ((V*)curr_vessel)->lambda_th_curr;
+    T lambda_z_s = ((V*)curr_vessel)->lambda_z_curr;
 
     //Calculate constituent specific stretches for evolving constituents at the current time
-    int n_alpha = ((struct vessel*)curr_vessel)->n_alpha;
-    vector<double> lambda_alpha_s(n_alpha, 0);
+    int n_alpha = ((V*)curr_vessel)->n_alpha;
+    vector<T> lambda_alpha_s(n_alpha, 0);
     double eta_alpha = 0;
     for (int alpha = 0; alpha < n_alpha; alpha++) {
 
         //Check to see if constituent is isotropic
-        eta_alpha = ((struct vessel*)curr_vessel)->eta_alpha_h[alpha];
+        eta_alpha = ((V*)curr_vessel)->eta_alpha_h[alpha];
         if (eta_alpha >= 0) {
 
             //Stretch is equal to the sqrt of I4
@@ -970,61 +1151,61 @@ void update_sigma(void* curr_vessel) {
                 + pow(lambda_th_s * sin(eta_alpha), 2));
 
             //Update stored current stretch if not numerical experiment
-            if (((struct vessel*)curr_vessel)->num_exp_flag == 0) {
-                ((struct vessel*)curr_vessel)->lambda_alpha_tau[nts * alpha + sn] = lambda_alpha_s[alpha];
+            if (((V*)curr_vessel)->num_exp_flag == 0) {
+                ((V*)curr_vessel)->lambda_alpha_tau[nts * alpha + sn] = lambda_alpha_s[alpha];
             }
         }
     }
 
     //Find the current deformation gradient
-    double J_s = ((struct vessel*)curr_vessel)->rhoR[sn] / ((struct vessel*)curr_vessel)->rho[sn];
-    double F_s[3] = { J_s / (lambda_th_s * lambda_z_s), lambda_th_s, lambda_z_s };
+    T J_s = ((V*)curr_vessel)->rhoR[sn] / ((V*)curr_vessel)->rho[sn];
+    T F_s[3] = { J_s / (lambda_th_s * lambda_z_s), lambda_th_s, lambda_z_s };
 
     //Find the mechanical contributions of each constituent for each direction
-    double a, h;
-    double lambda_th_tau = 0;
-    double lambda_z_tau = 0; //Assume constant axial stretch
-    double J_tau = 1;
-    double F_tau[3] = { 1, 1, 1 };
-    double lambda_alpha_ntau_s = 0;
-    double Q1 = 0, Q2 = 0;
-    double F_alpha_ntau_s = 0;
-    double hat_S_alpha = 0;
-    double sigma[3] = { 0 };
-    double lagrange = 0;
-    double pol_mod = 0;
+    T a, h;
+    T lambda_th_tau = 0;
+    T lambda_z_tau = 0; //Assume constant axial stretch
+    T J_tau = 1;
+    T F_tau[3] = { 1, 1, 1 };
+    T lambda_alpha_ntau_s = 0;
+    T Q1 = 0, Q2 = 0;
+    T F_alpha_ntau_s = 0;
+    T hat_S_alpha = 0;
+    T sigma[3] = { 0 };
+    T lagrange = 0;
+    T pol_mod = 0;
 
     //Local active variables
-    double C = 0;
-    double lambda_act = 0;
-    double parab_act = 0;
-    double hat_sigma_act = 0, sigma_act = 0;
+    T C = 0;
+    T lambda_act = 0;
+    T parab_act = 0;
+    T hat_sigma_act = 0, sigma_act = 0;
 
     //Stiffness variables
-    double hat_dSdC_alpha = 0;
-    double hat_dSdC_act = 0;
-    double Cbar[3] = { 0 };
-    double Cbar_act = 0;
-    vector<double> constitutive_return = { 0, 0 };
+    T hat_dSdC_alpha = 0;
+    T hat_dSdC_act = 0;
+    T Cbar[3] = { 0 };
+    T Cbar_act = 0;
+    vector<T> constitutive_return = { 0, 0 };
 
     //Integration variables
     //For mass
-    double mq_0 = 0, mq_1 = 0, mq_2 = 0;
-    double q_0 = 1.0, q_1 = 1.0, q_2 = 1.0;
-    double k_0 = 0, k_1 = 0, k_2 = 0;
+    T mq_0 = 0, mq_1 = 0, mq_2 = 0;
+    T q_0 = 1.0, q_1 = 1.0, q_2 = 1.0;
+    T k_0 = 0, k_1 = 0, k_2 = 0;
 
     int n = 0; //number of pts in integration interval
 
     //For stress
-    vector<double> hat_sigma_0 = { 0, 0, 0 }, hat_sigma_1 = { 0, 0, 0 }, hat_sigma_2 = { 0, 0, 0 };
+    vector<T> hat_sigma_0 = { 0, 0, 0 }, hat_sigma_1 = { 0, 0, 0 }, hat_sigma_2 = { 0, 0, 0 };
     //For active stress
-    double a_act = 0;
-    double k_act = ((struct vessel*) curr_vessel)->k_act;
-    double q_act_0 = 0, q_act_1 = 0, q_act_2 = 0;
-    double a_0 = 0, a_1 = 0, a_2 = 0;
+    T a_act = 0;
+    double k_act = ((V*) curr_vessel)->k_act;
+    T q_act_0 = 0, q_act_1 = 0, q_act_2 = 0;
+    T a_0 = 0, a_1 = 0, a_2 = 0;
 
     //For stiffness
-    vector<double> hat_Cbar_0 = { 0, 0, 0 }, hat_Cbar_1 = { 0, 0, 0 }, hat_Cbar_2 = { 0, 0, 0 };
+    vector<T> hat_Cbar_0 = { 0, 0, 0 }, hat_Cbar_1 = { 0, 0, 0 }, hat_Cbar_2 = { 0, 0, 0 };
 
     //Boolean for checks
     bool deg_check = 0;
@@ -1044,13 +1225,13 @@ void update_sigma(void* curr_vessel) {
     for (int alpha = 0; alpha < n_alpha; alpha++) {
 
         //Trapz rule allows for fast heredity integral evaluation
-        k_2 = ((struct vessel*)curr_vessel)->k_alpha[nts * alpha + sn];
+        k_2 = ((V*)curr_vessel)->k_alpha[nts * alpha + sn];
         q_2 = 1.0;
-        mq_2 = ((struct vessel*)curr_vessel)->mR_alpha[nts * alpha + sn];
+        mq_2 = ((V*)curr_vessel)->mR_alpha[nts * alpha + sn];
 
         //Find active radius from current cohort
-        if (((struct vessel*) curr_vessel)->alpha_active[alpha] == 1) {
-            a_2 = ((struct vessel*) curr_vessel)->a[sn];
+        if (((V*) curr_vessel)->alpha_active[alpha] == 1) {
+            a_2 = ((V*) curr_vessel)->a[sn];
             q_act_2 = 1.0;
         }
 
@@ -1064,13 +1245,13 @@ void update_sigma(void* curr_vessel) {
             constitutive_return = constitutive(curr_vessel, lambda_alpha_s[alpha], alpha, sn, dir);
             hat_S_alpha = constitutive_return[0];
             hat_dSdC_alpha = constitutive_return[1];
-            F_alpha_ntau_s = F_s[dir] / F_tau[dir] * ((struct vessel*)curr_vessel)->G_alpha_h[3 * alpha + dir];
+            F_alpha_ntau_s = F_s[dir] / F_tau[dir] * ((V*)curr_vessel)->G_alpha_h[3 * alpha + dir];
             hat_sigma_2[dir] = F_alpha_ntau_s * hat_S_alpha * F_alpha_ntau_s / J_s;
             hat_Cbar_2[dir] = F_alpha_ntau_s * F_alpha_ntau_s * hat_dSdC_alpha * F_alpha_ntau_s * F_alpha_ntau_s / J_s;
         }
 
         //Boolean for whether the constituent increases ref mass density
-        deg_check = ((struct vessel*)curr_vessel)->mR_alpha_h[alpha] > 0;
+        deg_check = ((V*)curr_vessel)->mR_alpha_h[alpha] > 0;
 
         //Check if during G&R or at initial time point
         if (sn > 0 && deg_check) {
@@ -1078,22 +1259,22 @@ void update_sigma(void* curr_vessel) {
             for (int taun = sn - 1; taun >= taun_min; taun = taun - 1) {
 
                 //Find the 1st intermediate deformation gradient
-                a = ((struct vessel*)curr_vessel)->a[taun];
-                h = ((struct vessel*)curr_vessel)->h[taun];
+                a = ((V*)curr_vessel)->a[taun];
+                h = ((V*)curr_vessel)->h[taun];
                 lambda_th_tau = (a + h / 2) / (a0 + h0 / 2);
-                lambda_z_tau = ((struct vessel*)curr_vessel)->lambda_z_tau[taun];
-                J_tau = ((struct vessel*)curr_vessel)->rhoR[taun] / ((struct vessel*)curr_vessel)->rho[taun];
+                lambda_z_tau = ((V*)curr_vessel)->lambda_z_tau[taun];
+                J_tau = ((V*)curr_vessel)->rhoR[taun] / ((V*)curr_vessel)->rho[taun];
                 F_tau[0] = J_tau / (lambda_th_tau * lambda_z_tau);
                 F_tau[1] = lambda_th_tau;
                 F_tau[2] = lambda_z_tau;
 
                 //Find 1st intermediate kinetics
-                k_1 = ((struct vessel*)curr_vessel)->k_alpha[nts * alpha + taun];
+                k_1 = ((V*)curr_vessel)->k_alpha[nts * alpha + taun];
                 q_1 = exp(-(k_2 + k_1) * dt / 2) * q_2;
-                mq_1 = ((struct vessel*)curr_vessel)->mR_alpha[nts * alpha + taun] * q_1;
+                mq_1 = ((V*)curr_vessel)->mR_alpha[nts * alpha + taun] * q_1;
 
                 //Find intermediate active state
-                if (((struct vessel*) curr_vessel)->alpha_active[alpha] == 1) {
+                if (((V*) curr_vessel)->alpha_active[alpha] == 1) {
                     a_1 = a;
                     q_act_1 = exp(-k_act * dt) * q_act_2;
                 }
@@ -1104,28 +1285,28 @@ void update_sigma(void* curr_vessel) {
                     constitutive_return = constitutive(curr_vessel, lambda_alpha_s[alpha], alpha, taun, dir);
                     hat_S_alpha = constitutive_return[0];
                     hat_dSdC_alpha = constitutive_return[1];
-                    F_alpha_ntau_s = F_s[dir] / F_tau[dir] * ((struct vessel*)curr_vessel)->G_alpha_h[3 * alpha + dir];
+                    F_alpha_ntau_s = F_s[dir] / F_tau[dir] * ((V*)curr_vessel)->G_alpha_h[3 * alpha + dir];
                     hat_sigma_1[dir] = F_alpha_ntau_s * hat_S_alpha * F_alpha_ntau_s / J_s;
                     hat_Cbar_1[dir] = F_alpha_ntau_s * F_alpha_ntau_s * hat_dSdC_alpha * F_alpha_ntau_s * F_alpha_ntau_s / J_s;
                 }
 
                 // //Find the 2nd intermediate deformation gradient
-                // a = ((struct vessel*)curr_vessel)->a[taun - 1];
-                // h = ((struct vessel*)curr_vessel)->h[taun - 1];
+                // a = ((V*)curr_vessel)->a[taun - 1];
+                // h = ((V*)curr_vessel)->h[taun - 1];
                 // lambda_th_tau = (a + h / 2) / (a0 + h0 / 2);
-                // lambda_z_tau = ((struct vessel*)curr_vessel)->lambda_z_tau[taun - 1];
-                // J_tau = ((struct vessel*)curr_vessel)->rhoR[taun - 1] / ((struct vessel*)curr_vessel)->rho[taun - 1];;
+                // lambda_z_tau = ((V*)curr_vessel)->lambda_z_tau[taun - 1];
+                // J_tau = ((V*)curr_vessel)->rhoR[taun - 1] / ((V*)curr_vessel)->rho[taun - 1];;
                 // F_tau[0] = J_tau / (lambda_th_tau * lambda_z_tau);
                 // F_tau[1] = lambda_th_tau;
                 // F_tau[2] = lambda_z_tau;
 
                 // //Find 2nd intermediate kinetics
-                // k_0 = ((struct vessel*)curr_vessel)->k_alpha[nts * alpha + taun - 1];
+                // k_0 = ((V*)curr_vessel)->k_alpha[nts * alpha + taun - 1];
                 // q_0 = exp(-(k_2 + 4 * k_1 + k_0) * dt / 3) * q_2;
-                // mq_0 = ((struct vessel*)curr_vessel)->mR_alpha[nts * alpha + taun - 1] * q_0;
+                // mq_0 = ((V*)curr_vessel)->mR_alpha[nts * alpha + taun - 1] * q_0;
 
                 // //Find intermediate active state
-                // if (((struct vessel*) curr_vessel)->alpha_active[alpha] == 1) {
+                // if (((V*) curr_vessel)->alpha_active[alpha] == 1) {
                 //     a_0 = a;
                 //     q_act_0 = exp(-k_act * dt) * q_act_1;
                 // }
@@ -1136,20 +1317,20 @@ void update_sigma(void* curr_vessel) {
                     // constitutive_return = constitutive(curr_vessel, lambda_alpha_s[alpha], alpha, taun - 1, dir);
                     // hat_S_alpha = constitutive_return[0];
                     // hat_dSdC_alpha = constitutive_return[1];
-                    // F_alpha_ntau_s = F_s[dir] / F_tau[dir] * ((struct vessel*)curr_vessel)->G_alpha_h[3 * alpha + dir];
+                    // F_alpha_ntau_s = F_s[dir] / F_tau[dir] * ((V*)curr_vessel)->G_alpha_h[3 * alpha + dir];
                     // hat_sigma_0[dir] = F_alpha_ntau_s * hat_S_alpha * F_alpha_ntau_s / J_s;
                     // hat_Cbar_0[dir] = F_alpha_ntau_s * F_alpha_ntau_s * hat_dSdC_alpha * F_alpha_ntau_s * F_alpha_ntau_s / J_s;
 
                     //Add to the stress and stiffness contribution in the given direction
                     sigma[dir] += (mq_2 * hat_sigma_2[dir] + mq_1 * hat_sigma_1[dir])
-                        / ((struct vessel*)curr_vessel)->rho_hat_alpha_h[alpha] * dt / 2;
+                        / ((V*)curr_vessel)->rho_hat_alpha_h[alpha] * dt / 2;
                     Cbar[dir] += (mq_2 * hat_Cbar_2[dir] + mq_1 * hat_Cbar_1[dir])
-                        / ((struct vessel*)curr_vessel)->rho_hat_alpha_h[alpha] * dt / 2;
+                        / ((V*)curr_vessel)->rho_hat_alpha_h[alpha] * dt / 2;
                 }
 
                 //Store active vars for next iteration
                 //Find intermediate active state
-                if (((struct vessel*) curr_vessel)->alpha_active[alpha] == 1) {
+                if (((V*) curr_vessel)->alpha_active[alpha] == 1) {
                     a_act += k_act * (q_act_2 * a_2 + q_act_1 * a_1) * dt / 2;
                     a_2 = a_1;
                     q_act_2 = q_act_1;
@@ -1169,22 +1350,22 @@ void update_sigma(void* curr_vessel) {
             // if (even_n) {
 
             //     //Find the 2nd intermediate deformation gradient
-            //     a = ((struct vessel*)curr_vessel)->a[taun_min];
-            //     h = ((struct vessel*)curr_vessel)->h[taun_min];
+            //     a = ((V*)curr_vessel)->a[taun_min];
+            //     h = ((V*)curr_vessel)->h[taun_min];
             //     lambda_th_tau = (a + h / 2) / (a0 + h0 / 2);
-            //     lambda_z_tau = ((struct vessel*)curr_vessel)->lambda_z_tau[taun_min];
-            //     J_tau = ((struct vessel*)curr_vessel)->rhoR[taun_min] / ((struct vessel*)curr_vessel)->rho_hat_alpha_h[alpha];
+            //     lambda_z_tau = ((V*)curr_vessel)->lambda_z_tau[taun_min];
+            //     J_tau = ((V*)curr_vessel)->rhoR[taun_min] / ((V*)curr_vessel)->rho_hat_alpha_h[alpha];
             //     F_tau[0] = J_tau / (lambda_th_tau * lambda_z_tau);
             //     F_tau[1] = lambda_th_tau;
             //     F_tau[2] = lambda_z_tau;
 
             //     //Find 2nd intermediate kinetics
-            //     k_0 = ((struct vessel*)curr_vessel)->k_alpha[nts * alpha + taun_min];
+            //     k_0 = ((V*)curr_vessel)->k_alpha[nts * alpha + taun_min];
             //     q_0 = exp(-(k_2 + k_0) * dt / 2) * q_2;
-            //     mq_0 = ((struct vessel*)curr_vessel)->mR_alpha[nts * alpha + taun_min] * q_0;
+            //     mq_0 = ((V*)curr_vessel)->mR_alpha[nts * alpha + taun_min] * q_0;
 
             //     //Find intermediate active state
-            //     if (((struct vessel*) curr_vessel)->alpha_active[alpha] == 1) {
+            //     if (((V*) curr_vessel)->alpha_active[alpha] == 1) {
             //         a_0 = a;
             //         q_act_0 = exp(-k_act * dt) * q_act_2;
             //     }
@@ -1195,18 +1376,18 @@ void update_sigma(void* curr_vessel) {
             //         constitutive_return = constitutive(curr_vessel, lambda_alpha_s[alpha], alpha, taun_min, dir);
             //         hat_S_alpha = constitutive_return[0];
             //         hat_dSdC_alpha = constitutive_return[1];
-            //         F_alpha_ntau_s = F_s[dir] / F_tau[dir] * ((struct vessel*)curr_vessel)->G_alpha_h[3 * alpha + dir];
+            //         F_alpha_ntau_s = F_s[dir] / F_tau[dir] * ((V*)curr_vessel)->G_alpha_h[3 * alpha + dir];
             //         hat_sigma_0[dir] = F_alpha_ntau_s * hat_S_alpha * F_alpha_ntau_s / J_s;
             //         hat_Cbar_0[dir] = F_alpha_ntau_s * F_alpha_ntau_s * hat_dSdC_alpha * F_alpha_ntau_s * F_alpha_ntau_s / J_s;
 
             //         //Add to the stress and stiffness contribution in the given direction
             //         sigma[dir] += (mq_2 * hat_sigma_2[dir] + mq_0 * hat_sigma_0[dir])
-            //             / ((struct vessel*)curr_vessel)->rho_hat_alpha_h[alpha] * dt / 2;
+            //             / ((V*)curr_vessel)->rho_hat_alpha_h[alpha] * dt / 2;
             //         Cbar[dir] += (mq_2 * hat_Cbar_2[dir] + mq_0 * hat_Cbar_0[dir])
-            //             / ((struct vessel*)curr_vessel)->rho_hat_alpha_h[alpha] * dt / 2;
+            //             / ((V*)curr_vessel)->rho_hat_alpha_h[alpha] * dt / 2;
             //     }
 
-            //     if (((struct vessel*) curr_vessel)->alpha_active[alpha] == 1) {
+            //     if (((V*) curr_vessel)->alpha_active[alpha] == 1) {
             //         a_act += k_act * (q_act_2 * a_2 + q_act_0 * a_0) * dt / 2;
             //     }
             // }
@@ -1214,10 +1395,10 @@ void update_sigma(void* curr_vessel) {
             //Add in the stress and stiffness contributions of the initial material
             if (taun_min == 0) {
                 for (int dir = 0; dir < 3; dir++) {
-                    sigma[dir] += ((struct vessel*)curr_vessel)->rhoR_alpha[nts * alpha + 0]
-                        / ((struct vessel*)curr_vessel)->rho_hat_alpha_h[alpha] * q_1 * hat_sigma_1[dir];
-                    Cbar[dir] += ((struct vessel*)curr_vessel)->rhoR_alpha[nts * alpha + 0]
-                        / ((struct vessel*)curr_vessel)->rho_hat_alpha_h[alpha] * q_1 * hat_Cbar_1[dir];
+                    sigma[dir] += ((V*)curr_vessel)->rhoR_alpha[nts * alpha + 0]
+                        / ((V*)curr_vessel)->rho_hat_alpha_h[alpha] * q_1 * hat_sigma_1[dir];
+                    Cbar[dir] += ((V*)curr_vessel)->rhoR_alpha[nts * alpha + 0]
+                        / ((V*)curr_vessel)->rho_hat_alpha_h[alpha] * q_1 * hat_Cbar_1[dir];
                 }
             }
 
@@ -1230,20 +1411,20 @@ void update_sigma(void* curr_vessel) {
                 constitutive_return = constitutive(curr_vessel, lambda_alpha_s[alpha], alpha, 0, dir);
                 hat_S_alpha = constitutive_return[0];
                 hat_dSdC_alpha = constitutive_return[1];
-                F_alpha_ntau_s = F_s[dir] * ((struct vessel*)curr_vessel)->G_alpha_h[3 * alpha + dir];
+                F_alpha_ntau_s = F_s[dir] * ((V*)curr_vessel)->G_alpha_h[3 * alpha + dir];
                 hat_sigma_2[dir] = F_alpha_ntau_s * hat_S_alpha * F_alpha_ntau_s / J_s;
                 hat_Cbar_2[dir] = F_alpha_ntau_s * F_alpha_ntau_s * hat_dSdC_alpha * F_alpha_ntau_s * F_alpha_ntau_s / J_s;
 
-                sigma[dir] += ((struct vessel*)curr_vessel)->rhoR_alpha[nts * alpha + sn] /
-                    ((struct vessel*)curr_vessel)->rho_hat_alpha_h[alpha] * hat_sigma_2[dir];
-                Cbar[dir] += ((struct vessel*)curr_vessel)->rhoR_alpha[nts * alpha + sn] /
-                    ((struct vessel*)curr_vessel)->rho_hat_alpha_h[alpha] * hat_Cbar_2[dir];
+                sigma[dir] += ((V*)curr_vessel)->rhoR_alpha[nts * alpha + sn] /
+                    ((V*)curr_vessel)->rho_hat_alpha_h[alpha] * hat_sigma_2[dir];
+                Cbar[dir] += ((V*)curr_vessel)->rhoR_alpha[nts * alpha + sn] /
+                    ((V*)curr_vessel)->rho_hat_alpha_h[alpha] * hat_Cbar_2[dir];
             }
 
         }
 
-        if (taun_min == 0 && ((struct vessel*) curr_vessel)->alpha_active[alpha] == 1) {
-            a_act += ((struct vessel*) curr_vessel)->a_act[0] * q_act_1;
+        if (taun_min == 0 && ((V*) curr_vessel)->alpha_active[alpha] == 1) {
+            a_act += ((V*) curr_vessel)->a_act[0] * q_act_1;
         }
 
 
@@ -1251,44 +1432,44 @@ void update_sigma(void* curr_vessel) {
 
     //Find active stress contribtion
     //add in initial active stress radius contribution
-    C = ((struct vessel*) curr_vessel)->CB -
-        ((struct vessel*) curr_vessel)->CS * (((struct vessel*) curr_vessel)->bar_tauw /
-        ((struct vessel*) curr_vessel)->bar_tauw_h - 1);
+    C = ((V*) curr_vessel)->CB -
+        ((V*) curr_vessel)->CS * (((V*) curr_vessel)->bar_tauw /
+        ((V*) curr_vessel)->bar_tauw_h - 1);
 
-    lambda_act = ((struct vessel*) curr_vessel)->a[sn] / ((struct vessel*) curr_vessel)->a_act[sn];
+    lambda_act = ((V*) curr_vessel)->a[sn] / ((V*) curr_vessel)->a_act[sn];
 
     if (sn == 0) {
-        a_act = ((struct vessel*) curr_vessel)->a_act[0];
-        C = ((struct vessel*) curr_vessel)->CB;
+        a_act = ((V*) curr_vessel)->a_act[0];
+        C = ((V*) curr_vessel)->CB;
         lambda_act = 1.0;
     }
     
-    parab_act = 1 - pow((((struct vessel*) curr_vessel)->lambda_m - lambda_act) /
-        (((struct vessel*) curr_vessel)->lambda_m - ((struct vessel*) curr_vessel)->lambda_0), 2);
+    parab_act = 1 - pow((((V*) curr_vessel)->lambda_m - lambda_act) /
+        (((V*) curr_vessel)->lambda_m - ((V*) curr_vessel)->lambda_0), 2);
 
-    hat_sigma_act = ((struct vessel*) curr_vessel)->T_act * (1 - exp(-pow(C, 2))) * lambda_act * parab_act;
+    hat_sigma_act = ((V*) curr_vessel)->T_act * (1 - exp(-pow(C, 2))) * lambda_act * parab_act;
 
     // basically: sigma_act = (rho(0) + KTact * ( rho(s) - rho(0) )) / rho_hat * hat_sigma
-    if (((struct vessel*) curr_vessel)->K_i_Tact != 0 ){
-        sigma_act = (((struct vessel*) curr_vessel)->rhoR_alpha[nts * 1 + 0] +
-                    ((struct vessel*) curr_vessel)->K_i_Tact *
-                    (((struct vessel*) curr_vessel)->rhoR_alpha[nts * 1 + sn] - ((struct vessel*) curr_vessel)->rhoR_alpha[nts * 1 + 0])) 
-                    * hat_sigma_act / (((struct vessel*) curr_vessel)->rhoR_h * J_s);
+    if (((V*) curr_vessel)->K_i_Tact != 0 ){
+        sigma_act = (((V*) curr_vessel)->rhoR_alpha[nts * 1 + 0] +
+                    ((V*) curr_vessel)->K_i_Tact *
+                    (((V*) curr_vessel)->rhoR_alpha[nts * 1 + sn] - ((V*) curr_vessel)->rhoR_alpha[nts * 1 + 0])) 
+                    * hat_sigma_act / (((V*) curr_vessel)->rhoR_h * J_s);
     }
     else{
-        sigma_act = (((struct vessel*) curr_vessel)->rhoR_alpha[nts * 1 + 0] * 
-                    ((1 - ((struct vessel*) curr_vessel)->phi_Tact0_min) * exp(-((struct vessel*) curr_vessel)->delta_i * s)  
-                    + ((struct vessel*) curr_vessel)->phi_Tact0_min))
-                    * hat_sigma_act / (((struct vessel*) curr_vessel)->rhoR_h * J_s);
+        sigma_act = (((V*) curr_vessel)->rhoR_alpha[nts * 1 + 0] * 
+                    ((1 - ((V*) curr_vessel)->phi_Tact0_min) * exp(-((V*) curr_vessel)->delta_i * s)  
+                    + ((V*) curr_vessel)->phi_Tact0_min))
+                    * hat_sigma_act / (((V*) curr_vessel)->rhoR_h * J_s);
     }
 
-    hat_dSdC_act = ((struct vessel*) curr_vessel)->T_act * (pow(lambda_act, -2) / 2 * 
-                   ((((struct vessel*) curr_vessel)->lambda_m - lambda_act) / 
-                   pow(((struct vessel*) curr_vessel)->lambda_m - ((struct vessel*) curr_vessel)->lambda_0, 2)) 
+    hat_dSdC_act = ((V*) curr_vessel)->T_act * (pow(lambda_act, -2) / 2 * 
+                   ((((V*) curr_vessel)->lambda_m - lambda_act) / 
+                   pow(((V*) curr_vessel)->lambda_m - ((V*) curr_vessel)->lambda_0, 2)) 
                    - pow(lambda_act, -3) / 4 * (parab_act));
 
-    Cbar_act = ((struct vessel*) curr_vessel)->rhoR_alpha[nts * 1 + sn] / J_s / 
-                ((struct vessel*) curr_vessel)->rhoR_h * 
+    Cbar_act = ((V*) curr_vessel)->rhoR_alpha[nts * 1 + sn] / J_s / 
+                ((V*) curr_vessel)->rhoR_h * 
                 lambda_act * lambda_act * lambda_act * lambda_act * hat_dSdC_act;
 
     //The Lagrange multiplier is the radial stress component
@@ -1306,41 +1487,43 @@ void update_sigma(void* curr_vessel) {
         //Calculating full cauchy stress
         sigma[dir] = sigma[dir] - lagrange;
         
-        ((struct vessel*)curr_vessel)->sigma[dir] = sigma[dir];
-        ((struct vessel*)curr_vessel)->Cbar[dir] = Cbar[dir];
+        ((V*)curr_vessel)->sigma[dir] = sigma[dir];
+        ((V*)curr_vessel)->Cbar[dir] = Cbar[dir];
     }
 
     //Save updated active radius
-    ((struct vessel*) curr_vessel)->a_act[sn] = a_act;
+    ((V*) curr_vessel)->a_act[sn] = a_act;
 
 }
 
-vector<double> constitutive(void* curr_vessel, double lambda_alpha_s, int alpha, int ts, int dir) {
-
-    double lambda_alpha_ntau_s = 0;
-    double Q1 = 0;
-    double Q2 = 0;
-    double hat_S_alpha = 0;
-    double hat_dSdC_alpha = 0;
-    double pol_mod = 0;
-    double epsilon_curr = 0;
-    double c1 = 0.0;
-    double c2 = 0.0;
-    double gamma1_i = 0.0;
-    double gamma2_i = 0.0;
-    int nts = ((struct vessel*)curr_vessel)->nts;
-    int sn = ((struct vessel*)curr_vessel)->sn;
-    vector<double> return_constitutive = { 0, 0 };
+template <typename V>
+vector<typename V::scalar> constitutive(V* curr_vessel, typename V::scalar lambda_alpha_s, int alpha, int ts, int dir) {
+    typedef typename V::scalar T;
+
+    T lambda_alpha_ntau_s = 0;
+    T Q1 = 0;
+    T Q2 = 0;
+    T hat_S_alpha = 0;
+    T hat_dSdC_alpha = 0;
+    T pol_mod = 0;
+    T epsilon_curr = 0;
+    T c1 = 0.0;
+    T c2 = 0.0;
+    T gamma1_i = 0.0;
+    T gamma2_i = 0.0;
+    int nts = ((V*)curr_vessel)->nts;
+    int sn = ((V*)curr_vessel)->sn;
+    vector<T> return_constitutive = { 0, 0 };
 
     //Check if ansisotropic
-    if (((struct vessel*)curr_vessel)->eta_alpha_h[alpha] >= 0) {
+    if (((V*)curr_vessel)->eta_alpha_h[alpha] >= 0) {
 
         //Infl adjustment of material parameters
-        c1 = (1 + ((struct vessel*)curr_vessel)->gamma_inf * ((struct vessel*)curr_vessel)->ups_infl_p[nts * alpha + ts]) * ((struct vessel*)curr_vessel)->c_alpha_h[2 * alpha];
-        c2 = ((struct vessel*)curr_vessel)->c_alpha_h[2 * alpha + 1];
+        c1 = (1 + ((V*)curr_vessel)->gamma_inf * ((V*)curr_vessel)->ups_infl_p[nts * alpha + ts]) * ((V*)curr_vessel)->c_alpha_h[2 * alpha];
+        c2 = ((V*)curr_vessel)->c_alpha_h[2 * alpha + 1];
 
-        lambda_alpha_ntau_s = ((struct vessel*)curr_vessel)->g_alpha_h[alpha] *
-                              lambda_alpha_s / ((struct vessel*)curr_vessel)->lambda_alpha_tau[nts * alpha + ts];
+        lambda_alpha_ntau_s = ((V*)curr_vessel)->g_alpha_h[alpha] *
+                              lambda_alpha_s / ((V*)curr_vessel)->lambda_alpha_tau[nts * alpha + ts];
 
         if (lambda_alpha_ntau_s < 1) {
             lambda_alpha_ntau_s = 1;
@@ -1354,20 +1537,20 @@ vector<double> constitutive(void* curr_vessel, double lambda_alpha_s, int alpha,
     }
     else {
 
-        if (alpha < ((struct vessel*)curr_vessel)->n_pol_alpha) {
+        if (alpha < ((V*)curr_vessel)->n_pol_alpha) {
 
-            if (((struct vessel*)curr_vessel)->epsilon_alpha[nts * alpha + sn] <
-                ((struct vessel*)curr_vessel)->epsilon_pol_min[alpha]) {
-                ((struct vessel*)curr_vessel)->epsilon_pol_min[alpha] = ((struct vessel*)curr_vessel)->epsilon_alpha[nts * alpha + sn];
+            if (((V*)curr_vessel)->epsilon_alpha[nts * alpha + sn] <
+                ((V*)curr_vessel)->epsilon_pol_min[alpha]) {
+                ((V*)curr_vessel)->epsilon_pol_min[alpha] = ((V*)curr_vessel)->epsilon_alpha[nts * alpha + sn];
             }
-            epsilon_curr = ((struct vessel*)curr_vessel)->epsilon_pol_min[alpha];
+            epsilon_curr = ((V*)curr_vessel)->epsilon_pol_min[alpha];
             pol_mod = 0.03 * pow(epsilon_curr, 2);
         }
         else {
             pol_mod = 1;
         }
 
-        hat_S_alpha = pol_mod * ((struct vessel*)curr_vessel)->c_alpha_h[2 * alpha];
+        hat_S_alpha = pol_mod * ((V*)curr_vessel)->c_alpha_h[2 * alpha];
     }
 
     return_constitutive = { hat_S_alpha , hat_dSdC_alpha };
@@ -1376,6 +1559,45 @@ vector<double> constitutive(void* curr_vessel, double lambda_alpha_s, int alpha,
 
 }
 
+template <typename V>
+void update_inflammation(V& curr_vessel) {
+    //Immunological stimulus and mechano-mediated gains at every step from the
+    //inflammation parameters and the homeostatic gains
+    typedef typename V::scalar T;
+    int nts = curr_vessel.nts;
+    int n_alpha = curr_vessel.n_alpha;
+    T gamma_fun, steady_fun_i, steady_fun_m;
+    double s;
+
+    curr_vessel.ups_infl_p.resize(nts * n_alpha);
+    curr_vessel.ups_infl_d.resize(nts * n_alpha);
+    curr_vessel.K_sigma_p_alpha.resize(nts * n_alpha);
+    curr_vessel.K_sigma_d_alpha.resize(nts * n_alpha);
+    curr_vessel.K_tauw_p_alpha.resize(nts * n_alpha);
+    curr_vessel.K_tauw_d_alpha.resize(nts * n_alpha);
+
+    T delta_i = curr_vessel.delta_i, beta_i = curr_vessel.beta_i;
+    T delta_m = curr_vessel.delta_m;
+    for (int sn = 1; sn < nts; sn++) {
+        s = sn * curr_vessel.dt;
+        gamma_fun = (pow(delta_i, beta_i)) * pow(s, beta_i - 1) * exp(-delta_i * s)
+            / (delta_i * pow((beta_i - 1), (beta_i - 1)) * exp(1 - beta_i));
+        steady_fun_i = (1 - exp(-delta_i * s)) - (s > curr_vessel.s_int_infl) * (1 - curr_vessel.K_infl_eff) * (1 - exp(-delta_i * (s - curr_vessel.s_int_infl))) ;
+        steady_fun_m = (exp(-delta_m * s)) + 0.25 * (1 - exp(-delta_m * s)) + 
+        + (s > curr_vessel.s_int_mech) * (curr_vessel.K_mech_eff - 0.25) * (1 - exp(-delta_m * (s - curr_vessel.s_int_mech)));
+        for (int alpha = 0; alpha < n_alpha; alpha++){
+            if (curr_vessel.alpha_mechinfl[alpha] == 1){
+                curr_vessel.ups_infl_p[nts * alpha + sn] = curr_vessel.Ki_trans * gamma_fun + curr_vessel.Ki_steady * steady_fun_i;
+                curr_vessel.ups_infl_d[nts * alpha + sn] = curr_vessel.Ki_deg;
+            }
+            curr_vessel.K_sigma_p_alpha[nts * alpha + sn] = curr_vessel.K_sigma_p_alpha_h[alpha] * steady_fun_m;
+            curr_vessel.K_sigma_d_alpha[nts * alpha + sn] = curr_vessel.K_sigma_d_alpha_h[alpha] * steady_fun_m;
+            curr_vessel.K_tauw_p_alpha[nts * alpha + sn] = curr_vessel.K_tauw_p_alpha_h[alpha] * steady_fun_m;
+            curr_vessel.K_tauw_d_alpha[nts * alpha + sn] = curr_vessel.K_tauw_d_alpha_h[alpha] * steady_fun_m;
+        }
+    }
+}
+
 double get_app_visc(void* curr_vessel, int sn){
     //Returns apparent viscosity if diameter dependent factors from Secomb 2017 are in effect
     //Otherwise returns default for blood
@@ -1384,11 +1606,36 @@ double get_app_visc(void* curr_vessel, int sn){
 
     if (((struct vessel*)curr_vessel)->app_visc_flag == 1){
         d = ((struct vessel*)curr_vessel)->a[sn] * 2 * 1000000;
-	    mu = (1+(6*exp(-0.0858*d)+3.2-2.44*exp(-0.06*pow(d,0.645))-1)*pow(d/(d-1.1),2)*pow(d/(d-1.1),2)) * 0.0124;
+	    mu = rel_viscosity_ref(d, visc_gnr) * 0.0124;
     }
     else{
         mu = 0.04;
     }
 
     return mu;
-}
\ No newline at end of file
+}
+
+static void gsl_error_throw(const char* reason, const char* file, int line, int gsl_errno) {
+    throw std::runtime_error(string("GSL error: ") + reason + " (" + file + ":" + std::to_string(line) + ")");
+}
+
+void set_gsl_error_throw() {
+    gsl_set_error_handler(&gsl_error_throw);
+}
+
+//The kernels for the model (double), for forward sensitivities (dual_vessel) and for
+//the adjoint (adjoint_vessel)
+template double iv_residual<vessel>(double, vessel*);
+template void update_kinetics<vessel>(vessel&);
+template void update_sigma<vessel>(vessel*);
+template vector<double> constitutive<vessel>(vessel*, double, int, int, int);
+template void update_inflammation<vessel>(vessel&);
+template dual iv_residual<dual_vessel>(dual, dual_vessel*);
+template void update_kinetics<dual_vessel>(dual_vessel&);
+template void update_sigma<dual_vessel>(dual_vessel*);
+template vector<dual> constitutive<dual_vessel>(dual_vessel*, dual, int, int, int);
+template void update_inflammation<dual_vessel>(dual_vessel&);
+template adj iv_residual<adjoint_vessel>(adj, adjoint_vessel*);
+template void update_kinetics<adjoint_vessel>(adjoint_vessel&);
+template void update_sigma<adjoint_vessel>(adjoint_vessel*);
+template vector<adj> constitutive<adjoint_vessel>(adjoint_vessel*, adj, int, int, int);
@@ -1,21 +1,33 @@
 #ifndef FUNCTIONS
 #define FUNCTIONS
 
+template <typename T> class ad_vessel;
+struct dual;
+typedef ad_vessel<dual> dual_vessel;
 
+void step_vessel(vessel& curr_vessel, int sn);
 void update_time_step(vessel& curr_vessel);
+void step_dual_vessel(dual_vessel& tangent, const vessel& primal, int sn);
 int ramp_pressure_test(void* curr_vessel, double P_low, double P_high);
 int ramp_active_test(void* curr_vessel, double T_act_low, double T_act_high);
 int run_pd_test(vessel& curr_vessel, double P_low, double P_high, double lambda_z_test);
-int find_equil_geom(void* curr_vessel);
+int find_pd_response(vessel& curr_vessel, const vector<double>& P_test, vector<double>& a_test);
+int find_equil_geom(void* curr_vessel, const double* x_guess = NULL); //x_guess of equil_obj_f, e.g. a nearby solution
 int equil_obj_f(const gsl_vector* x, void* curr_vessel, gsl_vector* f);
 int print_state_mr(size_t iter, gsl_multiroot_fsolver* s);
 int find_tf_geom(void* curr_vessel);
 int tf_obj_f(const gsl_vector* x, void* curr_vessel, gsl_vector* f);
 int find_iv_geom(void* curr_vessel);
 double iv_obj_f(double a_mid_guess, void* curr_vessel);
-void update_kinetics(vessel& curr_vessel);
-void update_sigma(void* curr_vessel);
-vector<double> constitutive(void* curr_vessel, double lambda_alpha_s, int alpha, int ts, int dir);
+//Kernels of a G&R step, for vessel and for dual_vessel (dual_vessel.h)
+template <typename V> typename V::scalar iv_residual(typename V::scalar a_mid_guess, V* curr_vessel);
+template <typename V> void update_kinetics(V& curr_vessel);
+template <typename V> void update_sigma(V* curr_vessel);
+template <typename V> vector<typename V::scalar> constitutive(V* curr_vessel, typename V::scalar lambda_alpha_s, int alpha, int ts, int dir);
+template <typename V> void update_inflammation(V& curr_vessel);
 double get_app_visc(void* curr_vessel, int sn);
+//GSL errors throw std::runtime_error rather than abort, so that a failed run can be
+//recorded and the others continue
+void set_gsl_error_throw();
 
 #endif /* GNR_FUNCTIONS */
\ No newline at end of file
@@ -0,0 +1,212 @@
+// gnr_binary.cpp
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "gnr_binary.h"
+
+static void read_header(FILE* f, string name, vector<string>& columns, uint64_t& header_bytes) {
+    //Reads and checks the table header, leaving the file positioned at the first record
+    char magic[8];
+    uint32_t n_cols = 0, h_bytes = 0;
+    if (fread(magic, 1, 8, f) != 8 || memcmp(magic, gnr_bin_magic, 8) != 0 ||
+        fread(&n_cols, sizeof(uint32_t), 1, f) != 1 || fread(&h_bytes, sizeof(uint32_t), 1, f) != 1) {
+        throw std::runtime_error("Not a G&R binary table: " + name);
+    }
+
+    columns.clear();
+    for (uint32_t i = 0; i < n_cols; i++) {
+        string col;
+        int c;
+        while ((c = fgetc(f)) != EOF && c != '\0') {
+            col.push_back(char(c));
+        }
+        if (c == EOF) {
+            throw std::runtime_error("Truncated header in G&R binary table: " + name);
+        }
+        columns.push_back(col);
+    }
+    header_bytes = h_bytes;
+    fseek(f, long(header_bytes), SEEK_SET);
+}
+
+static uint64_t count_rows(FILE* f, uint64_t header_bytes, int n_cols, bool& indexed) {
+    //Row count from the trailer if it is valid, otherwise from the complete records on disk
+    uint64_t rec_bytes = uint64_t(n_cols) * sizeof(double);
+    fseek(f, 0, SEEK_END);
+    uint64_t file_bytes = uint64_t(ftell(f));
+
+    indexed = false;
+    if (file_bytes >= header_bytes + gnr_trailer_bytes) {
+        uint64_t trailer[3];
+        char magic[8];
+        fseek(f, -long(gnr_trailer_bytes), SEEK_END);
+        if (fread(trailer, sizeof(uint64_t), 3, f) == 3 && fread(magic, 1, 8, f) == 8 &&
+            memcmp(magic, gnr_idx_magic, 8) == 0 && trailer[2] == header_bytes &&
+            header_bytes + trailer[0] * rec_bytes + gnr_trailer_bytes == file_bytes) {
+            indexed = true;
+            return trailer[0];
+        }
+    }
+
+    if (file_bytes < header_bytes || rec_bytes == 0) {
+        return 0;
+    }
+    return (file_bytes - header_bytes) / rec_bytes;
+}
+
+binary_table_writer::binary_table_writer() {
+    file = NULL;
+    n_cols = 0;
+    n_rows = 0;
+    header_bytes = 0;
+    data_end = 0;
+}
+
+binary_table_writer::~binary_table_writer() {
+    close();
+}
+
+void binary_table_writer::open(string file_name, const vector<string>& columns, bool append) {
+    close();
+    name = file_name;
+    n_cols = int(columns.size());
+    n_rows = 0;
+
+    if (append) {
+        file = fopen(file_name.c_str(), "r+b");
+    }
+
+    if (file != NULL) {
+        //Continue an existing table, which must have the same columns
+        vector<string> old_columns;
+        read_header(file, name, old_columns, header_bytes);
+        if (old_columns != columns) {
+            throw std::runtime_error("Columns do not match existing G&R binary table: " + name);
+        }
+        bool indexed;
+        n_rows = count_rows(file, header_bytes, n_cols, indexed);
+    }
+    else {
+        file = fopen(file_name.c_str(), "w+b");
+        if (file == NULL) {
+            throw std::runtime_error("Could not open output file " + file_name);
+        }
+
+        string names;
+        for (int i = 0; i < n_cols; i++) {
+            names.append(columns[i]);
+            names.push_back('\0');
+        }
+        header_bytes = 16 + names.size();
+        header_bytes = (header_bytes + 7) / 8 * 8;
+        names.resize(header_bytes - 16, '\0');
+
+        uint32_t n_cols_u = uint32_t(n_cols), h_bytes = uint32_t(header_bytes);
+        fwrite(gnr_bin_magic, 1, 8, file);
+        fwrite(&n_cols_u, sizeof(uint32_t), 1, file);
+        fwrite(&h_bytes, sizeof(uint32_t), 1, file);
+        fwrite(names.data(), 1, names.size(), file);
+    }
+
+    data_end = header_bytes + n_rows * n_cols * sizeof(double);
+    write_index();
+}
+
+void binary_table_writer::write_row(const double* vals) {
+    //Rows overwrite the previous trailer, which is put back by write_index
+    fseek(file, long(data_end), SEEK_SET);
+    fwrite(vals, sizeof(double), n_cols, file);
+    data_end += n_cols * sizeof(double);
+    n_rows++;
+}
+
+void binary_table_writer::write_index() {
+    uint64_t trailer[3];
+    trailer[0] = n_rows;
+    trailer[1] = n_rows > 0 ? data_end - n_cols * sizeof(double) : header_bytes;
+    trailer[2] = header_bytes;
+
+    fseek(file, long(data_end), SEEK_SET);
+    fwrite(trailer, sizeof(uint64_t), 3, file);
+    fwrite(gnr_idx_magic, 1, 8, file);
+    fflush(file);
+}
+
+void binary_table_writer::truncate(uint64_t n_rows_inp) {
+    //Drops the rows after the first n_rows_inp, e.g. those written after a checkpoint
+    if (n_rows_inp > n_rows) {
+        throw std::runtime_error("Cannot truncate G&R binary table to more rows than it has: " + name);
+    }
+    n_rows = n_rows_inp;
+    data_end = header_bytes + n_rows * n_cols * sizeof(double);
+    write_index();
+    if (ftruncate(fileno(file), off_t(data_end + gnr_trailer_bytes)) != 0) {
+        throw std::runtime_error("Could not truncate " + name);
+    }
+}
+
+void binary_table_writer::close() {
+    if (file != NULL) {
+        write_index();
+        fclose(file);
+        file = NULL;
+    }
+}
+
+binary_table_reader::binary_table_reader() {
+    file = NULL;
+    n_cols = 0;
+    n_rows = 0;
+    indexed = false;
+    header_bytes = 0;
+}
+
+binary_table_reader::~binary_table_reader() {
+    close();
+}
+
+void binary_table_reader::open(string file_name) {
+    close();
+    name = file_name;
+    file = fopen(file_name.c_str(), "rb");
+    if (file == NULL) {
+        throw std::runtime_error("Could not open G&R binary table " + file_name);
+    }
+    read_header(file, name, columns, header_bytes);
+    n_cols = int(columns.size());
+    n_rows = count_rows(file, header_bytes, n_cols, indexed);
+}
+
+void binary_table_reader::read_row(uint64_t row, double* vals) {
+    if (row >= n_rows) {
+        throw std::runtime_error("Row out of range in G&R binary table " + name);
+    }
+    fseek(file, long(header_bytes + row * n_cols * sizeof(double)), SEEK_SET);
+    if (fread(vals, sizeof(double), n_cols, file) != size_t(n_cols)) {
+        throw std::runtime_error("Could not read row from G&R binary table " + name);
+    }
+}
+
+void binary_table_reader::read_last_row(double* vals) {
+    if (n_rows == 0) {
+        throw std::runtime_error("G&R binary table has no rows: " + name);
+    }
+    read_row(n_rows - 1, vals);
+}
+
+int binary_table_reader::column(string col_name) const {
+    for (int i = 0; i < n_cols; i++) {
+        if (columns[i] == col_name) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void binary_table_reader::close() {
+    if (file != NULL) {
+        fclose(file);
+        file = NULL;
+    }
+}
@@ -0,0 +1,72 @@
+// gnr_binary.h
+#ifndef GNR_BINARY
+#define GNR_BINARY
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+//Self-describing binary table used for the G&R output streams.
+//
+//Layout (native byte order, all offsets in bytes):
+//  header   "GNRBIN1" + '\0', uint32 n_cols, uint32 header_bytes,
+//           n_cols NUL-terminated column names, zero padding to a multiple of 8
+//  records  n_rows fixed-width rows of n_cols doubles
+//  trailer  uint64 n_rows, uint64 last_row_offset, uint64 header_bytes, "GNRIDX1" + '\0'
+//
+//The trailer is rewritten at the end of the file on every flush, so a reader can seek
+//to the last 32 bytes and go straight to the latest row. If a run is killed before a
+//flush the reader falls back to the number of complete rows implied by the file size.
+static const char gnr_bin_magic[8] = { 'G', 'N', 'R', 'B', 'I', 'N', '1', '\0' };
+static const char gnr_idx_magic[8] = { 'G', 'N', 'R', 'I', 'D', 'X', '1', '\0' };
+static const int gnr_trailer_bytes = 32;
+
+class binary_table_writer {
+public:
+    binary_table_writer();
+    ~binary_table_writer();
+
+    //Creates a new table, or reopens an existing one with the same columns for appending
+    void open(string file_name, const vector<string>& columns, bool append);
+    void write_row(const double* vals);
+    void write_index(); //rewrites the trailer and flushes
+    void truncate(uint64_t n_rows_inp); //keeps the first n_rows_inp rows
+    void close();
+
+    int n_cols;
+    uint64_t n_rows;
+
+private:
+    FILE* file;
+    string name;
+    uint64_t header_bytes;
+    uint64_t data_end;
+};
+
+class binary_table_reader {
+public:
+    binary_table_reader();
+    ~binary_table_reader();
+
+    void open(string file_name);
+    void read_row(uint64_t row, double* vals); //row 0 is the first record
+    void read_last_row(double* vals);
+    int column(string col_name) const; //index of a column, -1 if not present
+    void close();
+
+    vector<string> columns;
+    int n_cols;
+    uint64_t n_rows;
+    bool indexed; //false if the row count came from the file size instead of the trailer
+
+private:
+    FILE* file;
+    string name;
+    uint64_t header_bytes;
+};
+
+#endif /* GNR_BINARY */
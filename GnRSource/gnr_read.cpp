@@ -0,0 +1,123 @@
+//Prints rows of a G&R binary output table as tab-separated text
+#include <iostream>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gnr_binary.h"
+
+using std::string;
+using std::vector;
+using std::cout;
+
+#include <boost/program_options.hpp>
+namespace po = boost::program_options;
+
+int main( int ac, char* av[] ) {
+
+    try{
+
+        string file_arg;
+        string cols_arg;
+        int info_flag;
+        int last_flag;
+        int names_flag;
+        int precision;
+        long first_row;
+        long num_rows;
+
+        po::options_description desc("Allowed options");
+        desc.add_options()
+            ("help,h", "produce help message")
+            ("file,f", po::value<string>(&file_arg), "binary table to read (e.g. GnR_out_ord1.bin)")
+            ("info,i", po::value<int>(&info_flag)->default_value(0), "print the columns and row count only")
+            ("last,l", po::value<int>(&last_flag)->default_value(0), "print the last row only")
+            ("first_row", po::value<long>(&first_row)->default_value(0), "first row to print")
+            ("num_rows", po::value<long>(&num_rows)->default_value(-1), "number of rows to print (-1 = all)")
+            ("columns,c", po::value<string>(&cols_arg)->default_value(""), "comma separated columns to print (default all)")
+            ("names", po::value<int>(&names_flag)->default_value(0), "print column names as a leading % comment line")
+            ("precision,p", po::value<int>(&precision)->default_value(6), "significant digits of printed values")
+        ;
+
+        po::positional_options_description p;
+        p.add("file", -1);
+
+        po::variables_map vm;
+        po::store(po::command_line_parser(ac, av).
+                  options(desc).positional(p).run(), vm);
+        po::notify(vm);
+
+        if (vm.count("help") || !vm.count("file")) {
+            cout << "Usage: gnr_read [options] file\n";
+            cout << desc;
+            return 0;
+        }
+
+        binary_table_reader table;
+        table.open(file_arg);
+
+        if (info_flag) {
+            cout << "Columns: " << table.n_cols << "\n";
+            for (int i = 0; i < table.n_cols; i++) {
+                cout << i + 1 << "\t" << table.columns[i] << "\n";
+            }
+            cout << "Rows: " << table.n_rows << (table.indexed ? "" : " (from file size, no index)") << "\n";
+            return 0;
+        }
+
+        //Columns to print
+        vector<int> cols;
+        if (cols_arg.empty()) {
+            for (int i = 0; i < table.n_cols; i++) {
+                cols.push_back(i);
+            }
+        }
+        else {
+            std::stringstream ss(cols_arg);
+            string col;
+            while (std::getline(ss, col, ',')) {
+                int i = table.column(col);
+                if (i < 0) {
+                    throw std::runtime_error("No column named " + col + " in " + file_arg);
+                }
+                cols.push_back(i);
+            }
+        }
+
+        if (names_flag) {
+            printf("%%");
+            for (int i = 0; i < cols.size(); i++) {
+                printf("%s%s", i == 0 ? "" : "\t", table.columns[cols[i]].c_str());
+            }
+            printf("\n");
+        }
+
+        //Rows to print
+        uint64_t row_begin = uint64_t(first_row), row_end = table.n_rows;
+        if (last_flag) {
+            row_begin = table.n_rows > 0 ? table.n_rows - 1 : 0;
+        }
+        else if (num_rows >= 0 && row_begin + uint64_t(num_rows) < row_end) {
+            row_end = row_begin + uint64_t(num_rows);
+        }
+
+        vector<double> vals(table.n_cols);
+        for (uint64_t row = row_begin; row < row_end; row++) {
+            table.read_row(row, vals.data());
+            for (int i = 0; i < cols.size(); i++) {
+                printf("%s%.*g", i == 0 ? "" : "\t", precision, vals[cols[i]]);
+            }
+            printf("\n");
+        }
+
+    }
+    catch(std::exception& e)
+    {
+        cout << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+
+}
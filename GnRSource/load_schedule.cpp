@@ -0,0 +1,139 @@
+// load_schedule.cpp
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "vessel.h"
+#include "load_schedule.h"
+
+using std::string;
+using std::vector;
+
+void load_schedule::read(string file_name) {
+    std::ifstream schedule_in(file_name);
+    if (!schedule_in) {
+        throw std::runtime_error("Could not open load schedule " + file_name);
+    }
+
+    string line;
+    while (std::getline(schedule_in, line)) {
+        size_t hash = line.find('#');
+        if (hash != string::npos) {
+            line = line.substr(0, hash);
+        }
+        std::stringstream ss(line);
+        load_curve curve;
+        if (!(ss >> curve.quantity)) {
+            continue;
+        }
+        if (curve.quantity != "P" && curve.quantity != "Q" && curve.quantity != "T_act" && curve.quantity != "lambda_z") {
+            throw std::runtime_error("Unknown load schedule quantity " + curve.quantity);
+        }
+        ss >> curve.type;
+        curve.gamma = 0.0;
+        curve.tau = 1.0;
+        curve.t0 = 0.0;
+
+        if (curve.type == "table") {
+            double t, g;
+            while (ss >> t >> g) {
+                curve.t.push_back(t);
+                curve.g.push_back(g);
+            }
+            //Continue a table started on an earlier line
+            if (!curves.empty() && curves.back().quantity == curve.quantity && curves.back().type == "table") {
+                curves.back().t.insert(curves.back().t.end(), curve.t.begin(), curve.t.end());
+                curves.back().g.insert(curves.back().g.end(), curve.g.begin(), curve.g.end());
+                continue;
+            }
+            if (curve.t.empty()) {
+                throw std::runtime_error("Load schedule table for " + curve.quantity + " has no points");
+            }
+        }
+        else if (curve.type == "ramp") {
+            if (!(ss >> curve.gamma >> curve.tau >> curve.t0) || curve.tau <= 0) {
+                throw std::runtime_error("Load schedule ramp for " + curve.quantity + " needs gamma, tau > 0, t0");
+            }
+        }
+        else if (curve.type == "const") {
+            if (!(ss >> curve.gamma)) {
+                throw std::runtime_error("Load schedule const for " + curve.quantity + " needs a value");
+            }
+        }
+        else {
+            throw std::runtime_error("Unknown load schedule type " + curve.type);
+        }
+
+        for (int i = 0; i < curves.size(); i++) {
+            if (curves[i].quantity == curve.quantity) {
+                throw std::runtime_error("Load schedule has more than one curve for " + curve.quantity);
+            }
+        }
+        curves.push_back(curve);
+    }
+
+    for (int i = 0; i < curves.size(); i++) {
+        for (int j = 1; j < curves[i].t.size(); j++) {
+            if (curves[i].t[j] <= curves[i].t[j - 1]) {
+                throw std::runtime_error("Load schedule table times must increase for " + curves[i].quantity);
+            }
+        }
+    }
+}
+
+double load_schedule::evaluate(const load_curve& curve, double s) {
+    if (curve.type == "const") {
+        return curve.gamma;
+    }
+    else if (curve.type == "ramp") {
+        return s > curve.t0 ? curve.gamma * (1 - exp(-(s - curve.t0) / curve.tau)) : 0.0;
+    }
+
+    //Piecewise linear table, held constant outside its range
+    const vector<double>& t = curve.t;
+    const vector<double>& g = curve.g;
+    if (s <= t.front()) {
+        return g.front();
+    }
+    if (s >= t.back()) {
+        return g.back();
+    }
+    int i = 1;
+    while (t[i] < s) {
+        i++;
+    }
+    return g[i - 1] + (g[i] - g[i - 1]) * (s - t[i - 1]) / (t[i] - t[i - 1]);
+}
+
+double load_schedule::gamma(string quantity, double s) const {
+    for (int i = 0; i < curves.size(); i++) {
+        if (curves[i].quantity == quantity) {
+            return evaluate(curves[i], s);
+        }
+    }
+    return 0.0;
+}
+
+void load_schedule::apply(vessel& curr_vessel) const {
+    //Only scheduled quantities are changed, others keep their current values
+    double s = curr_vessel.s;
+    for (int i = 0; i < curves.size(); i++) {
+        double g = evaluate(curves[i], s);
+        if (curves[i].quantity == "P") {
+            curr_vessel.P = (1 + g) * curr_vessel.P_h;
+        }
+        else if (curves[i].quantity == "Q") {
+            curr_vessel.Q = (1 + g) * curr_vessel.Q_h;
+        }
+        else if (curves[i].quantity == "T_act") {
+            curr_vessel.T_act = (1 + g) * curr_vessel.T_act_h;
+        }
+        else {
+            curr_vessel.lambda_z_curr = (1 + g) * curr_vessel.lambda_z_h;
+        }
+    }
+}
@@ -0,0 +1,41 @@
+// load_schedule.h
+#ifndef LOAD_SCHEDULE
+#define LOAD_SCHEDULE
+
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+class vessel;
+
+//Time-varying loads applied in-process at each time step. Each line of a schedule file is
+//
+//  <quantity> table t1 g1 t2 g2 ...   piecewise linear in time (days), constant outside
+//  <quantity> ramp gamma tau t0       gamma * (1 - exp(-(s - t0) / tau)) for s > t0, 0 before
+//  <quantity> const gamma
+//
+//where quantity is P, Q, T_act or lambda_z and the values are fold changes from the
+//homeostatic values, as for --gamma_p/--gamma_q/--gamma_act (P = (1 + gamma) * P_h).
+//Table points may be split over several lines; text after '#' is ignored.
+struct load_curve {
+    string quantity;
+    string type;
+    vector<double> t, g; //table points
+    double gamma, tau, t0; //ramp/const parameters
+};
+
+class load_schedule {
+public:
+    void read(string file_name);
+    bool empty() const { return curves.empty(); }
+    double gamma(string quantity, double s) const; //fold change at time s, 0 if not scheduled
+    void apply(vessel& curr_vessel) const; //sets the loads for the vessel's current time
+
+private:
+    static double evaluate(const load_curve& curve, double s);
+    vector<load_curve> curves;
+};
+
+#endif /* LOAD_SCHEDULE */
@@ -0,0 +1,189 @@
+//Runs a parameter sweep, an uncertainty quantification study, or forward sensitivities
+//of a vessel's G&R
+//from one initialized base vessel
+#define _USE_MATH_DEFINES
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <gsl/gsl_errno.h>
+#include <gsl/gsl_vector.h>
+#include <gsl/gsl_roots.h>
+#include <gsl/gsl_multiroots.h>
+
+#include "vessel.h"
+#include "functions.h"
+#include "ensemble.h"
+#include "uq.h"
+#include "sensitivity.h"
+
+using std::string;
+using std::vector;
+using std::cout;
+
+#include <boost/program_options.hpp>
+namespace po = boost::program_options;
+
+int main( int ac, char* av[] ) {
+
+    try{
+
+        string jobs_arg;
+        string name_arg;
+        string out_prefix;
+        string init_cache_dir;
+        int step_arg;
+        int branch_step;
+        double step_size;
+        int num_days;
+        int n_threads;
+        int gnr_equil_arg;
+        string uq_arg;
+        long n_samples;
+        string sampler_arg;
+        unsigned long seed_arg;
+        string uq_outputs_arg;
+        string quantiles_arg;
+        string sens_arg;
+        string sens_outputs_arg;
+
+        po::options_description desc("Allowed options");
+        desc.add_options()
+            ("help,h", "produce help message")
+            ("jobs,j", po::value<string>(&jobs_arg), "job table, a header of parameter names and one job per line")
+            ("name,n", po::value<string>(&name_arg)->default_value(""), "suffix of the Native_in file")
+            ("step,s", po::value<int>(&step_arg), "number of timesteps to run simulation")
+            ("time step size,d", po::value<double>(&step_size)->default_value(1.0), "size of each time step in days")
+            ("max_days,m", po::value<int>(&num_days)->default_value(361), "maximum days to simulate")
+            ("threads,t", po::value<int>(&n_threads)->default_value(0), "worker threads (0 = one per core)")
+            ("branch_step", po::value<int>(&branch_step)->default_value(0), "run the base vessel once to this step and branch every job from it (0 = every job from the start)")
+            ("simulate_equil", po::value<int>(&gnr_equil_arg)->default_value(1), "execute equilibrated simulation")
+            ("init_cache", po::value<string>(&init_cache_dir)->default_value(""), "directory of initialized vessel snapshots")
+            ("out", po::value<string>(&out_prefix)->default_value("Ensemble"), "prefix of the consolidated output files")
+            ("uq", po::value<string>(&uq_arg), "parameter ranges for an uncertainty quantification study in place of a job table")
+            ("samples", po::value<long>(&n_samples)->default_value(256), "UQ samples")
+            ("sampler", po::value<string>(&sampler_arg)->default_value("sobol"), "UQ sampler: sobol or lhs")
+            ("seed", po::value<unsigned long>(&seed_arg)->default_value(1), "seed of the Latin hypercube")
+            ("uq_outputs", po::value<string>(&uq_outputs_arg)->default_value("a,P"), "comma separated GnR_out columns summarized by the UQ study")
+            ("quantiles", po::value<string>(&quantiles_arg)->default_value("0.05,0.5,0.95"), "comma separated quantiles of the UQ study")
+            ("sensitivity", po::value<string>(&sens_arg), "parameter values for forward sensitivities in place of a job table")
+            ("sens_outputs", po::value<string>(&sens_outputs_arg)->default_value("a,h"), "comma separated GnR_out columns differentiated")
+        ;
+
+        po::positional_options_description p;
+        p.add("jobs", -1);
+
+        po::variables_map vm;
+        po::store(po::command_line_parser(ac, av).
+                  options(desc).positional(p).run(), vm);
+        po::notify(vm);
+
+        if (vm.count("help") || (!vm.count("jobs") && !vm.count("uq") && !vm.count("sensitivity"))) {
+            cout << "Usage: gnr_ensemble [options] jobs\n";
+            cout << "       gnr_ensemble [options] --uq ranges\n";
+            cout << "       gnr_ensemble [options] --sensitivity parameters\n";
+            cout << desc;
+            cout << "Parameters:";
+            vector<string> parameters = ensemble::parameterNames();
+            for (int i = 0; i < parameters.size(); i++) {
+                cout << " " << parameters[i];
+            }
+            cout << "\n";
+            return 0;
+        }
+
+        if (!vm.count("step")) {
+            step_arg = int( num_days / step_size );
+        }
+
+        //A job or UQ sample whose solve fails in GSL is recorded as failed and the others
+        //continue
+        set_gsl_error_throw();
+
+        //Uncertainty quantification: streaming statistics of the sampled trajectories
+        if (vm.count("uq")) {
+            uq_study study(n_threads);
+            study.readRanges(uq_arg);
+            study.sampler = sampler_arg;
+            study.seed = seed_arg;
+            vector<string> outputs;
+            vector<double> quantiles;
+            std::stringstream outputs_ss(uq_outputs_arg), quantiles_ss(quantiles_arg);
+            string item;
+            while (std::getline(outputs_ss, item, ',')) {
+                outputs.push_back(item);
+            }
+            while (std::getline(quantiles_ss, item, ',')) {
+                quantiles.push_back(atof(item.c_str()));
+            }
+            std::cout << "UQ parameters: " << study.params.size() << " samples: " << n_samples << " (" << sampler_arg
+                      << ") on " << study.pool.size() << " threads" << std::endl;
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            study.initialize("Native_in_" + name_arg, num_days, step_size, init_cache_dir);
+            study.run(n_samples, step_arg, outputs, quantiles, out_prefix);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            printf("%s %f %s %ld\n", "UQ seconds:", seconds, "failed samples:", study.n_failed);
+            return 0;
+        }
+
+        //Forward sensitivities: derivatives of the outputs along one run
+        if (vm.count("sensitivity")) {
+            sensitivity sens(n_threads);
+            sens.readParameters(sens_arg);
+            vector<string> outputs;
+            std::stringstream outputs_ss(sens_outputs_arg);
+            string item;
+            while (std::getline(outputs_ss, item, ',')) {
+                outputs.push_back(item);
+            }
+            std::cout << "Sensitivity parameters: " << sens.params.size() << " on " << sens.pool.size()
+                      << " threads" << std::endl;
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            sens.initialize("Native_in_" + name_arg, num_days, step_size, init_cache_dir);
+            sens.run(step_arg, outputs, out_prefix);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            printf("%s %f\n", "Sensitivity seconds:", seconds);
+            return 0;
+        }
+
+        ensemble sweep(n_threads);
+        sweep.readJobs(jobs_arg);
+        sweep.branch_step = std::max(branch_step, 0);
+        std::cout << "Jobs: " << sweep.n_jobs << " on " << sweep.pool.size() << " threads" << std::endl;
+
+        //One parsed and initialized vessel shared by every job
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        sweep.initialize("Native_in_" + name_arg, num_days, step_size, init_cache_dir);
+        std::cout << "Steps to simulate: " << step_arg << "\n";
+
+        sweep.run(step_arg, gnr_equil_arg, out_prefix);
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("%s %f %s %d\n", "Ensemble seconds:", seconds, "tasks stolen:", sweep.pool.steals());
+        int n_failed = 0;
+        for (int j = 0; j < sweep.n_jobs; j++) {
+            n_failed += sweep.job_status[j] != "ok";
+        }
+        if (n_failed > 0) {
+            printf("%s %d\n", "Failed jobs:", n_failed);
+        }
+
+    }
+    catch(std::exception& e)
+    {
+        cout << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+
+}
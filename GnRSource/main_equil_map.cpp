@@ -0,0 +1,119 @@
+//Precomputes the equilibrated states of a vessel over a grid of loads for the tree solvers
+#define _USE_MATH_DEFINES
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <gsl/gsl_errno.h>
+#include <gsl/gsl_vector.h>
+#include <gsl/gsl_roots.h>
+#include <gsl/gsl_multiroots.h>
+
+#include "vessel.h"
+#include "functions.h"
+#include "thread_pool.h"
+#include "equil_map.h"
+
+using std::string;
+using std::vector;
+using std::cout;
+
+#include <boost/program_options.hpp>
+namespace po = boost::program_options;
+
+int main( int ac, char* av[] ) {
+
+    try{
+
+        string name_arg;
+        string map_dir;
+        string init_cache_dir;
+        string gamma_p_arg, gamma_q_arg, gamma_act_arg;
+        double step_size;
+        int num_days;
+        int n_threads;
+
+        po::options_description desc("Allowed options");
+        desc.add_options()
+            ("help,h", "produce help message")
+            ("name,n", po::value<string>(&name_arg)->default_value(""), "suffix of the Native_in file")
+            ("time step size,d", po::value<double>(&step_size)->default_value(1.0), "size of each time step in days")
+            ("max_days,m", po::value<int>(&num_days)->default_value(361), "maximum days to simulate")
+            ("threads,t", po::value<int>(&n_threads)->default_value(0), "worker threads (0 = one per core)")
+            ("init_cache", po::value<string>(&init_cache_dir)->default_value(""), "directory of initialized vessel snapshots")
+            ("gamma_p", po::value<string>(&gamma_p_arg)->default_value("0"), "fold changes in pressure, <value> or <low>:<high>:<points>")
+            ("gamma_q", po::value<string>(&gamma_q_arg)->default_value("0"), "fold changes in flow, <value> or <low>:<high>:<points>")
+            ("gamma_act", po::value<string>(&gamma_act_arg)->default_value("0"), "fold changes in active stress, <value> or <low>:<high>:<points>")
+            ("map_dir", po::value<string>(&map_dir)->default_value("."), "directory of the equilibrated maps, as --equil_maps of gnr_tree")
+        ;
+
+        po::variables_map vm;
+        po::store(po::command_line_parser(ac, av).options(desc).run(), vm);
+        po::notify(vm);
+
+        if (vm.count("help")) {
+            cout << "Usage: gnr_equil_map [options]\n";
+            cout << desc;
+            return 0;
+        }
+
+        string native_file = "Native_in_" + name_arg;
+        equil_map map;
+        map.gamma_p = equil_map::parseAxis(gamma_p_arg);
+        map.gamma_q = equil_map::parseAxis(gamma_q_arg);
+        map.gamma_act = equil_map::parseAxis(gamma_act_arg);
+        thread_pool pool(n_threads);
+        std::cout << "Grid points: " << map.gamma_p.size() << " x " << map.gamma_q.size() << " x "
+                  << map.gamma_act.size() << " on " << pool.size() << " threads" << std::endl;
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        vessel base_vessel;
+        if (init_cache_dir.empty()) {
+            base_vessel.initializeNative(native_file, num_days, step_size);
+        }
+        else {
+            base_vessel.initializeNativeCached(native_file, init_cache_dir, num_days, step_size);
+        }
+        std::ostringstream state_out(std::ios::binary);
+        base_vessel.writeState(state_out);
+        string hash_str;
+        string key = vessel::inputKey(native_file, num_days, step_size, hash_str);
+
+        map.build(state_out.str(), key, pool);
+        string map_name = map_dir + "/equil_" + hash_str + ".bin";
+        map.write(map_name);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("%s %d %s %d %s %d\n", "Warm starts:", map.n_warm, "cold starts:", map.n_cold, "failed:", map.n_failed);
+        printf("%s %f %s %s\n", "Map seconds:", seconds, "written to", map_name.c_str());
+
+        //Cost of a query at the centres of the cells
+        const int n_queries = 100000;
+        vector<double> row(vessel::n_native_equil_outputs);
+        int n_hits = 0;
+        auto mid = [](const vector<double>& axis, int k) {
+            int n = int(axis.size());
+            return n > 1 ? (axis[k % (n - 1)] + axis[k % (n - 1) + 1]) / 2 : axis[0];
+        };
+        start = std::chrono::steady_clock::now();
+        for (int k = 0; k < n_queries; k++) {
+            n_hits += map.lookup(mid(map.gamma_p, k), mid(map.gamma_q, k / 7), mid(map.gamma_act, k / 49), &row[0]);
+        }
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("%s %f %s %d %s %d\n", "Lookup microseconds:", 1e6 * seconds / n_queries, "hits:", n_hits, "of", n_queries);
+
+    }
+    catch(std::exception& e)
+    {
+        cout << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+
+}
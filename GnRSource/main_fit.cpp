@@ -0,0 +1,156 @@
+//Fits parameters of a vessel's G&R to time-course data by nonlinear least squares
+#define _USE_MATH_DEFINES
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <gsl/gsl_errno.h>
+#include <gsl/gsl_vector.h>
+#include <gsl/gsl_roots.h>
+#include <gsl/gsl_multiroots.h>
+
+#include "vessel.h"
+#include "functions.h"
+#include "ensemble.h"
+#include "calibration.h"
+#include "mcmc.h"
+
+using std::string;
+using std::vector;
+using std::cout;
+
+#include <boost/program_options.hpp>
+namespace po = boost::program_options;
+
+int main( int ac, char* av[] ) {
+
+    try{
+
+        string data_arg;
+        string params_arg;
+        string name_arg;
+        string out_prefix;
+        string init_cache_dir;
+        double step_size;
+        int num_days;
+        int n_threads;
+        int max_iter;
+        double xtol, gtol, ftol;
+        double fd_step;
+        double steady_tol;
+        int steady_steps;
+        long mcmc_iterations;
+        int n_walkers;
+        unsigned long seed;
+        long burn;
+        long checkpoint_every;
+
+        po::options_description desc("Allowed options");
+        desc.add_options()
+            ("help,h", "produce help message")
+            ("data", po::value<string>(&data_arg), "time-course data, <column>[:fold] <day> <value> [sd] per line")
+            ("params,p", po::value<string>(&params_arg), "parameters, <parameter> <initial> [log|fixed] [<low> <high>] per line")
+            ("name,n", po::value<string>(&name_arg)->default_value(""), "suffix of the Native_in file")
+            ("time step size,d", po::value<double>(&step_size)->default_value(1.0), "size of each time step in days")
+            ("max_days,m", po::value<int>(&num_days)->default_value(361), "maximum days to simulate")
+            ("threads,t", po::value<int>(&n_threads)->default_value(0), "worker threads (0 = one per core)")
+            ("init_cache", po::value<string>(&init_cache_dir)->default_value(""), "directory of initialized vessel snapshots")
+            ("out", po::value<string>(&out_prefix)->default_value("Fit"), "prefix of the fit and residual files")
+            ("max_iter", po::value<int>(&max_iter)->default_value(100), "maximum iterations")
+            ("xtol", po::value<double>(&xtol)->default_value(1e-6), "relative step tolerance")
+            ("gtol", po::value<double>(&gtol)->default_value(1e-6), "gradient tolerance")
+            ("ftol", po::value<double>(&ftol)->default_value(0.0), "residual change tolerance")
+            ("fd_step", po::value<double>(&fd_step)->default_value(1e-4), "relative step of the finite difference Jacobian")
+            ("ups_gradient", "write the gradient with respect to the inflammation history at the initial values instead of fitting")
+            ("steady_tol", po::value<double>(&steady_tol)->default_value(0.0), "relative change below which a run is steady (0 = run every step)")
+            ("steady_steps", po::value<int>(&steady_steps)->default_value(10), "steps below steady_tol before a run stops")
+            ("mcmc", po::value<long>(&mcmc_iterations)->default_value(0), "sample the posterior for this many iterations instead of fitting")
+            ("walkers", po::value<int>(&n_walkers)->default_value(0), "walkers of the sampler (0 = 2 * fitted parameters + 2)")
+            ("seed", po::value<unsigned long>(&seed)->default_value(1), "random seed of the sampler")
+            ("burn", po::value<long>(&burn)->default_value(0), "iterations left out of the posterior summary")
+            ("checkpoint_every", po::value<long>(&checkpoint_every)->default_value(10), "iterations between checkpoints of the sampler")
+            ("resume", "continue the sampler from its checkpoint")
+        ;
+
+        po::positional_options_description p;
+        p.add("data", 1);
+        p.add("params", 1);
+
+        po::variables_map vm;
+        po::store(po::command_line_parser(ac, av).
+                  options(desc).positional(p).run(), vm);
+        po::notify(vm);
+
+        if (vm.count("help") || !vm.count("data") || !vm.count("params")) {
+            cout << "Usage: gnr_fit [options] data params\n";
+            cout << desc;
+            cout << "Parameters:";
+            vector<string> parameters = ensemble::parameterNames();
+            for (int i = 0; i < parameters.size(); i++) {
+                cout << " " << parameters[i];
+            }
+            cout << " Native_in:<line>:<column>\n";
+            return 0;
+        }
+
+        calibration cal(n_threads);
+        cal.readData(data_arg);
+        cal.readParameters(params_arg);
+        cal.fd_step = fd_step;
+        cal.steady_tol = steady_tol;
+        cal.steady_steps = steady_steps;
+        std::cout << "Data points: " << cal.n_data << " fitted parameters: " << cal.n_fit
+                  << " on " << cal.pool.size() << " threads" << std::endl;
+
+        //A run that fails in GSL is rejected as a failed run rather than aborting the fit
+        set_gsl_error_throw();
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        cal.initialize("Native_in_" + name_arg, num_days, step_size, init_cache_dir);
+        if (vm.count("ups_gradient")) {
+            cal.inflammationGradient(out_prefix);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            printf("%s %f\n", "Gradient seconds:", seconds);
+            return 0;
+        }
+        if (mcmc_iterations > 0) {
+            mcmc_sampler sampler(cal);
+            sampler.n_walkers = n_walkers;
+            sampler.seed = seed;
+            sampler.burn = burn;
+            sampler.checkpoint_every = std::max(checkpoint_every, 1L);
+            if (vm.count("resume")) {
+                sampler.resume(out_prefix);
+            }
+            else {
+                sampler.start(out_prefix);
+            }
+            sampler.run(mcmc_iterations, out_prefix);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            printf("%s %f\n", "Sampling seconds:", seconds);
+            return 0;
+        }
+        int status = cal.fit(max_iter, xtol, gtol, ftol, out_prefix);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("%s %f\n", "Fit seconds:", seconds);
+        if (status != GSL_SUCCESS) {
+            return 1;
+        }
+
+    }
+    catch(std::exception& e)
+    {
+        cout << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+
+}
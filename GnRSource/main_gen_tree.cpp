@@ -0,0 +1,87 @@
+//Generates the morphometric tree of generate_morphometric_tree.m as a compact binary file
+#include <iostream>
+#include <cstdio>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "tree_generator.h"
+
+using std::string;
+using std::vector;
+using std::cout;
+
+#include <boost/program_options.hpp>
+namespace po = boost::program_options;
+
+int main( int ac, char* av[] ) {
+
+    try{
+
+        string morph_arg;
+        string out_arg;
+        string text_arg;
+        int root_order;
+        int order_remodeling;
+        double alpha;
+        double beta;
+
+        po::options_description desc("Allowed options");
+        desc.add_options()
+            ("help,h", "produce help message")
+            ("morphometry,i", po::value<string>(&morph_arg), "connectivity matrix, diameters and lengths (write_tree_morphometry.m)")
+            ("order,o", po::value<int>(&root_order)->default_value(0), "order of the root element (0 = highest order)")
+            ("out,b", po::value<string>(&out_arg)->default_value("morphometric_tree.bin"), "binary tree file")
+            ("text", po::value<string>(&text_arg)->default_value(""), "also write the tree as text for --hemo_tree")
+            ("order_remodeling", po::value<int>(&order_remodeling)->default_value(0), "orders pruned by alpha and beta")
+            ("alpha", po::value<double>(&alpha)->default_value(1.0), "scaling of the number of children of pruned orders")
+            ("beta", po::value<double>(&beta)->default_value(1.0), "scaling of the diameter of pruned orders")
+        ;
+
+        po::positional_options_description p;
+        p.add("morphometry", -1);
+
+        po::variables_map vm;
+        po::store(po::command_line_parser(ac, av).
+                  options(desc).positional(p).run(), vm);
+        po::notify(vm);
+
+        if (vm.count("help") || !vm.count("morphometry")) {
+            cout << "Usage: gnr_gen_tree [options] morphometry\n";
+            cout << desc;
+            return 0;
+        }
+
+        tree_generator gen;
+        gen.readMorphometry(morph_arg);
+        gen.prune(order_remodeling, alpha, beta);
+        if (root_order == 0) {
+            root_order = gen.n_orders;
+        }
+
+        auto t_start = std::chrono::steady_clock::now();
+        gen.generate(root_order);
+        double gen_secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+
+        printf("%s %d %s %zu %s %zu %s %f %s\n", "Root order:", root_order, "segments:", gen.seg_parent.size(),
+               "elements:", gen.elem_parent_seg.size(), "generated in", gen_secs, "s");
+        for (int ord = 0; ord < gen.n_orders; ord++) {
+            printf("%s %d %s %.0f\n", "Order", ord + 1, "elements created:", gen.total_elements_created[ord]);
+        }
+        fflush(stdout);
+
+        gen.writeBinary(out_arg);
+        if (!text_arg.empty()) {
+            gen.writeText(text_arg);
+        }
+
+    }
+    catch(std::exception& e)
+    {
+        cout << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+
+}
@@ -5,6 +5,7 @@
 #include <fstream>
 #include <cstring>
 #include <cmath>
+#include <stdexcept>
 #include <string>
 #include <vector>
 #include <gsl/gsl_errno.h>
@@ -14,6 +15,10 @@
 
 #include "vessel.h"
 #include "functions.h"
+#include "output_writer.h"
+#include "output_spec.h"
+#include "load_schedule.h"
+#include "parareal.h"
 
 using std::string;
 using std::vector;
@@ -52,6 +57,20 @@ int main( int ac, char* av[] ) {
         int gnr_out_flag;
         int mech_infl_flag;
         int mech_exp_flag;
+        int async_out_flag;
+        int flush_steps;
+        double flush_secs;
+        int exact_out_flag;
+        int bin_out_flag;
+        string output_spec_file;
+        vector<string> output_lines;
+        string load_schedule_file;
+        string init_cache_dir;
+        int parareal_slabs;
+        int parareal_coarse;
+        double parareal_tol;
+        int parareal_max_iter;
+        int n_threads;
 
         po::options_description desc("Allowed options");
         desc.add_options()
@@ -74,6 +93,21 @@ int main( int ac, char* av[] ) {
             ("gnr_out_flag", po::value<int>(&gnr_out_flag)->default_value(1), "flag for outputting to GnR_out")
             ("mech_infl_flag", po::value<int>(&mech_infl_flag)->default_value(0), "flag for controlling mech-mediated infl.")
             ("mech_exp_flag", po::value<int>(&mech_exp_flag)->default_value(0), "flag for controlling mech exp")
+            ("async_out", po::value<int>(&async_out_flag)->default_value(0), "write outputs from a background thread")
+            ("flush_steps", po::value<int>(&flush_steps)->default_value(1), "async output: flush every N steps (0 = off)")
+            ("flush_secs", po::value<double>(&flush_secs)->default_value(0.0), "async output: flush every T seconds (0 = off)")
+            ("exact_out", po::value<int>(&exact_out_flag)->default_value(0), "async output: byte-identical text formatting")
+            ("bin_out", po::value<int>(&bin_out_flag)->default_value(0), "write outputs as binary tables (<file>.bin)")
+            ("init_cache", po::value<string>(&init_cache_dir), "directory of initialized vessel snapshots keyed by input hash")
+            ("load_schedule", po::value<string>(&load_schedule_file), "file of time-varying P, Q, T_act, lambda_z applied each step")
+            ("parareal", po::value<int>(&parareal_slabs)->default_value(0), "time slabs of a parareal run (0 = serial)")
+            ("parareal_coarse", po::value<int>(&parareal_coarse)->default_value(10), "parareal: fine steps per coarse step")
+            ("parareal_tol", po::value<double>(&parareal_tol)->default_value(1e-8), "parareal: relative radius and thickness tolerance")
+            ("parareal_max_iter", po::value<int>(&parareal_max_iter)->default_value(0), "parareal: most iterations (0 = up to the slabs)")
+            ("threads,t", po::value<int>(&n_threads)->default_value(0), "parareal: worker threads (0 = one per core)")
+            ("output_spec", po::value<string>(&output_spec_file), "file selecting output channels, one output per line")
+            ("output", po::value< vector<string> >(&output_lines)->composing(),
+                "output channel line, e.g. \"GnR_out every=10 days=30,90 : a h sigma rhoR_alpha:0-2\"")
         ;
 
         po::positional_options_description p;
@@ -87,9 +121,24 @@ int main( int ac, char* av[] ) {
         if (vm.count("help")) {
             cout << "Usage: options_description [options]\n";
             cout << desc;
+            cout << "Output quantities:";
+            vector<string> quantities = output_spec::quantities();
+            for (int i = 0; i < quantities.size(); i++) {
+                cout << " " << quantities[i];
+            }
+            cout << "\nDefault output: " << output_spec::default_native << "\n";
             return 0;
         }
 
+        //Selected output channels replace the fixed GnR_out/Exp_out columns
+        output_spec out_spec;
+        if (vm.count("output_spec")){
+            out_spec.read(output_spec_file);
+        }
+        for (int i = 0; i < output_lines.size(); i++){
+            out_spec.add(output_lines[i]);
+        }
+
         std::cout << "Restarting simulation: " << restart_arg << "\n";
         std::cout << "Filename suffix: " << name_arg << "\n";
 
@@ -97,7 +146,12 @@ int main( int ac, char* av[] ) {
         string native_file = "Native_in_" + name_arg;
 
         vessel native_vessel;
-        native_vessel.initializeNative(native_file,num_days,step_size);
+        if (vm.count("init_cache")){
+            native_vessel.initializeNativeCached(native_file,init_cache_dir,num_days,step_size);
+        }
+        else{
+            native_vessel.initializeNative(native_file,num_days,step_size);
+        }
 
         if (!vm.count("step")) {
             step_arg = int( num_days / step_size );
@@ -128,12 +182,29 @@ int main( int ac, char* av[] ) {
             std::cout << "Setting mech exp flag: " << mech_exp_flag << std::endl;
         }
 
+        //Time-varying loads, evaluated in-process at every step
+        load_schedule schedule;
+        if (vm.count("load_schedule")){
+            schedule.read(load_schedule_file);
+            native_vessel.schedule = &schedule;
+            std::cout << "Using load schedule: " << load_schedule_file << std::endl;
+        }
+
         //Setup all other output files
         native_vessel.gnr_name = native_vessel.gnr_name + "_" + name_arg;
         native_vessel.equil_gnr_name = native_vessel.equil_gnr_name + "_" + name_arg;
         native_vessel.exp_name = native_vessel.exp_name + "_" + name_arg;
         native_vessel.file_name = native_vessel.file_name + "_" + name_arg;
 
+        //Buffered (optionally asynchronous) output, always flushed at exit
+        output_writer out_writer(flush_steps, flush_secs, exact_out_flag, async_out_flag);
+        if (async_out_flag || bin_out_flag || !out_spec.empty()){
+            native_vessel.writer = &out_writer;
+        }
+        if (async_out_flag){
+            setvbuf(stdout, NULL, _IOFBF, 1 << 16);
+        }
+
         //------------------------------------------------------------------------
 
         //For elastin degradation 
@@ -171,13 +242,30 @@ int main( int ac, char* av[] ) {
         {
             std::cout << "Initializing new simulation..." << std::endl;
             //Setup file I/O for G&R output
-            native_vessel.GnR_out.open(native_vessel.gnr_name);
-            native_vessel.Equil_GnR_out.open(native_vessel.equil_gnr_name);
-            native_vessel.Exp_out.open(native_vessel.exp_name);
+            if (native_vessel.writer){
+                if (out_spec.empty()){
+                    native_vessel.gnr_stream = out_writer.open_stream(native_vessel.gnr_name, false, vessel::nativeOutputNames(), bin_out_flag);
+                    native_vessel.exp_stream = out_writer.open_stream(native_vessel.exp_name, false, vessel::expOutputNames(), bin_out_flag);
+                }
+                else{
+                    out_spec.open(native_vessel, out_writer, name_arg, bin_out_flag, false);
+                }
+                native_vessel.equil_gnr_stream = out_writer.open_stream(native_vessel.equil_gnr_name, false, vessel::nativeEquilibratedOutputNames(), bin_out_flag);
+            }
+            else{
+                native_vessel.GnR_out.open(native_vessel.gnr_name);
+                native_vessel.Equil_GnR_out.open(native_vessel.equil_gnr_name);
+                native_vessel.Exp_out.open(native_vessel.exp_name);
+            }
 
             //Write initial state to file
             int sn = 0;
-            native_vessel.printNativeOutputs();
+            if (out_spec.empty()){
+                native_vessel.printNativeOutputs();
+            }
+            else{
+                out_spec.record(native_vessel);
+            }
             //Simulate number of timesteps
             //native_vessel.nts = step_arg;
 
@@ -197,6 +285,33 @@ int main( int ac, char* av[] ) {
                 native_vessel.T_act = (1 + gamma_act) * native_vessel.T_act_h;
             }
 
+            //Time-parallel G&R, the rows written once the slabs have converged
+            if (gnr_arg && parareal_slabs > 0){
+                if (!out_spec.empty()){
+                    throw std::runtime_error("Parareal runs write the GnR_out rows only, without an output spec");
+                }
+                parareal para(n_threads);
+                para.n_slabs = parareal_slabs;
+                para.coarse_factor = parareal_coarse;
+                para.tol = parareal_tol;
+                para.max_iter = parareal_max_iter;
+                para.initialize(native_vessel, native_file, num_days, vm.count("init_cache") ? init_cache_dir : "");
+                para.run(native_vessel, std::min(step_arg,native_vessel.nts) - 1);
+                for (int k = 0; k < int(para.rows.size()) / vessel::n_native_outputs; k++){
+                    native_vessel.writeRow(native_vessel.GnR_out, native_vessel.gnr_stream,
+                                           &para.rows[k * vessel::n_native_outputs], vessel::n_native_outputs);
+                    out_writer.end_step();
+                }
+                printf("%s %d %s %e %s %d %s %d\n", "Parareal iterations:", para.iterations, "residual:", para.residual,
+                       "slabs:", para.n_slabs, "threads:", para.pool.size());
+                printf("%s %f %s %f %s %f %s %f\n", "Parareal seconds:", para.run_seconds, "serial fine:", para.fine_seconds,
+                       "coarse:", para.coarse_seconds, "speedup:", para.speedup);
+                printf("%s %f %s %f\n", "Parareal seconds with a thread per slab:", para.critical_seconds,
+                       "speedup:", para.slab_speedup);
+                fflush(stdout);
+                step_arg = 0; //Nothing left to step serially
+            }
+
             //Run the G&R time stepping
             for (int sn = 1; sn < std::min(step_arg,native_vessel.nts); sn++) {
                 
@@ -210,19 +325,7 @@ int main( int ac, char* av[] ) {
                     //     native_vessel.lambda_z_curr = native_vessel.lambda_z_h * (1 + gamma_lambda_z * (1 - exp(-(s - perturb_time) / 10))); // + gamma_lambda_z2 * (1 - exp(-(s  - perturb_time2) / 10)));
                     // }
 
-                    native_vessel.s = native_vessel.dt * sn;
-                    native_vessel.sn = sn;
-
-                    update_time_step(native_vessel);
-                    printf("%s \n", "---------------------------");
-                    fflush(stdout);
-
-                    //Store axial stretch history
-                    native_vessel.lambda_z_tau[sn] = native_vessel.lambda_z_curr;
-
-                    //Update previous loading state
-                    native_vessel.P_prev = native_vessel.P;
-                    native_vessel.T_act_prev = native_vessel.T_act;
+                    step_vessel(native_vessel, sn);
 
                 }
                 // else{
@@ -242,7 +345,13 @@ int main( int ac, char* av[] ) {
                 //}
 
                 //Write full model outputs
-               native_vessel.printNativeOutputs();
+                if (out_spec.empty()){
+                    native_vessel.printNativeOutputs();
+                }
+                else{
+                    out_spec.record(native_vessel);
+                }
+                out_writer.end_step();
             }
 
             //Long-term equilibrated solution
@@ -256,6 +365,10 @@ int main( int ac, char* av[] ) {
             
                 native_vessel.P = (1.0 + gamma_p) * native_vessel.P_h;
                 native_vessel.Q = (1.0 + gamma_q) * native_vessel.Q_h;
+                //Loads of a schedule at the last step in place of the constant ones
+                if (native_vessel.schedule != NULL){
+                    native_vessel.schedule->apply(native_vessel);
+                }
             
                 int equil_solve = find_equil_geom(&native_vessel);
                 native_vessel.printNativeEquilibratedOutputs();
@@ -273,8 +386,19 @@ int main( int ac, char* av[] ) {
         {
             std::cout << "Continuing simulation from file..." << std::endl;
             //Setup file I/O for G&R output
-            native_vessel.GnR_out.open(native_vessel.gnr_name, std::ofstream::out | std::ofstream::app);
-            native_vessel.Exp_out.open(native_vessel.exp_name, std::ofstream::out | std::ofstream::app);
+            if (native_vessel.writer){
+                if (out_spec.empty()){
+                    native_vessel.gnr_stream = out_writer.open_stream(native_vessel.gnr_name, true, vessel::nativeOutputNames(), bin_out_flag);
+                    native_vessel.exp_stream = out_writer.open_stream(native_vessel.exp_name, true, vessel::expOutputNames(), bin_out_flag);
+                }
+                else{
+                    out_spec.open(native_vessel, out_writer, name_arg, bin_out_flag, true);
+                }
+            }
+            else{
+                native_vessel.GnR_out.open(native_vessel.gnr_name, std::ofstream::out | std::ofstream::app);
+                native_vessel.Exp_out.open(native_vessel.exp_name, std::ofstream::out | std::ofstream::app);
+            }
 
             //Read vessel from file
             native_vessel.load();
@@ -302,7 +426,12 @@ int main( int ac, char* av[] ) {
             if (native_vessel.sn == 0){
                 //Write initial state to file
                 int sn = 0;
-                native_vessel.printNativeOutputs();
+                if (out_spec.empty()){
+                    native_vessel.printNativeOutputs();
+                }
+                else{
+                    out_spec.record(native_vessel);
+                }
             }
 
             if (!(vm.count("wss"))){
@@ -318,15 +447,7 @@ int main( int ac, char* av[] ) {
             for (int sn = csn; sn < std::min(csn+step_arg,native_vessel.nts); sn++) {
                 
                 if(gnr_arg){
-                    native_vessel.s = native_vessel.dt * sn;
-                    native_vessel.sn = sn;
-                    update_time_step(native_vessel);
-                    printf("%s \n", "---------------------------");
-                    fflush(stdout);
-                    //Store axial stretch history
-                    native_vessel.lambda_z_tau[sn] = native_vessel.lambda_z_curr;
-                    native_vessel.P_prev = native_vessel.P;
-                    native_vessel.T_act_prev = native_vessel.T_act;
+                    step_vessel(native_vessel, sn);
                 }
                 else{
 
@@ -344,12 +465,16 @@ int main( int ac, char* av[] ) {
                     //native_vessel.printExpOutputs();
                 //}
 
-                if (gnr_out_flag) {
+                if (!out_spec.empty()) {
+                    out_spec.record(native_vessel);
+                }
+                else if (gnr_out_flag) {
                     native_vessel.printNativeOutputs();
                 }
                 else{
                     native_vessel.printExpOutputs();
                 }
+                out_writer.end_step();
 
             }
 
@@ -373,6 +498,7 @@ int main( int ac, char* av[] ) {
         native_vessel.GnR_out.close();
         native_vessel.Equil_GnR_out.close();
         native_vessel.Exp_out.close();
+        out_writer.close();
 
     }
     catch(std::exception& e)
@@ -0,0 +1,297 @@
+//Models the G&R of the vessel orders of a pulmonary arterial tree in parallel
+#define _USE_MATH_DEFINES
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <gsl/gsl_errno.h>
+#include <gsl/gsl_vector.h>
+#include <gsl/gsl_roots.h>
+#include <gsl/gsl_multiroots.h>
+
+#include "vessel.h"
+#include "functions.h"
+#include "vessel_tree.h"
+#include "morphometric_tree.h"
+#include "load_schedule.h"
+
+using std::string;
+using std::vector;
+using std::cout;
+
+#include <boost/program_options.hpp>
+namespace po = boost::program_options;
+
+int main( int ac, char* av[] ) {
+
+    try{
+
+        string manifest_arg;
+        int step_arg;
+        double step_size;
+        int num_days;
+        int coupling_steps;
+        int n_threads;
+        int gnr_equil_arg;
+        int bin_out_flag;
+        string init_cache_dir;
+        string equil_map_dir;
+        string hemo_tree_file;
+        double Q_in;
+        double P_term;
+        string tree_schedule_file;
+        int hemo_dag_flag;
+        double hemo_tol;
+        int hemo_kernel_arg;
+        int hemo_newton_flag;
+        double resp_dP;
+        int equil_tree_flag;
+        double adapt_tol;
+        int coupling_max;
+        int extrapolate_flag;
+        int implicit_arg;
+        double implicit_tol;
+
+        po::options_description desc("Allowed options");
+        desc.add_options()
+            ("help,h", "produce help message")
+            ("manifest,f", po::value<string>(&manifest_arg), "tree manifest, one vessel per line")
+            ("step,s", po::value<int>(&step_arg), "number of timesteps to run simulation")
+            ("time step size,d", po::value<double>(&step_size)->default_value(1.0), "size of each time step in days")
+            ("max_days,m", po::value<int>(&num_days)->default_value(361), "maximum days to simulate")
+            ("coupling_steps,c", po::value<int>(&coupling_steps)->default_value(1), "time steps between coupling points")
+            ("threads,t", po::value<int>(&n_threads)->default_value(0), "worker threads (0 = one per core)")
+            ("simulate_equil", po::value<int>(&gnr_equil_arg)->default_value(1), "execute equilibrated simulation")
+            ("init_cache", po::value<string>(&init_cache_dir)->default_value(""), "directory of initialized vessel snapshots")
+            ("equil_maps", po::value<string>(&equil_map_dir)->default_value(""), "directory of equilibrated maps (gnr_equil_map) to start the equilibrated solutions from")
+            ("bin_out", po::value<int>(&bin_out_flag)->default_value(0), "write outputs as binary tables (<file>.bin)")
+            ("hemo_tree", po::value<string>(&hemo_tree_file)->default_value(""), "morphometric tree (text or gnr_gen_tree binary) for hemodynamic feedback")
+            ("Q_in", po::value<double>(&Q_in)->default_value(10.4 / 60 * 0.30), "tree inlet flow (ml/s)")
+            ("P_term", po::value<double>(&P_term)->default_value(4.8), "tree terminal pressure (mmHg)")
+            ("hemo_dag", po::value<int>(&hemo_dag_flag)->default_value(0), "solve the hemodynamic tree on its unique subtrees only")
+            ("hemo_tol", po::value<double>(&hemo_tol)->default_value(-1), "re-solve only orders whose radius changed by more than this (relative) and their ancestors (-1 = full solve)")
+            ("hemo_kernel", po::value<int>(&hemo_kernel_arg)->default_value(0), "tree viscosity: 0 scalar, 1 vectorized double, 2 vectorized float")
+            ("hemo_newton", po::value<int>(&hemo_newton_flag)->default_value(0), "couple the tree to distensible vessels by Newton's method on the order radii")
+            ("resp_dP", po::value<double>(&resp_dP)->default_value(0.05), "relative pressure spacing of the pressure-diameter tables for --hemo_newton")
+            ("equil_tree", po::value<int>(&equil_tree_flag)->default_value(0), "equilibrated solution of the vessels and the hemodynamic tree together")
+            ("adapt_tol", po::value<double>(&adapt_tol)->default_value(-1), "adapt the coupling interval to keep order radius and WSS changes per coupling below this (relative, -1 = fixed interval)")
+            ("coupling_max", po::value<int>(&coupling_max)->default_value(32), "largest adaptive coupling interval in time steps")
+            ("extrapolate", po::value<int>(&extrapolate_flag)->default_value(0), "extrapolate the tree loads linearly in time between couplings")
+            ("implicit", po::value<int>(&implicit_arg)->default_value(0), "couple every time step implicitly: 0 off, 1 Aitken, 2 IQN-ILS")
+            ("implicit_tol", po::value<double>(&implicit_tol)->default_value(1e-8), "relative radius tolerance of the implicit coupling")
+            ("tree_schedule", po::value<string>(&tree_schedule_file)->default_value(""), "load schedule of the tree inlet flow (Q) and terminal pressure (P)")
+        ;
+
+        po::positional_options_description p;
+        p.add("manifest", -1);
+
+        po::variables_map vm;
+        po::store(po::command_line_parser(ac, av).
+                  options(desc).positional(p).run(), vm);
+        po::notify(vm);
+
+        if (vm.count("help") || !vm.count("manifest")) {
+            cout << "Usage: gnr_tree [options] manifest\n";
+            cout << desc;
+            return 0;
+        }
+        if (coupling_steps < 1) {
+            coupling_steps = 1;
+        }
+
+        vessel_tree tree(n_threads);
+        tree.readManifest(manifest_arg);
+        std::cout << "Vessels in tree: " << tree.n_vessels << " on " << tree.pool.size() << " threads" << std::endl;
+
+        tree.initialize(num_days, step_size, init_cache_dir);
+        if (!equil_map_dir.empty()) {
+            int n_maps = tree.readEquilMaps(equil_map_dir, num_days, step_size);
+            std::cout << "Equilibrated maps: " << n_maps << " of " << tree.n_vessels << " vessels" << std::endl;
+        }
+        int nts = tree.vessels[0].nts;
+        if (!vm.count("step")) {
+            step_arg = int( num_days / step_size );
+        }
+        std::cout << "Steps to simulate: " << step_arg << "\n";
+
+        tree.openOutputs(bin_out_flag);
+
+        //Hemodynamic feedback replaces the manifest gamma_p/gamma_q
+        morphometric_tree hemo_tree;
+        load_schedule tree_schedule;
+        std::ofstream Hemo_out;
+        bool hemo_flag = !hemo_tree_file.empty();
+        if (hemo_flag) {
+            hemo_tree.read(hemo_tree_file);
+            hemo_tree.visc_kernel = hemo_kernel_arg;
+            tree.resp_dP = resp_dP;
+            tree.extrapolate_loads = extrapolate_flag && !implicit_arg;
+            tree.implicit_method = implicit_arg;
+            tree.implicit_tol = implicit_tol;
+            if (implicit_arg && hemo_newton_flag) {
+                throw std::runtime_error("--implicit and --hemo_newton cannot be used together");
+            }
+            if (!tree_schedule_file.empty()) {
+                tree_schedule.read(tree_schedule_file);
+            }
+            std::cout << "Hemodynamic tree segments: " << hemo_tree.n_seg << "\n";
+            if (hemo_dag_flag) {
+                hemo_tree.compress(true, std::max(hemo_tol, 0.0));
+                std::cout << "Unique subtrees: " << hemo_tree.dag.n_classes << "\n";
+            }
+            else if (hemo_tol >= 0) {
+                hemo_tree.compress(false, hemo_tol);
+            }
+            tree.setHemodynamicBaseline(hemo_tree, Q_in, P_term);
+            Hemo_out.open("Hemo_out");
+        }
+
+        //Write initial state to file
+        tree.printOutputs();
+        tree.setLoads();
+
+        //Tree order means at time s
+        auto write_hemo = [&](double s) {
+            Hemo_out << s;
+            vector<double>* hemo_cols[4] = { &hemo_tree.P_order_mean, &hemo_tree.Q_order_mean,
+                                             &hemo_tree.WSS_order_mean, &hemo_tree.Sigma_order_mean };
+            for (int k = 0; k < 4; k++) {
+                for (int o = 0; o < hemo_tree.n_orders; o++) {
+                    Hemo_out << "\t" << (*hemo_cols[k])[o];
+                }
+            }
+            Hemo_out << "\n";
+        };
+
+        //Solves the tree for the current geometry and loads, setting the vessel loads
+        auto couple = [&]() {
+            double s = tree.steps() * step_size;
+            double Q_s = (1 + tree_schedule.gamma("Q", s)) * Q_in;
+            double P_s = (1 + tree_schedule.gamma("P", s)) * P_term;
+            if (hemo_newton_flag) {
+                tree.coupleDistensible(hemo_tree, Q_s, P_s);
+                printf("%s %d %s %e\n", "Hemodynamic Newton iterations:", tree.newton_iter, "residual:", tree.newton_residual);
+            }
+            else {
+                tree.coupleHemodynamics(hemo_tree, Q_s, P_s);
+            }
+            write_hemo(s);
+        };
+        if (hemo_flag) {
+            couple();
+        }
+
+        //Adaptive coupling: the interval is halved when an order's radius or mean WSS
+        //changed by more than adapt_tol since the last coupling and doubled when all
+        //changed by less than a quarter of it. The schedule is logged to Coupling_out.
+        bool implicit_flag = hemo_flag && implicit_arg;
+        bool adapt_flag = hemo_flag && adapt_tol > 0 && !implicit_flag;
+        int interval = coupling_steps;
+        vector<double> a_coupled, wss_coupled;
+        std::ofstream Coupling_out;
+        auto store_coupled = [&]() {
+            a_coupled.resize(tree.n_vessels);
+            for (int i = 0; i < tree.n_vessels; i++) {
+                a_coupled[i] = tree.vessels[i].a[tree.vessels[i].sn];
+            }
+            wss_coupled = hemo_tree.WSS_order_mean;
+        };
+        if (adapt_flag) {
+            store_coupled();
+            Coupling_out.open("Coupling_out");
+        }
+
+        //Run the G&R time stepping, synchronizing all vessels at each coupling point
+        int sn_end = std::min(step_arg, nts) - 1;
+        while (tree.steps() < sn_end) {
+            //Implicit coupling: the tree loads of each step are those of its own end state
+            if (implicit_flag) {
+                double s = (tree.steps() + 1) * step_size;
+                tree.stepImplicit(hemo_tree, (1 + tree_schedule.gamma("Q", s)) * Q_in,
+                                  (1 + tree_schedule.gamma("P", s)) * P_term);
+                printf("%s %f %s %d %s %e\n", "Coupling time:", s, "implicit passes:", tree.implicit_iter,
+                       "residual:", tree.implicit_residual);
+                write_hemo(s);
+                fflush(stdout);
+                continue;
+            }
+
+            int n_steps = std::min(interval, sn_end - tree.steps());
+            tree.advance(n_steps);
+
+            //Coupling point: every vessel is at the same time step
+            printf("%s %f\n", "Coupling time:", tree.steps() * step_size);
+            if (hemo_flag) {
+                couple();
+                if (hemo_tree.compressed) {
+                    printf("%s %d %s %d\n", "Hemodynamic subtrees re-solved:", hemo_tree.dag.n_updated, "of", hemo_tree.dag.n_classes);
+                }
+            }
+            if (adapt_flag) {
+                double change_a = 0.0, change_wss = 0.0;
+                for (int i = 0; i < tree.n_vessels; i++) {
+                    double a_now = tree.vessels[i].a[tree.vessels[i].sn];
+                    change_a = std::max(change_a, fabs(a_now / a_coupled[i] - 1));
+                    change_wss = std::max(change_wss, fabs(hemo_tree.WSS_order_mean[i] / wss_coupled[i] - 1));
+                }
+                double change = std::max(change_a, change_wss);
+                if (change > adapt_tol) {
+                    interval = std::max(1, interval / 2);
+                }
+                else if (change < adapt_tol / 4) {
+                    interval = std::min(coupling_max, 2 * interval);
+                }
+                Coupling_out << tree.steps() * step_size << "\t" << n_steps << "\t" << change_a << "\t"
+                             << change_wss << "\t" << interval << "\n";
+                printf("%s %d\n", "Coupling interval:", interval);
+                store_coupled();
+            }
+            fflush(stdout);
+        }
+        Coupling_out.close();
+
+        //Long-term equilibrated solution
+        if (gnr_equil_arg && hemo_flag && equil_tree_flag) {
+            double s = tree.steps() * step_size;
+            tree.solveEquilibratedTree(hemo_tree, (1 + tree_schedule.gamma("Q", s)) * Q_in,
+                                       (1 + tree_schedule.gamma("P", s)) * P_term);
+            printf("%s %d %s %d %s %e\n", "Equilibrated tree iterations:", tree.equil_iter, "decoupled passes:", tree.equil_passes,
+                   "residual:", tree.equil_residual);
+        }
+        else if (gnr_equil_arg) {
+            tree.solveEquilibrated();
+        }
+        if (gnr_equil_arg && !equil_map_dir.empty()) {
+            printf("%s %d\n", "Orders from equilibrated maps:", tree.equil_map_hits);
+        }
+        if (gnr_equil_arg) {
+            for (int i = 0; i < tree.n_vessels; i++) {
+                printf("%s %s %s %e %s %e %s %f\n", "Vessel:", tree.names[i].c_str(), "a_e: ", tree.vessels[i].a_e,
+                       "h_e:", tree.vessels[i].h_e, "mb_equil:", tree.vessels[i].mb_equil_e);
+            }
+            fflush(stdout);
+        }
+
+        //Print vessels to file
+        for (int i = 0; i < tree.n_vessels; i++) {
+            tree.vessels[i].save();
+        }
+
+        tree.closeOutputs();
+        Hemo_out.close();
+
+    }
+    catch(std::exception& e)
+    {
+        cout << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+
+}
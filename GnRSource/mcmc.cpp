@@ -0,0 +1,313 @@
+// mcmc.cpp
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "vessel.h"
+#include "gnr_binary.h"
+#include "calibration.h"
+#include "mcmc.h"
+
+using std::string;
+using std::vector;
+
+mcmc_sampler::mcmc_sampler(calibration& cal_inp) : cal(cal_inp) {
+    n_walkers = 0;
+    stretch = 2.0;
+    init_scale = 1e-2;
+    seed = 1;
+    checkpoint_every = 10;
+    burn = 0;
+    iteration = 0;
+    chain_rows = 0;
+}
+
+double mcmc_sampler::logPosterior(const double* x) {
+    int p = cal.n_fit;
+    for (int i = 0; i < p; i++) {
+        double value_i = cal.log_flag[i] ? exp(x[i]) : x[i];
+        if (!(value_i >= cal.low[i] && value_i <= cal.high[i])) {
+            return -HUGE_VAL;
+        }
+    }
+    vector<double> r(cal.n_data);
+    if (!cal.residuals(x, &r[0])) {
+        return -HUGE_VAL;
+    }
+    double chisq = 0.0;
+    for (int k = 0; k < cal.n_data; k++) {
+        chisq += r[k] * r[k];
+    }
+    return -chisq / 2;
+}
+
+//Columns of the chain table
+static vector<string> chain_columns(const calibration& cal) {
+    vector<string> cols = { "iteration", "walker", "log_post" };
+    cols.insert(cols.end(), cal.params.begin(), cal.params.begin() + cal.n_fit);
+    return cols;
+}
+
+void mcmc_sampler::start(string out_prefix) {
+    int p = cal.n_fit;
+    if (p == 0) {
+        throw std::runtime_error("No parameters to sample");
+    }
+    if (n_walkers == 0) {
+        n_walkers = 2 * p + 2;
+    }
+    if (n_walkers % 2 != 0 || n_walkers < 2 * p) {
+        throw std::runtime_error("Number of walkers must be even and at least twice the fitted parameters");
+    }
+
+    rng.resize(n_walkers);
+    for (int w = 0; w < n_walkers; w++) {
+        std::seed_seq stream_seed = { (unsigned long) seed, (unsigned long) w };
+        rng[w].seed(stream_seed);
+    }
+
+    //Walkers scattered around the initial values, within the prior
+    vector<double> x_0(p);
+    for (int i = 0; i < p; i++) {
+        x_0[i] = cal.log_flag[i] ? log(cal.value[i]) : cal.value[i];
+    }
+    walkers.assign(n_walkers * p, 0.0);
+    log_post.assign(n_walkers, -HUGE_VAL);
+    n_accepted.assign(n_walkers, 0);
+    cal.pool.run(n_walkers, [&](int w) {
+        std::normal_distribution<double> normal(0.0, 1.0);
+        for (int attempt = 0; attempt < 100 && !std::isfinite(log_post[w]); attempt++) {
+            for (int i = 0; i < p; i++) {
+                walkers[w * p + i] = x_0[i] + init_scale * std::max(fabs(x_0[i]), 1.0) * normal(rng[w]);
+            }
+            log_post[w] = logPosterior(&walkers[w * p]);
+        }
+        if (!std::isfinite(log_post[w])) {
+            throw std::runtime_error("No initial walker with a finite posterior near the initial values");
+        }
+    });
+
+    iteration = 0;
+    binary_table_writer chain;
+    chain.open(out_prefix + "_chain.bin", chain_columns(cal), false);
+    chain_rows = chain.n_rows;
+    chain.close();
+    checkpoint(out_prefix);
+}
+
+void mcmc_sampler::checkpoint(string out_prefix) {
+    //Written to a temporary file and renamed, so a checkpoint is never partly written
+    int p = cal.n_fit;
+    string state_file = out_prefix + "_mcmc_state";
+    std::ofstream state_out(state_file + ".tmp");
+    state_out.precision(17);
+    state_out << "#mcmc_sampler state\n";
+    state_out << "iteration " << iteration << "\n";
+    state_out << "chain_rows " << chain_rows << "\n";
+    state_out << "walkers " << n_walkers << " " << p << "\n";
+    state_out << "params";
+    for (int i = 0; i < p; i++) {
+        state_out << " " << cal.params[i] << " " << cal.log_flag[i];
+    }
+    state_out << "\n";
+    for (int w = 0; w < n_walkers; w++) {
+        state_out << "walker " << w << " " << n_accepted[w] << " " << log_post[w];
+        for (int i = 0; i < p; i++) {
+            state_out << " " << walkers[w * p + i];
+        }
+        state_out << "\n";
+        state_out << "rng " << w << " " << rng[w] << "\n";
+    }
+    state_out.close();
+    if (!state_out || std::rename((state_file + ".tmp").c_str(), state_file.c_str()) != 0) {
+        throw std::runtime_error("Could not write " + state_file);
+    }
+}
+
+void mcmc_sampler::resume(string out_prefix) {
+    int p = cal.n_fit;
+    string state_file = out_prefix + "_mcmc_state";
+    std::ifstream state_in(state_file);
+    if (!state_in) {
+        throw std::runtime_error("Could not open " + state_file);
+    }
+
+    string line;
+    int n_read = 0;
+    while (std::getline(state_in, line)) {
+        std::istringstream ss(line);
+        string key;
+        if (!(ss >> key) || key[0] == '#') {
+            continue;
+        }
+        bool ok = true;
+        if (key == "iteration") {
+            ok = bool(ss >> iteration);
+        }
+        else if (key == "chain_rows") {
+            ok = bool(ss >> chain_rows);
+        }
+        else if (key == "walkers") {
+            int p_state = 0;
+            ok = bool(ss >> n_walkers >> p_state);
+            if (ok && p_state != p) {
+                throw std::runtime_error("Checkpoint " + state_file + " has different fitted parameters");
+            }
+            walkers.assign(n_walkers * p, 0.0);
+            log_post.assign(n_walkers, -HUGE_VAL);
+            n_accepted.assign(n_walkers, 0);
+            rng.resize(n_walkers);
+        }
+        else if (key == "params") {
+            for (int i = 0; i < p; i++) {
+                string name;
+                int log_i = 0;
+                ok = ok && bool(ss >> name >> log_i);
+                if (ok && (name != cal.params[i] || log_i != cal.log_flag[i])) {
+                    throw std::runtime_error("Checkpoint " + state_file + " has different fitted parameters");
+                }
+            }
+        }
+        else if (key == "walker" || key == "rng") {
+            int w = -1;
+            ok = bool(ss >> w) && w >= 0 && w < n_walkers;
+            if (ok && key == "walker") {
+                ok = bool(ss >> n_accepted[w] >> log_post[w]);
+                for (int i = 0; i < p && ok; i++) {
+                    ok = bool(ss >> walkers[w * p + i]);
+                }
+                n_read++;
+            }
+            else if (ok) {
+                ok = bool(ss >> rng[w]);
+            }
+        }
+        if (!ok) {
+            throw std::runtime_error("Bad line in checkpoint " + state_file + ": " + line);
+        }
+    }
+    if (n_walkers == 0 || n_read != n_walkers) {
+        throw std::runtime_error("Incomplete checkpoint " + state_file);
+    }
+
+    //Rows written after the checkpoint are run again
+    binary_table_writer chain;
+    chain.open(out_prefix + "_chain.bin", chain_columns(cal), true);
+    chain.truncate(chain_rows);
+    chain.close();
+    printf("%s %ld %s %d %s\n", "Resuming at iteration", iteration, "with", n_walkers, "walkers");
+    fflush(stdout);
+}
+
+void mcmc_sampler::run(long n_iterations, string out_prefix) {
+    int p = cal.n_fit;
+    int n_half = n_walkers / 2;
+    binary_table_writer chain;
+    chain.open(out_prefix + "_chain.bin", chain_columns(cal), true);
+    vector<double> row(3 + p);
+
+    for (long it = 0; it < n_iterations; it++) {
+        iteration++;
+        long accepted = 0;
+        for (int half = 0; half < 2; half++) {
+            vector<int> accept(n_half, 0);
+            cal.pool.run(n_half, [&](int j) {
+                int w = half * n_half + j;
+                std::uniform_real_distribution<double> uniform(0.0, 1.0);
+                int k = (1 - half) * n_half + std::min(int(uniform(rng[w]) * n_half), n_half - 1);
+                double z = pow((stretch - 1) * uniform(rng[w]) + 1, 2) / stretch;
+                double u = uniform(rng[w]);
+
+                vector<double> y(p);
+                for (int i = 0; i < p; i++) {
+                    y[i] = walkers[k * p + i] + z * (walkers[w * p + i] - walkers[k * p + i]);
+                }
+                //A failed run (-HUGE_VAL) is rejected outright
+                double log_post_y = logPosterior(&y[0]);
+                if (std::isfinite(log_post_y) && log(u) < (p - 1) * log(z) + log_post_y - log_post[w]) {
+                    std::copy(y.begin(), y.end(), walkers.begin() + w * p);
+                    log_post[w] = log_post_y;
+                    accept[j] = 1;
+                }
+            });
+            for (int j = 0; j < n_half; j++) {
+                n_accepted[half * n_half + j] += accept[j];
+                accepted += accept[j];
+            }
+        }
+
+        for (int w = 0; w < n_walkers; w++) {
+            row[0] = double(iteration);
+            row[1] = double(w);
+            row[2] = log_post[w];
+            for (int i = 0; i < p; i++) {
+                row[3 + i] = cal.log_flag[i] ? exp(walkers[w * p + i]) : walkers[w * p + i];
+            }
+            chain.write_row(&row[0]);
+        }
+        double best = *std::max_element(log_post.begin(), log_post.end());
+        printf("%s %ld %s %f %s %e %s %ld\n", "Iteration:", iteration, "acceptance:", double(accepted) / n_walkers,
+               "max log_post:", best, "runs:", long(cal.n_evals));
+        fflush(stdout);
+
+        if (iteration % checkpoint_every == 0 || it == n_iterations - 1) {
+            chain.write_index();
+            chain_rows = chain.n_rows;
+            checkpoint(out_prefix);
+        }
+    }
+    chain.close();
+    summarize(out_prefix);
+}
+
+void mcmc_sampler::summarize(string out_prefix) {
+    int p = cal.n_fit;
+    binary_table_reader chain;
+    chain.open(out_prefix + "_chain.bin");
+    vector<vector<double>> samples(p);
+    vector<double> row(chain.n_cols);
+    for (uint64_t j = 0; j < chain.n_rows; j++) {
+        chain.read_row(j, &row[0]);
+        if (row[0] > burn) {
+            for (int i = 0; i < p; i++) {
+                samples[i].push_back(row[3 + i]);
+            }
+        }
+    }
+    chain.close();
+
+    long total_accepted = 0;
+    for (int w = 0; w < n_walkers; w++) {
+        total_accepted += n_accepted[w];
+    }
+    printf("%s %ld %s %f %s %ld %s %ld %s %ld\n", "Iterations:", iteration, "acceptance:",
+           iteration > 0 ? double(total_accepted) / (double(iteration) * n_walkers) : 0.0,
+           "runs:", long(cal.n_evals), "failed runs:", long(cal.n_failed), "steady runs:", long(cal.n_steady));
+
+    std::ofstream posterior_out(out_prefix + "_posterior");
+    posterior_out << "#parameter\tmean\tsd\tq2.5\tq50\tq97.5\tsamples\n";
+    for (int i = 0; i < p; i++) {
+        vector<double>& x = samples[i];
+        int n = int(x.size());
+        double mean = 0.0, var = 0.0;
+        for (int j = 0; j < n; j++) {
+            mean += x[j] / n;
+        }
+        for (int j = 0; j < n; j++) {
+            var += (x[j] - mean) * (x[j] - mean) / std::max(n - 1, 1);
+        }
+        std::sort(x.begin(), x.end());
+        auto quantile = [&](double q) { return n > 0 ? x[std::min(int(q * n), n - 1)] : 0.0; };
+        posterior_out << cal.params[i] << "\t" << mean << "\t" << sqrt(var) << "\t" << quantile(0.025) << "\t"
+                      << quantile(0.5) << "\t" << quantile(0.975) << "\t" << n << "\n";
+        printf("%s %s %e %s %e\n", "Posterior:", cal.params[i].c_str(), mean, "sd:", sqrt(var));
+    }
+    posterior_out.close();
+}
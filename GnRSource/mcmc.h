@@ -0,0 +1,62 @@
+// mcmc.h
+#ifndef MCMC
+#define MCMC
+
+#include <random>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+class calibration;
+
+//Posterior samples of the fitted parameters of a calibration (calibration.h) by the
+//affine-invariant ensemble sampler (stretch move, Goodman and Weare 2010). The likelihood
+//is Gaussian in the residuals, log L = -chisq / 2, one G&R run per evaluation from the
+//calibration's base vessel (from the init cache if set); the prior is uniform in the
+//fitted values (log-uniform for log parameters) within the bounds of the parameter file.
+//A run that fails, by an exception or a GSL error (gnr_fit makes these throw), has a log
+//posterior of -HUGE_VAL and its move is rejected.
+//
+//The walkers are split in two halves that are moved in turn, each walker of a half
+//against one of the other, so a half runs in parallel. Every walker has its own random
+//stream, and the chain does not depend on the number of threads.
+//
+//The chain goes to <prefix>_chain.bin (iteration, walker, log_post and the parameter
+//values). The walkers, their log posteriors and random streams are checkpointed to
+//<prefix>_mcmc_state every checkpoint_every iterations and at the end, so a run can be
+//resumed; the rows of the chain after the last checkpoint are then dropped. The posterior
+//mean, sd and quantiles of the rows after burn iterations go to <prefix>_posterior.
+class mcmc_sampler {
+public:
+    mcmc_sampler(calibration& cal_inp);
+
+    //Walkers scattered around the initial values, or from the checkpoint of out_prefix
+    void start(string out_prefix);
+    void resume(string out_prefix);
+    void run(long n_iterations, string out_prefix);
+    double logPosterior(const double* x); //of fitted values (log for log parameters)
+
+    calibration& cal;
+    int n_walkers; //even, at least 2 * n_fit; 0 for 2 * n_fit + 2
+    double stretch; //scale a of the stretch move
+    double init_scale; //spread of the initial walkers in the fitted values
+    unsigned long seed;
+    long checkpoint_every;
+    long burn;
+
+    //Sampler state
+    long iteration;
+    vector<double> walkers; //[w * n_fit + i] fitted values
+    vector<double> log_post;
+    vector<std::mt19937_64> rng;
+    vector<long> n_accepted; //per walker
+    unsigned long long chain_rows; //rows of the chain at the checkpoint
+
+private:
+    void checkpoint(string out_prefix);
+    void summarize(string out_prefix);
+};
+
+#endif /* MCMC */
@@ -0,0 +1,371 @@
+// morphometric_tree.cpp
+#define _USE_MATH_DEFINES
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "morphometric_tree.h"
+#include "tree_generator.h"
+#include "viscosity_kernel.h"
+
+using std::string;
+using std::vector;
+
+morphometric_tree::morphometric_tree() {
+    n_seg = 0;
+    n_orders = 0;
+    plasma_viscosity = 0.0124; //Poise
+    visc_kernel = 0;
+    compressed = false;
+}
+
+static int child_index(int c) {
+    //seg_connectivity child code to 0-based index or segment code
+    if (c == 0) {
+        return seg_terminal;
+    }
+    else if (c < 0) {
+        return seg_unconnected;
+    }
+    return c - 1;
+}
+
+void morphometric_tree::readText(string file_name) {
+    std::ifstream tree_in(file_name);
+    if (!tree_in) {
+        throw std::runtime_error("Could not open morphometric tree " + file_name);
+    }
+
+    //Skip comment lines
+    while (tree_in.peek() == '#') {
+        tree_in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+    tree_in >> n_seg >> n_orders;
+    if (!tree_in || n_seg < 1 || n_orders < 1) {
+        throw std::runtime_error("Bad morphometric tree header in " + file_name);
+    }
+
+    parent.resize(n_seg);
+    left.resize(n_seg);
+    right.resize(n_seg);
+    order.resize(n_seg);
+    radius.resize(n_seg);
+    length.resize(n_seg);
+    for (int i = 0; i < n_seg; i++) {
+        int p, l, r;
+        tree_in >> p >> l >> r >> radius[i] >> length[i] >> order[i];
+        parent[i] = p - 1;
+        left[i] = child_index(l);
+        right[i] = child_index(r);
+    }
+    if (!tree_in) {
+        throw std::runtime_error("Morphometric tree file ended early: " + file_name);
+    }
+    checkTopology();
+}
+
+template <typename T>
+static bool read_array(FILE* f, vector<T>& vals, size_t n) {
+    vals.resize(n);
+    return fread(vals.data(), sizeof(T), n, f) == n;
+}
+
+void morphometric_tree::readBinary(string file_name) {
+    FILE* tree_in = fopen(file_name.c_str(), "rb");
+    if (tree_in == NULL) {
+        throw std::runtime_error("Could not open morphometric tree " + file_name);
+    }
+
+    char magic[8];
+    uint32_t header[4];
+    if (fread(magic, 1, 8, tree_in) != 8 || memcmp(magic, gnr_tree_magic, 8) != 0 ||
+        fread(header, sizeof(uint32_t), 4, tree_in) != 4) {
+        fclose(tree_in);
+        throw std::runtime_error("Not a binary morphometric tree: " + file_name);
+    }
+    n_seg = int(header[0]);
+    n_orders = int(header[3]); //orders present, up to the root order
+
+    vector<int32_t> p, l, r;
+    vector<float> radius_f, length_f;
+    vector<uint8_t> order_u;
+    bool ok = read_array(tree_in, p, n_seg) && read_array(tree_in, l, n_seg) && read_array(tree_in, r, n_seg) &&
+              read_array(tree_in, radius_f, n_seg) && read_array(tree_in, length_f, n_seg) &&
+              read_array(tree_in, order_u, n_seg);
+    fclose(tree_in);
+    if (!ok || n_seg < 1) {
+        throw std::runtime_error("Morphometric tree file ended early: " + file_name);
+    }
+
+    parent.resize(n_seg);
+    left.resize(n_seg);
+    right.resize(n_seg);
+    order.resize(n_seg);
+    radius.resize(n_seg);
+    length.resize(n_seg);
+    for (int i = 0; i < n_seg; i++) {
+        parent[i] = p[i] - 1;
+        left[i] = child_index(l[i]);
+        right[i] = child_index(r[i]);
+        order[i] = order_u[i];
+        radius[i] = radius_f[i];
+        length[i] = length_f[i];
+    }
+    checkTopology();
+}
+
+void morphometric_tree::read(string file_name) {
+    char magic[8] = { 0 };
+    FILE* tree_in = fopen(file_name.c_str(), "rb");
+    if (tree_in == NULL) {
+        throw std::runtime_error("Could not open morphometric tree " + file_name);
+    }
+    size_t n_read = fread(magic, 1, 8, tree_in);
+    fclose(tree_in);
+
+    if (n_read == 8 && memcmp(magic, gnr_tree_magic, 8) == 0) {
+        readBinary(file_name);
+    }
+    else {
+        readText(file_name);
+    }
+}
+
+void morphometric_tree::checkTopology() {
+    for (int i = 0; i < n_seg; i++) {
+        if ((left[i] >= 0 && (left[i] <= i || left[i] >= n_seg)) || (right[i] >= 0 && (right[i] <= i || right[i] >= n_seg)) ||
+            order[i] < 1 || order[i] > n_orders) {
+            throw std::runtime_error("Morphometric tree segments must be numbered parents before children");
+        }
+    }
+    thickness.assign(n_orders, 0.0);
+}
+
+double morphometric_tree::rel_viscosity(double d) {
+    //Pries et al Resistance to blood flow in microvessel in vivo, as rel_viscosity in the MATLAB code
+    return rel_viscosity_ref(d, visc_tree);
+}
+
+void morphometric_tree::viscosity(const vector<double>& radius_inp, vector<double>& viscosity_out) const {
+    size_t n = radius_inp.size();
+    viscosity_out.resize(n);
+    if (visc_kernel == 1) {
+        hemo_kernel(radius_inp.data(), NULL, NULL, plasma_viscosity, viscosity_out.data(), NULL, NULL, n, visc_tree);
+    }
+    else if (visc_kernel == 2) {
+        vector<float> radius_f(radius_inp.begin(), radius_inp.end()), viscosity_f(n);
+        hemo_kernel(radius_f.data(), NULL, NULL, float(plasma_viscosity), viscosity_f.data(), NULL, NULL, n, visc_tree);
+        std::copy(viscosity_f.begin(), viscosity_f.end(), viscosity_out.begin());
+    }
+    else {
+        for (size_t i = 0; i < n; i++) {
+            viscosity_out[i] = rel_viscosity(radius_inp[i] * 2 * 10000) * plasma_viscosity; //convert to micron
+        }
+    }
+}
+
+void morphometric_tree::setOrderGeometry(const vector<double>& diameter, const vector<double>& thickness_inp) {
+    //Every segment of an order takes that order's diameter (cm), as find_opt_morphometric_tree with gen = 0
+    order_radius.resize(n_orders);
+    for (int o = 0; o < n_orders; o++) {
+        order_radius[o] = diameter[o] / 2;
+    }
+    if (!compressed) {
+        for (int i = 0; i < n_seg; i++) {
+            radius[i] = order_radius[order[i] - 1];
+        }
+    }
+    thickness = thickness_inp;
+}
+
+void morphometric_tree::compress(bool share_subtrees, double radius_tol) {
+    dag.build(n_seg, n_orders, parent, left, right, order, length, share_subtrees);
+    dag.radius_tol = radius_tol;
+    compressed = true;
+
+    //Release the per segment storage
+    vector<int>().swap(parent);
+    vector<int>().swap(left);
+    vector<int>().swap(right);
+    vector<int>().swap(order);
+    vector<double>().swap(radius);
+    vector<double>().swap(length);
+}
+
+void morphometric_tree::computeResistance() {
+    if (compressed) {
+        vector<double> viscosity_order;
+        viscosity(order_radius, viscosity_order);
+        dag.update(order_radius, viscosity_order);
+        return;
+    }
+
+    //Viscosity of every segment at once, kept for the WSS in solve
+    input_resistance.assign(n_seg, 0.0);
+    r_seg.assign(n_seg, 0.0);
+    viscosity(radius, viscosity_seg);
+    for (int i = 0; i < n_seg; i++) {
+        r_seg[i] = 8 * viscosity_seg[i] * length[i] / (M_PI * pow(radius[i], 4));
+    }
+
+    for (int i = n_seg - 1; i >= 0; i--) {
+        if (left[i] == seg_terminal && right[i] == seg_terminal) {
+            input_resistance[i] = r_seg[i];
+        }
+        else if (left[i] == seg_unconnected && right[i] != seg_unconnected) {
+            //One child missing, treat as a serial circuit
+            input_resistance[i] = r_seg[i] + (right[i] >= 0 ? input_resistance[right[i]] : 0.0);
+        }
+        else if (right[i] == seg_unconnected && left[i] != seg_unconnected) {
+            input_resistance[i] = r_seg[i] + (left[i] >= 0 ? input_resistance[left[i]] : 0.0);
+        }
+        else if (left[i] >= 0 && right[i] >= 0) {
+            input_resistance[i] = r_seg[i] + 1 / (1 / input_resistance[left[i]] + 1 / input_resistance[right[i]]);
+        }
+    }
+}
+
+void morphometric_tree::solve(double Q_in, double P_term) {
+    if (compressed) {
+        vector<double> n, sum, sum_sq;
+        dag.orderSums(Q_in, P_term * 133.33 * 10, thickness, n, sum, sum_sq);
+        sumsToOrders(n, sum, sum_sq);
+        return;
+    }
+
+    Q_seg.assign(n_seg, 0.0);
+    WSS_seg.assign(n_seg, 0.0);
+    dP_seg.assign(n_seg, 0.0);
+    P_up.assign(n_seg, 0.0);
+    P_down.assign(n_seg, 0.0);
+    Sigma_seg.assign(n_seg, 0.0);
+
+    //Split flow by downstream resistance from the root down
+    Q_seg[0] = Q_in;
+    WSS_seg[0] = 4 * viscosity_seg[0] * Q_in / (M_PI * pow(radius[0], 3));
+    dP_seg[0] = Q_seg[0] * r_seg[0];
+
+    for (int j = 0; j < n_seg; j++) {
+        if (left[j] >= 0 && right[j] >= 0) {
+            int ind_l = left[j], ind_r = right[j];
+            double rl = input_resistance[ind_l], rr = input_resistance[ind_r];
+
+            //Note: Uses full downstream resistance from other child
+            Q_seg[ind_l] = Q_seg[j] * rr / (rl + rr);
+            Q_seg[ind_r] = Q_seg[j] * rl / (rl + rr);
+
+            int ind[2] = { ind_l, ind_r };
+            for (int k = 0; k < 2; k++) {
+                int c = ind[k];
+                WSS_seg[c] = 4 * viscosity_seg[c] * Q_seg[c] / (M_PI * pow(radius[c], 3));
+                dP_seg[c] = Q_seg[c] * r_seg[c];
+            }
+        }
+    }
+
+    //Go from the last terminal segment to the root to find the root pressure
+    P_down[n_seg - 1] = P_term * 133.33 * 10; //dynes / cm^2
+    int seg = n_seg - 1;
+    while (seg > 0) {
+        int par_seg = parent[seg];
+        P_up[seg] = P_down[seg] + dP_seg[seg];
+        P_down[par_seg] = P_up[seg];
+        seg = par_seg;
+    }
+    P_up[seg] = P_down[seg] + dP_seg[seg];
+
+    //Go down the tree again and find pressures and wall stress from the root pressure
+    for (int j = 0; j < n_seg; j++) {
+        if (left[j] >= 0 && right[j] >= 0) {
+            int ind[2] = { left[j], right[j] };
+            for (int k = 0; k < 2; k++) {
+                int c = ind[k];
+                P_up[c] = P_down[j];
+                P_down[c] = P_down[j] - dP_seg[c];
+                Sigma_seg[c] = (P_up[c] + P_down[c]) / 2 * radius[c] / thickness[order[c] - 1];
+            }
+        }
+        if (parent[j] < 0) {
+            Sigma_seg[j] = (P_up[j] + P_down[j]) / 2 * radius[j] / thickness[order[j] - 1];
+        }
+    }
+
+    aggregateOrders();
+}
+
+void morphometric_tree::aggregateOrders() {
+    //Mean and sample standard deviation per order (MATLAB mean/std)
+    n_seg_order.assign(n_orders, 0);
+    vector<double> sum(4 * n_orders, 0.0), sum_sq(4 * n_orders, 0.0);
+    vector<double> mean(4 * n_orders, 0.0);
+
+    for (int i = 0; i < n_seg; i++) {
+        n_seg_order[order[i] - 1]++;
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < n_seg; i++) {
+            int o = order[i] - 1;
+            double vals[4] = { (P_up[i] + P_down[i]) / 2, Q_seg[i], Sigma_seg[i], WSS_seg[i] };
+            for (int k = 0; k < 4; k++) {
+                if (pass == 0) {
+                    sum[4 * o + k] += vals[k];
+                }
+                else {
+                    sum_sq[4 * o + k] += pow(vals[k] - mean[4 * o + k], 2);
+                }
+            }
+        }
+        if (pass == 0) {
+            for (int m = 0; m < 4 * n_orders; m++) {
+                int n = n_seg_order[m / 4];
+                mean[m] = n > 0 ? sum[m] / n : std::numeric_limits<double>::quiet_NaN();
+            }
+        }
+    }
+
+    vector<double>* means[4] = { &P_order_mean, &Q_order_mean, &Sigma_order_mean, &WSS_order_mean };
+    vector<double>* stds[4] = { &P_order_std, &Q_order_std, &Sigma_order_std, &WSS_order_std };
+    for (int k = 0; k < 4; k++) {
+        means[k]->resize(n_orders);
+        stds[k]->resize(n_orders);
+        for (int o = 0; o < n_orders; o++) {
+            int n = n_seg_order[o];
+            (*means[k])[o] = mean[4 * o + k];
+            (*stds[k])[o] = n > 1 ? sqrt(sum_sq[4 * o + k] / (n - 1)) : (n == 1 ? 0.0 : mean[4 * o + k]);
+        }
+    }
+}
+
+void morphometric_tree::sumsToOrders(const vector<double>& n, const vector<double>& sum, const vector<double>& sum_sq) {
+    //Mean and sample standard deviation from sums and sums of squares
+    n_seg_order.resize(n_orders);
+    vector<double> mean(4 * n_orders), var(4 * n_orders);
+    for (int m = 0; m < 4 * n_orders; m++) {
+        double n_o = n[m / 4];
+        n_seg_order[m / 4] = int(n_o);
+        mean[m] = n_o > 0 ? sum[m] / n_o : std::numeric_limits<double>::quiet_NaN();
+        var[m] = n_o > 1 ? std::max(0.0, sum_sq[m] - sum[m] * mean[m]) : 0.0;
+    }
+
+    vector<double>* means[4] = { &P_order_mean, &Q_order_mean, &Sigma_order_mean, &WSS_order_mean };
+    vector<double>* stds[4] = { &P_order_std, &Q_order_std, &Sigma_order_std, &WSS_order_std };
+    for (int k = 0; k < 4; k++) {
+        means[k]->resize(n_orders);
+        stds[k]->resize(n_orders);
+        for (int o = 0; o < n_orders; o++) {
+            int n = n_seg_order[o];
+            (*means[k])[o] = mean[4 * o + k];
+            (*stds[k])[o] = n > 1 ? sqrt(var[4 * o + k] / (n - 1)) : (n == 1 ? 0.0 : mean[4 * o + k]);
+        }
+    }
+}
@@ -0,0 +1,75 @@
+// morphometric_tree.h
+#ifndef MORPHOMETRIC_TREE
+#define MORPHOMETRIC_TREE
+
+#include <string>
+#include <vector>
+
+#include "tree_dag.h"
+
+using std::string;
+using std::vector;
+
+//Segment tree of a morphometric pulmonary arterial tree and its steady hemodynamics,
+//following find_opt_morphometric_tree.m and calculate_hemo_morphometric_tree_termBC.m.
+//Units are CGS (cm, ml/s, dyn/cm^2, Poise) as in the MATLAB code.
+//
+//Segments are 0-based. Children always have larger indices than their parent, so
+//resistances are found in one reverse pass and flows/pressures in one forward pass.
+class morphometric_tree {
+public:
+    morphometric_tree();
+
+    //Text export of morphometric_tree.mat (export_morphometric_tree.m):
+    //  n_seg n_orders, then per segment: parent left right radius length order,
+    //  with the 1-based indices and 0/-1 codes of seg_connectivity
+    void readText(string file_name);
+    void readBinary(string file_name); //tree file of gnr_gen_tree (tree_generator.h)
+    void read(string file_name); //either format, by the binary magic
+
+    void setOrderGeometry(const vector<double>& diameter, const vector<double>& thickness_inp);
+    void computeResistance(); //seg_input_resistance
+    void solve(double Q_in, double P_term); //Q_in in ml/s, P_term in mmHg
+    void aggregateOrders(); //per-order mean and standard deviation
+
+    //Replaces the segments by the subtree-sharing form (tree_dag.h). The per-order
+    //results are then found from the unique subtrees and per segment results are not
+    //kept. Radii become per order, set by setOrderGeometry. Without sharing each
+    //segment keeps its own subtree sums, so a re-solve only visits the segments of
+    //orders whose radius changed by more than radius_tol and their ancestors.
+    void compress(bool share_subtrees = true, double radius_tol = 0.0);
+    void sumsToOrders(const vector<double>& n, const vector<double>& sum, const vector<double>& sum_sq);
+
+    void checkTopology(); //children after parents, orders in range
+
+    static double rel_viscosity(double d); //Pries et al., d in microns, Hd = 0.45
+
+    //Segment viscosities (Poise) of the radii, by visc_kernel
+    void viscosity(const vector<double>& radius_inp, vector<double>& viscosity_out) const;
+
+    int n_seg;
+    int n_orders;
+
+    //Topology and geometry
+    vector<int> parent, left, right, order; //order is 1-based as in seg_size(:,3)
+    vector<double> radius, length;
+    vector<double> thickness; //per order
+
+    //Per segment results
+    vector<double> viscosity_seg, input_resistance, r_seg, dP_seg;
+    vector<double> Q_seg, P_up, P_down, WSS_seg, Sigma_seg;
+
+    //Per order results, [ord - 1] = {mean, std}
+    vector<double> P_order_mean, P_order_std, Q_order_mean, Q_order_std;
+    vector<double> Sigma_order_mean, Sigma_order_std, WSS_order_mean, WSS_order_std;
+    vector<int> n_seg_order;
+
+    double plasma_viscosity;
+    int visc_kernel; //0 scalar reference, 1 batch kernel in double, 2 in float (viscosity_kernel.h)
+
+    bool compressed;
+    tree_dag dag;
+    vector<double> order_radius;
+};
+
+#endif /* MORPHOMETRIC_TREE */
@@ -0,0 +1,306 @@
+// output_spec.cpp
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "vessel.h"
+#include "output_writer.h"
+#include "output_spec.h"
+
+using std::string;
+using std::vector;
+
+//Storage of a quantity in the vessel
+enum quantity_kind {
+    scalar_q, //current value
+    history_q, //vector indexed by time step
+    alpha_q, //vector indexed by nts * alpha + time step
+    vector_q //current vector, e.g. stress components
+};
+
+struct quantity_def {
+    const char* name;
+    int kind;
+    double vessel::* scalar;
+    vector<double> vessel::* history;
+};
+
+static const quantity_def quantity_table[] = {
+    //Time
+    { "s", scalar_q, &vessel::s, NULL },
+    //Loaded and passive geometry
+    { "a", history_q, NULL, &vessel::a },
+    { "h", history_q, NULL, &vessel::h },
+    { "a_mid", history_q, NULL, &vessel::a_mid },
+    { "a_pas", history_q, NULL, &vessel::a_pas },
+    { "a_mid_pas", history_q, NULL, &vessel::a_mid_pas },
+    { "h_pas", history_q, NULL, &vessel::h_pas },
+    { "a_act", history_q, NULL, &vessel::a_act },
+    { "lambda_z_tau", history_q, NULL, &vessel::lambda_z_tau },
+    //Mass densities and kinetics
+    { "rho", history_q, NULL, &vessel::rho },
+    { "rhoR", history_q, NULL, &vessel::rhoR },
+    { "rhoR_alpha", alpha_q, NULL, &vessel::rhoR_alpha },
+    { "mR_alpha", alpha_q, NULL, &vessel::mR_alpha },
+    { "k_alpha", alpha_q, NULL, &vessel::k_alpha },
+    { "epsilon_alpha", alpha_q, NULL, &vessel::epsilon_alpha },
+    { "epsilonR_alpha", alpha_q, NULL, &vessel::epsilonR_alpha },
+    { "ups_infl_p", alpha_q, NULL, &vessel::ups_infl_p },
+    { "ups_infl_d", alpha_q, NULL, &vessel::ups_infl_d },
+    //Loads and stresses
+    { "P", scalar_q, &vessel::P, NULL },
+    { "P_h", scalar_q, &vessel::P_h, NULL },
+    { "Q", scalar_q, &vessel::Q, NULL },
+    { "Q_h", scalar_q, &vessel::Q_h, NULL },
+    { "f", scalar_q, &vessel::f, NULL },
+    { "f_h", scalar_q, &vessel::f_h, NULL },
+    { "bar_tauw", scalar_q, &vessel::bar_tauw, NULL },
+    { "bar_tauw_h", scalar_q, &vessel::bar_tauw_h, NULL },
+    { "T_act", scalar_q, &vessel::T_act, NULL },
+    { "lambda_z_curr", scalar_q, &vessel::lambda_z_curr, NULL },
+    { "mb_equil", scalar_q, &vessel::mb_equil, NULL },
+    { "sigma", vector_q, NULL, &vessel::sigma },
+    { "sigma_h", vector_q, NULL, &vessel::sigma_h },
+    { "Cbar", vector_q, NULL, &vessel::Cbar },
+    //Mechanobiologically equilibrated state
+    { "a_e", scalar_q, &vessel::a_e, NULL },
+    { "h_e", scalar_q, &vessel::h_e, NULL },
+    { "rho_m_e", scalar_q, &vessel::rho_m_e, NULL },
+    { "rho_c_e", scalar_q, &vessel::rho_c_e, NULL },
+    { "f_z_e", scalar_q, &vessel::f_z_e, NULL },
+    { "mb_equil_e", scalar_q, &vessel::mb_equil_e, NULL },
+};
+static const int n_quantities = sizeof(quantity_table) / sizeof(quantity_def);
+
+const char* output_spec::default_native = "GnR_out : a h rhoR rhoR_alpha:0-2 bar_tauw bar_tauw_h P P_h f f_h "
+    "Q Q_h Cbar:1 k_alpha:0-2 mR_alpha:0-5";
+
+vector<string> output_spec::quantities() {
+    vector<string> names;
+    for (int i = 0; i < n_quantities; i++) {
+        names.push_back(quantity_table[i].name);
+    }
+    return names;
+}
+
+static int n_components(const vessel& curr_vessel, const quantity_def& q) {
+    if (q.kind == alpha_q) {
+        return curr_vessel.n_alpha;
+    }
+    else if (q.kind == vector_q) {
+        return int((curr_vessel.*q.history).size());
+    }
+    return 1;
+}
+
+static void resolve_column(const vessel& curr_vessel, string token, vector<output_column>& cols) {
+    //Expands a column token (name, name:i or name:i-j) into single-valued columns
+    string name = token, range;
+    size_t colon = token.find(':');
+    if (colon != string::npos) {
+        name = token.substr(0, colon);
+        range = token.substr(colon + 1);
+    }
+
+    const quantity_def* q = NULL;
+    for (int i = 0; i < n_quantities; i++) {
+        if (name == quantity_table[i].name) {
+            q = &quantity_table[i];
+        }
+    }
+    if (q == NULL) {
+        throw std::runtime_error("Unknown output quantity " + name);
+    }
+
+    //Histories must cover every time step of this vessel
+    if (q->kind == history_q && (curr_vessel.*q->history).size() < size_t(curr_vessel.nts)) {
+        throw std::runtime_error("Output quantity " + name + " is not stored for this vessel");
+    }
+    if (q->kind == alpha_q && (curr_vessel.*q->history).size() < size_t(curr_vessel.nts * curr_vessel.n_alpha)) {
+        throw std::runtime_error("Output quantity " + name + " is not stored per constituent for this vessel");
+    }
+
+    int n_comp = n_components(curr_vessel, *q);
+    int first = 0, last = n_comp - 1;
+    if (!range.empty() && range != "all") {
+        if (q->kind == scalar_q || q->kind == history_q) {
+            throw std::runtime_error("Output quantity " + name + " has no components");
+        }
+        size_t dash = range.find('-');
+        first = atoi(range.substr(0, dash).c_str());
+        last = dash == string::npos ? first : atoi(range.substr(dash + 1).c_str());
+        if (first < 0 || last >= n_comp || first > last) {
+            throw std::runtime_error("Component range out of bounds in output column " + token);
+        }
+    }
+
+    for (int i = first; i <= last; i++) {
+        output_column col;
+        col.kind = q->kind;
+        col.scalar = q->scalar;
+        col.history = q->history;
+        col.comp = i;
+        col.name = name;
+        if (q->kind == alpha_q || q->kind == vector_q) {
+            col.name += "_" + std::to_string(i);
+        }
+        cols.push_back(col);
+    }
+}
+
+static double column_value(const vessel& curr_vessel, const output_column& col) {
+    switch (col.kind) {
+    case scalar_q:
+        return curr_vessel.*col.scalar;
+    case history_q:
+        return (curr_vessel.*col.history)[curr_vessel.sn];
+    case alpha_q:
+        return (curr_vessel.*col.history)[col.comp * curr_vessel.nts + curr_vessel.sn];
+    default:
+        return (curr_vessel.*col.history)[col.comp];
+    }
+}
+
+void output_spec::add(string line) {
+    //Strip comments
+    size_t hash = line.find('#');
+    if (hash != string::npos) {
+        line = line.substr(0, hash);
+    }
+    size_t colon = line.find(" : ");
+    std::stringstream head(colon == string::npos ? line : line.substr(0, colon));
+
+    output_def out;
+    out.every = -1;
+    out.stream_id = -1;
+    if (!(head >> out.stream)) {
+        return; //blank line
+    }
+    if (colon == string::npos) {
+        throw std::runtime_error("Output spec needs ' : ' before its columns: " + line);
+    }
+
+    string opt;
+    while (head >> opt) {
+        size_t eq = opt.find('=');
+        string key = opt.substr(0, eq), val = eq == string::npos ? "" : opt.substr(eq + 1);
+        if (key == "every") {
+            out.every = atoi(val.c_str());
+        }
+        else if (key == "days") {
+            std::stringstream ss(val);
+            string day;
+            while (std::getline(ss, day, ',')) {
+                out.days.push_back(atof(day.c_str()));
+            }
+        }
+        else if (key == "cross") {
+            size_t comma = val.find(',');
+            if (comma == string::npos) {
+                throw std::runtime_error("Output crossing needs <column>,<value>: " + opt);
+            }
+            output_crossing c;
+            c.column = val.substr(0, comma);
+            c.value = atof(val.substr(comma + 1).c_str());
+            c.prev = 0.0;
+            c.have_prev = false;
+            out.crossings.push_back(c);
+        }
+        else {
+            throw std::runtime_error("Unknown output spec option " + opt);
+        }
+    }
+    if (out.every < 0) {
+        out.every = out.days.empty() && out.crossings.empty() ? 1 : 0;
+    }
+
+    std::stringstream body(line.substr(colon + 3));
+    string col;
+    while (body >> col) {
+        out.columns.push_back(col);
+    }
+    if (out.columns.empty()) {
+        throw std::runtime_error("Output spec for " + out.stream + " has no columns");
+    }
+
+    outputs.push_back(out);
+}
+
+void output_spec::read(string file_name) {
+    std::ifstream spec_in(file_name);
+    if (!spec_in) {
+        throw std::runtime_error("Could not open output spec " + file_name);
+    }
+    string line;
+    while (std::getline(spec_in, line)) {
+        add(line);
+    }
+}
+
+void output_spec::open(vessel& curr_vessel, output_writer& writer, string suffix, int bin_flag, bool append) {
+    for (int i = 0; i < outputs.size(); i++) {
+        output_def& out = outputs[i];
+        if (out.stream == "Equil_GnR_out") {
+            throw std::runtime_error("Equil_GnR_out is written by the equilibrated solve and cannot be respecified");
+        }
+
+        out.cols.clear();
+        for (int j = 0; j < out.columns.size(); j++) {
+            resolve_column(curr_vessel, out.columns[j], out.cols);
+        }
+        for (int j = 0; j < out.crossings.size(); j++) {
+            vector<output_column> cross_col;
+            resolve_column(curr_vessel, out.crossings[j].column, cross_col);
+            if (cross_col.size() != 1) {
+                throw std::runtime_error("Output crossing needs a single column: " + out.crossings[j].column);
+            }
+            out.crossings[j].col = cross_col[0];
+        }
+
+        vector<string> names;
+        for (int j = 0; j < out.cols.size(); j++) {
+            names.push_back(out.cols[j].name);
+        }
+        out.row.resize(out.cols.size());
+        out.stream_id = writer.open_stream(out.stream + "_" + suffix, append, names, bin_flag);
+    }
+}
+
+void output_spec::record(vessel& curr_vessel) {
+    int sn = curr_vessel.sn;
+    double s = curr_vessel.dt * sn;
+
+    for (int i = 0; i < outputs.size(); i++) {
+        output_def& out = outputs[i];
+
+        bool due = out.every > 0 && sn % out.every == 0;
+        for (int j = 0; j < out.days.size(); j++) {
+            //First step at or after the listed day
+            if (out.days[j] <= s && (sn == 0 || out.days[j] > s - curr_vessel.dt)) {
+                due = true;
+            }
+        }
+        for (int j = 0; j < out.crossings.size(); j++) {
+            output_crossing& c = out.crossings[j];
+            double val = column_value(curr_vessel, c.col);
+            if (c.have_prev && ((c.prev < c.value && val >= c.value) || (c.prev > c.value && val <= c.value))) {
+                due = true;
+            }
+            c.prev = val;
+            c.have_prev = true;
+        }
+        if (!due) {
+            continue;
+        }
+
+        for (int j = 0; j < out.cols.size(); j++) {
+            out.row[j] = column_value(curr_vessel, out.cols[j]);
+        }
+        curr_vessel.writer->write(out.stream_id, out.row.data(), int(out.row.size()));
+    }
+}
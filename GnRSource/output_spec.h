@@ -0,0 +1,71 @@
+// output_spec.h
+#ifndef OUTPUT_SPEC
+#define OUTPUT_SPEC
+
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+class vessel;
+class output_writer;
+
+//Selectable output channels. Each output is one line of the form
+//
+//  <stream> [every=k] [days=d1,d2,...] [cross=<column>,<value>] : <column> <column> ...
+//
+//stream  destination file prefix, written to <stream>_<name> (e.g. GnR_out, Exp_out, or a new file)
+//every   write every k steps (default 1 if no other cadence is given)
+//days    also write at the first step reaching each listed day
+//cross   also write at steps where the column crosses the value (may be repeated)
+//column  a quantity name, e.g. a, P, sigma, rhoR_alpha; constituent/component
+//        quantities take all entries, or name:i or name:i-j for a subset
+//
+//A spec file holds one output per line; blank lines and text after '#' are ignored.
+struct output_column {
+    string name;
+    int kind;
+    double vessel::* scalar;
+    vector<double> vessel::* history;
+    int comp;
+};
+
+struct output_crossing {
+    string column;
+    output_column col;
+    double value;
+    double prev; //column value at the previous step
+    bool have_prev;
+};
+
+struct output_def {
+    string stream;
+    int every;
+    vector<double> days;
+    vector<output_crossing> crossings;
+    vector<string> columns; //column tokens as given
+    vector<output_column> cols; //resolved against the vessel when opened
+    int stream_id;
+    vector<double> row;
+};
+
+class output_spec {
+public:
+    void add(string line);
+    void read(string file_name);
+    bool empty() const { return outputs.empty(); }
+
+    //Resolves the columns against the vessel and opens the streams on the writer
+    void open(vessel& curr_vessel, output_writer& writer, string suffix, int bin_flag, bool append);
+    //Writes each output that is due at the vessel's current step
+    void record(vessel& curr_vessel);
+
+    static const char* default_native; //same columns as vessel::printNativeOutputs
+    static vector<string> quantities(); //all recognized quantity names
+
+private:
+    vector<output_def> outputs;
+};
+
+#endif /* OUTPUT_SPEC */
@@ -0,0 +1,346 @@
+// output_writer.cpp
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <stdexcept>
+
+#include "output_writer.h"
+
+//Record marker for a flush request placed in the queue
+static const int flush_record = -1;
+
+//Exactly representable powers of ten
+static const double pow10_tab[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                     1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+static double scale_pow10(double x, int k) {
+    //Returns x * 10^k, dividing by exact powers where possible to limit rounding
+    if (k >= 0 && k <= 22) {
+        return x * pow10_tab[k];
+    }
+    else if (k < 0 && k >= -22) {
+        return x / pow10_tab[-k];
+    }
+    //Split large exponents so subnormals and huge values do not overflow the scale factor
+    return x * pow(10.0, k / 2) * pow(10.0, k - k / 2);
+}
+
+output_writer::output_writer(int flush_steps_inp, double flush_secs_inp, int exact_flag_inp, int async_flag_inp,
+                             int queue_pow2) {
+    flush_steps = flush_steps_inp;
+    flush_secs = flush_secs_inp;
+    exact_flag = exact_flag_inp;
+    async_flag = async_flag_inp;
+    step_count = 0;
+
+    ring.resize(size_t(1) << queue_pow2);
+    mask = ring.size() - 1;
+    head = 0;
+    tail = 0;
+    stop = false;
+
+    n_streams = 0;
+    for (int i = 0; i < max_streams; i++) {
+        files[i] = NULL;
+        binary[i] = false;
+    }
+    started = false;
+    last_flush = std::chrono::steady_clock::now();
+}
+
+output_writer::~output_writer() {
+    close();
+}
+
+int output_writer::open(string file_name, bool append) {
+    if (n_streams == max_streams) {
+        throw std::runtime_error("Too many output streams for writer");
+    }
+    FILE* f = fopen(file_name.c_str(), append ? "a" : "w");
+    if (f == NULL) {
+        throw std::runtime_error("Could not open output file " + file_name);
+    }
+    return add_stream(f, false);
+}
+
+int output_writer::open_binary(string file_name, bool append, const vector<string>& columns) {
+    if (n_streams == max_streams) {
+        throw std::runtime_error("Too many output streams for writer");
+    }
+    tables[n_streams].open(file_name, columns, append);
+    return add_stream(NULL, true);
+}
+
+int output_writer::open_stream(string file_name, bool append, const vector<string>& columns, int bin_flag) {
+    if (bin_flag) {
+        return open_binary(file_name + ".bin", append, columns);
+    }
+    return open(file_name, append);
+}
+
+int output_writer::add_stream(FILE* f, bool binary_inp) {
+    int n = n_streams.load(std::memory_order_relaxed);
+    files[n] = f;
+    binary[n] = binary_inp;
+    n_streams.store(n + 1, std::memory_order_release);
+
+    if (!started) {
+        stop = false;
+        last_flush = std::chrono::steady_clock::now();
+        if (async_flag) {
+            worker = std::thread(&output_writer::run, this);
+        }
+        started = true;
+    }
+
+    return n;
+}
+
+void output_writer::write(int stream, const double* vals, int n_vals) {
+    if (binary[stream] && n_vals != tables[stream].n_cols) {
+        throw std::runtime_error("Row width does not match binary output columns");
+    }
+    if (!async_flag) {
+        emit(stream, vals, n_vals);
+        return;
+    }
+    push(stream, vals, n_vals);
+}
+
+void output_writer::end_step() {
+    step_count++;
+    if (flush_steps > 0 && step_count % flush_steps == 0) {
+        flush();
+    }
+    else if (!async_flag && flush_due()) {
+        write_buffers(true);
+    }
+}
+
+void output_writer::flush() {
+    //Synchronous, or no consumer thread yet (no stream opened): nothing is queued,
+    //so flush directly and never fill the ring
+    if (!async_flag || !started) {
+        write_buffers(true);
+        return;
+    }
+    push(flush_record, NULL, 0);
+}
+
+void output_writer::push(int stream, const double* vals, int n_vals) {
+    size_t len = n_vals + 2;
+    if (len > ring.size()) {
+        throw std::runtime_error("Output row larger than writer queue");
+    }
+
+    //Wait for the consumer to free enough space
+    size_t h = head.load(std::memory_order_relaxed);
+    while (h + len - tail.load(std::memory_order_acquire) > ring.size()) {
+        std::this_thread::yield();
+    }
+
+    ring[h & mask] = stream;
+    ring[(h + 1) & mask] = n_vals;
+    for (int i = 0; i < n_vals; i++) {
+        ring[(h + 2 + i) & mask] = vals[i];
+    }
+    head.store(h + len, std::memory_order_release);
+}
+
+void output_writer::close() {
+    if (!started) {
+        return;
+    }
+    if (async_flag) {
+        stop.store(true, std::memory_order_release);
+        worker.join();
+    }
+    else {
+        write_buffers(true);
+    }
+    for (int i = 0; i < n_streams; i++) {
+        if (binary[i]) {
+            tables[i].close();
+        }
+        else {
+            fclose(files[i]);
+            files[i] = NULL;
+        }
+    }
+    n_streams = 0;
+    started = false;
+}
+
+void output_writer::run() {
+    vector<double> vals;
+
+    while (true) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t h = head.load(std::memory_order_acquire);
+
+        if (t == h) {
+            if (stop.load(std::memory_order_acquire)) {
+                //Producer is done, check once more for records written before stop
+                if (head.load(std::memory_order_acquire) == t) {
+                    break;
+                }
+                continue;
+            }
+            if (flush_due()) {
+                write_buffers(true);
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            continue;
+        }
+
+        int stream = int(ring[t & mask]);
+        int n_vals = int(ring[(t + 1) & mask]);
+
+        if (stream == flush_record) {
+            write_buffers(true);
+        }
+        else {
+            vals.resize(n_vals);
+            for (int i = 0; i < n_vals; i++) {
+                vals[i] = ring[(t + 2 + i) & mask];
+            }
+            emit(stream, vals.data(), n_vals);
+        }
+        tail.store(t + n_vals + 2, std::memory_order_release);
+
+        if (flush_due()) {
+            write_buffers(true);
+        }
+    }
+
+    //Flush at exit
+    write_buffers(true);
+}
+
+void output_writer::emit(int stream, const double* vals, int n_vals) {
+    //Formats one row into the stream's buffer, or writes it straight to a binary table
+    if (binary[stream]) {
+        tables[stream].write_row(vals);
+        return;
+    }
+
+    char num[32];
+    int len = 0;
+    string& buf = bufs[stream];
+    for (int i = 0; i < n_vals; i++) {
+        len = exact_flag ? format_exact(vals[i], num) : format_fast(vals[i], num);
+        buf.append(num, len);
+        buf.push_back(i == n_vals - 1 ? '\n' : '\t');
+    }
+    if (buf.size() > (1 << 16)) {
+        fwrite(buf.data(), 1, buf.size(), files[stream]);
+        buf.clear();
+    }
+}
+
+bool output_writer::flush_due() {
+    return flush_secs > 0 && std::chrono::duration<double>(std::chrono::steady_clock::now() - last_flush).count() > flush_secs;
+}
+
+void output_writer::write_buffers(bool sync) {
+    int n = n_streams.load(std::memory_order_acquire);
+    for (int i = 0; i < n; i++) {
+        if (binary[i]) {
+            if (sync) {
+                tables[i].write_index();
+            }
+            continue;
+        }
+        if (!bufs[i].empty()) {
+            fwrite(bufs[i].data(), 1, bufs[i].size(), files[i]);
+            bufs[i].clear();
+        }
+        if (sync) {
+            fflush(files[i]);
+        }
+    }
+    if (sync) {
+        fflush(stdout);
+        last_flush = std::chrono::steady_clock::now();
+    }
+}
+
+int output_writer::format_exact(double x, char* buf) {
+    //std::ostream uses %g with the default precision of 6
+    return snprintf(buf, 32, "%g", x);
+}
+
+int output_writer::format_fast(double x, char* buf) {
+    //Scientific notation with up to 10 significant digits (trailing zeros trimmed).
+    //The scaling by a power of ten can be off by 1 ulp, so the last digit may differ
+    //from a correctly rounded printf in rare cases.
+    const int n_digits = 10;
+    const uint64_t m_low = 1000000000ULL, m_high = 10000000000ULL;
+
+    if (std::isnan(x) || std::isinf(x)) {
+        return format_exact(x, buf);
+    }
+
+    char* p = buf;
+    if (x < 0) {
+        *p++ = '-';
+        x = -x;
+    }
+    if (x == 0) {
+        *p++ = '0';
+        *p = '\0';
+        return int(p - buf);
+    }
+
+    //Estimate decimal exponent from the binary exponent, then correct it
+    int e2 = 0;
+    frexp(x, &e2);
+    int e10 = int(floor((e2 - 1) * 0.30102999566398120));
+    uint64_t m = 0;
+    for (int i = 0; i < 3; i++) {
+        m = uint64_t(scale_pow10(x, n_digits - 1 - e10) + 0.5);
+        if (m >= m_high) {
+            e10++;
+        }
+        else if (m < m_low) {
+            e10--;
+        }
+        else {
+            break;
+        }
+    }
+    if (m >= m_high) {
+        m /= 10;
+    }
+
+    //Mantissa digits
+    char digits[n_digits];
+    for (int i = n_digits - 1; i >= 0; i--) {
+        digits[i] = char('0' + m % 10);
+        m /= 10;
+    }
+    int last = n_digits - 1;
+    while (last > 0 && digits[last] == '0') {
+        last--;
+    }
+    *p++ = digits[0];
+    if (last > 0) {
+        *p++ = '.';
+        for (int i = 1; i <= last; i++) {
+            *p++ = digits[i];
+        }
+    }
+
+    //Exponent with at least two digits, as printf
+    *p++ = 'e';
+    *p++ = e10 < 0 ? '-' : '+';
+    int e_abs = e10 < 0 ? -e10 : e10;
+    if (e_abs >= 100) {
+        *p++ = char('0' + e_abs / 100);
+    }
+    *p++ = char('0' + (e_abs / 10) % 10);
+    *p++ = char('0' + e_abs % 10);
+    *p = '\0';
+
+    return int(p - buf);
+}
@@ -0,0 +1,80 @@
+// output_writer.h
+#ifndef OUTPUT_WRITER
+#define OUTPUT_WRITER
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gnr_binary.h"
+
+using std::string;
+using std::vector;
+
+//Asynchronous writer for the tabulated G&R outputs (GnR_out, Exp_out, Equil_GnR_out).
+//The simulation thread pushes rows of doubles into a lock-free single-producer/single-consumer
+//ring; a background thread formats them and writes them out according to the flush policy.
+//Streams are either tab-separated text or self-describing binary tables (gnr_binary.h).
+//With async_flag = 0 rows are written on the calling thread under the same flush policy.
+class output_writer {
+public:
+    static const int max_streams = 16;
+
+    //flush_steps: flush every N calls to end_step (0 = never on steps)
+    //flush_secs: flush when T seconds have passed since the last flush (0 = never on time)
+    //exact_flag: 1 = format like the default iostream output (byte-identical), 0 = fast formatting
+    //Output is always flushed when the writer is closed.
+    output_writer(int flush_steps_inp = 1, double flush_secs_inp = 0.0, int exact_flag_inp = 1,
+                  int async_flag_inp = 1, int queue_pow2 = 16);
+    ~output_writer();
+
+    int open(string file_name, bool append); //returns the stream id to write to
+    int open_binary(string file_name, bool append, const vector<string>& columns);
+    //Opens file_name as text, or file_name.bin as a binary table if bin_flag is set
+    int open_stream(string file_name, bool append, const vector<string>& columns, int bin_flag);
+    void write(int stream, const double* vals, int n_vals); //producer side, never blocks on I/O
+    void end_step(); //marks the end of a time step for the flush policy
+    void flush(); //requests a flush of everything written so far
+    void close(); //drains the queue, flushes, and closes all streams
+
+    static int format_exact(double x, char* buf); //same text as std::ostream << x
+    static int format_fast(double x, char* buf); //10 significant digits, no printf machinery
+
+private:
+    void run();
+    int add_stream(FILE* f, bool binary);
+    void push(int stream, const double* vals, int n_vals);
+    void emit(int stream, const double* vals, int n_vals);
+    void write_buffers(bool sync);
+    bool flush_due();
+
+    int flush_steps;
+    double flush_secs;
+    int exact_flag;
+    int async_flag;
+    long step_count;
+
+    //Ring of doubles holding records [stream, n_vals, vals...]
+    vector<double> ring;
+    size_t mask;
+    std::atomic<size_t> head; //written by producer
+    std::atomic<size_t> tail; //written by consumer
+    std::atomic<bool> stop;
+
+    //Streams may be opened while the worker runs: a slot is filled before the release
+    //store of n_streams that publishes it, and the worker reads n_streams with acquire
+    std::atomic<int> n_streams;
+    FILE* files[max_streams];
+    string bufs[max_streams];
+    bool binary[max_streams];
+    binary_table_writer tables[max_streams];
+
+    std::thread worker;
+    bool started;
+    std::chrono::steady_clock::time_point last_flush;
+};
+
+#endif /* OUTPUT_WRITER */
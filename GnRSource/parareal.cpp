@@ -0,0 +1,326 @@
+// parareal.cpp
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <gsl/gsl_errno.h>
+#include <gsl/gsl_vector.h>
+#include <gsl/gsl_roots.h>
+#include <gsl/gsl_multiroots.h>
+
+#include "vessel.h"
+#include "functions.h"
+#include "step_transaction.h"
+#include "parareal.h"
+
+using std::string;
+using std::vector;
+
+//A slab's segment: the entries of every history array at steps b_0 + 1 to b_0 + n_len,
+//then the carried state and s, P, Q, T_act, P_prev, T_act_prev after the last of them
+static void read_segment(vessel& curr_vessel, int b_0, int n_len, vector<double>& seg) {
+    int nts = curr_vessel.nts;
+    vector<vector<double>*> arrays = step_history_arrays(curr_vessel);
+    vector<double*> carried = step_carried_state(curr_vessel);
+    seg.clear();
+    for (int j = 0; j < arrays.size(); j++) {
+        int n_blocks = int(arrays[j]->size()) / nts;
+        for (int b = 0; b < n_blocks; b++) {
+            seg.insert(seg.end(), arrays[j]->begin() + b * nts + b_0 + 1, arrays[j]->begin() + b * nts + b_0 + 1 + n_len);
+        }
+    }
+    for (int j = 0; j < carried.size(); j++) {
+        seg.push_back(*carried[j]);
+    }
+    const double scalars[] = { curr_vessel.s, curr_vessel.P, curr_vessel.Q, curr_vessel.T_act,
+                               curr_vessel.P_prev, curr_vessel.T_act_prev };
+    seg.insert(seg.end(), scalars, scalars + 6);
+}
+
+//Writes the history entries of a segment, and with end_state the state after it
+static void write_segment(vessel& curr_vessel, int b_0, int n_len, const vector<double>& seg, bool end_state) {
+    int nts = curr_vessel.nts;
+    vector<vector<double>*> arrays = step_history_arrays(curr_vessel);
+    int k = 0;
+    for (int j = 0; j < arrays.size(); j++) {
+        int n_blocks = int(arrays[j]->size()) / nts;
+        for (int b = 0; b < n_blocks; b++) {
+            std::copy(seg.begin() + k, seg.begin() + k + n_len, arrays[j]->begin() + b * nts + b_0 + 1);
+            k += n_len;
+        }
+    }
+    if (!end_state) {
+        return;
+    }
+    vector<double*> carried = step_carried_state(curr_vessel);
+    for (int j = 0; j < carried.size(); j++) {
+        *carried[j] = seg[k++];
+    }
+    curr_vessel.sn = b_0 + n_len;
+    curr_vessel.s = seg[k++];
+    curr_vessel.P = seg[k++];
+    curr_vessel.Q = seg[k++];
+    curr_vessel.T_act = seg[k++];
+    curr_vessel.P_prev = seg[k++];
+    curr_vessel.T_act_prev = seg[k++];
+}
+
+//Largest relative change of the radii and thicknesses (a and h lead the segment)
+static double segment_change(const vector<double>& seg_new, const vector<double>& seg_old, int n_len) {
+    double change = 0.0;
+    for (int i = 0; i < 2 * n_len; i++) {
+        int k = i < n_len ? i : n_len + i; //a, then h after a_mid
+        change = std::max(change, fabs(seg_new[k] - seg_old[k]) / fabs(seg_new[k]));
+    }
+    return change;
+}
+
+parareal::parareal(int n_threads) : pool(n_threads) {
+    n_slabs = 0;
+    coarse_factor = 10;
+    tol = 1e-8;
+    max_iter = 0;
+    iterations = 0;
+    residual = 0.0;
+    run_seconds = 0.0;
+    fine_seconds = 0.0;
+    coarse_seconds = 0.0;
+    speedup = 0.0;
+    critical_seconds = 0.0;
+    slab_speedup = 0.0;
+    schedule = NULL;
+    slab_steps = 0;
+    n_steps = 0;
+}
+
+void parareal::initialize(vessel& fine_vessel, string native_file, double n_days, string cache_dir) {
+    if (fine_vessel.mech_exp_flag == 1) {
+        throw std::runtime_error("No parareal runs of mechanical experiments");
+    }
+    if (coarse_factor < 1) {
+        throw std::runtime_error("Parareal coarse factor must be at least 1");
+    }
+    std::ostringstream fine_out(std::ios::binary);
+    fine_vessel.writeState(fine_out);
+    fine_state = fine_out.str();
+    schedule = fine_vessel.schedule;
+
+    //The coarse vessel reaches the last fine step, at coarse steps of coarse_factor
+    double dt_c = coarse_factor * fine_vessel.dt;
+    int nts_c = (fine_vessel.nts - 1 + coarse_factor - 1) / coarse_factor + 1;
+    vessel coarse_vessel;
+    if (cache_dir.empty()) {
+        coarse_vessel.initializeNative(native_file, dt_c * (nts_c + 0.5), dt_c);
+    }
+    else {
+        coarse_vessel.initializeNativeCached(native_file, cache_dir, dt_c * (nts_c + 0.5), dt_c);
+    }
+
+    //Loads and flags as set on the fine vessel
+    coarse_vessel.P = fine_vessel.P;
+    coarse_vessel.Q = fine_vessel.Q;
+    coarse_vessel.T_act = fine_vessel.T_act;
+    coarse_vessel.P_prev = fine_vessel.P_prev;
+    coarse_vessel.T_act_prev = fine_vessel.T_act_prev;
+    coarse_vessel.lambda_z_curr = fine_vessel.lambda_z_curr;
+    coarse_vessel.bar_tauw = fine_vessel.bar_tauw;
+    coarse_vessel.wss_calc_flag = fine_vessel.wss_calc_flag;
+    coarse_vessel.app_visc_flag = fine_vessel.app_visc_flag;
+    coarse_vessel.mech_infl_flag = fine_vessel.mech_infl_flag;
+    coarse_vessel.pol_only_flag = fine_vessel.pol_only_flag;
+    std::ostringstream coarse_out(std::ios::binary);
+    coarse_vessel.writeState(coarse_out);
+    coarse_state = coarse_out.str();
+}
+
+void parareal::assemble(vessel& curr_vessel, int n) const {
+    std::istringstream state_in(fine_state, std::ios::binary);
+    curr_vessel.readState(state_in);
+    curr_vessel.schedule = schedule;
+    for (int m = 0; m < n; m++) {
+        int b_0 = m * slab_steps;
+        write_segment(curr_vessel, b_0, std::min(slab_steps, n_steps - b_0), U[m], m == n - 1);
+    }
+}
+
+void parareal::fine(int n, vector<double>& seg) {
+    const int n_out = vessel::n_native_outputs;
+    int b_0 = n * slab_steps, b_1 = std::min(b_0 + slab_steps, n_steps);
+    vessel curr_vessel;
+    assemble(curr_vessel, n);
+    for (int sn = b_0 + 1; sn <= b_1; sn++) {
+        step_vessel(curr_vessel, sn);
+        curr_vessel.nativeOutputRow(&rows[(sn - 1) * n_out]);
+    }
+    read_segment(curr_vessel, b_0, b_1 - b_0, seg);
+}
+
+void parareal::startSweep(int n, vessel& fine_vessel, vessel& coarse_vessel) const {
+    assemble(fine_vessel, n);
+    std::istringstream state_in(coarse_state, std::ios::binary);
+    coarse_vessel.readState(state_in);
+    coarse_vessel.schedule = schedule;
+}
+
+void parareal::nextSlab(int n, vessel& fine_vessel) const {
+    write_segment(fine_vessel, (n - 1) * slab_steps, slab_steps, U[n - 1], true);
+}
+
+void parareal::coarse(int n, vessel& fine_vessel, vessel& coarse_vessel, vector<double>& seg) {
+    const int m = coarse_factor;
+    int b_0 = n * slab_steps, b_1 = std::min(b_0 + slab_steps, n_steps);
+    int j_0 = b_0 / m, j_1 = (b_1 + m - 1) / m;
+
+    //Fine history at the coarse steps, then the coarse steps over the slab
+    int nts = fine_vessel.nts, nts_c = coarse_vessel.nts;
+    vector<vector<double>*> arrays = step_history_arrays(fine_vessel);
+    vector<vector<double>*> arrays_c = step_history_arrays(coarse_vessel);
+    for (int j = 0; j < arrays.size(); j++) {
+        int n_blocks = int(arrays[j]->size()) / nts;
+        for (int b = 0; b < n_blocks; b++) {
+            for (int jc = 0; jc <= j_0; jc++) {
+                (*arrays_c[j])[b * nts_c + jc] = (*arrays[j])[b * nts + jc * m];
+            }
+        }
+    }
+    vector<double*> carried = step_carried_state(fine_vessel);
+    vector<double*> carried_c = step_carried_state(coarse_vessel);
+    for (int j = 0; j < carried.size(); j++) {
+        *carried_c[j] = *carried[j];
+    }
+    coarse_vessel.P = fine_vessel.P;
+    coarse_vessel.Q = fine_vessel.Q;
+    coarse_vessel.T_act = fine_vessel.T_act;
+    coarse_vessel.P_prev = fine_vessel.P_prev;
+    coarse_vessel.T_act_prev = fine_vessel.T_act_prev;
+    coarse_vessel.sn = j_0;
+    coarse_vessel.s = coarse_vessel.dt * j_0;
+    for (int jc = j_0 + 1; jc <= j_1; jc++) {
+        step_vessel(coarse_vessel, jc);
+    }
+
+    //Coarse history interpolated to the fine steps of the slab
+    for (int j = 0; j < arrays.size(); j++) {
+        int n_blocks = int(arrays[j]->size()) / nts;
+        for (int b = 0; b < n_blocks; b++) {
+            const double* c = &(*arrays_c[j])[b * nts_c];
+            for (int sn = b_0 + 1; sn <= b_1; sn++) {
+                int jc = sn / m;
+                double w = double(sn - jc * m) / m;
+                (*arrays[j])[b * nts + sn] = w > 0 ? (1 - w) * c[jc] + w * c[jc + 1] : c[jc];
+            }
+        }
+    }
+    for (int j = 0; j < carried.size(); j++) {
+        *carried[j] = *carried_c[j];
+    }
+    fine_vessel.s = coarse_vessel.s;
+    fine_vessel.P = coarse_vessel.P;
+    fine_vessel.Q = coarse_vessel.Q;
+    fine_vessel.T_act = coarse_vessel.T_act;
+    fine_vessel.P_prev = coarse_vessel.P_prev;
+    fine_vessel.T_act_prev = coarse_vessel.T_act_prev;
+    read_segment(fine_vessel, b_0, b_1 - b_0, seg);
+}
+
+void parareal::run(vessel& fine_vessel, int n_steps_inp) {
+    auto now = []() { return std::chrono::steady_clock::now(); };
+    auto seconds = [](std::chrono::steady_clock::time_point t) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+    };
+    std::chrono::steady_clock::time_point start = now();
+    const int n_out = vessel::n_native_outputs;
+    n_steps = std::min(n_steps_inp, fine_vessel.nts - 1);
+    if (n_slabs < 1 || n_steps < 1) {
+        throw std::runtime_error("Parareal needs at least one slab and one step");
+    }
+
+    //Slabs of whole coarse steps
+    slab_steps = (n_steps + n_slabs - 1) / n_slabs;
+    slab_steps = (slab_steps + coarse_factor - 1) / coarse_factor * coarse_factor;
+    int N = (n_steps + slab_steps - 1) / slab_steps;
+    rows.assign(n_steps * n_out, 0.0);
+    U.assign(N, vector<double>());
+    vector<vector<double>> G_old(N), F(N);
+    vector<double> F_seconds(N, 0.0);
+
+    //Initial coarse sweep
+    std::chrono::steady_clock::time_point t = now();
+    vessel sweep_fine, sweep_coarse;
+    startSweep(0, sweep_fine, sweep_coarse);
+    for (int n = 0; n < N; n++) {
+        if (n > 0) {
+            nextSlab(n, sweep_fine);
+        }
+        coarse(n, sweep_fine, sweep_coarse, G_old[n]);
+        U[n] = G_old[n];
+    }
+    coarse_seconds = seconds(t);
+
+    //Slabs before n_exact start from the serial state and are final
+    int n_exact = 0;
+    int iter_limit = max_iter > 0 ? std::min(max_iter, N) : N;
+    fine_seconds = 0.0;
+    critical_seconds = 0.0;
+    iterations = 0;
+    residual = 0.0;
+    while (n_exact < N && iterations < iter_limit) {
+        pool.run(N - n_exact, [&](int task) {
+            int n = n_exact + task;
+            std::chrono::steady_clock::time_point t_n = std::chrono::steady_clock::now();
+            fine(n, F[n]);
+            F_seconds[n] = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_n).count();
+        });
+        if (iterations == 0) {
+            for (int n = 0; n < N; n++) {
+                fine_seconds += F_seconds[n];
+            }
+        }
+        critical_seconds += *std::max_element(F_seconds.begin() + n_exact, F_seconds.end());
+        iterations++;
+
+        //Correction sweep; the first open slab started from a final state, so its
+        //coarse prediction is unchanged and it takes the fine result exactly
+        t = now();
+        residual = 0.0;
+        vector<double> G_new;
+        startSweep(n_exact, sweep_fine, sweep_coarse);
+        for (int n = n_exact; n < N; n++) {
+            if (n == n_exact) {
+                G_new = G_old[n];
+            }
+            else {
+                nextSlab(n, sweep_fine);
+                coarse(n, sweep_fine, sweep_coarse, G_new);
+            }
+            vector<double> U_new(F[n].size());
+            for (int k = 0; k < U_new.size(); k++) {
+                U_new[k] = F[n][k] + (G_new[k] - G_old[n][k]);
+            }
+            int n_len = std::min(slab_steps, n_steps - n * slab_steps);
+            residual = std::max(residual, segment_change(U_new, U[n], n_len));
+            U[n].swap(U_new);
+            G_old[n].swap(G_new);
+        }
+        coarse_seconds += seconds(t);
+        n_exact++;
+        printf("%s %d %s %e %s %d\n", "Parareal iteration:", iterations, "residual:", residual, "exact slabs:", n_exact);
+        fflush(stdout);
+        if (residual < tol) {
+            break;
+        }
+    }
+
+    //The vessel at the last step, as after the serial run
+    assemble(fine_vessel, N);
+    run_seconds = seconds(start);
+    speedup = fine_seconds / run_seconds;
+    critical_seconds += coarse_seconds;
+    slab_speedup = fine_seconds / critical_seconds;
+}
@@ -0,0 +1,75 @@
+// parareal.h
+#ifndef PARAREAL
+#define PARAREAL
+
+#include <string>
+#include <vector>
+
+#include "thread_pool.h"
+
+using std::string;
+using std::vector;
+
+class vessel;
+class load_schedule;
+
+//Parareal time-parallel G&R of one vessel. The steps are split into slabs; a coarse
+//propagator predicts the state at every slab boundary in one sequential sweep, the fine
+//steps of all slabs are then run in parallel from the predicted boundaries, and the
+//boundaries are corrected as
+//
+//  U_n+1 <- F(U_n) + G(U_n new) - G(U_n old)
+//
+//until they change less than tol. After k iterations the first k slabs are exact, so the
+//iteration ends after at most n_slabs of them with the serial solution.
+//
+//The state at a boundary is the whole history up to it, and a slab only adds to it: a
+//boundary is stored as the entries of the history arrays at the slab's steps and the
+//state carried out of it (step_transaction.h), and a slab starts from the initialized
+//vessel with the entries of every earlier slab written back. The coarse propagator is
+//the same step at coarse_factor * dt, on a vessel initialized at that step with the
+//fine history sampled at its steps; its history over a slab is interpolated linearly
+//to the fine steps. A step integrates over the whole history, so a coarse step costs
+//nearly a fine one and the coarse sweeps, which are serial, bound the speedup; the step
+//is also much less accurate at large dt, so coarse_factor is best kept small.
+class parareal {
+public:
+    parareal(int n_threads = 0);
+
+    //The fine vessel initialized, with its loads and flags set; the coarse vessel is
+    //initialized from the same Native_in file
+    void initialize(vessel& fine_vessel, string native_file, double n_days, string cache_dir = "");
+    //Steps the fine vessel to n_steps; rows[(sn - 1) * n_native_outputs + k] are the GnR_out
+    //rows of steps 1 to n_steps from the last fine runs
+    void run(vessel& fine_vessel, int n_steps);
+
+    int n_slabs;
+    int coarse_factor; //coarse steps of coarse_factor fine steps
+    double tol; //on the largest relative change of the slab radii and thicknesses
+    int max_iter; //0 for no limit before n_slabs
+    int iterations; //iterations and residual of the last run
+    double residual;
+    double run_seconds, fine_seconds, coarse_seconds; //wall time, fine slabs of one sweep, coarse sweeps
+    double speedup; //fine_seconds / run_seconds, against the serial run
+    //Coarse sweeps and the slowest fine slab of every iteration, the run time with a
+    //thread per slab, and fine_seconds over it
+    double critical_seconds, slab_speedup;
+    vector<double> rows;
+    thread_pool pool;
+
+private:
+    void assemble(vessel& curr_vessel, int n) const; //State at the end of slab n
+    void fine(int n, vector<double>& seg); //Slab n + 1 from the state at the end of slab n
+    //A coarse sweep keeps a fine vessel at the end of slab n, moved on a slab at a time,
+    //and the coarse vessel; coarse leaves the fine vessel with its prediction of slab n + 1
+    void startSweep(int n, vessel& fine_vessel, vessel& coarse_vessel) const;
+    void nextSlab(int n, vessel& fine_vessel) const; //from the end of slab n - 1 to n
+    void coarse(int n, vessel& fine_vessel, vessel& coarse_vessel, vector<double>& seg);
+
+    string fine_state, coarse_state; //writeState of the initialized vessels
+    const load_schedule* schedule;
+    int slab_steps, n_steps;
+    vector<vector<double>> U; //boundary segments of slabs 1 to n_slabs
+};
+
+#endif /* PARAREAL */
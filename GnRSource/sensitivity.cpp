@@ -0,0 +1,182 @@
+// sensitivity.cpp
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <gsl/gsl_errno.h>
+#include <gsl/gsl_vector.h>
+#include <gsl/gsl_roots.h>
+#include <gsl/gsl_multiroots.h>
+
+#include "vessel.h"
+#include "functions.h"
+#include "dual_vessel.h"
+#include "gnr_binary.h"
+#include "ensemble.h"
+#include "sensitivity.h"
+
+using std::string;
+using std::vector;
+using std::cout;
+
+sensitivity::sensitivity(int n_threads) : pool(n_threads) {
+}
+
+void sensitivity::readParameters(string param_file) {
+    std::ifstream params_in(param_file);
+    if (!params_in) {
+        throw std::runtime_error("Could not open parameter file " + param_file);
+    }
+
+    string line;
+    while (std::getline(params_in, line)) {
+        size_t hash = line.find('#');
+        if (hash != string::npos) {
+            line = line.substr(0, hash);
+        }
+        std::stringstream ss(line);
+        string name;
+        double val;
+        if (!(ss >> name)) {
+            continue;
+        }
+        if (!(ss >> val)) {
+            throw std::runtime_error("Parameter line needs <parameter> <value>: " + line);
+        }
+        params.push_back(name);
+        value.push_back(val);
+    }
+    if (params.empty()) {
+        throw std::runtime_error("No parameters in " + param_file);
+    }
+}
+
+void sensitivity::initialize(string native_file, double n_days, double dt, string cache_dir) {
+    vessel base_vessel;
+    if (cache_dir.empty()) {
+        base_vessel.initializeNative(native_file, n_days, dt);
+    }
+    else {
+        base_vessel.initializeNativeCached(native_file, cache_dir, n_days, dt);
+    }
+    std::ostringstream state_out(std::ios::binary);
+    base_vessel.writeState(state_out);
+    base_state = state_out.str();
+}
+
+void sensitivity::solve(const string& state, const vector<string>& params, const vector<double>& values,
+                        int n_steps, thread_pool& pool, vector<double>& rows, vector<double>& d_rows) {
+    const int n_out = vessel::n_native_outputs;
+    int n_params = int(params.size());
+
+    vessel primal;
+    std::istringstream state_in(state, std::ios::binary);
+    primal.readState(state_in);
+    if (primal.mech_exp_flag == 1) {
+        throw std::runtime_error("No sensitivities of mechanical experiments");
+    }
+    int n_rows = std::min(n_steps, primal.nts);
+    rows.assign(n_rows * n_out, 0.0);
+    d_rows.assign(n_rows * n_out * n_params, 0.0);
+
+    //Initial state as written by gnr, before the loads
+    primal.nativeOutputRow(&rows[0]);
+    primal.P = primal.P_h;
+    primal.Q = primal.Q_h;
+    primal.T_act = primal.T_act_h;
+    primal.wss_calc_flag = 1;
+    bool infl_flag = false;
+    for (int j = 0; j < n_params; j++) {
+        ensemble::setParameter(primal, params[j], values[j]);
+        infl_flag = infl_flag || !ensemble::isLoadParameter(params[j]);
+    }
+    if (infl_flag) {
+        primal.updateInflammation();
+    }
+
+    //One dual vessel per batch of parameters, from the loaded state
+    int n_batches = (n_params + dual::n_dirs - 1) / dual::n_dirs;
+    vector<dual_vessel> tangents(n_batches, dual_vessel(primal));
+    for (int b = 0; b < n_batches; b++) {
+        bool batch_infl_flag = false;
+        for (int j = b * dual::n_dirs; j < std::min(n_params, (b + 1) * dual::n_dirs); j++) {
+            batch_infl_flag = tangents[b].seed(params[j], j - b * dual::n_dirs) || batch_infl_flag;
+        }
+        if (batch_infl_flag) {
+            update_inflammation(tangents[b]);
+        }
+    }
+
+    //The G&R solution, then its derivatives
+    for (int sn = 1; sn < n_rows; sn++) {
+        step_vessel(primal, sn);
+        primal.nativeOutputRow(&rows[sn * n_out]);
+    }
+
+    pool.run(n_batches, [&](int b) {
+        dual row[vessel::n_native_outputs];
+        for (int sn = 1; sn < n_rows; sn++) {
+            step_dual_vessel(tangents[b], primal, sn);
+            tangents[b].nativeOutputRow(row);
+            for (int k = 0; k < n_out; k++) {
+                for (int j = b * dual::n_dirs; j < std::min(n_params, (b + 1) * dual::n_dirs); j++) {
+                    d_rows[(sn * n_out + k) * n_params + j] = row[k].d[j - b * dual::n_dirs];
+                }
+            }
+        }
+    });
+}
+
+void sensitivity::run(int n_steps, const vector<string>& outputs, string out_prefix) {
+    int n_params = int(params.size());
+    vector<string> native_names = vessel::nativeOutputNames();
+    vector<int> out_index;
+    vector<string> out_cols = { "s" };
+    for (int k = 0; k < outputs.size(); k++) {
+        int idx = int(std::find(native_names.begin(), native_names.end(), outputs[k]) - native_names.begin());
+        if (idx == native_names.size()) {
+            throw std::runtime_error("Unknown GnR_out column " + outputs[k]);
+        }
+        out_index.push_back(idx);
+        out_cols.push_back(outputs[k]);
+        for (int j = 0; j < n_params; j++) {
+            out_cols.push_back("d" + outputs[k] + "/d" + params[j]);
+        }
+    }
+
+    vector<double> rows, d_rows;
+    solve(base_state, params, value, n_steps, pool, rows, d_rows);
+
+    const int n_out = vessel::n_native_outputs;
+    int n_rows = int(rows.size()) / n_out;
+    double dt;
+    {
+        vessel check;
+        std::istringstream state_in(base_state, std::ios::binary);
+        check.readState(state_in);
+        dt = check.dt;
+    }
+
+    binary_table_writer sens_table;
+    sens_table.open(out_prefix + "_sens.bin", out_cols, false);
+    vector<double> out_row(out_cols.size());
+    for (int sn = 0; sn < n_rows; sn++) {
+        int c = 0;
+        out_row[c++] = dt * sn;
+        for (int k = 0; k < out_index.size(); k++) {
+            out_row[c++] = rows[sn * n_out + out_index[k]];
+            for (int j = 0; j < n_params; j++) {
+                out_row[c++] = d_rows[(sn * n_out + out_index[k]) * n_params + j];
+            }
+        }
+        sens_table.write_row(&out_row[0]);
+    }
+    sens_table.close();
+}
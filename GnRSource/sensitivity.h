@@ -0,0 +1,47 @@
+// sensitivity.h
+#ifndef SENSITIVITY
+#define SENSITIVITY
+
+#include <string>
+#include <vector>
+
+#include "thread_pool.h"
+
+using std::string;
+using std::vector;
+
+//Forward sensitivities of a vessel's G&R: the derivatives of the GnR_out columns with
+//respect to parameters, by dual numbers through the step kernels (dual_vessel.h) instead
+//of perturbed runs. A parameter file has one parameter per line:
+//
+//  <parameter> <value>
+//
+//with the loads, inflammation parameters and gains of ensemble.h (not the flags, nor
+//Native_in entries, which set the homeostatic state). Text after '#' is ignored.
+//
+//The G&R runs once with the values set; then batches of dual::n_dirs parameters step
+//their derivatives along the solution in parallel. The result is one binary table
+//<prefix>_sens.bin with s and, for each selected column c, c and d<c>/d<parameter> per
+//step. Derivatives of the initial row, before the loads, are zero.
+class sensitivity {
+public:
+    sensitivity(int n_threads = 0);
+
+    void readParameters(string param_file);
+    void initialize(string native_file, double n_days, double dt, string cache_dir = "");
+    void run(int n_steps, const vector<string>& outputs, string out_prefix);
+
+    //GnR_out rows [step * vessel::n_native_outputs + k] of the run from a state snapshot
+    //with the parameters set, and their derivatives [(step * n_native_outputs + k) *
+    //params.size() + j]
+    static void solve(const string& state, const vector<string>& params, const vector<double>& values,
+                      int n_steps, thread_pool& pool, vector<double>& rows, vector<double>& d_rows);
+
+    vector<string> params;
+    vector<double> value;
+
+    string base_state; //writeState of the initialized base vessel
+    thread_pool pool;
+};
+
+#endif /* SENSITIVITY */
@@ -0,0 +1,93 @@
+// step_transaction.cpp
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "vessel.h"
+#include "step_transaction.h"
+
+using std::string;
+using std::vector;
+
+//History arrays of the step, with the passive configuration of the mechanical tests
+static vector<vector<double>*> journal_arrays(vessel& v) {
+    vector<vector<double>*> arrays = step_history_arrays(v);
+    arrays.push_back(&v.a_pas);
+    arrays.push_back(&v.a_mid_pas);
+    arrays.push_back(&v.h_pas);
+    return arrays;
+}
+
+step_transaction::step_transaction() {
+    curr_vessel = NULL;
+    sn = 0;
+    sn_prev = 0;
+}
+
+void step_transaction::begin(vessel& curr_vessel_inp, int sn_inp) {
+    curr_vessel = &curr_vessel_inp;
+    sn = sn_inp;
+    sn_prev = curr_vessel->sn;
+    vessel& v = *curr_vessel;
+    int nts = v.nts;
+    vector<vector<double>*> arrays = journal_arrays(v);
+    vector<double*> carried = step_carried_state(v);
+
+    journal.clear();
+    journal.push_back(v.s);
+    journal.push_back(v.P);
+    journal.push_back(v.Q);
+    journal.push_back(v.T_act);
+    journal.push_back(v.P_prev);
+    journal.push_back(v.T_act_prev);
+    for (int j = 0; j < carried.size(); j++) {
+        journal.push_back(*carried[j]);
+    }
+    //Past the last step nothing is written to the history
+    if (sn >= 0 && sn < nts) {
+        for (int j = 0; j < arrays.size(); j++) {
+            int n_blocks = int(arrays[j]->size()) / nts;
+            for (int b = 0; b < n_blocks; b++) {
+                journal.push_back((*arrays[j])[b * nts + sn]);
+            }
+        }
+    }
+}
+
+void step_transaction::rollback() {
+    if (curr_vessel == NULL) {
+        throw std::runtime_error("Rollback without a step transaction");
+    }
+    vessel& v = *curr_vessel;
+    int nts = v.nts;
+    vector<vector<double>*> arrays = journal_arrays(v);
+    vector<double*> carried = step_carried_state(v);
+
+    int k = 0;
+    v.sn = sn_prev;
+    v.s = journal[k++];
+    v.P = journal[k++];
+    v.Q = journal[k++];
+    v.T_act = journal[k++];
+    v.P_prev = journal[k++];
+    v.T_act_prev = journal[k++];
+    for (int j = 0; j < carried.size(); j++) {
+        *carried[j] = journal[k++];
+    }
+    if (sn >= 0 && sn < nts) {
+        for (int j = 0; j < arrays.size(); j++) {
+            int n_blocks = int(arrays[j]->size()) / nts;
+            for (int b = 0; b < n_blocks; b++) {
+                (*arrays[j])[b * nts + sn] = journal[k++];
+            }
+        }
+    }
+}
+
+void step_transaction::commit() {
+    curr_vessel = NULL;
+    journal.clear();
+}
@@ -0,0 +1,52 @@
+// step_transaction.h
+#ifndef STEP_TRANSACTION
+#define STEP_TRANSACTION
+
+#include <vector>
+
+using std::vector;
+
+class vessel;
+
+//History arrays [block * nts + sn] written at step sn and read by later steps
+template <typename V>
+vector<vector<typename V::scalar>*> step_history_arrays(V& v) {
+    return { &v.a, &v.a_mid, &v.h, &v.a_act, &v.rhoR, &v.rho, &v.rhoR_alpha, &v.mR_alpha,
+             &v.k_alpha, &v.epsilonR_alpha, &v.epsilon_alpha, &v.lambda_alpha_tau, &v.lambda_z_tau,
+             &v.ups_infl_p, &v.ups_infl_d };
+}
+
+//State carried from one step to the next
+template <typename V>
+vector<typename V::scalar*> step_carried_state(V& v) {
+    vector<typename V::scalar*> state = { &v.bar_tauw, &v.bar_tauw_prev, &v.lambda_th_curr,
+                                          &v.lambda_z_curr, &v.f };
+    for (int i = 0; i < v.sigma.size(); i++) state.push_back(&v.sigma[i]);
+    for (int i = 0; i < v.sigma_prev.size(); i++) state.push_back(&v.sigma_prev[i]);
+    for (int i = 0; i < v.Cbar.size(); i++) state.push_back(&v.Cbar[i]);
+    for (int i = 0; i < v.epsilon_pol_min.size(); i++) state.push_back(&v.epsilon_pol_min[i]);
+    return state;
+}
+
+//One time step of a vessel that can be tried, inspected and discarded. begin journals
+//what step_vessel overwrites when it takes step sn: the entries of the history arrays
+//(and of the passive configuration) at sn, the carried state, and the time and loads
+//s, sn, P, Q, T_act, P_prev, T_act_prev. These are O(n_alpha) values in place of the
+//O(nts n_alpha) copy of writeState. rollback returns the vessel to the journal and can
+//be repeated for further tries; commit keeps the step.
+class step_transaction {
+public:
+    step_transaction();
+
+    void begin(vessel& curr_vessel, int sn_inp);
+    void rollback();
+    void commit();
+    bool open() const { return curr_vessel != NULL; }
+
+private:
+    vessel* curr_vessel;
+    int sn, sn_prev;
+    vector<double> journal;
+};
+
+#endif /* STEP_TRANSACTION */
@@ -0,0 +1,159 @@
+// thread_pool.cpp
+#include "thread_pool.h"
+
+thread_pool::thread_pool(int n_threads_inp) {
+    n_threads = n_threads_inp > 0 ? n_threads_inp : int(std::thread::hardware_concurrency());
+    if (n_threads < 1) {
+        n_threads = 1;
+    }
+    next_task = 0;
+    n_jobs = 0;
+    n_busy = 0;
+    batch = 0;
+    stop = false;
+    stealing = false;
+    n_steals = 0;
+    queues.reset(new task_queue[n_threads]);
+
+    //The calling thread also works on each batch as worker 0, so start one fewer worker
+    for (int i = 1; i < n_threads; i++) {
+        workers.push_back(std::thread(&thread_pool::work, this, i));
+    }
+}
+
+thread_pool::~thread_pool() {
+    {
+        std::lock_guard<std::mutex> lock(m);
+        stop = true;
+    }
+    start_cv.notify_all();
+    for (int i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+}
+
+void thread_pool::run(int n_tasks, std::function<void(int)> task) {
+    {
+        std::lock_guard<std::mutex> lock(m);
+        job = task;
+        n_jobs = n_tasks;
+        next_task = 0;
+        n_busy = int(workers.size());
+        error = nullptr;
+        stealing = false;
+        batch++;
+    }
+    start_cv.notify_all();
+
+    run_tasks(0);
+
+    std::unique_lock<std::mutex> lock(m);
+    done_cv.wait(lock, [this] { return n_busy == 0; });
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void thread_pool::run_stealing(const vector<int>& order, std::function<void(int)> task) {
+    //No worker is inside a batch here, so the queues can be filled without their locks
+    for (int t = 0; t < n_threads; t++) {
+        queues[t].tasks.clear();
+    }
+    for (int k = 0; k < order.size(); k++) {
+        queues[k % n_threads].tasks.push_back(order[k]);
+    }
+    n_steals = 0;
+    {
+        std::lock_guard<std::mutex> lock(m);
+        job = task;
+        n_jobs = int(order.size());
+        n_busy = int(workers.size());
+        error = nullptr;
+        stealing = true;
+        batch++;
+    }
+    start_cv.notify_all();
+
+    run_tasks(0);
+
+    std::unique_lock<std::mutex> lock(m);
+    done_cv.wait(lock, [this] { return n_busy == 0; });
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+bool thread_pool::next_stolen(int worker, int& task) {
+    {
+        std::lock_guard<std::mutex> lock(queues[worker].m);
+        if (!queues[worker].tasks.empty()) {
+            task = queues[worker].tasks.front();
+            queues[worker].tasks.pop_front();
+            return true;
+        }
+    }
+
+    //Tasks never add tasks, so once every queue is seen empty the batch is done
+    while (true) {
+        int victim = -1;
+        size_t most = 0;
+        for (int t = 0; t < n_threads; t++) {
+            if (t == worker) {
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(queues[t].m);
+            if (queues[t].tasks.size() > most) {
+                most = queues[t].tasks.size();
+                victim = t;
+            }
+        }
+        if (victim < 0) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(queues[victim].m);
+        if (!queues[victim].tasks.empty()) {
+            task = queues[victim].tasks.back();
+            queues[victim].tasks.pop_back();
+            n_steals++;
+            return true;
+        }
+    }
+}
+
+void thread_pool::run_tasks(int worker) {
+    //Claims tasks until none are left
+    int i;
+    while (stealing ? next_stolen(worker, i) : (i = next_task.fetch_add(1)) < n_jobs) {
+        try {
+            job(i);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(m);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    }
+}
+
+void thread_pool::work(int worker) {
+    long seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m);
+            start_cv.wait(lock, [this, seen] { return stop || batch != seen; });
+            if (stop) {
+                return;
+            }
+            seen = batch;
+        }
+
+        run_tasks(worker);
+
+        {
+            std::lock_guard<std::mutex> lock(m);
+            n_busy--;
+        }
+        done_cv.notify_all();
+    }
+}
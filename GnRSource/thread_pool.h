@@ -0,0 +1,61 @@
+// thread_pool.h
+#ifndef THREAD_POOL
+#define THREAD_POOL
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using std::vector;
+
+//Fixed pool of worker threads running independent tasks, e.g. one vessel per task.
+//run() blocks until every task has finished; the first exception thrown by a task
+//is rethrown on the calling thread.
+class thread_pool {
+public:
+    thread_pool(int n_threads_inp = 0); //0 = one thread per hardware core
+    ~thread_pool();
+
+    void run(int n_tasks, std::function<void(int)> task);
+    //Runs the tasks in order by work stealing: they are dealt round-robin to a deque per
+    //thread, each thread takes from the front of its own and, once it is empty, from the
+    //back of the fullest other one. For tasks of very different cost, listed costliest first.
+    void run_stealing(const vector<int>& order, std::function<void(int)> task);
+    int size() const { return n_threads; }
+    int steals() const { return n_steals; } //tasks stolen in the last run_stealing
+
+private:
+    struct task_queue {
+        std::mutex m;
+        std::deque<int> tasks;
+    };
+
+    void work(int worker);
+    void run_tasks(int worker);
+    bool next_stolen(int worker, int& task);
+
+    int n_threads;
+    vector<std::thread> workers;
+    std::mutex m;
+    std::condition_variable start_cv, done_cv;
+
+    std::function<void(int)> job;
+    std::atomic<int> next_task;
+    int n_jobs;
+    int n_busy; //workers still inside the current batch
+    long batch; //incremented for every call to run
+    bool stop;
+    std::exception_ptr error;
+
+    bool stealing; //the current batch is run from the queues
+    std::unique_ptr<task_queue[]> queues;
+    std::atomic<int> n_steals;
+};
+
+#endif /* THREAD_POOL */
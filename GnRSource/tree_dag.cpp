@@ -0,0 +1,287 @@
+// tree_dag.cpp
+#define _USE_MATH_DEFINES
+
+#include <iostream>
+#include <cstring>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+
+#include "tree_dag.h"
+
+using std::string;
+using std::vector;
+
+struct class_key {
+    int order;
+    uint64_t length_bits;
+    int left, right;
+
+    bool operator==(const class_key& other) const {
+        return order == other.order && length_bits == other.length_bits && left == other.left && right == other.right;
+    }
+};
+
+struct class_key_hash {
+    size_t operator()(const class_key& key) const {
+        //FNV-1a over the key fields
+        uint64_t h = 14695981039346656037ULL;
+        uint64_t vals[4] = { uint64_t(key.order), key.length_bits, uint64_t(uint32_t(key.left)), uint64_t(uint32_t(key.right)) };
+        for (int i = 0; i < 4; i++) {
+            h = (h ^ vals[i]) * 1099511628211ULL;
+        }
+        return size_t(h);
+    }
+};
+
+tree_dag::tree_dag() {
+    n_seg = 0;
+    n_orders = 0;
+    n_classes = 0;
+    root_class = -1;
+    radius_tol = 0.0;
+    n_updated = 0;
+}
+
+void tree_dag::build(int n_seg_inp, int n_orders_inp, const vector<int>& parent, const vector<int>& left,
+                     const vector<int>& right, const vector<int>& order, const vector<double>& length,
+                     bool share_subtrees) {
+    n_seg = n_seg_inp;
+    n_orders = n_orders_inp;
+    cls_order.clear(); cls_left.clear(); cls_right.clear();
+    cls_length.clear(); cls_mask.clear(); cls_top.clear();
+
+    //Hash-cons the segments from the leaves up, children always follow their parent
+    vector<int> seg_class(n_seg);
+    std::unordered_map<class_key, int, class_key_hash> classes;
+    for (int i = n_seg - 1; i >= 0; i--) {
+        class_key key;
+        key.order = order[i];
+        memcpy(&key.length_bits, &length[i], sizeof(double));
+        key.left = left[i] >= 0 ? seg_class[left[i]] : left[i];
+        key.right = right[i] >= 0 ? seg_class[right[i]] : right[i];
+
+        if (share_subtrees) {
+            auto found = classes.find(key);
+            if (found != classes.end()) {
+                seg_class[i] = found->second;
+                continue;
+            }
+        }
+
+        int c = int(cls_order.size());
+        if (share_subtrees) {
+            classes[key] = c;
+        }
+        seg_class[i] = c;
+        cls_order.push_back(key.order);
+        cls_length.push_back(length[i]);
+        cls_left.push_back(key.left);
+        cls_right.push_back(key.right);
+
+        uint64_t mask = n_orders > 64 ? ~uint64_t(0) : uint64_t(1) << (key.order - 1);
+        int top = key.order;
+        int child[2] = { key.left, key.right };
+        for (int k = 0; k < 2; k++) {
+            if (child[k] >= 0) {
+                mask |= cls_mask[child[k]];
+                top = std::max(top, cls_top[child[k]]);
+            }
+        }
+        cls_mask.push_back(mask);
+        cls_top.push_back(top);
+    }
+    n_classes = int(cls_order.size());
+    root_class = seg_class[0];
+
+    //Classes on the path from the root to the last segment and the side taken at each
+    vector<int> path_seg;
+    for (int seg = n_seg - 1; seg >= 0; seg = parent[seg]) {
+        path_seg.push_back(seg);
+    }
+    std::reverse(path_seg.begin(), path_seg.end());
+    path_class.resize(path_seg.size());
+    path_side.resize(path_seg.size());
+    for (size_t k = 0; k < path_seg.size(); k++) {
+        int seg = path_seg[k];
+        path_class[k] = seg_class[seg];
+        path_side[k] = k + 1 < path_seg.size() && right[seg] == path_seg[k + 1] ? 1 : 0;
+    }
+
+    //Per order storage only up to the highest order in each subtree
+    cls_offset.resize(n_classes + 1);
+    cls_offset[0] = 0;
+    for (int c = 0; c < n_classes; c++) {
+        cls_offset[c + 1] = cls_offset[c] + cls_top[c];
+    }
+    size_t n_vals = cls_offset[n_classes];
+
+    //Segment counts only depend on the topology
+    cls_n.assign(n_vals, 0.0);
+    cls_n_flow.assign(n_vals, 0.0);
+    for (int c = 0; c < n_classes; c++) {
+        double* n_c = &cls_n[cls_offset[c]];
+        double* n_flow_c = &cls_n_flow[cls_offset[c]];
+        n_c[cls_order[c] - 1] += 1;
+        n_flow_c[cls_order[c] - 1] += 1;
+
+        //Children only carry flow when both are connected
+        bool split = cls_left[c] >= 0 && cls_right[c] >= 0;
+        int child[2] = { cls_left[c], cls_right[c] };
+        for (int k = 0; k < 2; k++) {
+            if (child[k] < 0) {
+                continue;
+            }
+            size_t m = cls_offset[child[k]];
+            for (int o = 0; o < cls_top[child[k]]; o++) {
+                n_c[o] += cls_n[m + o];
+                if (split) {
+                    n_flow_c[o] += cls_n_flow[m + o];
+                }
+            }
+        }
+    }
+
+    cls_r_seg.assign(n_classes, 0.0);
+    cls_input_resistance.assign(n_classes, 0.0);
+    cls_phi_left.assign(n_classes, 0.0);
+    cls_phi_right.assign(n_classes, 0.0);
+    cls_f1.assign(n_vals, 0.0);
+    cls_f2.assign(n_vals, 0.0);
+    cls_a1.assign(n_vals, 0.0);
+    cls_a2.assign(n_vals, 0.0);
+    radius_cached.clear();
+    viscosity_cached.clear();
+}
+
+void tree_dag::updateClass(int c) {
+    int o_s = cls_order[c] - 1;
+    double r = radius_cached[o_s];
+    double r_s = 8 * viscosity_cached[o_s] * cls_length[c] / (M_PI * pow(r, 4));
+    int l = cls_left[c], rt = cls_right[c];
+    cls_r_seg[c] = r_s;
+
+    //Input resistance, as computeResistance
+    double resistance = 0.0;
+    if (l == seg_terminal && rt == seg_terminal) {
+        resistance = r_s;
+    }
+    else if (l == seg_unconnected && rt != seg_unconnected) {
+        resistance = r_s + (rt >= 0 ? cls_input_resistance[rt] : 0.0);
+    }
+    else if (rt == seg_unconnected && l != seg_unconnected) {
+        resistance = r_s + (l >= 0 ? cls_input_resistance[l] : 0.0);
+    }
+    else if (l >= 0 && rt >= 0) {
+        resistance = r_s + 1 / (1 / cls_input_resistance[l] + 1 / cls_input_resistance[rt]);
+    }
+    cls_input_resistance[c] = resistance;
+
+    double* f1 = &cls_f1[cls_offset[c]];
+    double* f2 = &cls_f2[cls_offset[c]];
+    double* a1 = &cls_a1[cls_offset[c]];
+    double* a2 = &cls_a2[cls_offset[c]];
+    for (int o = 0; o < cls_top[c]; o++) {
+        f1[o] = f2[o] = a1[o] = a2[o] = 0.0;
+    }
+
+    //Root segment: unit flow, mean pressure drop of half the segment
+    f1[o_s] += 1;
+    f2[o_s] += 1;
+    a1[o_s] += r_s / 2;
+    a2[o_s] += r_s * r_s / 4;
+
+    if (l < 0 || rt < 0) {
+        cls_phi_left[c] = cls_phi_right[c] = 0.0;
+        return;
+    }
+
+    //Children see the outlet pressure of the root segment and a fraction of its flow
+    double rl = cls_input_resistance[l], rr = cls_input_resistance[rt];
+    cls_phi_left[c] = rr / (rl + rr);
+    cls_phi_right[c] = rl / (rl + rr);
+    int child[2] = { l, rt };
+    double phi[2] = { cls_phi_left[c], cls_phi_right[c] };
+    for (int k = 0; k < 2; k++) {
+        size_t m = cls_offset[child[k]];
+        for (int o = 0; o < cls_top[child[k]]; o++) {
+            double n_flow = cls_n_flow[m + o];
+            f1[o] += phi[k] * cls_f1[m + o];
+            f2[o] += phi[k] * phi[k] * cls_f2[m + o];
+            a1[o] += r_s * n_flow + phi[k] * cls_a1[m + o];
+            a2[o] += r_s * r_s * n_flow + 2 * r_s * phi[k] * cls_a1[m + o] + phi[k] * phi[k] * cls_a2[m + o];
+        }
+    }
+}
+
+void tree_dag::update(const vector<double>& radius_order, const vector<double>& viscosity_order) {
+    //Orders whose radius moved beyond the tolerance since they were last solved
+    uint64_t changed = 0;
+    bool first = radius_cached.empty();
+    if (first) {
+        radius_cached = radius_order;
+        viscosity_cached = viscosity_order;
+    }
+    for (int o = 0; o < n_orders; o++) {
+        double dr = fabs(radius_order[o] - radius_cached[o]);
+        double dv = fabs(viscosity_order[o] - viscosity_cached[o]);
+        if (first || dr > radius_tol * radius_cached[o] || dv > radius_tol * viscosity_cached[o]) {
+            changed |= n_orders > 64 ? ~uint64_t(0) : uint64_t(1) << o;
+            radius_cached[o] = radius_order[o];
+            viscosity_cached[o] = viscosity_order[o];
+        }
+    }
+
+    n_updated = 0;
+    if (changed == 0) {
+        return;
+    }
+    for (int c = 0; c < n_classes; c++) {
+        if (cls_mask[c] & changed) {
+            updateClass(c);
+            n_updated++;
+        }
+    }
+}
+
+void tree_dag::orderSums(double Q_in, double P_term, const vector<double>& thickness,
+                         vector<double>& n_seg_order, vector<double>& sum, vector<double>& sum_sq) const {
+    //Root pressure from the terminal pressure at the last segment
+    double p = P_term;
+    double f = 1.0;
+    for (size_t k = 0; k < path_class.size(); k++) {
+        int c = path_class[k];
+        p += Q_in * f * cls_r_seg[c];
+        f *= path_side[k] == 1 ? cls_phi_right[c] : cls_phi_left[c];
+    }
+    double q = Q_in;
+
+    n_seg_order.assign(n_orders, 0.0);
+    sum.assign(4 * n_orders, 0.0);
+    sum_sq.assign(4 * n_orders, 0.0);
+    size_t m = cls_offset[root_class];
+    for (int o = 0; o < cls_top[root_class]; o++) {
+        double n_flow = cls_n_flow[m + o];
+        double f1 = cls_f1[m + o], f2 = cls_f2[m + o], a1 = cls_a1[m + o], a2 = cls_a2[m + o];
+        double r = radius_cached[o];
+        double k_wss = 4 * viscosity_cached[o] / (M_PI * pow(r, 3));
+        double k_sigma = r / thickness[o];
+
+        //Segment mean pressure is p - q * a, flow q * f, without flow both are 0
+        double sum_p = n_flow * p - q * a1;
+        double sum_sq_p = n_flow * p * p - 2 * p * q * a1 + q * q * a2;
+
+        n_seg_order[o] = cls_n[m + o];
+        sum[4 * o + 0] = sum_p;
+        sum_sq[4 * o + 0] = sum_sq_p;
+        sum[4 * o + 1] = q * f1;
+        sum_sq[4 * o + 1] = q * q * f2;
+        sum[4 * o + 2] = k_sigma * sum_p;
+        sum_sq[4 * o + 2] = k_sigma * k_sigma * sum_sq_p;
+        sum[4 * o + 3] = k_wss * q * f1;
+        sum_sq[4 * o + 3] = k_wss * k_wss * q * q * f2;
+    }
+}
@@ -0,0 +1,81 @@
+// tree_dag.h
+#ifndef TREE_DAG
+#define TREE_DAG
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+static const int seg_terminal = -1; //no children (0 in seg_connectivity)
+static const int seg_unconnected = -2; //child not generated (-1 in seg_connectivity)
+
+//Subtree-sharing form of a morphometric tree. Segments whose order, length and child
+//subtrees are identical form one class, so a tree generated from a connectivity matrix
+//is stored as a directed acyclic graph of a few unique subtrees.
+//
+//Every segment of an order has that order's radius, so the flow in a subtree is its
+//inlet flow times fixed fractions and the mean pressure of a segment is the inlet
+//pressure less the inlet flow times a fixed resistance. Each class keeps, per order,
+//the segment counts and the sums and sums of squares of these fractions and
+//resistances, from which the per-order mean and standard deviation of pressure, flow,
+//wall stress and WSS of the whole tree follow without visiting any segment.
+//
+//Classes are numbered children first. When the radius of some orders changes only the
+//classes whose subtree contains one of these orders are recomputed.
+//
+//Without sharing every segment is its own class. An update then recomputes the
+//segments of the changed orders and their ancestors only, and with radius_tol > 0
+//orders whose radius moved by less than radius_tol (relative) since they were last
+//solved keep their previous resistances.
+class tree_dag {
+public:
+    tree_dag();
+
+    //Topology as morphometric_tree: 0-based, seg_terminal/seg_unconnected child codes
+    void build(int n_seg_inp, int n_orders_inp, const vector<int>& parent, const vector<int>& left,
+               const vector<int>& right, const vector<int>& order, const vector<double>& length,
+               bool share_subtrees = true);
+
+    //Resistances, flow fractions and sums of the classes affected by a change of the
+    //per-order radius (cm) and viscosity (Poise)
+    void update(const vector<double>& radius_order, const vector<double>& viscosity_order);
+
+    //Per-order counts, sums and sums of squares of P, Q, Sigma, WSS (k = 0..3) for the
+    //inlet flow Q_in (ml/s) and terminal pressure P_term (dyn/cm^2), [4 * (ord - 1) + k]
+    void orderSums(double Q_in, double P_term, const vector<double>& thickness,
+                   vector<double>& n_seg_order, vector<double>& sum, vector<double>& sum_sq) const;
+
+    int n_seg; //segments represented
+    int n_orders;
+    int n_classes;
+    int root_class;
+    double radius_tol; //relative radius change below which an order is not re-solved
+    int n_updated; //classes recomputed by the last update
+
+    //Classes: root segment order and length, child classes or child codes
+    vector<int> cls_order, cls_left, cls_right;
+    vector<double> cls_length;
+    vector<uint64_t> cls_mask; //orders present in the subtree, all bits if n_orders > 64
+    vector<int> cls_top; //highest order in the subtree
+
+    //Per class results
+    vector<double> cls_r_seg, cls_input_resistance, cls_phi_left, cls_phi_right;
+
+private:
+    void updateClass(int c);
+
+    //Per class and order up to cls_top, [cls_offset[c] + ord - 1]
+    vector<size_t> cls_offset;
+    vector<double> cls_n, cls_n_flow; //segments, segments with flow
+    vector<double> cls_f1, cls_f2, cls_a1, cls_a2; //sums of flow fraction and pressure drop per unit flow
+
+    //Root to the last segment, for the pressure at the root from the terminal pressure
+    vector<int> path_class, path_side;
+
+    vector<double> radius_cached, viscosity_cached;
+};
+
+#endif /* TREE_DAG */
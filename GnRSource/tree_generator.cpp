@@ -0,0 +1,248 @@
+// tree_generator.cpp
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "tree_generator.h"
+
+using std::string;
+using std::vector;
+
+tree_generator::tree_generator() {
+    n_orders = 0;
+    root_order = 0;
+}
+
+void tree_generator::readMorphometry(string file_name) {
+    std::ifstream morph_in(file_name);
+    if (!morph_in) {
+        throw std::runtime_error("Could not open tree morphometry " + file_name);
+    }
+
+    //Skip comment lines
+    while (morph_in.peek() == '#') {
+        morph_in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+    morph_in >> n_orders;
+    if (!morph_in || n_orders < 1 || n_orders > 255) {
+        throw std::runtime_error("Bad number of orders in tree morphometry " + file_name);
+    }
+
+    //Matrix is written row by row, stored column by column as in MATLAB
+    connectivity.resize(n_orders * n_orders);
+    for (int child = 0; child < n_orders; child++) {
+        for (int par = 0; par < n_orders; par++) {
+            morph_in >> connectivity[child + n_orders * par];
+        }
+    }
+    diameter.resize(n_orders);
+    length.resize(n_orders);
+    for (int ord = 0; ord < n_orders; ord++) {
+        morph_in >> diameter[ord];
+    }
+    for (int ord = 0; ord < n_orders; ord++) {
+        morph_in >> length[ord];
+    }
+    if (!morph_in) {
+        throw std::runtime_error("Tree morphometry file ended early: " + file_name);
+    }
+}
+
+void tree_generator::prune(int order_remodeling, double alpha, double beta) {
+    for (int ord = 0; ord < std::min(order_remodeling, n_orders); ord++) {
+        for (int par = 0; par < n_orders; par++) {
+            connectivity[ord + n_orders * par] *= alpha;
+        }
+        diameter[ord] *= beta;
+    }
+}
+
+int tree_generator::childOrders(int elem_order, vector<int>& child_orders) {
+    //Round the mean number of children plus the running remainder, as Jiang et al.
+    //omit the pruned elements
+    int number_of_children = 0;
+    child_orders.clear();
+    for (int ord = 0; ord < n_orders; ord++) {
+        int m = ord + n_orders * (elem_order - 1);
+        double children = connectivity[m] + remainder[m];
+        remainder[m] = children - round(children);
+        children = round(children);
+        total_elements_created[ord] += children;
+        number_of_children += int(children);
+
+        //List of child orders from smallest to largest
+        if (ord < root_order) {
+            for (int k = 0; k < int(children); k++) {
+                child_orders.push_back(ord + 1);
+            }
+        }
+    }
+    if (int(child_orders.size()) != number_of_children) {
+        throw std::runtime_error("Connectivity gives children of an order above the root order");
+    }
+    return number_of_children;
+}
+
+static void reorder_children(vector<int>& child_orders, int root_order) {
+    //Move the largest child ahead of the next two when it is of the root order
+    int m = int(child_orders.size());
+    if (child_orders[m - 1] == root_order && m != 2) {
+        int largest = child_orders[m - 1];
+        child_orders[m - 1] = child_orders[m - 2];
+        child_orders[m - 2] = child_orders[m - 3];
+        child_orders[m - 3] = largest;
+    }
+}
+
+void tree_generator::addSegment(int32_t parent, int32_t left, int32_t right, double radius, double length, int order) {
+    seg_parent.push_back(parent);
+    seg_left.push_back(left);
+    seg_right.push_back(right);
+    seg_radius.push_back(float(radius));
+    seg_length.push_back(float(length));
+    seg_order.push_back(uint8_t(order));
+}
+
+void tree_generator::addElement(int32_t parent_seg, int side, int order) {
+    elem_parent_seg.push_back(parent_seg);
+    elem_side.push_back(uint8_t(side));
+    elem_order.push_back(uint8_t(order));
+}
+
+void tree_generator::generate(int root_order_inp) {
+    root_order = root_order_inp;
+    if (root_order < 1 || root_order > n_orders) {
+        throw std::runtime_error("Root order is outside the connectivity matrix");
+    }
+
+    remainder.assign(n_orders * n_orders, 0.0);
+    total_elements_created.assign(n_orders, 0.0);
+    seg_parent.clear(); seg_left.clear(); seg_right.clear();
+    seg_radius.clear(); seg_length.clear(); seg_order.clear();
+    elem_parent_seg.clear(); elem_side.clear(); elem_order.clear();
+
+    vector<int> child_orders;
+    int number_of_children = childOrders(root_order, child_orders);
+    if (number_of_children < 2) {
+        throw std::runtime_error("Children for root < 2");
+    }
+
+    //Root element, split into number_of_children - 1 segments
+    addElement(0, 0, root_order);
+    for (int i = 1; i <= number_of_children - 1; i++) {
+        addSegment(i - 1, -1, i < number_of_children - 1 ? i + 1 : -1, diameter[root_order - 1] / 2,
+                   length[root_order - 1] / (number_of_children - 1), root_order);
+    }
+    reorder_children(child_orders, root_order);
+
+    //Last two children at the outlet, the rest on the left of the interior segments
+    int32_t max_seg = int32_t(seg_parent.size());
+    int m = int(child_orders.size());
+    addElement(max_seg, 2, child_orders[m - 1]);
+    addElement(max_seg, 3, child_orders[m - 2]);
+    for (int i = 1; i <= m - 2; i++) {
+        addElement(max_seg - i, 2, child_orders[m - 2 - i]);
+    }
+
+    //Expand the remaining elements in the order they were created
+    for (size_t elem = 1; elem < elem_parent_seg.size(); elem++) {
+        int32_t par_index = elem_parent_seg[elem];
+        int side = elem_side[elem];
+        int current_order = elem_order[elem];
+        if (seg_parent.size() >= size_t(std::numeric_limits<int32_t>::max())) {
+            throw std::runtime_error("Morphometric tree exceeds 32-bit segment indices");
+        }
+        int32_t first_seg_index = int32_t(seg_parent.size()) + 1;
+
+        number_of_children = childOrders(current_order, child_orders);
+        double radius = diameter[current_order - 1] / 2;
+        double len = length[current_order - 1];
+
+        //Connect the first segment of the element to its parent segment
+        if (side == 2) {
+            seg_left[par_index - 1] = first_seg_index;
+        }
+        else {
+            seg_right[par_index - 1] = first_seg_index;
+        }
+
+        if (number_of_children == 0) {
+            addSegment(par_index, 0, 0, radius, len, current_order);
+        }
+        else if (number_of_children == 1) {
+            //Split the element into 2 and add the child to the mid point
+            addSegment(par_index, -1, first_seg_index + 1, radius, len / 2, current_order);
+            addSegment(first_seg_index, 0, 0, radius, len / 2, current_order);
+            addElement(first_seg_index, 2, child_orders[0]);
+        }
+        else {
+            reorder_children(child_orders, root_order);
+            double seg_len = len / (number_of_children - 1);
+            if (number_of_children == 2) {
+                addSegment(par_index, -1, -1, radius, seg_len, current_order);
+            }
+            else {
+                for (int i = 1; i <= number_of_children - 1; i++) {
+                    int32_t seg_par = i == 1 ? par_index : first_seg_index + i - 2;
+                    int32_t seg_right_child = i < number_of_children - 1 ? first_seg_index + i : -1;
+                    addSegment(seg_par, -1, seg_right_child, radius, seg_len, current_order);
+                }
+            }
+
+            max_seg = int32_t(seg_parent.size());
+            m = int(child_orders.size());
+            addElement(max_seg, 2, child_orders[m - 1]);
+            addElement(max_seg, 3, child_orders[m - 2]);
+            for (int i = 1; i <= m - 2; i++) {
+                addElement(max_seg - i, 2, child_orders[m - 2 - i]);
+            }
+        }
+    }
+}
+
+void tree_generator::writeBinary(string file_name) const {
+    FILE* tree_out = fopen(file_name.c_str(), "wb");
+    if (tree_out == NULL) {
+        throw std::runtime_error("Could not open tree file " + file_name);
+    }
+
+    uint32_t header[4] = { uint32_t(seg_parent.size()), uint32_t(elem_parent_seg.size()),
+                           uint32_t(n_orders), uint32_t(root_order) };
+    size_t n_seg = seg_parent.size(), n_elem = elem_parent_seg.size();
+    bool ok = fwrite(gnr_tree_magic, 1, 8, tree_out) == 8 && fwrite(header, sizeof(uint32_t), 4, tree_out) == 4 &&
+              fwrite(seg_parent.data(), sizeof(int32_t), n_seg, tree_out) == n_seg &&
+              fwrite(seg_left.data(), sizeof(int32_t), n_seg, tree_out) == n_seg &&
+              fwrite(seg_right.data(), sizeof(int32_t), n_seg, tree_out) == n_seg &&
+              fwrite(seg_radius.data(), sizeof(float), n_seg, tree_out) == n_seg &&
+              fwrite(seg_length.data(), sizeof(float), n_seg, tree_out) == n_seg &&
+              fwrite(seg_order.data(), sizeof(uint8_t), n_seg, tree_out) == n_seg &&
+              fwrite(elem_parent_seg.data(), sizeof(int32_t), n_elem, tree_out) == n_elem &&
+              fwrite(elem_side.data(), sizeof(uint8_t), n_elem, tree_out) == n_elem &&
+              fwrite(elem_order.data(), sizeof(uint8_t), n_elem, tree_out) == n_elem;
+    if (fclose(tree_out) != 0 || !ok) {
+        throw std::runtime_error("Could not write tree file " + file_name);
+    }
+}
+
+void tree_generator::writeText(string file_name) const {
+    FILE* tree_out = fopen(file_name.c_str(), "w");
+    if (tree_out == NULL) {
+        throw std::runtime_error("Could not open tree file " + file_name);
+    }
+
+    fprintf(tree_out, "# n_seg n_orders, then parent left right radius length order\n");
+    fprintf(tree_out, "%d %d\n", int(seg_parent.size()), root_order);
+    for (size_t i = 0; i < seg_parent.size(); i++) {
+        fprintf(tree_out, "%d %d %d %.9g %.9g %d\n", seg_parent[i], seg_left[i], seg_right[i],
+                seg_radius[i], seg_length[i], int(seg_order[i]));
+    }
+    if (fclose(tree_out) != 0) {
+        throw std::runtime_error("Could not write tree file " + file_name);
+    }
+}
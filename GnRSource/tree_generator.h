@@ -0,0 +1,66 @@
+// tree_generator.h
+#ifndef TREE_GENERATOR
+#define TREE_GENERATOR
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+//Builds the morphometric tree of generate_morphometric_tree.m from the Jiang et al.
+//connectivity matrix. Elements are expanded first-in first-out with the same remainder
+//rounding, so segment and element numbers (and the tree) are identical to the MATLAB
+//code, and the segments of each generation are stored contiguously (breadth-first).
+//
+//Storage is structure of arrays with 32-bit indices and float geometry. Connectivity
+//keeps the 1-based MATLAB codes of seg_connectivity: parent 0 for the root, child 0 for
+//a terminal and -1 for a child that was never connected.
+//
+//Binary tree file (native byte order):
+//  "GNRTREE1", uint32 n_seg, uint32 n_elem, uint32 n_orders, uint32 root_order
+//  int32 parent[n_seg], int32 left[n_seg], int32 right[n_seg],
+//  float radius[n_seg], float length[n_seg], uint8 order[n_seg],
+//  int32 elem_parent_seg[n_elem], uint8 elem_side[n_elem], uint8 elem_order[n_elem]
+static const char gnr_tree_magic[8] = { 'G', 'N', 'R', 'T', 'R', 'E', 'E', '1' };
+
+class tree_generator {
+public:
+    tree_generator();
+
+    //Morphometry file: n_orders, the n_orders x n_orders connectivity matrix (row is the
+    //child order, column the parent order), then diameter and length (cm) of each order
+    void readMorphometry(string file_name);
+    //Pruning of find_opt_morphometric_tree.m: connectivity rows and diameters of orders
+    //1..order_remodeling are scaled by alpha and beta
+    void prune(int order_remodeling, double alpha, double beta);
+    void generate(int root_order);
+
+    void writeBinary(string file_name) const;
+    void writeText(string file_name) const; //morphometric_tree::readText format
+
+    int n_orders;
+    int root_order;
+    vector<double> connectivity; //[child_ord - 1 + n_orders * (parent_ord - 1)]
+    vector<double> diameter, length;
+    vector<double> total_elements_created; //per order
+
+    //Segments, seg_connectivity and seg_size
+    vector<int32_t> seg_parent, seg_left, seg_right;
+    vector<float> seg_radius, seg_length;
+    vector<uint8_t> seg_order;
+
+    //Elements, parent_seg_elem
+    vector<int32_t> elem_parent_seg;
+    vector<uint8_t> elem_side, elem_order;
+
+private:
+    vector<double> remainder;
+
+    int childOrders(int elem_order, vector<int>& child_orders);
+    void addSegment(int32_t parent, int32_t left, int32_t right, double radius, double length, int order);
+    void addElement(int32_t parent_seg, int side, int order);
+};
+
+#endif /* TREE_GENERATOR */
@@ -0,0 +1,427 @@
+// uq.cpp
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <gsl/gsl_errno.h>
+#include <gsl/gsl_vector.h>
+#include <gsl/gsl_roots.h>
+#include <gsl/gsl_multiroots.h>
+
+#include "vessel.h"
+#include "functions.h"
+#include "gnr_binary.h"
+#include "ensemble.h"
+#include "uq.h"
+
+using std::string;
+using std::vector;
+using std::cout;
+
+//Joe and Kuo (2008) primitive polynomials (degree s, coefficients a) and initial
+//direction numbers m of dimensions 2 to 21; dimension 1 has all m = 1
+static const int sobol_s[] = { 1, 2, 3, 3, 4, 4, 5, 5, 5, 5, 5, 5, 6, 6, 6, 6, 6, 6, 7, 7 };
+static const int sobol_a[] = { 0, 1, 1, 2, 1, 4, 2, 4, 7, 11, 13, 14, 1, 13, 16, 19, 22, 25, 1, 4 };
+static const int sobol_m[][7] = {
+    { 1 }, { 1, 3 }, { 1, 3, 1 }, { 1, 1, 1 }, { 1, 1, 3, 3 }, { 1, 3, 5, 13 },
+    { 1, 1, 5, 5, 17 }, { 1, 1, 5, 5, 5 }, { 1, 1, 7, 11, 19 }, { 1, 1, 5, 1, 1 },
+    { 1, 1, 1, 3, 11 }, { 1, 3, 5, 5, 31 }, { 1, 3, 3, 9, 7, 49 }, { 1, 1, 1, 15, 21, 21 },
+    { 1, 3, 1, 13, 27, 49 }, { 1, 1, 1, 15, 7, 5 }, { 1, 3, 1, 15, 13, 25 }, { 1, 1, 5, 5, 19, 61 },
+    { 1, 3, 7, 11, 23, 15, 103 }, { 1, 3, 7, 13, 13, 15, 69 } };
+
+sobol_sequence::sobol_sequence(int n_dims_inp) {
+    n_dims = n_dims_inp;
+    if (n_dims < 1 || n_dims > max_dims) {
+        throw std::runtime_error("Sobol sequence needs 1 to " + std::to_string((long long) max_dims) + " dimensions");
+    }
+    v.assign(n_dims * 32, 0);
+    for (int k = 0; k < 32; k++) {
+        v[k] = uint32_t(1) << (31 - k);
+    }
+    for (int d = 1; d < n_dims; d++) {
+        uint32_t* v_d = &v[d * 32];
+        int s = sobol_s[d - 1], a = sobol_a[d - 1];
+        for (int k = 0; k < s; k++) {
+            v_d[k] = uint32_t(sobol_m[d - 1][k]) << (31 - k);
+        }
+        for (int k = s; k < 32; k++) {
+            v_d[k] = v_d[k - s] ^ (v_d[k - s] >> s);
+            for (int j = 1; j < s; j++) {
+                if ((a >> (s - 1 - j)) & 1) {
+                    v_d[k] ^= v_d[k - j];
+                }
+            }
+        }
+    }
+}
+
+void sobol_sequence::point(uint32_t i, double* x) const {
+    //Gray code order: point i is the XOR of the direction numbers of the bits of i ^ (i >> 1)
+    uint32_t gray = i ^ (i >> 1);
+    for (int d = 0; d < n_dims; d++) {
+        uint32_t bits = 0;
+        for (int k = 0; k < 32; k++) {
+            if ((gray >> k) & 1) {
+                bits ^= v[d * 32 + k];
+            }
+        }
+        x[d] = bits / 4294967296.0;
+    }
+}
+
+void running_stats::add(double x) {
+    n++;
+    double delta = x - mean;
+    mean += delta / n;
+    m2 += delta * (x - mean);
+}
+
+p2_quantile::p2_quantile(double p_inp) {
+    p = p_inp;
+    count = 0;
+    double np_0[5] = { 0, 2 * p, 4 * p, 2 + 2 * p, 4 };
+    double dn_0[5] = { 0, p / 2, p, (1 + p) / 2, 1 };
+    for (int i = 0; i < 5; i++) {
+        q[i] = 0.0;
+        n[i] = i;
+        np[i] = np_0[i];
+        dn[i] = dn_0[i];
+    }
+}
+
+void p2_quantile::add(double x) {
+    //The first five observations are the markers, sorted
+    if (count < 5) {
+        q[count++] = x;
+        std::sort(q, q + count);
+        return;
+    }
+    count++;
+
+    int k;
+    if (x < q[0]) {
+        q[0] = x;
+        k = 0;
+    }
+    else if (x >= q[4]) {
+        q[4] = x;
+        k = 3;
+    }
+    else {
+        k = 0;
+        while (x >= q[k + 1]) {
+            k++;
+        }
+    }
+    for (int i = k + 1; i < 5; i++) {
+        n[i] += 1;
+    }
+    for (int i = 0; i < 5; i++) {
+        np[i] += dn[i];
+    }
+
+    //Move the middle markers towards their desired positions, parabolically if the
+    //result stays between the neighbours and linearly otherwise
+    for (int i = 1; i < 4; i++) {
+        double d = np[i] - n[i];
+        if ((d >= 1 && n[i + 1] - n[i] > 1) || (d <= -1 && n[i - 1] - n[i] < -1)) {
+            int sd = d > 0 ? 1 : -1;
+            double q_new = q[i] + sd / (n[i + 1] - n[i - 1]) *
+                ((n[i] - n[i - 1] + sd) * (q[i + 1] - q[i]) / (n[i + 1] - n[i]) +
+                 (n[i + 1] - n[i] - sd) * (q[i] - q[i - 1]) / (n[i] - n[i - 1]));
+            if (!(q[i - 1] < q_new && q_new < q[i + 1])) {
+                q_new = q[i] + sd * (q[i + sd] - q[i]) / (n[i + sd] - n[i]);
+            }
+            q[i] = q_new;
+            n[i] += sd;
+        }
+    }
+}
+
+double p2_quantile::value() const {
+    if (count == 0) {
+        return 0.0;
+    }
+    if (count <= 5) {
+        //Nearest rank of the stored observations
+        int r = int(ceil(p * count)) - 1;
+        return q[std::min(std::max(r, 0), int(count) - 1)];
+    }
+    return q[2];
+}
+
+uq_study::uq_study(int n_threads) : pool(n_threads) {
+    sampler = "sobol";
+    seed = 1;
+    n_days = 0.0;
+    dt = 1.0;
+    n_failed = 0;
+    n_lhs = 0;
+}
+
+void uq_study::readRanges(string range_file) {
+    std::ifstream ranges_in(range_file);
+    if (!ranges_in) {
+        throw std::runtime_error("Could not open parameter ranges " + range_file);
+    }
+
+    string line;
+    while (std::getline(ranges_in, line)) {
+        size_t hash = line.find('#');
+        if (hash != string::npos) {
+            line = line.substr(0, hash);
+        }
+        std::stringstream ss(line);
+        string name, scale;
+        double lo, hi;
+        if (!(ss >> name)) {
+            continue;
+        }
+        if (!(ss >> lo >> hi)) {
+            throw std::runtime_error("Parameter range line needs name, low, high: " + line);
+        }
+        ss >> scale;
+        if (scale == "log" && (lo <= 0 || hi <= 0)) {
+            throw std::runtime_error("Log-uniform range of " + name + " must be positive");
+        }
+        params.push_back(name);
+        low.push_back(lo);
+        high.push_back(hi);
+        log_flag.push_back(scale == "log");
+    }
+    if (params.empty()) {
+        throw std::runtime_error("No parameter ranges in " + range_file);
+    }
+}
+
+void uq_study::initialize(string native_file, double n_days_inp, double dt_inp, string cache_dir) {
+    std::ifstream native_in(native_file);
+    if (!native_in) {
+        throw std::runtime_error("Could not open " + native_file);
+    }
+    std::stringstream contents;
+    contents << native_in.rdbuf();
+    native_text = contents.str();
+    n_days = n_days_inp;
+    dt = dt_inp;
+
+    vessel base_vessel;
+    if (cache_dir.empty()) {
+        base_vessel.initializeNative(native_file, n_days, dt);
+    }
+    else {
+        base_vessel.initializeNativeCached(native_file, cache_dir, n_days, dt);
+    }
+    std::ostringstream state_out(std::ios::binary);
+    base_vessel.writeState(state_out);
+    base_state = state_out.str();
+}
+
+//Uniform in [0, 1) from a hash of the seed, sample and dimension (splitmix64)
+static double hash_uniform(unsigned long seed, long i, int d) {
+    uint64_t z = uint64_t(seed) * 0x9e3779b97f4a7c15ULL + uint64_t(i) * 0xbf58476d1ce4e5b9ULL + uint64_t(d) * 0x94d049bb133111ebULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z = z ^ (z >> 31);
+    return (z >> 11) / 9007199254740992.0;
+}
+
+void uq_study::sample(long i, double* x) const {
+    int n_dims = int(params.size());
+    vector<double> u(n_dims);
+    if (sampler == "lhs") {
+        for (int d = 0; d < n_dims; d++) {
+            u[d] = (lhs_perm[d * n_lhs + i] + hash_uniform(seed, i, d)) / n_lhs;
+        }
+    }
+    else {
+        //From the origin, so that 2^k samples are a (t, k, d)-net
+        sobol.point(uint32_t(i), &u[0]);
+    }
+    for (int d = 0; d < n_dims; d++) {
+        if (log_flag[d]) {
+            x[d] = exp(log(low[d]) + u[d] * (log(high[d]) - log(low[d])));
+        }
+        else {
+            x[d] = low[d] + u[d] * (high[d] - low[d]);
+        }
+    }
+}
+
+void uq_study::run(long n_samples, int n_steps, const vector<string>& outputs, const vector<double>& quantiles,
+                   string out_prefix) {
+    int n_dims = int(params.size());
+    if (sampler == "lhs") {
+        //One random permutation of the strata per dimension
+        n_lhs = n_samples;
+        lhs_perm.resize(n_dims * n_samples);
+        std::mt19937_64 rng(seed);
+        for (int d = 0; d < n_dims; d++) {
+            int* perm = &lhs_perm[d * n_samples];
+            for (long i = 0; i < n_samples; i++) {
+                perm[i] = int(i);
+            }
+            std::shuffle(perm, perm + n_samples, rng);
+        }
+    }
+    else if (sampler == "sobol") {
+        sobol = sobol_sequence(n_dims);
+    }
+    else {
+        throw std::runtime_error("Unknown sampler " + sampler + " (sobol or lhs)");
+    }
+
+    //Native_in entries of the ranges, and checks of the other parameters
+    vector<int> native_line(n_dims, 0), native_col(n_dims, 0);
+    {
+        vessel check;
+        std::istringstream state_in(base_state, std::ios::binary);
+        check.readState(state_in);
+        for (int d = 0; d < n_dims; d++) {
+            if (params[d].compare(0, 10, "Native_in:") == 0) {
+                if (sscanf(params[d].c_str() + 10, "%d:%d", &native_line[d], &native_col[d]) != 2) {
+                    throw std::runtime_error("Native_in parameter needs <line>:<column>: " + params[d]);
+                }
+                ensemble::editNative(native_text, native_line[d], native_col[d], 0.0);
+            }
+            else {
+                ensemble::setParameter(check, params[d], 0.0);
+            }
+        }
+    }
+
+    //Selected GnR_out columns
+    vector<string> native_names = vessel::nativeOutputNames();
+    vector<int> out_index;
+    for (int k = 0; k < outputs.size(); k++) {
+        int idx = int(std::find(native_names.begin(), native_names.end(), outputs[k]) - native_names.begin());
+        if (idx == native_names.size()) {
+            throw std::runtime_error("Unknown GnR_out column " + outputs[k]);
+        }
+        out_index.push_back(idx);
+    }
+    int n_out = int(out_index.size());
+    int n_q = int(quantiles.size());
+    int nts = int(n_days / dt);
+    int n_rows = std::min(n_steps, nts);
+
+    vector<running_stats> stats(n_rows * n_out);
+    vector<p2_quantile> sketches;
+    for (int r = 0; r < n_rows * n_out; r++) {
+        for (int q = 0; q < n_q; q++) {
+            sketches.push_back(p2_quantile(quantiles[q]));
+        }
+    }
+    std::mutex stats_mutex;
+    n_failed = 0;
+
+    pool.run(int(n_samples), [&](int i) {
+        vector<double> x(n_dims), trajectory(n_rows * n_out, 0.0);
+        double row[vessel::n_native_outputs];
+        int n_done = 0;
+        try {
+            sample(i, &x[0]);
+
+            //Edited Native_in, or the shared base vessel
+            vessel curr_vessel;
+            string text = native_text;
+            bool native_flag = false;
+            for (int d = 0; d < n_dims; d++) {
+                if (native_line[d] > 0) {
+                    text = ensemble::editNative(text, native_line[d], native_col[d], x[d]);
+                    native_flag = true;
+                }
+            }
+            if (native_flag) {
+                std::istringstream native_in(text);
+                curr_vessel.initializeNative(native_in, n_days, dt);
+            }
+            else {
+                std::istringstream state_in(base_state, std::ios::binary);
+                curr_vessel.readState(state_in);
+            }
+
+            auto record = [&]() {
+                curr_vessel.nativeOutputRow(row);
+                for (int k = 0; k < n_out; k++) {
+                    trajectory[n_done * n_out + k] = row[out_index[k]];
+                }
+                n_done++;
+            };
+            record();
+            curr_vessel.P = curr_vessel.P_h;
+            curr_vessel.Q = curr_vessel.Q_h;
+            curr_vessel.T_act = curr_vessel.T_act_h;
+            curr_vessel.wss_calc_flag = 1;
+            bool infl_flag = false;
+            for (int d = 0; d < n_dims; d++) {
+                if (native_line[d] == 0) {
+                    ensemble::setParameter(curr_vessel, params[d], x[d]);
+                    infl_flag = infl_flag || !ensemble::isLoadParameter(params[d]);
+                }
+            }
+            if (infl_flag) {
+                curr_vessel.updateInflammation();
+            }
+            for (int sn = 1; sn < n_rows; sn++) {
+                step_vessel(curr_vessel, sn);
+                record();
+            }
+        }
+        catch (std::exception& e) {
+            printf("%s %d %s\n", "Sample failed:", i, e.what());
+            n_done = -1;
+        }
+
+        //Only complete trajectories are folded into the statistics
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        if (n_done != n_rows) {
+            n_failed++;
+            return;
+        }
+        for (int r = 0; r < n_rows * n_out; r++) {
+            stats[r].add(trajectory[r]);
+            for (int q = 0; q < n_q; q++) {
+                sketches[r * n_q + q].add(trajectory[r]);
+            }
+        }
+    });
+
+    vector<string> columns = { "s", "n" };
+    for (int k = 0; k < n_out; k++) {
+        columns.push_back(outputs[k] + "_mean");
+        columns.push_back(outputs[k] + "_sd");
+        for (int q = 0; q < n_q; q++) {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "_q%g", 100 * quantiles[q]);
+            columns.push_back(outputs[k] + buf);
+        }
+    }
+    binary_table_writer out_table;
+    out_table.open(out_prefix + "_out.bin", columns, false);
+    vector<double> out_row(columns.size());
+    for (int sn = 0; sn < n_rows; sn++) {
+        int c = 0;
+        out_row[c++] = sn * dt;
+        out_row[c++] = double(n_samples - n_failed);
+        for (int k = 0; k < n_out; k++) {
+            const running_stats& st = stats[sn * n_out + k];
+            out_row[c++] = st.mean;
+            out_row[c++] = sqrt(st.variance());
+            for (int q = 0; q < n_q; q++) {
+                out_row[c++] = sketches[(sn * n_out + k) * n_q + q].value();
+            }
+        }
+        out_table.write_row(&out_row[0]);
+    }
+    out_table.close();
+}
@@ -0,0 +1,92 @@
+// uq.h
+#ifndef UQ
+#define UQ
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "thread_pool.h"
+
+using std::string;
+using std::vector;
+
+//Points of the Sobol sequence in [0, 1)^d (Joe and Kuo direction numbers, d <= 21).
+//point(i) is computed directly from i, so samples can be generated in any order.
+class sobol_sequence {
+public:
+    sobol_sequence(int n_dims_inp = 1);
+    void point(uint32_t i, double* x) const;
+    static const int max_dims = 21;
+
+    int n_dims;
+private:
+    vector<uint32_t> v; //[dim * 32 + bit] direction numbers scaled by 2^32
+};
+
+//Running mean and variance (Welford)
+struct running_stats {
+    running_stats() : n(0), mean(0.0), m2(0.0) {}
+    void add(double x);
+    double variance() const { return n > 1 ? m2 / (n - 1) : 0.0; }
+
+    long n;
+    double mean, m2;
+};
+
+//Streaming estimate of the p-quantile with five markers (P^2, Jain and Chlamtac 1985)
+struct p2_quantile {
+    p2_quantile(double p_inp = 0.5);
+    void add(double x);
+    double value() const;
+
+    double p;
+    long count;
+    double q[5], n[5], np[5], dn[5];
+};
+
+//Uncertainty quantification over ranges of parameters of a Native_in file. Each line of
+//a range file is
+//
+//  <parameter> <low> <high> [log]
+//
+//with the ensemble parameters (ensemble.h) or Native_in:<line>:<column> for any entry of
+//the Native_in file (1-based, as laid out in the file), sampled uniformly, or log-uniformly
+//with "log". Samples with Native_in entries are initialized from the edited file; the
+//others start from the shared initialized base vessel.
+//
+//The samples are quasi-random (Sobol) or a Latin hypercube, and run in parallel. The
+//selected GnR_out columns of each sample are folded into running mean, standard
+//deviation and quantile sketches of every time step as the sample finishes, so memory
+//and output do not grow with the number of samples. The result is one binary table
+//<prefix>_out.bin with s, n and <column>_mean, <column>_sd, <column>_q<percent> per step.
+//Quantiles depend slightly on the order samples finish in.
+class uq_study {
+public:
+    uq_study(int n_threads = 0);
+
+    void readRanges(string range_file);
+    void initialize(string native_file, double n_days, double dt, string cache_dir = "");
+    void sample(long i, double* x) const; //parameter values of sample i
+    void run(long n_samples, int n_steps, const vector<string>& outputs, const vector<double>& quantiles,
+             string out_prefix);
+
+    string sampler; //"sobol" or "lhs"
+    unsigned long seed; //of the Latin hypercube permutations
+    vector<string> params;
+    vector<double> low, high;
+    vector<int> log_flag;
+
+    string native_text; //contents of the Native_in file
+    string base_state; //writeState of the initialized base vessel
+    double n_days, dt;
+    long n_failed;
+    thread_pool pool;
+
+private:
+    sobol_sequence sobol;
+    vector<int> lhs_perm; //[dim * n_samples + i]
+    long n_lhs;
+};
+
+#endif /* UQ */
@@ -5,6 +5,11 @@
 #include <cmath>
 #include <string>
 #include <vector>
+#include <sstream>
+#include <cstdio>
+#include <cstdint>
+#include <stdexcept>
+#include <chrono>
 #include <gsl/gsl_errno.h>
 #include <gsl/gsl_vector.h>
 #include <gsl/gsl_roots.h>
@@ -12,6 +17,7 @@
 
 #include "vessel.h"
 #include "functions.h"
+#include "output_writer.h"
 
 using std::string;
 using std::vector;
@@ -135,6 +141,7 @@ vessel::vessel() { //Default constructor
     phi_alpha_h = { 0 }, rhoR_alpha_h = { 0 }, mR_alpha_h = { 0 }, k_alpha_h = { 0 };
     K_sigma_p_alpha_h = { 0 }, K_sigma_d_alpha_h = { 0 }, K_tauw_p_alpha_h = { 0 }, K_tauw_d_alpha_h = { 0 };
     delta_i = 0, K_infl_eff = 0, s_int_infl = 0;
+    Ki_trans = 0, Ki_steady = 0, Ki_deg = 0, beta_i = 0;
     delta_m = 0, K_mech_eff = 0, s_int_mech = 0;
     K_i_Tact = 0, phi_Tact0_min = 0;
 
@@ -188,10 +195,25 @@ vessel::vessel() { //Default constructor
     wss_calc_flag = 0; //indicates if GnR should update its own current WSS
     app_visc_flag = 0; //indicates whether to use the empirical correction for viscosity from Secomb 2017
     mech_infl_flag = 0; //indicates whether deviations in mech. bio. stimuli induce infl.
+    mech_exp_flag = 0; //indicates doing a mech exp
+
+    //Output
+    writer = NULL;
+    gnr_stream = -1, equil_gnr_stream = -1, exp_stream = -1;
+
+    //Loading
+    schedule = NULL;
 }
 
 //Initialize the reference vessel for the simulation    
 void vessel::initializeNative(string native_name, double n_days_inp, double dt_inp) {
+    //Load the expereimentally determined and prescribed properties of the vessel from file
+    //Input arguments for scaffold input file (ELS)
+    std::ifstream native_in(native_name);
+    initializeNative(native_in, n_days_inp, dt_inp);
+}
+
+void vessel::initializeNative(std::istream& native_in, double n_days_inp, double dt_inp) {
 
     //Set native vessel time parameters
     double n_days = n_days_inp;
@@ -200,10 +222,6 @@ void vessel::initializeNative(string native_name, double n_days_inp, double dt_i
     sn = 0;
     s = 0.0;
 
-    //Load the expereimentally determined and prescribed properties of the vessel from file
-    //Input arguments for scaffold input file (ELS)
-    std::ifstream native_in(native_name);
-
     native_in >> vessel_name; //Type of vessel simulated
 
     //Initilize the parameters for the reference native vessel
@@ -386,21 +404,12 @@ void vessel::initializeNative(string native_name, double n_days_inp, double dt_i
 
     //Inflammation initialization
     //Need to pass on gamma_inf, K_i_Tact, phi_Tact0_min, delta_i
-    double gamma_fun, steady_fun_i, steady_fun_m;
-    double Ki_trans, Ki_steady, Ki_deg, beta_i;
     native_in >> Ki_trans >> Ki_steady >> Ki_deg;
     native_in >> delta_i >> beta_i;
     native_in >> K_infl_eff >> s_int_infl;
     native_in >> gamma_inf >> K_i_Tact >> phi_Tact0_min;
     native_in >> delta_m >> K_mech_eff >> s_int_mech;
 
-    ups_infl_p.resize(nts * n_alpha);
-    ups_infl_d.resize(nts * n_alpha);
-    K_sigma_p_alpha.resize(nts * n_alpha);
-    K_sigma_d_alpha.resize(nts * n_alpha);
-    K_tauw_p_alpha.resize(nts * n_alpha);
-    K_tauw_d_alpha.resize(nts * n_alpha);
-
     for (int sn = 1; sn < nts; sn++) {
         //Calculate polymer/ground degradation
         s = sn * dt;
@@ -414,25 +423,11 @@ void vessel::initializeNative(string native_name, double n_days_inp, double dt_i
         epsilonR_alpha[0 * nts + sn] = Q_e * epsilonR_alpha[0 * nts + 0];
         rhoR_alpha[0 * nts + sn] = epsilonR_alpha[0 * nts + sn] * rho_hat_alpha_h[0];
 
-        //Calculate immunological stimulus
-        gamma_fun = (pow(delta_i, beta_i)) * pow(s, beta_i - 1) * exp(-delta_i * s)
-            / (delta_i * pow((beta_i - 1), (beta_i - 1)) * exp(1 - beta_i));
-        steady_fun_i = (1 - exp(-delta_i * s)) - (s > s_int_infl) * (1 - K_infl_eff) * (1 - exp(-delta_i * (s - s_int_infl))) ;
-        steady_fun_m = (exp(-delta_m * s)) + 0.25 * (1 - exp(-delta_m * s)) + 
-        + (s > s_int_mech) * (K_mech_eff - 0.25) * (1 - exp(-delta_m * (s - s_int_mech)));
-        for (int alpha = 0; alpha < n_alpha; alpha++){
-            if (alpha_mechinfl[alpha] == 1){
-                ups_infl_p[nts * alpha + sn] = Ki_trans * gamma_fun + Ki_steady * steady_fun_i;
-                ups_infl_d[nts * alpha + sn] = Ki_deg;
-            }
-            K_sigma_p_alpha[nts * alpha + sn] = K_sigma_p_alpha_h[alpha] * steady_fun_m;
-            K_sigma_d_alpha[nts * alpha + sn] = K_sigma_d_alpha_h[alpha] * steady_fun_m;
-            K_tauw_p_alpha[nts * alpha + sn] = K_tauw_p_alpha_h[alpha] * steady_fun_m;
-            K_tauw_d_alpha[nts * alpha + sn] = K_tauw_d_alpha_h[alpha] * steady_fun_m;
-        }
-
     }
 
+    //Calculate immunological stimulus
+    updateInflammation();
+
     //Solve for native stress state
     //Initialize variables for load history
     P = P_h;
@@ -496,10 +491,13 @@ void vessel::initializeNative(string native_name, double n_days_inp, double dt_i
     //For pressure ramping
     P_prev = P;
     T_act_prev = T_act;
-    native_in.close();
 
 }
 
+void vessel::updateInflammation() {
+    update_inflammation(*this);
+}
+
 void vessel::initializeTEVG(string scaffold_name, string immune_name, vessel const &native_vessel, double n_days_inp, double dt_inp) {
     //Copy initialization variables over from native vessel counterpart
     //Initialization parameters
@@ -984,45 +982,95 @@ void vessel::print() {
     return;
 }
 
+void vessel::nativeOutputRow(double* out) const {
+    const double row[] = { a[sn], h[sn], rhoR[sn], rhoR_alpha[0 * nts + sn],
+        rhoR_alpha[1 * nts + sn], rhoR_alpha[2 * nts + sn],
+        bar_tauw, bar_tauw_h, P, P_h, f, f_h,
+        Q, Q_h, Cbar[1], k_alpha[0 * nts + sn], k_alpha[1 * nts + sn],
+        k_alpha[2 * nts + sn], mR_alpha[0 * nts + sn], mR_alpha[1 * nts + sn],
+        mR_alpha[2 * nts + sn], mR_alpha[3 * nts + sn], mR_alpha[4 * nts + sn], mR_alpha[5 * nts + sn] };
+    memcpy(out, row, sizeof(row));
+}
+
 void vessel::printNativeOutputs() {
-    GnR_out << a[sn] << "\t" << h[sn] << "\t" << rhoR[sn] << "\t" << rhoR_alpha[0 * nts + sn] << "\t"
-        << rhoR_alpha[1 * nts + sn] << "\t" << rhoR_alpha[2 * nts + sn]<< "\t"
-        << bar_tauw << "\t" << bar_tauw_h << "\t" << P << "\t" << P_h << "\t" << f << "\t" << f_h
-        << "\t" << Q << "\t" << Q_h << "\t" << Cbar[1] << "\t" << k_alpha[0 * nts + sn] << "\t" << k_alpha[1 * nts + sn] 
-        << "\t" << k_alpha[2 * nts + sn] << "\t" << mR_alpha[0 * nts + sn] << "\t" << mR_alpha[1 * nts + sn]
-        << "\t" << mR_alpha[2 * nts + sn] << "\t" << mR_alpha[3 * nts + sn] << "\t" << mR_alpha[4 * nts + sn] << "\t" << mR_alpha[5 * nts + sn] << "\n";
-    GnR_out.flush();
+    double out[n_native_outputs];
+    nativeOutputRow(out);
+    writeRow(GnR_out, gnr_stream, out, n_native_outputs);
 
     return;
 
 }
 
 void vessel::printExpOutputs() {
-    Exp_out << a[sn] << "\t" << h[sn] << "\t" << rhoR[sn] << "\t" << rhoR_alpha[0 * nts + sn] << "\t"
-        << rhoR_alpha[1 * nts + sn] << "\t" << rhoR_alpha[2 * nts + sn]<< "\t"
-        << bar_tauw << "\t" << bar_tauw_h << "\t" << P << "\t" << P_h << "\t" << f << "\t" << f_h
-        << "\t" << Q << "\t" << Q_h << "\n";
-    Exp_out.flush();
+    double out[] = { a[sn], h[sn], rhoR[sn], rhoR_alpha[0 * nts + sn],
+        rhoR_alpha[1 * nts + sn], rhoR_alpha[2 * nts + sn],
+        bar_tauw, bar_tauw_h, P, P_h, f, f_h,
+        Q, Q_h };
+    writeRow(Exp_out, exp_stream, out, 14);
 
     return;
 
 }
 
+void vessel::nativeEquilibratedOutputRow(double* out) const {
+    const double row[] = { a_e, h_e, rho_m_e, rho_c_e,
+        f_z_e, mb_equil_e };
+    memcpy(out, row, sizeof(row));
+}
+
 void vessel::printNativeEquilibratedOutputs() {
-    Equil_GnR_out << a_e << "\t" << h_e << "\t" << rho_m_e << "\t" << rho_c_e << "\t"
-        << f_z_e << "\t" << mb_equil_e << "\n";
-    Equil_GnR_out.flush();
+    double out[n_native_equil_outputs];
+    nativeEquilibratedOutputRow(out);
+    writeRow(Equil_GnR_out, equil_gnr_stream, out, n_native_equil_outputs);
 
     return;
 
 }
 
 void vessel::printTEVGOutputs() {
-    GnR_out << a[sn] << "\t" << h[sn] << "\t" << rhoR[sn] << "\t" << rhoR_alpha[0 * nts + sn] << "\t"
-        << rhoR_alpha[1 * nts + sn] << "\t" << rhoR_alpha[8 * nts + sn] << "\t"
-        << bar_tauw << "\t" << bar_tauw_h << "\t" << P << "\t" << P_h << "\t" << f << "\t" << f_h
-        << "\t" << Q << "\t" << Q_h << "\n";
-    GnR_out.flush();
+    double out[] = { a[sn], h[sn], rhoR[sn], rhoR_alpha[0 * nts + sn],
+        rhoR_alpha[1 * nts + sn], rhoR_alpha[8 * nts + sn],
+        bar_tauw, bar_tauw_h, P, P_h, f, f_h,
+        Q, Q_h };
+    writeRow(GnR_out, gnr_stream, out, 14);
+
+    return;
+}
+
+vector<string> vessel::nativeOutputNames() {
+    return { "a", "h", "rhoR", "rhoR_e", "rhoR_m", "rhoR_ct",
+        "bar_tauw", "bar_tauw_h", "P", "P_h", "f", "f_h",
+        "Q", "Q_h", "Cbar_t", "k_e", "k_m",
+        "k_ct", "mR_e", "mR_m",
+        "mR_ct", "mR_cz", "mR_cd1", "mR_cd2" };
+}
+
+vector<string> vessel::expOutputNames() {
+    return { "a", "h", "rhoR", "rhoR_e", "rhoR_m", "rhoR_ct",
+        "bar_tauw", "bar_tauw_h", "P", "P_h", "f", "f_h",
+        "Q", "Q_h" };
+}
+
+vector<string> vessel::nativeEquilibratedOutputNames() {
+    return { "a_e", "h_e", "rho_m_e", "rho_c_e",
+        "f_z_e", "mb_equil_e" };
+}
+
+void vessel::writeRow(std::ofstream& out, int stream, const double* vals, int n_vals) {
+    //Hand the row to the asynchronous writer if one is attached, otherwise write
+    //and flush synchronously
+    if (writer != NULL) {
+        writer->write(stream, vals, n_vals);
+        return;
+    }
+
+    for (int i = 0; i < n_vals; i++) {
+        out << vals[i];
+        if (i != n_vals - 1)
+            out << "\t";
+    }
+    out << "\n";
+    out.flush();
 
     return;
 }
@@ -1248,3 +1296,177 @@ void vessel::save() {
     ar.close();
     std::cout << "Saved vessel." << "\n";
 };
+
+//Binary archives for vessel::transfer
+struct state_out {
+    std::ostream& os;
+    template <typename T> void operator()(T& x) {
+        os.write(reinterpret_cast<const char*>(&x), sizeof(T));
+    }
+    template <typename T> void operator()(vector<T>& x) {
+        uint64_t n = x.size();
+        os.write(reinterpret_cast<const char*>(&n), sizeof(n));
+        os.write(reinterpret_cast<const char*>(x.data()), n * sizeof(T));
+    }
+    void operator()(string& x) {
+        uint64_t n = x.size();
+        os.write(reinterpret_cast<const char*>(&n), sizeof(n));
+        os.write(x.data(), n);
+    }
+};
+
+struct state_in {
+    std::istream& is;
+    template <typename T> void operator()(T& x) {
+        is.read(reinterpret_cast<char*>(&x), sizeof(T));
+    }
+    template <typename T> void operator()(vector<T>& x) {
+        uint64_t n = 0;
+        is.read(reinterpret_cast<char*>(&n), sizeof(n));
+        x.resize(n);
+        is.read(reinterpret_cast<char*>(x.data()), n * sizeof(T));
+    }
+    void operator()(string& x) {
+        uint64_t n = 0;
+        is.read(reinterpret_cast<char*>(&n), sizeof(n));
+        x.resize(n);
+        is.read(&x[0], n);
+    }
+};
+
+template <typename archive>
+void vessel::transfer(archive& ar) {
+    //Model state in declaration order. Output names, streams and attached
+    //writer/schedule are not part of the state.
+    ar(vessel_name);
+    ar(nts); ar(dt); ar(sn); ar(s);
+    ar(A_h); ar(B_h); ar(H_h); ar(A_mid_h); ar(a_h); ar(b_h); ar(h_h); ar(a_mid_h); ar(lambda_z_h);
+    ar(a); ar(a_mid); ar(b); ar(h);
+    ar(a_pas); ar(a_mid_pas); ar(h_pas);
+    ar(A); ar(A_mid); ar(B); ar(H); ar(lambda_z_pre);
+    ar(n_alpha); ar(n_pol_alpha); ar(n_native_alpha);
+    ar(alpha_infl); ar(alpha_mechinfl);
+    ar(c_alpha_h); ar(eta_alpha_h); ar(g_alpha_h); ar(G_alpha_h);
+    ar(epsilon_pol_min); ar(gamma_inf);
+    ar(phi_alpha_h); ar(rhoR_alpha_h); ar(mR_alpha_h); ar(k_alpha_h);
+    ar(K_sigma_p_alpha_h); ar(K_sigma_d_alpha_h); ar(K_tauw_p_alpha_h); ar(K_tauw_d_alpha_h);
+    ar(delta_i); ar(K_infl_eff); ar(s_int_infl);
+    ar(Ki_trans); ar(Ki_steady); ar(Ki_deg); ar(beta_i);
+    ar(delta_m); ar(K_mech_eff); ar(s_int_mech);
+    ar(K_i_Tact); ar(phi_Tact0_min);
+    ar(rho_hat_alpha_h); ar(epsilonR_alpha_0);
+    ar(rhoR_h);
+    ar(rhoR); ar(rho); ar(rhoR_alpha); ar(mR_alpha); ar(k_alpha);
+    ar(epsilonR_alpha); ar(epsilon_alpha);
+    ar(ups_infl_p); ar(ups_infl_d);
+    ar(K_sigma_p_alpha); ar(K_sigma_d_alpha); ar(K_tauw_p_alpha); ar(K_tauw_d_alpha);
+    ar(P_h); ar(f_h); ar(bar_tauw_h); ar(Q_h); ar(P_prev); ar(T_act_prev);
+    ar(sigma_h); ar(mu);
+    ar(lambda_th_curr); ar(lambda_z_curr);
+    ar(P); ar(f); ar(bar_tauw); ar(bar_tauw_prev); ar(Q);
+    ar(sigma); ar(sigma_prev); ar(Cbar); ar(lambda_alpha_tau); ar(lambda_z_tau);
+    ar(mb_equil);
+    ar(alpha_active); ar(a_act);
+    ar(T_act); ar(T_act_h); ar(k_act); ar(lambda_0); ar(lambda_m); ar(CB); ar(CS);
+    ar(a_e); ar(h_e); ar(rho_c_e); ar(rho_m_e); ar(f_z_e); ar(mb_equil_e);
+    ar(Ki_p_h); ar(Ki_d_h);
+    ar(num_exp_flag); ar(pol_only_flag); ar(wss_calc_flag); ar(app_visc_flag); ar(mech_infl_flag); ar(mech_exp_flag);
+}
+
+void vessel::writeState(std::ostream& out) {
+    state_out ar = { out };
+    transfer(ar);
+}
+
+void vessel::readState(std::istream& in) {
+    state_in ar = { in };
+    transfer(ar);
+    if (!in) {
+        throw std::runtime_error("Could not read vessel state");
+    }
+}
+
+//Header of an initialized vessel snapshot
+static const char init_cache_magic[8] = { 'G', 'N', 'R', 'I', 'N', 'I', 'T', '2' };
+
+static uint64_t fnv1a(const string& bytes, uint64_t hash = 14695981039346656037ULL) {
+    for (size_t i = 0; i < bytes.size(); i++) {
+        hash ^= uint64_t((unsigned char) bytes[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+string vessel::inputKey(string native_name, double n_days_inp, double dt_inp, string& hash_str) {
+    //The key covers the full input file and the time discretization
+    std::ifstream native_in(native_name, std::ios::binary);
+    if (!native_in) {
+        throw std::runtime_error("Could not open " + native_name);
+    }
+    std::stringstream contents;
+    contents << native_in.rdbuf();
+    string key = contents.str();
+    key.append(reinterpret_cast<const char*>(&n_days_inp), sizeof(double));
+    key.append(reinterpret_cast<const char*>(&dt_inp), sizeof(double));
+    uint64_t hash = fnv1a(key);
+
+    char hash_hex[17];
+    snprintf(hash_hex, sizeof(hash_hex), "%016llx", (unsigned long long) hash);
+    hash_str = hash_hex;
+    return key;
+}
+
+void vessel::initializeNativeCached(string native_name, string cache_dir, double n_days_inp, double dt_inp) {
+    string hash_str;
+    string key = inputKey(native_name, n_days_inp, dt_inp, hash_str);
+    string cache_name = cache_dir + "/init_" + hash_str + ".bin";
+
+    //Use the snapshot if its stored key matches exactly
+    std::ifstream cache_in(cache_name, std::ios::binary);
+    if (cache_in) {
+        char magic[8];
+        uint64_t key_size = 0;
+        cache_in.read(magic, 8);
+        cache_in.read(reinterpret_cast<char*>(&key_size), sizeof(key_size));
+        string cached_key;
+        if (cache_in && memcmp(magic, init_cache_magic, 8) == 0 && key_size == key.size()) {
+            cached_key.resize(key_size);
+            cache_in.read(&cached_key[0], key_size);
+        }
+        if (cache_in && cached_key == key) {
+            //A truncated or corrupt snapshot is rebuilt, from the state before the read
+            std::stringstream state_before(std::ios::in | std::ios::out | std::ios::binary);
+            writeState(state_before);
+            try {
+                readState(cache_in);
+                std::cout << "Loaded initialized vessel from " << cache_name << std::endl;
+                return;
+            }
+            catch (std::exception& e) {
+                std::cout << "Rebuilding init cache " << cache_name << ": " << e.what() << std::endl;
+                readState(state_before);
+            }
+        }
+    }
+
+    initializeNative(native_name, n_days_inp, dt_inp);
+
+    //Write to a temporary file first so concurrent runs never read a partial snapshot
+    string tmp_name = cache_name + ".tmp" + std::to_string((long long) std::chrono::steady_clock::now().time_since_epoch().count())
+        + "_" + std::to_string((unsigned long long) (uintptr_t) this);
+    std::ofstream cache_out(tmp_name, std::ios::binary);
+    if (!cache_out) {
+        std::cout << "Could not write init cache " << cache_name << std::endl;
+        return;
+    }
+    uint64_t key_size = key.size();
+    cache_out.write(init_cache_magic, 8);
+    cache_out.write(reinterpret_cast<const char*>(&key_size), sizeof(key_size));
+    cache_out.write(key.data(), key_size);
+    writeState(cache_out);
+    cache_out.close();
+    if (!cache_out || std::rename(tmp_name.c_str(), cache_name.c_str()) != 0) {
+        std::remove(tmp_name.c_str());
+        std::cout << "Could not write init cache " << cache_name << std::endl;
+    }
+}
@@ -6,8 +6,13 @@ using std::string;
 using std::vector;
 using std::cout;
 
+class output_writer;
+class load_schedule;
+
 class vessel {
 public:
+    typedef double scalar; //of the step kernels (functions.h)
+
     string vessel_name;
     string file_name;
     string gnr_name;
@@ -48,6 +53,7 @@ public:
     vector<double> phi_alpha_h, rhoR_alpha_h, mR_alpha_h, k_alpha_h;
     vector<double> K_sigma_p_alpha_h, K_sigma_d_alpha_h, K_tauw_p_alpha_h, K_tauw_d_alpha_h;
     double delta_i, K_infl_eff, s_int_infl;
+    double Ki_trans, Ki_steady, Ki_deg, beta_i;
     double delta_m, K_mech_eff, s_int_mech;
     double K_i_Tact, phi_Tact0_min;
 
@@ -140,6 +146,9 @@ public:
     double kPa_to_Pa = pow(10, 3);
 
     std::ofstream GnR_out, Equil_GnR_out, Exp_out;
+    output_writer* writer; //Asynchronous output, replaces the streams above when set
+    int gnr_stream, equil_gnr_stream, exp_stream; //Writer stream ids
+    const load_schedule* schedule; //Time-varying loads applied each step when set
 
     vessel(); //Default constructor
     //Vessel(string file_name); //File name constructor ***ELS USE DELEGATING CONSTRUCTOR***
@@ -151,7 +160,23 @@ public:
     void printNativeOutputs();
     void printExpOutputs();
     void printNativeEquilibratedOutputs();
+    static const int n_native_outputs = 24, n_native_equil_outputs = 6;
+    void nativeOutputRow(double* out) const; //Values of the GnR_out and Equil_GnR_out rows
+    void nativeEquilibratedOutputRow(double* out) const;
+    void writeRow(std::ofstream& out, int stream, const double* vals, int n_vals);
+    static vector<string> nativeOutputNames(); //Column names of the rows written above
+    static vector<string> expOutputNames();
+    static vector<string> nativeEquilibratedOutputNames();
     void initializeNative(string native_name, double n_days_inp = 10, double dt_inp = 1);
+    void initializeNative(std::istream& native_in, double n_days_inp = 10, double dt_inp = 1); //Native_in contents
+    void updateInflammation(); //Recomputes ups_infl_p/d and the K_sigma/K_tauw schedules
+    //Reuses a snapshot from cache_dir when Native_in contents, n_days and dt match
+    void initializeNativeCached(string native_name, string cache_dir, double n_days_inp = 10, double dt_inp = 1);
+    //Native_in contents with n_days and dt, the key of the init cache, and its hash as hex
+    static string inputKey(string native_name, double n_days_inp, double dt_inp, string& hash_str);
+    void writeState(std::ostream& out); //Exact binary snapshot of the model state
+    void readState(std::istream& in);
+    template <typename archive> void transfer(archive& ar); //Visits the model state members
     void initializeTEVG(string scaffold_name, string immune_name,vessel const &native_vessel, double n_days_inp = 10, double dt_inp = 1);
 
     //TODO
@@ -0,0 +1,852 @@
+// vessel_tree.cpp
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <gsl/gsl_errno.h>
+#include <gsl/gsl_vector.h>
+#include <gsl/gsl_roots.h>
+#include <gsl/gsl_multiroots.h>
+#include <gsl/gsl_matrix.h>
+#include <gsl/gsl_permutation.h>
+#include <gsl/gsl_linalg.h>
+
+#include "vessel.h"
+#include "functions.h"
+#include "vessel_tree.h"
+
+using std::string;
+using std::vector;
+using std::cout;
+
+vessel_tree::vessel_tree(int n_threads) : pool(n_threads) {
+    n_vessels = 0;
+    extrapolate_loads = 0;
+    s_coupled = -1.0;
+    resp_dP = 0.05;
+    resp_n = 4;
+    newton_tol = 1e-9;
+    newton_max_iter = 20;
+    newton_iter = 0;
+    newton_residual = 0.0;
+    equil_tol = 1e-10;
+    equil_max_iter = 50;
+    equil_iter = 0;
+    equil_passes = 0;
+    equil_residual = 0.0;
+    equil_map_hits = 0;
+    implicit_method = 2;
+    implicit_tol = 1e-8;
+    implicit_max_iter = 50;
+    implicit_omega = 0.5;
+    implicit_iter = 0;
+    implicit_residual = 0.0;
+}
+
+void vessel_tree::readManifest(string manifest_name) {
+    std::ifstream manifest_in(manifest_name);
+    if (!manifest_in) {
+        throw std::runtime_error("Could not open tree manifest " + manifest_name);
+    }
+
+    string line;
+    while (std::getline(manifest_in, line)) {
+        size_t hash = line.find('#');
+        if (hash != string::npos) {
+            line = line.substr(0, hash);
+        }
+        std::stringstream ss(line);
+        string name, native_file, schedule_file;
+        double g_p = 0, g_q = 0, g_act = 0;
+        if (!(ss >> name)) {
+            continue;
+        }
+        if (!(ss >> native_file >> g_p >> g_q >> g_act)) {
+            throw std::runtime_error("Tree manifest line needs name, Native_in file, gamma_p, gamma_q, gamma_act: " + line);
+        }
+        if (!(ss >> schedule_file)) {
+            schedule_file = "-";
+        }
+
+        names.push_back(name);
+        native_files.push_back(native_file);
+        gamma_p.push_back(g_p);
+        gamma_q.push_back(g_q);
+        gamma_act.push_back(g_act);
+        schedule_files.push_back(schedule_file);
+    }
+    n_vessels = int(names.size());
+    if (n_vessels == 0) {
+        throw std::runtime_error("Tree manifest has no vessels: " + manifest_name);
+    }
+}
+
+void vessel_tree::initialize(double n_days, double dt, string cache_dir) {
+    vessels.resize(n_vessels);
+    schedules.resize(n_vessels);
+
+    pool.run(n_vessels, [&](int i) {
+        vessel& curr_vessel = vessels[i];
+        if (cache_dir.empty()) {
+            curr_vessel.initializeNative(native_files[i], n_days, dt);
+        }
+        else {
+            curr_vessel.initializeNativeCached(native_files[i], cache_dir, n_days, dt);
+        }
+
+        if (schedule_files[i] != "-") {
+            schedules[i].read(schedule_files[i]);
+            curr_vessel.schedule = &schedules[i];
+        }
+
+        curr_vessel.gnr_name = curr_vessel.gnr_name + "_" + names[i];
+        curr_vessel.equil_gnr_name = curr_vessel.equil_gnr_name + "_" + names[i];
+        curr_vessel.exp_name = curr_vessel.exp_name + "_" + names[i];
+        curr_vessel.file_name = curr_vessel.file_name + "_" + names[i];
+    });
+}
+
+void vessel_tree::setLoads() {
+    //Loads relative to the homeostatic state, as --gamma_p/--gamma_q/--gamma_act
+    for (int i = 0; i < n_vessels; i++) {
+        vessel& curr_vessel = vessels[i];
+        curr_vessel.P = (1 + gamma_p[i]) * curr_vessel.P_h;
+        curr_vessel.Q = (1 + gamma_q[i]) * curr_vessel.Q_h;
+        curr_vessel.T_act = (1 + gamma_act[i]) * curr_vessel.T_act_h;
+        curr_vessel.wss_calc_flag = 1;
+    }
+}
+
+void vessel_tree::openOutputs(int bin_out_flag) {
+    for (int i = 0; i < n_vessels; i++) {
+        vessel& curr_vessel = vessels[i];
+        if (bin_out_flag) {
+            //Each vessel has its own synchronous writer so vessels never share a stream
+            output_writer* writer = new output_writer(1, 0.0, 1, 0);
+            writers.push_back(writer);
+            curr_vessel.writer = writer;
+            curr_vessel.gnr_stream = writer->open_stream(curr_vessel.gnr_name, false, vessel::nativeOutputNames(), 1);
+            curr_vessel.equil_gnr_stream = writer->open_stream(curr_vessel.equil_gnr_name, false, vessel::nativeEquilibratedOutputNames(), 1);
+            curr_vessel.exp_stream = writer->open_stream(curr_vessel.exp_name, false, vessel::expOutputNames(), 1);
+        }
+        else {
+            curr_vessel.GnR_out.open(curr_vessel.gnr_name);
+            curr_vessel.Equil_GnR_out.open(curr_vessel.equil_gnr_name);
+            curr_vessel.Exp_out.open(curr_vessel.exp_name);
+        }
+    }
+}
+
+void vessel_tree::closeOutputs() {
+    for (int i = 0; i < n_vessels; i++) {
+        vessels[i].GnR_out.close();
+        vessels[i].Equil_GnR_out.close();
+        vessels[i].Exp_out.close();
+        vessels[i].writer = NULL;
+    }
+    for (int i = 0; i < writers.size(); i++) {
+        writers[i]->close();
+        delete writers[i];
+    }
+    writers.clear();
+}
+
+void vessel_tree::advance(int n_steps, bool print) {
+    pool.run(n_vessels, [&](int i) {
+        vessel& curr_vessel = vessels[i];
+        int sn_end = std::min(curr_vessel.sn + n_steps, curr_vessel.nts - 1);
+        for (int sn = curr_vessel.sn + 1; sn <= sn_end; sn++) {
+            if (extrapolate_loads && s_coupled >= 0) {
+                double ds = curr_vessel.dt * sn - s_coupled;
+                curr_vessel.P = (1 + gamma_p[i] + gamma_p_rate[i] * ds) * curr_vessel.P_h;
+                curr_vessel.Q = (1 + gamma_q[i] + gamma_q_rate[i] * ds) * curr_vessel.Q_h;
+            }
+            step_vessel(curr_vessel, sn);
+            if (print) {
+                curr_vessel.printNativeOutputs();
+                if (curr_vessel.writer != NULL) {
+                    curr_vessel.writer->end_step();
+                }
+            }
+        }
+    });
+}
+
+void vessel_tree::printStep() {
+    for (int i = 0; i < n_vessels; i++) {
+        vessels[i].printNativeOutputs();
+        if (vessels[i].writer != NULL) {
+            vessels[i].writer->end_step();
+        }
+    }
+}
+
+void vessel_tree::snapshotVessels() {
+    step_transactions.resize(n_vessels);
+    for (int i = 0; i < n_vessels; i++) {
+        step_transactions[i].begin(vessels[i], vessels[i].sn + 1);
+    }
+}
+
+void vessel_tree::rollbackVessels() {
+    for (int i = 0; i < n_vessels; i++) {
+        step_transactions[i].rollback();
+    }
+}
+
+int vessel_tree::readEquilMaps(string map_dir, double n_days, double dt) {
+    equil_maps.assign(n_vessels, equil_map());
+    int n_maps = 0;
+    for (int i = 0; i < n_vessels; i++) {
+        string hash_str;
+        string key = vessel::inputKey(native_files[i], n_days, dt, hash_str);
+        if (equil_maps[i].read(map_dir + "/equil_" + hash_str + ".bin", key)) {
+            n_maps++;
+        }
+        else {
+            printf("%s %s\n", "No equilibrated map for vessel", names[i].c_str());
+        }
+    }
+    return n_maps;
+}
+
+void vessel_tree::solveEquilibrated() {
+    std::atomic<int> hits(0);
+    pool.run(n_vessels, [&](int i) {
+        vessel& curr_vessel = vessels[i];
+        curr_vessel.sn = curr_vessel.nts - 1;
+        curr_vessel.s = curr_vessel.dt * curr_vessel.sn;
+        curr_vessel.P = (1.0 + gamma_p[i]) * curr_vessel.P_h;
+        curr_vessel.Q = (1.0 + gamma_q[i]) * curr_vessel.Q_h;
+        if (curr_vessel.schedule != NULL) {
+            curr_vessel.schedule->apply(curr_vessel);
+        }
+        double row[vessel::n_native_equil_outputs], x_map[4];
+        bool from_map = i < int(equil_maps.size()) && equil_maps[i].lookup(curr_vessel, row);
+        if (from_map) {
+            equil_map::unknowns(curr_vessel, row, x_map);
+            hits++;
+        }
+        find_equil_geom(&curr_vessel, from_map ? x_map : NULL);
+        curr_vessel.printNativeEquilibratedOutputs();
+    });
+    equil_map_hits = hits;
+}
+
+void vessel_tree::printOutputs() {
+    for (int i = 0; i < n_vessels; i++) {
+        vessels[i].printNativeOutputs();
+    }
+}
+
+void vessel_tree::solveHemodynamics(morphometric_tree& hemo_tree, double Q_in, double P_term, bool initial) {
+    if (hemo_tree.n_orders != n_vessels) {
+        throw std::runtime_error("Hemodynamic tree orders do not match the number of vessels");
+    }
+
+    //Order geometry from the vessels' current (or initial) state
+    vector<double> radius(n_vessels), thickness(n_vessels);
+    for (int i = 0; i < n_vessels; i++) {
+        int sn = initial ? 0 : vessels[i].sn;
+        radius[i] = vessels[i].a[sn];
+        thickness[i] = vessels[i].h[sn];
+    }
+    solveTree(hemo_tree, radius, thickness, Q_in, P_term);
+}
+
+void vessel_tree::solveTree(morphometric_tree& hemo_tree, const vector<double>& radius, const vector<double>& thickness,
+                            double Q_in, double P_term) {
+    //Inner radius and thickness in m, tree geometry in cm
+    vector<double> diameter(n_vessels), thickness_cm(n_vessels);
+    for (int i = 0; i < n_vessels; i++) {
+        diameter[i] = 2 * radius[i] * 100;
+        thickness_cm[i] = thickness[i] * 100;
+    }
+    hemo_tree.setOrderGeometry(diameter, thickness_cm);
+    hemo_tree.computeResistance();
+    hemo_tree.solve(Q_in, P_term);
+}
+
+void vessel_tree::setHemodynamicBaseline(morphometric_tree& hemo_tree, double Q_in, double P_term) {
+    solveHemodynamics(hemo_tree, Q_in, P_term, true);
+    P_base = hemo_tree.P_order_mean;
+    Q_base = hemo_tree.Q_order_mean;
+}
+
+void vessel_tree::coupleHemodynamics(morphometric_tree& hemo_tree, double Q_in, double P_term) {
+    solveHemodynamics(hemo_tree, Q_in, P_term, false);
+    setTreeLoads(hemo_tree);
+}
+
+void vessel_tree::setTreeLoads(const morphometric_tree& hemo_tree) {
+    //Fold changes from baseline, and their rates since the previous coupling
+    double s = n_vessels > 0 ? vessels[0].dt * steps() : 0.0;
+    gamma_p_rate.assign(n_vessels, 0.0);
+    gamma_q_rate.assign(n_vessels, 0.0);
+    for (int i = 0; i < n_vessels; i++) {
+        double gamma_p_new = hemo_tree.P_order_mean[i] / P_base[i] - 1.0;
+        double gamma_q_new = hemo_tree.Q_order_mean[i] / Q_base[i] - 1.0;
+        if (s_coupled >= 0 && s > s_coupled) {
+            gamma_p_rate[i] = (gamma_p_new - gamma_p[i]) / (s - s_coupled);
+            gamma_q_rate[i] = (gamma_q_new - gamma_q[i]) / (s - s_coupled);
+        }
+        gamma_p[i] = gamma_p_new;
+        gamma_q[i] = gamma_q_new;
+    }
+    s_coupled = s;
+    setLoads();
+}
+
+void vessel_tree::buildPressureResponse() {
+    int n_P = 2 * resp_n + 1;
+    resp_P.assign(n_vessels * n_P, 0.0);
+    resp_a.assign(n_vessels * n_P, 0.0);
+    vector<int> failed(n_vessels, 0);
+
+    pool.run(n_vessels, [&](int i) {
+        vessel& curr_vessel = vessels[i];
+        vector<double> P_test(n_P), a_test;
+        for (int k = 0; k < n_P; k++) {
+            P_test[k] = curr_vessel.P * (1 + resp_dP * (k - resp_n));
+        }
+        failed[i] = find_pd_response(curr_vessel, P_test, a_test);
+        for (int k = 0; k < n_P; k++) {
+            resp_P[i * n_P + k] = P_test[k];
+            resp_a[i * n_P + k] = a_test[k];
+        }
+    });
+
+    for (int i = 0; i < n_vessels; i++) {
+        if (failed[i] > 0) {
+            printf("%s %s %s %d\n", "Vessel:", names[i].c_str(), "pressure-diameter points not converged:", failed[i]);
+        }
+    }
+}
+
+double vessel_tree::responseRadius(int i, double P, double& slope) const {
+    //Piecewise linear in the table, extended linearly past its ends
+    int n_P = 2 * resp_n + 1;
+    const double* P_i = &resp_P[i * n_P];
+    const double* a_i = &resp_a[i * n_P];
+    int k = 0;
+    while (k < n_P - 2 && P > P_i[k + 1]) {
+        k++;
+    }
+    slope = (a_i[k + 1] - a_i[k]) / (P_i[k + 1] - P_i[k]);
+    return a_i[k] + slope * (P - P_i[k]);
+}
+
+void vessel_tree::coupleDistensible(morphometric_tree& hemo_tree, double Q_in, double P_term) {
+    if (hemo_tree.n_orders != n_vessels) {
+        throw std::runtime_error("Hemodynamic tree orders do not match the number of vessels");
+    }
+    buildPressureResponse();
+
+    //The finite differences are below any re-solve tolerance, solve the tree in full
+    double radius_tol = hemo_tree.dag.radius_tol;
+    hemo_tree.dag.radius_tol = 0.0;
+
+    //Residual of each order's radius against its response to the tree pressure, with
+    //the vessel pressure being the homeostatic pressure scaled as in setLoads
+    int n = n_vessels;
+    vector<double> radius(n), thickness(n), slope(n), residual(n);
+    auto evaluate = [&](const vector<double>& x, vector<double>& F, vector<double>* dadP) {
+        solveTree(hemo_tree, x, thickness, Q_in, P_term);
+        for (int i = 0; i < n; i++) {
+            double P_vessel = hemo_tree.P_order_mean[i] / P_base[i] * vessels[i].P_h;
+            double s = 0.0;
+            F[i] = x[i] - responseRadius(i, P_vessel, s);
+            if (dadP != NULL) {
+                (*dadP)[i] = s * vessels[i].P_h / P_base[i];
+            }
+        }
+    };
+
+    for (int i = 0; i < n; i++) {
+        radius[i] = vessels[i].a[vessels[i].sn];
+        thickness[i] = vessels[i].h[vessels[i].sn];
+    }
+
+    gsl_matrix* J = gsl_matrix_alloc(n, n);
+    gsl_permutation* perm = gsl_permutation_alloc(n);
+    gsl_vector* F_vec = gsl_vector_alloc(n);
+    gsl_vector* dx = gsl_vector_alloc(n);
+
+    vector<double> P_tree(n), x_pert(n), F_pert(n);
+    newton_iter = 0;
+    evaluate(radius, residual, &slope);
+    while (true) {
+        newton_residual = 0.0;
+        for (int i = 0; i < n; i++) {
+            newton_residual = std::max(newton_residual, fabs(residual[i]) / radius[i]);
+        }
+        if (newton_residual < newton_tol || newton_iter >= newton_max_iter) {
+            break;
+        }
+        newton_iter++;
+
+        //J = I - diag(da/dP) dP_tree/dx, columns by forward differences on the tree alone
+        P_tree = hemo_tree.P_order_mean;
+        for (int j = 0; j < n; j++) {
+            x_pert = radius;
+            double dx_j = 1e-6 * radius[j];
+            x_pert[j] += dx_j;
+            solveTree(hemo_tree, x_pert, thickness, Q_in, P_term);
+            for (int i = 0; i < n; i++) {
+                double dP_dx = (hemo_tree.P_order_mean[i] - P_tree[i]) / dx_j;
+                gsl_matrix_set(J, i, j, (i == j ? 1.0 : 0.0) - slope[i] * dP_dx);
+            }
+        }
+        for (int i = 0; i < n; i++) {
+            gsl_vector_set(F_vec, i, -residual[i]);
+        }
+        int signum = 0;
+        gsl_linalg_LU_decomp(J, perm, &signum);
+        gsl_linalg_LU_solve(J, perm, F_vec, dx);
+        for (int i = 0; i < n; i++) {
+            radius[i] += gsl_vector_get(dx, i);
+        }
+        evaluate(radius, residual, &slope);
+    }
+
+    gsl_matrix_free(J);
+    gsl_permutation_free(perm);
+    gsl_vector_free(F_vec);
+    gsl_vector_free(dx);
+    hemo_tree.dag.radius_tol = radius_tol;
+
+    if (newton_residual >= newton_tol) {
+        printf("%s %e\n", "Warning: distensible tree hemodynamics did not converge, residual:", newton_residual);
+    }
+
+    //Tree loads at the converged radii, hemo_tree holds the last evaluation
+    setTreeLoads(hemo_tree);
+}
+
+//Least squares solution of min |V c - b| for the n x m column-major V by modified
+//Gram-Schmidt, dropping columns that are nearly dependent on the earlier ones
+static void least_squares(const vector<double>& V, const vector<double>& b, int n, int m, vector<double>& c) {
+    vector<double> Q(V), R(m * m, 0.0);
+    vector<int> kept;
+    for (int j = 0; j < m; j++) {
+        double* q_j = &Q[j * n];
+        double norm_0 = 0.0;
+        for (int i = 0; i < n; i++) {
+            norm_0 += q_j[i] * q_j[i];
+        }
+        for (int k : kept) {
+            double r = 0.0;
+            for (int i = 0; i < n; i++) {
+                r += Q[k * n + i] * q_j[i];
+            }
+            R[j * m + k] = r;
+            for (int i = 0; i < n; i++) {
+                q_j[i] -= r * Q[k * n + i];
+            }
+        }
+        double norm = 0.0;
+        for (int i = 0; i < n; i++) {
+            norm += q_j[i] * q_j[i];
+        }
+        if (norm <= 1e-20 * norm_0 || norm == 0.0) {
+            continue;
+        }
+        norm = sqrt(norm);
+        R[j * m + j] = norm;
+        for (int i = 0; i < n; i++) {
+            q_j[i] /= norm;
+        }
+        kept.push_back(j);
+    }
+
+    //R c = Q^T b over the kept columns
+    c.assign(m, 0.0);
+    for (int kk = int(kept.size()) - 1; kk >= 0; kk--) {
+        int j = kept[kk];
+        double sum = 0.0;
+        for (int i = 0; i < n; i++) {
+            sum += Q[j * n + i] * b[i];
+        }
+        for (int ll = kk + 1; ll < int(kept.size()); ll++) {
+            int l = kept[ll];
+            sum -= R[l * m + j] * c[l];
+        }
+        c[j] = sum / R[j * m + j];
+    }
+}
+
+void vessel_tree::stepImplicit(morphometric_tree& hemo_tree, double Q_in, double P_term) {
+    if (hemo_tree.n_orders != n_vessels) {
+        throw std::runtime_error("Hemodynamic tree orders do not match the number of vessels");
+    }
+    //Successive passes change the radii by less than any re-solve tolerance
+    double radius_tol = hemo_tree.dag.radius_tol;
+    hemo_tree.dag.radius_tol = 0.0;
+
+    //Radii of the passes relative to the start of the step, the first guess continuing
+    //the change of the previous step
+    int n = n_vessels;
+    vector<double> a_ref(n), x(n), thickness(n);
+    for (int i = 0; i < n; i++) {
+        int sn = vessels[i].sn;
+        a_ref[i] = vessels[i].a[sn];
+        thickness[i] = vessels[i].h[sn];
+        x[i] = sn > 0 ? a_ref[i] / vessels[i].a[sn - 1] : 1.0;
+    }
+    snapshotVessels();
+
+    //One pass: tree loads from the radii x, then the step from its start
+    vector<double> radius(n), x_out(n), residual(n);
+    auto pass = [&]() {
+        for (int i = 0; i < n; i++) {
+            radius[i] = x[i] * a_ref[i];
+        }
+        solveTree(hemo_tree, radius, thickness, Q_in, P_term);
+        setTreeLoads(hemo_tree);
+        advance(1, false);
+        for (int i = 0; i < n; i++) {
+            x_out[i] = vessels[i].a[vessels[i].sn] / a_ref[i];
+            thickness[i] = vessels[i].h[vessels[i].sn];
+            residual[i] = x_out[i] - x[i];
+        }
+    };
+
+    //Differences of the residuals (V) and of the pass outputs (W) for IQN-ILS,
+    //newest first and at most n of them
+    vector<double> V, W, c, x_out_prev, residual_prev, minus_residual(n);
+    double omega = implicit_omega;
+    implicit_iter = 0;
+    while (true) {
+        if (implicit_iter > 0) {
+            rollbackVessels();
+        }
+        pass();
+        implicit_iter++;
+        implicit_residual = 0.0;
+        for (int i = 0; i < n; i++) {
+            implicit_residual = std::max(implicit_residual, fabs(residual[i]));
+        }
+        if (implicit_residual < implicit_tol || implicit_iter >= implicit_max_iter) {
+            break;
+        }
+
+        if (implicit_iter == 1) {
+            for (int i = 0; i < n; i++) {
+                x[i] += omega * residual[i];
+            }
+        }
+        else if (implicit_method == 1) {
+            //Aitken: omega = -omega R_prev.(R - R_prev) / |R - R_prev|^2
+            double num = 0.0, den = 0.0;
+            for (int i = 0; i < n; i++) {
+                double dR = residual[i] - residual_prev[i];
+                num += residual_prev[i] * dR;
+                den += dR * dR;
+            }
+            if (den > 0.0) {
+                omega = -omega * num / den;
+            }
+            for (int i = 0; i < n; i++) {
+                x[i] += omega * residual[i];
+            }
+        }
+        else {
+            //IQN-ILS: x = x_out + W c with c minimizing |V c + R|
+            int m = std::min(int(V.size()) / n + 1, n);
+            V.insert(V.begin(), residual.begin(), residual.end());
+            W.insert(W.begin(), x_out.begin(), x_out.end());
+            for (int i = 0; i < n; i++) {
+                V[i] -= residual_prev[i];
+                W[i] -= x_out_prev[i];
+                minus_residual[i] = -residual[i];
+            }
+            V.resize(m * n);
+            W.resize(m * n);
+            least_squares(V, minus_residual, n, m, c);
+            x = x_out;
+            for (int j = 0; j < m; j++) {
+                for (int i = 0; i < n; i++) {
+                    x[i] += W[j * n + i] * c[j];
+                }
+            }
+        }
+        residual_prev = residual;
+        x_out_prev = x_out;
+    }
+    for (int i = 0; i < n; i++) {
+        step_transactions[i].commit();
+    }
+    hemo_tree.dag.radius_tol = radius_tol;
+
+    if (implicit_residual >= implicit_tol) {
+        printf("%s %e\n", "Warning: implicit coupling did not converge, residual:", implicit_residual);
+    }
+    printStep();
+}
+
+void vessel_tree::solveEquilibratedTree(morphometric_tree& hemo_tree, double Q_in, double P_term) {
+    if (hemo_tree.n_orders != n_vessels) {
+        throw std::runtime_error("Hemodynamic tree orders do not match the number of vessels");
+    }
+    double radius_tol = hemo_tree.dag.radius_tol;
+    hemo_tree.dag.radius_tol = 0.0;
+
+    //Each order's own equilibrium (find_equil_geom) for given loads
+    const int n = n_vessels, n_x = 4, n_y = 2;
+    vector<double> x(n_x * n), y(n_y * n);
+    std::atomic<int> hits(0);
+    auto equilibrate_orders = [&]() {
+        pool.run(n, [&](int i) {
+            vessel& curr_vessel = vessels[i];
+            curr_vessel.sn = curr_vessel.nts - 1;
+            curr_vessel.s = curr_vessel.dt * curr_vessel.sn;
+            curr_vessel.P = y[n_y * i + 0];
+            curr_vessel.Q = y[n_y * i + 1];
+            double row[vessel::n_native_equil_outputs];
+            if (i < int(equil_maps.size()) && equil_maps[i].lookup(curr_vessel, row)) {
+                equil_map::unknowns(curr_vessel, row, &x[n_x * i]);
+                hits++;
+                return;
+            }
+            find_equil_geom(&curr_vessel);
+            double J_e = curr_vessel.h_e / curr_vessel.h_h * (curr_vessel.a_e + curr_vessel.h_e / 2) /
+                         (curr_vessel.a_h + curr_vessel.h_h / 2) * curr_vessel.lambda_z_curr;
+            x[n_x * i + 0] = curr_vessel.a_e;
+            x[n_x * i + 1] = curr_vessel.h_e;
+            x[n_x * i + 2] = curr_vessel.rho_c_e / J_e;
+            x[n_x * i + 3] = curr_vessel.f_z_e;
+        });
+    };
+    for (int i = 0; i < n; i++) {
+        y[n_y * i + 0] = (1.0 + gamma_p[i]) * vessels[i].P_h;
+        y[n_y * i + 1] = (1.0 + gamma_q[i]) * vessels[i].Q_h;
+    }
+    equilibrate_orders();
+
+    //Residuals of one order's equilibrium for its own unknowns and loads
+    auto order_residual = [&](int i, const double* x_i, const double* y_i, double* F_i) {
+        vessel& curr_vessel = vessels[i];
+        curr_vessel.P = y_i[0];
+        curr_vessel.Q = y_i[1];
+        gsl_vector* x_vec = gsl_vector_alloc(n_x);
+        gsl_vector* f_vec = gsl_vector_alloc(n_x);
+        for (int k = 0; k < n_x; k++) {
+            gsl_vector_set(x_vec, k, x_i[k]);
+        }
+        equil_obj_f(x_vec, &curr_vessel, f_vec);
+        for (int k = 0; k < n_x; k++) {
+            F_i[k] = gsl_vector_get(f_vec, k);
+        }
+        gsl_vector_free(x_vec);
+        gsl_vector_free(f_vec);
+    };
+
+    //Loads of every order from the tree solved for the equilibrated radii
+    auto tree_loads = [&](const vector<double>& x_all, vector<double>& H) {
+        vector<double> radius(n), thickness(n);
+        for (int i = 0; i < n; i++) {
+            radius[i] = x_all[n_x * i + 0];
+            thickness[i] = x_all[n_x * i + 1];
+        }
+        solveTree(hemo_tree, radius, thickness, Q_in, P_term);
+        H.resize(n_y * n);
+        for (int i = 0; i < n; i++) {
+            H[n_y * i + 0] = vessels[i].P_h * hemo_tree.P_order_mean[i] / P_base[i];
+            H[n_y * i + 1] = vessels[i].Q_h * hemo_tree.Q_order_mean[i] / Q_base[i];
+        }
+    };
+
+    //All residuals, and their norm scaled by the homeostatic quantities
+    vector<double> F(n_x * n), G(n_y * n), H;
+    auto evaluate = [&](const vector<double>& x_all, const vector<double>& y_all,
+                        vector<double>& F_all, vector<double>& G_all) {
+        pool.run(n, [&](int i) {
+            order_residual(i, &x_all[n_x * i], &y_all[n_y * i], &F_all[n_x * i]);
+        });
+        tree_loads(x_all, H);
+        double res = 0.0;
+        for (int i = 0; i < n; i++) {
+            vessel& curr_vessel = vessels[i];
+            double sigma_h = curr_vessel.sigma_h[1] + curr_vessel.sigma_h[2];
+            double scale[4] = { 1.0, curr_vessel.rhoR_h, sigma_h, sigma_h };
+            for (int k = 0; k < n_x; k++) {
+                res += pow(F_all[n_x * i + k] / scale[k], 2);
+            }
+            G_all[n_y * i + 0] = y_all[n_y * i + 0] - H[n_y * i + 0];
+            G_all[n_y * i + 1] = y_all[n_y * i + 1] - H[n_y * i + 1];
+            res += pow(G_all[n_y * i + 0] / curr_vessel.P_h, 2);
+            res += pow(G_all[n_y * i + 1] / curr_vessel.Q_h, 2);
+        }
+        return sqrt(res);
+    };
+
+    //Per order Newton blocks: dx_i = u_i - W_i dy_i with u = -A^-1 F, W = A^-1 B
+    vector<double> u(n_x * n), W(n_x * n_y * n);
+    vector<double> dx(n_x * n), dy(n_y * n), x_trial, y_trial;
+    vector<double> F_trial(n_x * n), G_trial(n_y * n);
+    gsl_matrix* M = gsl_matrix_alloc(n_y * n, n_y * n);
+    gsl_permutation* perm = gsl_permutation_alloc(n_y * n);
+    gsl_vector* rhs = gsl_vector_alloc(n_y * n);
+    gsl_vector* dy_vec = gsl_vector_alloc(n_y * n);
+
+    equil_iter = 0;
+    equil_passes = 0;
+    equil_residual = evaluate(x, y, F, G);
+    while (equil_residual >= equil_tol && equil_iter < equil_max_iter) {
+        equil_iter++;
+
+        pool.run(n, [&](int i) {
+            double* x_i = &x[n_x * i];
+            double* y_i = &y[n_y * i];
+            double F_pert[n_x];
+            gsl_matrix* A = gsl_matrix_alloc(n_x, n_x);
+            gsl_matrix* B = gsl_matrix_alloc(n_x, n_y);
+            for (int k = 0; k < n_x; k++) {
+                double x_store = x_i[k];
+                double dx_k = x_store != 0 ? 1e-7 * fabs(x_store) : 1e-7;
+                x_i[k] += dx_k;
+                order_residual(i, x_i, y_i, F_pert);
+                x_i[k] = x_store;
+                for (int r = 0; r < n_x; r++) {
+                    gsl_matrix_set(A, r, k, (F_pert[r] - F[n_x * i + r]) / dx_k);
+                }
+            }
+            for (int k = 0; k < n_y; k++) {
+                double y_store = y_i[k];
+                double dy_k = y_store != 0 ? 1e-7 * fabs(y_store) : 1e-7;
+                y_i[k] += dy_k;
+                order_residual(i, x_i, y_i, F_pert);
+                y_i[k] = y_store;
+                for (int r = 0; r < n_x; r++) {
+                    gsl_matrix_set(B, r, k, (F_pert[r] - F[n_x * i + r]) / dy_k);
+                }
+            }
+
+            gsl_permutation* perm_i = gsl_permutation_alloc(n_x);
+            gsl_vector* b = gsl_vector_alloc(n_x);
+            gsl_vector* sol = gsl_vector_alloc(n_x);
+            int signum = 0;
+            gsl_linalg_LU_decomp(A, perm_i, &signum);
+            for (int k = 0; k <= n_y; k++) {
+                for (int r = 0; r < n_x; r++) {
+                    gsl_vector_set(b, r, k == 0 ? -F[n_x * i + r] : gsl_matrix_get(B, r, k - 1));
+                }
+                gsl_linalg_LU_solve(A, perm_i, b, sol);
+                for (int r = 0; r < n_x; r++) {
+                    if (k == 0) {
+                        u[n_x * i + r] = gsl_vector_get(sol, r);
+                    }
+                    else {
+                        W[(n_x * i + r) * n_y + k - 1] = gsl_vector_get(sol, r);
+                    }
+                }
+            }
+            gsl_permutation_free(perm_i);
+            gsl_vector_free(b);
+            gsl_vector_free(sol);
+            gsl_matrix_free(A);
+            gsl_matrix_free(B);
+            order_residual(i, x_i, y_i, &F[n_x * i]);
+        });
+
+        //Tree sensitivity C = dH/da_e by forward differences, one order at a time, and
+        //the reduced system (I + C W_a) dy = -G + C u_a in the loads
+        vector<double> H0;
+        tree_loads(x, H0);
+        gsl_matrix_set_identity(M);
+        for (int r = 0; r < n_y * n; r++) {
+            gsl_vector_set(rhs, r, -G[r]);
+        }
+        for (int j = 0; j < n; j++) {
+            vector<double> x_pert = x;
+            double da = 1e-6 * x[n_x * j];
+            x_pert[n_x * j] += da;
+            vector<double> H_pert;
+            tree_loads(x_pert, H_pert);
+            for (int r = 0; r < n_y * n; r++) {
+                double C_rj = (H_pert[r] - H0[r]) / da;
+                for (int k = 0; k < n_y; k++) {
+                    int col = n_y * j + k;
+                    gsl_matrix_set(M, r, col, gsl_matrix_get(M, r, col) + C_rj * W[(n_x * j + 0) * n_y + k]);
+                }
+                gsl_vector_set(rhs, r, gsl_vector_get(rhs, r) + C_rj * u[n_x * j + 0]);
+            }
+        }
+        int signum = 0;
+        gsl_linalg_LU_decomp(M, perm, &signum);
+        gsl_linalg_LU_solve(M, perm, rhs, dy_vec);
+        for (int i = 0; i < n; i++) {
+            for (int k = 0; k < n_y; k++) {
+                dy[n_y * i + k] = gsl_vector_get(dy_vec, n_y * i + k);
+            }
+            for (int r = 0; r < n_x; r++) {
+                dx[n_x * i + r] = u[n_x * i + r];
+                for (int k = 0; k < n_y; k++) {
+                    dx[n_x * i + r] -= W[(n_x * i + r) * n_y + k] * dy[n_y * i + k];
+                }
+            }
+        }
+
+        //Newton steps (halved at most twice) must halve the residual. Far from the
+        //solution they may not, then a decoupled pass as in calc_tree_equil2.m, the
+        //tree loads for the current radii and each order's equilibrium for them
+        double step = 1.0, res_trial = 0.0;
+        for (int halving = 0; halving < 3; halving++) {
+            x_trial = x;
+            y_trial = y;
+            for (int r = 0; r < n_x * n; r++) {
+                x_trial[r] += step * dx[r];
+            }
+            for (int r = 0; r < n_y * n; r++) {
+                y_trial[r] += step * dy[r];
+            }
+            res_trial = evaluate(x_trial, y_trial, F_trial, G_trial);
+            if (res_trial < 0.5 * equil_residual) {
+                break;
+            }
+            step /= 2;
+        }
+        if (res_trial < 0.5 * equil_residual) {
+            x = x_trial;
+            y = y_trial;
+            F = F_trial;
+            G = G_trial;
+            equil_residual = res_trial;
+        }
+        else {
+            tree_loads(x, y);
+            equilibrate_orders();
+            equil_residual = evaluate(x, y, F, G);
+            equil_passes++;
+        }
+    }
+
+    gsl_matrix_free(M);
+    gsl_permutation_free(perm);
+    gsl_vector_free(rhs);
+    gsl_vector_free(dy_vec);
+    hemo_tree.dag.radius_tol = radius_tol;
+    equil_map_hits = hits;
+
+    if (equil_residual >= equil_tol) {
+        printf("%s %e\n", "Warning: equilibrated tree did not converge, residual:", equil_residual);
+    }
+
+    //Vessels hold the equilibrated state of the last evaluation, hemo_tree its loads
+    for (int i = 0; i < n; i++) {
+        gamma_p[i] = y[n_y * i + 0] / vessels[i].P_h - 1.0;
+        gamma_q[i] = y[n_y * i + 1] / vessels[i].Q_h - 1.0;
+        vessels[i].printNativeEquilibratedOutputs();
+    }
+}
+
+int vessel_tree::steps() const {
+    return n_vessels > 0 ? vessels[0].sn : 0;
+}
@@ -0,0 +1,127 @@
+// vessel_tree.h
+#ifndef VESSEL_TREE
+#define VESSEL_TREE
+
+#include <string>
+#include <vector>
+
+#include "equil_map.h"
+#include "load_schedule.h"
+#include "morphometric_tree.h"
+#include "output_writer.h"
+#include "step_transaction.h"
+#include "thread_pool.h"
+
+using std::string;
+using std::vector;
+
+//A set of independent vessels (one per order of a morphometric tree) that are advanced
+//concurrently and synchronized at coupling points. The manifest has one vessel per line:
+//
+//  <name> <Native_in file> <gamma_p> <gamma_q> <gamma_act> [load schedule file]
+//
+//Outputs of each vessel are written to GnR_out_<name>, Exp_out_<name>, Equil_GnR_out_<name>.
+class vessel_tree {
+public:
+    vessel_tree(int n_threads = 0);
+
+    void readManifest(string manifest_name);
+    void initialize(double n_days, double dt, string cache_dir = "");
+    void setLoads(); //Applies gamma_p, gamma_q, gamma_act
+    void openOutputs(int bin_out_flag);
+    void closeOutputs();
+
+    //Advances every vessel n_steps time steps (stopping at the last step) in parallel,
+    //writing the outputs of each step when print is set
+    void advance(int n_steps, bool print = true);
+    void solveEquilibrated(); //Mechanobiologically equilibrated solution of every vessel
+    void printOutputs(); //Writes the current state of every vessel
+    int steps() const; //Time steps taken so far
+
+    //Hemodynamic feedback through a morphometric tree, vessel i being order i + 1.
+    //The baseline is the tree solution for the initial geometry; at each coupling the
+    //tree is solved for the current geometry and gamma_p/gamma_q are the fold changes
+    //of the mean order pressure and flow from baseline, as in run_tree_GnR.m.
+    void setHemodynamicBaseline(morphometric_tree& hemo_tree, double Q_in, double P_term);
+    void coupleHemodynamics(morphometric_tree& hemo_tree, double Q_in, double P_term);
+    vector<double> P_base, Q_base;
+
+    //Between couplings the tree loads are held, or with extrapolate_loads continued
+    //linearly in time at their rate of change over the last coupling interval
+    int extrapolate_loads;
+    double s_coupled; //time of the last coupling (days), -1 before the first
+    vector<double> gamma_p_rate, gamma_q_rate; //per day
+
+    //Distensible coupling: each order's loaded radius follows its pressure through a
+    //pressure-diameter table found from the vessel's current state (find_pd_response),
+    //and the tree and the radii are solved together by Newton's method with a finite
+    //difference Jacobian of the tree, in place of repeated rigid solves and G&R runs as
+    //the calc_tree_equil_wgnr passes of run_tree_GnR.m.
+    void buildPressureResponse(); //resp_n points either side of the current pressure
+    void coupleDistensible(morphometric_tree& hemo_tree, double Q_in, double P_term);
+    double resp_dP; //relative pressure spacing of the table
+    int resp_n;
+    double newton_tol; //on the relative radius residual
+    int newton_max_iter;
+    int newton_iter; //iterations and residual of the last coupling
+    double newton_residual;
+    vector<double> resp_P, resp_a; //[i * (2 * resp_n + 1) + k], pressure ascending
+
+    //Mechanobiologically equilibrated state of the whole tree in one solve. The unknowns
+    //are every order's (a_e, h_e, rho_c_e, f_z_e) of equil_obj_f and its pressure and
+    //flow (P, Q), which must equal the tree solution for the equilibrated radii scaled
+    //as in setLoads. Newton's method eliminates each order's 4 x 4 block, found by
+    //finite differences in parallel across orders, leaving a 2 n system in the loads.
+    //Starts from find_equil_geom of every order at its current loads; iterations where
+    //Newton does not halve the residual take a decoupled pass instead.
+    void solveEquilibratedTree(morphometric_tree& hemo_tree, double Q_in, double P_term);
+    double equil_tol; //on the scaled residual
+    int equil_max_iter;
+    int equil_iter, equil_passes; //iterations, decoupled passes and residual of the last solve
+    double equil_residual;
+
+    //Equilibrated maps (equil_map.h) of the vessels found in map_dir. Where a map covers
+    //an order's loads, solveEquilibrated starts find_equil_geom from the interpolated
+    //state and solveEquilibratedTree takes it as the order's equilibrium to start Newton
+    //from, in place of solving each order first.
+    int readEquilMaps(string map_dir, double n_days, double dt); //vessels with a map
+    vector<equil_map> equil_maps;
+    int equil_map_hits; //orders started from a map in the last solve
+
+    //Implicit coupling: one time step is re-run (step_transaction.h) until the order radii
+    //that set the tree loads agree with the radii the step produces, as the repeated
+    //--gnr_iter_flag runs of run_tree_GnR.m but in process. The fixed point iteration
+    //on the radii (relative to the start of the step) is accelerated by Aitken
+    //relaxation (implicit_method 1) or IQN-ILS, a least squares quasi-Newton update
+    //from the residual differences of the earlier passes (implicit_method 2).
+    void stepImplicit(morphometric_tree& hemo_tree, double Q_in, double P_term);
+    int implicit_method;
+    double implicit_tol; //on the largest relative radius residual
+    int implicit_max_iter;
+    double implicit_omega; //relaxation of the first pass
+    int implicit_iter; //passes and residual of the last step
+    double implicit_residual;
+
+    int n_vessels;
+    vector<vessel> vessels;
+    vector<string> names, native_files, schedule_files;
+    vector<double> gamma_p, gamma_q, gamma_act;
+    thread_pool pool;
+
+private:
+    void solveHemodynamics(morphometric_tree& hemo_tree, double Q_in, double P_term, bool initial);
+    void setTreeLoads(const morphometric_tree& hemo_tree); //gamma_p/gamma_q from the tree solution
+    void solveTree(morphometric_tree& hemo_tree, const vector<double>& radius, const vector<double>& thickness,
+                   double Q_in, double P_term);
+    double responseRadius(int i, double P, double& slope) const;
+    void snapshotVessels(); //Opens a step transaction on every vessel for its next step
+    void rollbackVessels();
+    void printStep(); //Outputs of the current step of every vessel
+
+    vector<step_transaction> step_transactions;
+
+    vector<load_schedule> schedules;
+    vector<output_writer*> writers;
+};
+
+#endif /* VESSEL_TREE */
@@ -0,0 +1,267 @@
+// viscosity_kernel.cpp
+#define _USE_MATH_DEFINES
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "viscosity_kernel.h"
+
+double rel_viscosity_ref(double d, int form) {
+    //Pries et al Resistance to blood flow in microvessel in vivo
+    double eta = 6 * exp(-0.0858 * d) + 3.2 - 2.44 * exp(-0.06 * pow(d, 0.645));
+    if (form == visc_gnr) {
+        return 1 + (eta - 1) * pow(d / (d - 1.1), 2) * pow(d / (d - 1.1), 2);
+    }
+    double x2 = pow(d / (d - 1.1), 2);
+    return (1 + (eta - 1) * x2) * x2;
+}
+
+//Branch-free exp and log: range reduction by ln 2 and polynomials, with the power of 2
+//set in the exponent bits. They are written once for a scalar type S and are evaluated
+//either on S or, with GCC/Clang vector extensions, on a full SSE/AVX register at a time.
+template <typename S> struct fp_bits;
+template <> struct fp_bits<double> {
+    typedef uint64_t int_type; //unsigned, SSE2 has no 64-bit arithmetic shift
+    static constexpr double exp_max = 700.0;
+    static constexpr double magic = 6755399441055744.0; //1.5 * 2^52, rounds to an integer
+    static constexpr uint64_t magic_bits = 0x4338000000000000ULL;
+    static constexpr int mant_bits = 52;
+    static constexpr uint64_t bias = 1023;
+    static constexpr uint64_t exp_mask = 0x7ff;
+    static constexpr uint64_t mant_mask = 0xfffffffffffffULL;
+    static constexpr uint64_t one_bits = 0x3ff0000000000000ULL;
+    static constexpr double ln2_hi = 6.93147180369123816490e-01;
+    static constexpr double ln2_lo = 1.90821492927058770002e-10;
+    static constexpr int exp_terms = 13; //Taylor terms of exp on |r| <= ln2 / 2
+    static constexpr int log_terms = 11; //odd atanh terms on |s| <= 0.172
+};
+template <> struct fp_bits<float> {
+    typedef uint32_t int_type;
+    static constexpr float exp_max = 87.0f;
+    static constexpr float magic = 12582912.0f; //1.5 * 2^23
+    static constexpr uint32_t magic_bits = 0x4B400000;
+    static constexpr int mant_bits = 23;
+    static constexpr uint32_t bias = 127;
+    static constexpr uint32_t exp_mask = 0xff;
+    static constexpr uint32_t mant_mask = 0x7fffff;
+    static constexpr uint32_t one_bits = 0x3f800000;
+    static constexpr float ln2_hi = 0.693145751953125f;
+    static constexpr float ln2_lo = 1.428606765330187e-06f;
+    static constexpr int exp_terms = 8;
+    static constexpr int log_terms = 6;
+};
+
+//Integer lanes to real without a conversion instruction (|i| < 2^22), and comparison
+//masks to 0/1, overloaded for scalars and vectors
+template <typename S, typename V, typename I>
+static inline V as_real(I i) {
+    I r_bits = i + fp_bits<S>::magic_bits;
+    V r;
+    memcpy(&r, &r_bits, sizeof(V));
+    return r - fp_bits<S>::magic;
+}
+template <typename S> static inline S from_mask(S, bool c) { return c ? S(1) : S(0); }
+template <typename S> static inline S clamp_lanes(S x, S lo, S hi) { return x < lo ? lo : (x > hi ? hi : x); }
+
+#if defined(__GNUC__)
+#define VISC_KERNEL_VECTOR 1
+#ifdef __AVX__
+#define VISC_KERNEL_BYTES 32
+#else
+#define VISC_KERNEL_BYTES 16
+#endif
+typedef double v_double __attribute__((vector_size(VISC_KERNEL_BYTES)));
+typedef uint64_t v_uint64 __attribute__((vector_size(VISC_KERNEL_BYTES)));
+typedef int64_t v_int64 __attribute__((vector_size(VISC_KERNEL_BYTES)));
+typedef float v_float __attribute__((vector_size(VISC_KERNEL_BYTES)));
+typedef uint32_t v_uint32 __attribute__((vector_size(VISC_KERNEL_BYTES)));
+typedef int32_t v_int32 __attribute__((vector_size(VISC_KERNEL_BYTES)));
+
+static inline v_double from_mask(v_double, v_int64 c) {
+    v_int64 bits = c & int64_t(fp_bits<double>::one_bits);
+    v_double r;
+    memcpy(&r, &bits, sizeof(v_double));
+    return r;
+}
+static inline v_float from_mask(v_float, v_int32 c) {
+    v_int32 bits = c & int32_t(fp_bits<float>::one_bits);
+    v_float r;
+    memcpy(&r, &bits, sizeof(v_float));
+    return r;
+}
+static inline v_double clamp_lanes(v_double x, double lo, double hi) {
+    x = x < lo ? lo : x;
+    return x > hi ? hi : x;
+}
+static inline v_float clamp_lanes(v_float x, float lo, float hi) {
+    x = x < lo ? lo : x;
+    return x > hi ? hi : x;
+}
+#endif
+
+//Horner evaluation of sum_{j=J}^{N-1} c_j t^(j-J), unrolled at compile time, with
+//c_j = 1 / j! for exp and c_j = 1 / (2 j + 1) for the atanh series of log
+constexpr double inv_factorial(int j) { return j == 0 ? 1.0 : inv_factorial(j - 1) / j; }
+
+template <typename S, typename V, int J, int N>
+struct exp_series {
+    static inline V eval(V r) { return exp_series<S, V, J + 1, N>::eval(r) * r + S(inv_factorial(J)); }
+};
+template <typename S, typename V, int N>
+struct exp_series<S, V, N, N> {
+    static inline V eval(V r) { return r * S(0); }
+};
+
+template <typename S, typename V, int J, int N>
+struct atanh_series {
+    static inline V eval(V s2) { return atanh_series<S, V, J + 1, N>::eval(s2) * s2 + S(1.0 / (2 * J + 1)); }
+};
+template <typename S, typename V, int N>
+struct atanh_series<S, V, N, N> {
+    static inline V eval(V s2) { return s2 * S(0); }
+};
+
+template <typename S, typename V, typename I>
+static inline V kernel_exp(V x) {
+    typedef fp_bits<S> fp;
+    x = clamp_lanes(x, -fp::exp_max, fp::exp_max);
+    V kd = x * S(1.4426950408889634) + fp::magic;
+    I k_bits;
+    memcpy(&k_bits, &kd, sizeof(V));
+    kd -= fp::magic;
+    V r = (x - kd * fp::ln2_hi) - kd * fp::ln2_lo;
+
+    V p = exp_series<S, V, 0, fp::exp_terms>::eval(r);
+
+    I scale_bits = ((k_bits - fp::magic_bits) + fp::bias) << fp::mant_bits;
+    V scale;
+    memcpy(&scale, &scale_bits, sizeof(V));
+    return p * scale;
+}
+
+template <typename S, typename V, typename I>
+static inline V kernel_log(V x) {
+    //x = m 2^e with m in [sqrt(1/2), sqrt(2)), ln m = 2 atanh((m - 1) / (m + 1))
+    typedef fp_bits<S> fp;
+    I bits;
+    memcpy(&bits, &x, sizeof(V));
+    V e = as_real<S, V, I>(((bits >> fp::mant_bits) & fp::exp_mask) - fp::bias);
+    I m_bits = (bits & fp::mant_mask) | fp::one_bits;
+    V m;
+    memcpy(&m, &m_bits, sizeof(V));
+    V high = from_mask(x, m > S(1.4142135623730951));
+    m *= S(1) - S(0.5) * high;
+    e += high;
+
+    V s = (m - S(1)) / (m + S(1));
+    V s2 = s * s;
+    V p = atanh_series<S, V, 0, fp::log_terms>::eval(s2);
+    return e * fp::ln2_hi + (e * fp::ln2_lo + S(2) * s * p);
+}
+
+template <typename S, typename V, typename I>
+static inline V kernel_rel_viscosity(V d, S gnr) {
+    V eta = S(6) * kernel_exp<S, V, I>(S(-0.0858) * d) + S(3.2) -
+            S(2.44) * kernel_exp<S, V, I>(S(-0.06) * kernel_exp<S, V, I>(S(0.645) * kernel_log<S, V, I>(d)));
+    V x = d / (d - S(1.1));
+    V x2 = x * x;
+
+    //visc_tree: (1 + (eta - 1) x2) x2, visc_gnr: 1 + (eta - 1) x2 x2
+    V tree = (S(1) + (eta - S(1)) * x2) * x2;
+    V g = S(1) + (eta - S(1)) * x2 * x2;
+    return gnr * g + (S(1) - gnr) * tree;
+}
+
+template <typename S, typename V, typename I>
+static void rel_viscosity_lanes(const S* d, S* mu_rel, size_t n, int form) {
+    const S gnr = form == visc_gnr ? S(1) : S(0);
+    const size_t lanes = sizeof(V) / sizeof(S);
+    size_t i = 0;
+    for (; i + lanes <= n; i += lanes) {
+        V dv;
+        memcpy(&dv, d + i, sizeof(V));
+        V mu = kernel_rel_viscosity<S, V, I>(dv, gnr);
+        memcpy(mu_rel + i, &mu, sizeof(V));
+    }
+    for (; i < n; i++) {
+        mu_rel[i] = kernel_rel_viscosity<S, S, typename fp_bits<S>::int_type>(d[i], gnr);
+    }
+}
+
+template <typename S>
+static void rel_viscosity_loop(const S* d, S* mu_rel, size_t n, int form);
+
+template <>
+void rel_viscosity_loop(const double* d, double* mu_rel, size_t n, int form) {
+#ifdef VISC_KERNEL_VECTOR
+    rel_viscosity_lanes<double, v_double, v_uint64>(d, mu_rel, n, form);
+#else
+    rel_viscosity_lanes<double, double, uint64_t>(d, mu_rel, n, form);
+#endif
+}
+
+template <>
+void rel_viscosity_loop(const float* d, float* mu_rel, size_t n, int form) {
+#ifdef VISC_KERNEL_VECTOR
+    rel_viscosity_lanes<float, v_float, v_uint32>(d, mu_rel, n, form);
+#else
+    rel_viscosity_lanes<float, float, uint32_t>(d, mu_rel, n, form);
+#endif
+}
+
+void rel_viscosity_batch(const double* d, double* mu_rel, size_t n, int form) {
+    rel_viscosity_loop(d, mu_rel, n, form);
+}
+
+void rel_viscosity_batch(const float* d, float* mu_rel, size_t n, int form) {
+    rel_viscosity_loop(d, mu_rel, n, form);
+}
+
+template <typename T>
+static void hemo_loop(const T* radius, const T* length, const T* Q, T plasma_viscosity,
+                      T* viscosity, T* resistance, T* wss, size_t n, int form) {
+    //Blocks keep the diameters and viscosities in cache between the passes
+    const size_t block = 256;
+    T d[block], mu[block];
+    for (size_t start = 0; start < n; start += block) {
+        size_t m = n - start < block ? n - start : block;
+        const T* r = radius + start;
+        for (size_t i = 0; i < m; i++) {
+            d[i] = r[i] * T(2 * 10000); //cm to micron
+        }
+        rel_viscosity_loop(d, mu, m, form);
+        for (size_t i = 0; i < m; i++) {
+            mu[i] *= plasma_viscosity;
+        }
+
+        if (viscosity != NULL) {
+            for (size_t i = 0; i < m; i++) {
+                viscosity[start + i] = mu[i];
+            }
+        }
+        if (resistance != NULL) {
+            const T* len = length + start;
+            for (size_t i = 0; i < m; i++) {
+                T r2 = r[i] * r[i];
+                resistance[start + i] = T(8) * mu[i] * len[i] / (T(M_PI) * r2 * r2);
+            }
+        }
+        if (wss != NULL) {
+            const T* q = Q + start;
+            for (size_t i = 0; i < m; i++) {
+                wss[start + i] = T(4) * mu[i] * q[i] / (T(M_PI) * r[i] * r[i] * r[i]);
+            }
+        }
+    }
+}
+
+void hemo_kernel(const double* radius, const double* length, const double* Q, double plasma_viscosity,
+                 double* viscosity, double* resistance, double* wss, size_t n, int form) {
+    hemo_loop(radius, length, Q, plasma_viscosity, viscosity, resistance, wss, n, form);
+}
+
+void hemo_kernel(const float* radius, const float* length, const float* Q, float plasma_viscosity,
+                 float* viscosity, float* resistance, float* wss, size_t n, int form) {
+    hemo_loop(radius, length, Q, plasma_viscosity, viscosity, resistance, wss, n, form);
+}
@@ -48,7 +48,7 @@ function order_geom_actual = calc_tree_equil_wgnr(order_geom, mat_tree, mat_temp
                 order_geom_actual(1, ord) = gnr_out(1,1);
                 order_geom_actual(2, ord) = gnr_out(1,2);
             case 2
-                gnr_out = load("GnR_out_ord" + ord);
+                gnr_out = read_gnr_out("GnR_out_ord" + ord, "last");
                 
                 order_geom_actual(1, ord) = gnr_out(end,1);
                 order_geom_actual(2, ord) = gnr_out(end,2);
@@ -58,7 +58,7 @@ function order_geom_actual = calc_tree_equil_wgnr(order_geom, mat_tree, mat_temp
                 order_geom_actual(1, ord) = gnr_out(end,1);
                 order_geom_actual(2, ord) = gnr_out(end,2);
             case 4
-                gnr_out = load("Exp_out_ord" + ord);
+                gnr_out = read_gnr_out("Exp_out_ord" + ord, "last");
                 
                 order_geom_actual(1, ord) = gnr_out(end,1);
                 order_geom_actual(2, ord) = gnr_out(end,2);
@@ -0,0 +1,22 @@
+function export_morphometric_tree(file_name)
+%Writes morphometric_tree.mat as text for ./gnr_tree --hemo_tree. The first
+%line is n_seg n_orders, then one line per segment with the parent, left and
+%right children (seg_connectivity codes) and the radius, length (cm) and order
+%(seg_size).
+
+    load morphometric_tree seg_connectivity seg_size
+
+    n_seg = size(seg_connectivity, 1);
+    n_orders = max(seg_size(:,3));
+
+    fid = fopen(file_name, 'w');
+    fprintf(fid, '# n_seg n_orders, then parent left right radius length order\n');
+    fprintf(fid, '%d %d\n', n_seg, n_orders);
+    for seg = 1:n_seg
+        fprintf(fid, '%d %d %d %.10g %.10g %d\n', seg_connectivity(seg,1), ...
+            seg_connectivity(seg,2), seg_connectivity(seg,3), ...
+            seg_size(seg,1), seg_size(seg,2), seg_size(seg,3));
+    end
+    fclose(fid);
+
+end
@@ -0,0 +1,58 @@
+function [gnr_out, col_names] = read_gnr_out(file_name, rows)
+%Reads a G&R output stream written by ./gnr. Uses the binary table
+%file_name + ".bin" (written with --bin_out 1) if it exists, otherwise
+%loads the text file. rows = "all" (default) or "last"; for binary tables
+%the last row is read directly via the trailer index.
+
+    if nargin < 2
+        rows = "all";
+    end
+
+    bin_name = file_name + ".bin";
+    if ~isfile(bin_name)
+        gnr_out = load(file_name);
+        if rows == "last"
+            gnr_out = gnr_out(end, :);
+        end
+        col_names = {};
+        return
+    end
+
+    fid = fopen(bin_name, 'r');
+    cleanup = onCleanup(@() fclose(fid));
+
+    %Header: magic, number of columns, header size, NUL-terminated names
+    magic = fread(fid, 8, '*char')';
+    if ~strcmp(magic(1:7), 'GNRBIN1')
+        error("Not a G&R binary table: " + bin_name)
+    end
+    n_cols = fread(fid, 1, 'uint32');
+    header_bytes = fread(fid, 1, 'uint32');
+    names = fread(fid, header_bytes - 16, '*char')';
+    col_names = strsplit(names, char(0));
+    col_names = col_names(1:n_cols);
+
+    %Row count from the trailer, or from the file size if the run did not finish
+    rec_bytes = 8 * n_cols;
+    fseek(fid, 0, 'eof');
+    file_bytes = ftell(fid);
+    n_rows = floor((file_bytes - header_bytes) / rec_bytes);
+    if file_bytes >= header_bytes + 32
+        fseek(fid, -32, 'eof');
+        trailer = fread(fid, 3, 'uint64');
+        idx_magic = fread(fid, 8, '*char')';
+        if strcmp(idx_magic(1:7), 'GNRIDX1') && ...
+                header_bytes + trailer(1) * rec_bytes + 32 == file_bytes
+            n_rows = trailer(1);
+        end
+    end
+
+    if rows == "last"
+        first_row = max(n_rows - 1, 0);
+    else
+        first_row = 0;
+    end
+    fseek(fid, header_bytes + first_row * rec_bytes, 'bof');
+    gnr_out = fread(fid, [n_cols, n_rows - first_row], 'double')';
+
+end
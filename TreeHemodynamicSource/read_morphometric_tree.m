@@ -0,0 +1,32 @@
+function [seg_connectivity, seg_size, parent_seg_elem] = read_morphometric_tree(file_name)
+%Reads the binary tree file of ./gnr_gen_tree into the arrays saved in
+%morphometric_tree.mat by generate_morphometric_tree. Save them with
+%  save morphometric_tree seg_connectivity parent_seg_elem seg_size
+
+    fid = fopen(file_name, 'r');
+    magic = fread(fid, 8, 'char=>char')';
+    if ~strcmp(magic, 'GNRTREE1')
+        fclose(fid);
+        error('%s is not a binary morphometric tree', file_name);
+    end
+    header = fread(fid, 4, 'uint32');
+    n_seg = header(1);
+    n_elem = header(2);
+
+    seg_connectivity = zeros(n_seg, 3);
+    seg_connectivity(:,1) = fread(fid, n_seg, 'int32');
+    seg_connectivity(:,2) = fread(fid, n_seg, 'int32');
+    seg_connectivity(:,3) = fread(fid, n_seg, 'int32');
+
+    seg_size = zeros(n_seg, 3);
+    seg_size(:,1) = fread(fid, n_seg, 'single');
+    seg_size(:,2) = fread(fid, n_seg, 'single');
+    seg_size(:,3) = fread(fid, n_seg, 'uint8');
+
+    parent_seg_elem = zeros(n_elem, 3);
+    parent_seg_elem(:,1) = fread(fid, n_elem, 'int32');
+    parent_seg_elem(:,2) = fread(fid, n_elem, 'uint8');
+    parent_seg_elem(:,3) = fread(fid, n_elem, 'uint8');
+    fclose(fid);
+
+end
@@ -0,0 +1,22 @@
+function write_load_schedule(file_name, ts, gamma_p, gamma_q, gamma_act)
+%Writes a --load_schedule file for ./gnr with piecewise-linear fold changes
+%in pressure, flow, and active stress at times ts (days), e.g. the dP_s/dQ_s
+%ramps of run_tree_GnR, so an open-loop run needs a single gnr call.
+%Pass [] for a quantity to leave it at its --gamma_* value.
+
+    fid = fopen(file_name, 'w');
+    fprintf(fid, '# G&R load schedule: <quantity> table t1 g1 t2 g2 ... (fold change from homeostatic)\n');
+    quantities = ["P", "Q", "T_act"];
+    gammas = {gamma_p, gamma_q, gamma_act};
+    for i = 1:length(quantities)
+        if isempty(gammas{i})
+            continue
+        end
+        %One point per line keeps long schedules readable
+        for j = 1:length(ts)
+            fprintf(fid, '%s table %.10g %.10g\n', quantities(i), ts(j), gammas{i}(j));
+        end
+    end
+    fclose(fid);
+
+end
@@ -0,0 +1,14 @@
+function write_tree_manifest(file_name, n_orders, gamma_p_ord, gamma_q_ord, gamma_act_ord)
+%Writes the manifest for ./gnr_tree, one vessel per order using the
+%Native_in_ord<k> files written by write_Native_in. Outputs of each order
+%go to GnR_out_ord<k>, as with ./gnr -n ord<k>.
+
+    fid = fopen(file_name, 'w');
+    fprintf(fid, '# name Native_in gamma_p gamma_q gamma_act\n');
+    for ord = 1:n_orders
+        fprintf(fid, 'ord%d Native_in_ord%d %.10g %.10g %.10g\n', ord, ord, ...
+            gamma_p_ord(ord), gamma_q_ord(ord), gamma_act_ord(ord));
+    end
+    fclose(fid);
+
+end
@@ -0,0 +1,20 @@
+function write_tree_morphometry(file_name, connectivity, diameter, length)
+%Writes the connectivity matrix and order diameters and lengths (cm) for
+%./gnr_gen_tree, which builds the same tree as generate_morphometric_tree.
+
+    n_orders = size(connectivity, 1);
+
+    fid = fopen(file_name, 'w');
+    fprintf(fid, '# n_orders, connectivity (row = child order), diameter, length\n');
+    fprintf(fid, '%d\n', n_orders);
+    for ord = 1:n_orders
+        fprintf(fid, '%.10g ', connectivity(ord, :));
+        fprintf(fid, '\n');
+    end
+    fprintf(fid, '%.10g ', diameter);
+    fprintf(fid, '\n');
+    fprintf(fid, '%.10g ', length);
+    fprintf(fid, '\n');
+    fclose(fid);
+
+end